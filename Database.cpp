@@ -65,6 +65,14 @@ namespace
 		}
 	}
 
+	bool changes_connection_state(const std::string& query)
+	{
+		std::string stmt = strlower(trim(query));
+		return next(stmt, 0, "pragma")
+			|| next(stmt, 0, "attach")
+			|| next(stmt, 0, "detach");
+	}
+
 	void errorLogCallback(void *pArg, int iErrCode, const char *zMsg)
 	{
 		switch (iErrCode)
@@ -127,6 +135,7 @@ bool CDatabase::Open(std::string pFile, const std::vector<std::pair<std::string,
 
 	attached_dbs=attach;
 	in_transaction=false;
+	state_changed=false;
 	if( sqlite3_open(pFile.c_str(), &db) )
 	{
 		Server->Log("Could not open db ["+pFile+"]");
@@ -200,6 +209,8 @@ bool CDatabase::Open(std::string pFile, const std::vector<std::pair<std::string,
 
 		AttachDBs();
 
+		state_changed=false;
+
 		return true;
 	}
 }
@@ -402,6 +413,11 @@ IQuery* CDatabase::Prepare(std::string pQuery, bool autodestroy)
 
 		return NULL;
 	}
+	if(changes_connection_state(pQuery))
+	{
+		state_changed=true;
+	}
+
 	CQuery *q=new CQuery(pQuery, prepared_statement, this);
 	if( autodestroy )
 	{
@@ -523,6 +539,29 @@ bool CDatabase::isInTransaction(void)
 	return in_transaction;
 }
 
+bool CDatabase::isReusable(void)
+{
+	if(state_changed
+		|| in_transaction
+		|| write_lock.get()!=NULL
+		|| transaction_read_lock.get()!=NULL)
+	{
+		return false;
+	}
+
+	//Temporary schema is private to this connection, so this does not need the single user lock
+	sqlite3_stmt* temp_objects;
+	if(sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_temp_master LIMIT 1", -1, &temp_objects, NULL)!=SQLITE_OK)
+	{
+		return false;
+	}
+
+	bool has_temp_objects = sqlite3_step(temp_objects)!=SQLITE_DONE;
+	sqlite3_finalize(temp_objects);
+
+	return !has_temp_objects;
+}
+
 bool CDatabase::Import(const std::string &pFile)
 {
 	IFile *file=Server->openFile(pFile, MODE_READ);
@@ -44,6 +44,7 @@ public:
 	bool LockForTransaction(void);
 	void UnlockForTransaction(void);
 	bool isInTransaction(void);
+	virtual bool isReusable(void);
 	
 	static void initMutex(void);
 	static void destroyMutex(void);
@@ -78,6 +79,7 @@ private:
 
 	sqlite3 *db;
 	bool in_transaction;
+	bool state_changed;
 
 	std::vector<CQuery*> queries;
 	std::map<int, IQuery*> prepared_queries;
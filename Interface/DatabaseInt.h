@@ -13,6 +13,12 @@ public:
 	virtual bool Open(std::string pFile, const std::vector<std::pair<std::string, std::string> > &attach,
 		size_t allocation_chunk_size, ISharedMutex* single_user_mutex, IMutex* lock_mutex,
 		int* lock_count, ICondition *unlock_cond, const str_map& params) = 0;
+
+	virtual bool isInTransaction(void) = 0;
+
+	//False if the connection has temporary objects or changed pragmas/attached databases,
+	//i.e. it should not be handed to another thread
+	virtual bool isReusable(void) = 0;
 };
 
 #endif
\ No newline at end of file
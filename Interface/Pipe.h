@@ -45,6 +45,11 @@ public:
 	virtual void resetTransferedBytes(void)=0;
 
 	virtual _i64 getRealTransferredBytes() { return 0; }
+
+	/**
+	* Socket which can be polled for readability or -1 if not available
+	**/
+	virtual int getPollFd() { return -1; }
 };
 
 #endif //IPIPE_H
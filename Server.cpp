@@ -112,6 +112,81 @@ const size_t MAX_THREAD_ID=std::string::npos;
 
 namespace
 {
+	//Connections of the current thread by database id, so that getDatabase
+	//does not need to lock db_mutex once a thread has a connection
+	struct SThreadDbCache
+	{
+		SThreadDbCache()
+			: tid(-1), generation(0) {}
+
+		THREAD_ID tid;
+		size_t generation;
+		std::vector<IDatabaseInt*> dbs;
+	};
+
+	const DATABASE_ID max_cached_database_id = 1024;
+
+	thread_local SThreadDbCache thread_db_cache;
+
+	thread_local THREAD_ID curr_thread_tid = -1;
+
+	//Log entries get queued up to this size before the logging threads wait for the log writer
+	const size_t max_log_queue_size = 10000;
+
+	thread_local bool is_log_writer_thread = false;
+
+	//Formatting the time is expensive (localtime has a global lock), so only do it once a second
+	struct SLogTimeCache
+	{
+		SLogTimeCache()
+			: rawtime(-1)
+		{
+			buffer[0] = 0;
+		}
+
+		time_t rawtime;
+		char buffer[100];
+	};
+
+	thread_local SLogTimeCache log_time_cache;
+
+	const char* formatLogTime(time_t rawtime)
+	{
+		SLogTimeCache& cache = log_time_cache;
+		if (cache.rawtime == rawtime)
+		{
+			return cache.buffer;
+		}
+
+#ifdef _WIN32
+		struct tm  timeinfo;
+		localtime_s(&timeinfo, &rawtime);
+		strftime (cache.buffer,100,"%Y-%m-%d %X: ",&timeinfo);
+#else
+		struct tm timeinfo;
+		localtime_r(&rawtime, &timeinfo);
+		strftime (cache.buffer,100,"%Y-%m-%d %X: ",&timeinfo);
+#endif
+		cache.rawtime = rawtime;
+		return cache.buffer;
+	}
+
+	class LogWriterThread : public IThread
+	{
+	public:
+		LogWriterThread(CServer* server)
+			: server(server) {}
+
+		void operator()()
+		{
+			server->runLogWriter();
+			delete this;
+		}
+
+	private:
+		CServer* server;
+	};
+
 	//GetTickCount64 for Windows Server 2003
 #ifdef _WIN32
 	typedef ULONGLONG(WINAPI GetTickCount64_t)(VOID);
@@ -164,6 +239,7 @@ extern bool run;
 CServer::CServer()
 {	
 	curr_thread_id=0;
+	db_generation=0;
 	curr_pluginid=0;
 	curr_postfilekey=0;
 	loglevel=LL_INFO;
@@ -171,11 +247,16 @@ CServer::CServer()
 	circular_log_buffer_id=0;
 	circular_log_buffer_idx=0;
 	has_circular_log_buffer=false;
+	log_writer_running=false;
+	log_writer_exit=false;
 	failbits=0;
 
 	startup_complete=false;
 	
 	log_mutex=createMutex();
+	circular_log_mutex=createMutex();
+	log_queue_mutex=createMutex();
+	log_queue_cond=createCondition();
 	action_mutex=createMutex();
 	web_socket_mutex = createMutex();
 	requests_mutex=createMutex();
@@ -244,6 +325,8 @@ void CServer::destroyAllDatabases(void)
 {
 	IScopedLock lock(db_mutex);
 
+	++db_generation;
+
 	for(std::map<DATABASE_ID, SDatabase* >::iterator i=databases.begin();
 		i!=databases.end();++i)
 	{
@@ -252,6 +335,12 @@ void CServer::destroyAllDatabases(void)
 			delete j->second;
 		}
 		i->second->tmap.clear();
+
+		for(size_t j=0;j<i->second->pool.size();++j)
+		{
+			delete i->second->pool[j];
+		}
+		i->second->pool.clear();
 	}
 }
 
@@ -259,20 +348,42 @@ void CServer::destroyDatabases(THREAD_ID tid)
 {
 	IScopedLock lock(db_mutex);
 
+	if(tid==getThreadID())
+	{
+		thread_db_cache.dbs.clear();
+	}
+	else
+	{
+		++db_generation;
+	}
+
 	for(std::map<DATABASE_ID, SDatabase* >::iterator i=databases.begin();
 		i!=databases.end();++i)
 	{
 		std::map<THREAD_ID, IDatabaseInt*>::iterator iter=i->second->tmap.find(tid);
 		if(iter!=i->second->tmap.end())
 		{
-			delete iter->second;
+			IDatabaseInt* db = iter->second;
 			i->second->tmap.erase(iter);
+
+			if(i->second->pool.size()<i->second->max_pool_size
+				&& db->isReusable())
+			{
+				db->destroyAllQueries();
+				i->second->pool.push_back(db);
+			}
+			else
+			{
+				delete db;
+			}
 		}
 	}
 }
 
 CServer::~CServer()
 {
+	stopLogWriter();
+
 	if(getServerParameter("leak_check")!="true") //minimal cleanup
 	{
 		return;
@@ -355,6 +466,9 @@ CServer::~CServer()
 	Log("Destroying mutexes");
 	
 	destroy(log_mutex);
+	destroy(circular_log_mutex);
+	destroy(log_queue_mutex);
+	destroy(log_queue_cond);
 	destroy(action_mutex);
 	destroy(web_socket_mutex);
 	destroy(requests_mutex);
@@ -412,64 +526,170 @@ void CServer::Log( const std::string &pStr, int LogLevel)
 {
 	if( loglevel <=LogLevel )
 	{
-		IScopedLock lock(log_mutex);
+		bool logged = false;
+		{
+			IScopedLock lock(log_queue_mutex);
+			if(log_writer_running
+				&& LogLevel==LL_ERROR)
+			{
+				//Errors are written synchronously (together with the queued entries before them),
+				//so they are in the log file if the process aborts afterwards
+				std::vector<SLogQueueEntry> entries;
+				entries.swap(log_queue);
+				log_queue_cond->notify_all();
+
+				IScopedLock file_lock(log_mutex);
+				for(size_t i=0;i<entries.size();++i)
+				{
+					writeLogEntry(entries[i].msg, entries[i].loglevel, entries[i].rawtime);
+				}
+				writeLogEntry(pStr, LogLevel, time(NULL));
+				flushLog();
+				logged = true;
+			}
+			else if(log_writer_running)
+			{
+				while(log_queue.size()>=max_log_queue_size
+					&& log_writer_running
+					&& !is_log_writer_thread)
+				{
+					log_queue_cond->wait(&lock);
+				}
 
-		time_t rawtime;		
-		char buffer [100];
-		time ( &rawtime );
-#ifdef _WIN32
-		struct tm  timeinfo;
-		localtime_s(&timeinfo, &rawtime);
-		strftime (buffer,100,"%Y-%m-%d %X: ",&timeinfo);
-#else
-		struct tm *timeinfo;
-		timeinfo = localtime ( &rawtime );
-		strftime (buffer,100,"%Y-%m-%d %X: ",timeinfo);
-#endif	
+				log_queue.push_back(SLogQueueEntry(pStr, LogLevel, time(NULL)));
+				if(log_queue.size()==1)
+				{
+					log_queue_cond->notify_all();
+				}
+				logged = true;
+			}
+		}
 
-		if(log_console_time)
+		if(!logged)
 		{
-			std::cout << buffer;
+			IScopedLock lock(log_mutex);
+			writeLogEntry(pStr, LogLevel, time(NULL));
+			flushLog();
 		}
+	}
+
+	if(has_circular_log_buffer)
+	{
+		IScopedLock lock(circular_log_mutex);
+
+		logToCircularBuffer(pStr, LogLevel);
+	}
+}
+
+void CServer::writeLogEntry(const std::string& msg, int loglevel, time_t rawtime)
+{
+	const char* buffer = formatLogTime(rawtime);
+
+	if(log_console_time)
+	{
+		std::cout << buffer;
+	}
+
+	if( loglevel==LL_ERROR )
+	{
+		std::cout << "ERROR: " << msg << "\n";
+		if(logfile_a)
+			logfile << buffer << "ERROR: " << msg << "\n";
+	}
+	else if( loglevel==LL_WARNING )
+	{
+		std::cout << "WARNING: " << msg << "\n";
+		if(logfile_a)
+			logfile<< buffer << "WARNING: " << msg << "\n";
+	}
+	else
+	{
+		std::cout << msg << "\n";
+		if(logfile_a)
+			logfile << buffer << msg << "\n";
+	}
+}
+
+void CServer::flushLog()
+{
+	std::cout.flush();
+
+	if(logfile_a)
+	{
+		logfile.flush();
 
-		if( LogLevel==LL_ERROR )
+		rotateLogfile();
+	}
+}
+
+void CServer::startLogWriter()
+{
+	{
+		IScopedLock lock(log_queue_mutex);
+		if(log_writer_running)
 		{
-			std::cout << "ERROR: " << pStr << std::endl;
-			if(logfile_a)
-				logfile << buffer << "ERROR: " << pStr << std::endl;
+			return;
 		}
-		else if( LogLevel==LL_WARNING )
+		log_writer_running=true;
+		log_writer_exit=false;
+	}
+
+	if(!createThread(new LogWriterThread(this), "log writer"))
+	{
+		IScopedLock lock(log_queue_mutex);
+		log_writer_running=false;
+	}
+}
+
+void CServer::stopLogWriter()
+{
+	IScopedLock lock(log_queue_mutex);
+	log_writer_exit=true;
+	log_queue_cond->notify_all();
+	while(log_writer_running)
+	{
+		log_queue_cond->wait(&lock);
+	}
+}
+
+void CServer::runLogWriter()
+{
+	is_log_writer_thread=true;
+
+	std::vector<SLogQueueEntry> entries;
+	IScopedLock lock(log_queue_mutex);
+	while(true)
+	{
+		while(log_queue.empty()
+			&& !log_writer_exit)
 		{
-			std::cout << "WARNING: " << pStr << std::endl;
-			if(logfile_a)
-				logfile<< buffer << "WARNING: " << pStr << std::endl;
+			log_queue_cond->wait(&lock);
 		}
-		else
+
+		if(log_queue.empty())
 		{
-			std::cout << pStr << std::endl;		
-			if(logfile_a)
-				logfile << buffer << pStr << std::endl;
+			break;
 		}
-		
-		if(logfile_a)
-		{
-			logfile.flush();
-
-			rotateLogfile();
 
-		}
+		entries.swap(log_queue);
+		log_queue_cond->notify_all();
+		lock.relock(NULL);
 
-		if(has_circular_log_buffer)
 		{
-			logToCircularBuffer(pStr, LogLevel);
+			IScopedLock file_lock(log_mutex);
+			for(size_t i=0;i<entries.size();++i)
+			{
+				writeLogEntry(entries[i].msg, entries[i].loglevel, entries[i].rawtime);
+			}
+			flushLog();
 		}
-	}
-	else if(has_circular_log_buffer)
-	{
-		IScopedLock lock(log_mutex);
 
-		logToCircularBuffer(pStr, LogLevel);
+		entries.clear();
+		lock.relock(log_queue_mutex);
 	}
+
+	log_writer_running=false;
+	log_queue_cond->notify_all();
 }
 
 void CServer::setLogRotationFiles(size_t n)
@@ -499,6 +719,7 @@ void CServer::rotateLogfile()
 
 void CServer::setLogFile(const std::string &plf, std::string chown_user)
 {
+	bool chown_failed = false;
 	IScopedLock lock(log_mutex);
 	if(logfile_a)
 	{
@@ -523,12 +744,19 @@ void CServer::setLogFile(const std::string &plf, std::string chown_user)
 			}
 			else
 			{
-	    		Server->Log("Unable to change logfile ownership", LL_ERROR);
+				chown_failed = true;
 			}
 		}
 #endif
 		logfile_a=true;
 	}
+
+	lock.relock(NULL);
+
+	if(chown_failed)
+	{
+		Log("Unable to change logfile ownership", LL_ERROR);
+	}
 }
 
 void CServer::setLogLevel(int LogLevel)
@@ -844,6 +1072,11 @@ ITemplate* CServer::createTemplate(std::string pFile)
 
 THREAD_ID CServer::getThreadID(void)
 {
+	if(curr_thread_tid!=-1)
+	{
+		return curr_thread_tid;
+	}
+
 #ifdef _WIN32
 	IScopedLock lock(thread_mutex);
 	
@@ -852,6 +1085,7 @@ THREAD_ID CServer::getThreadID(void)
 	
 	if(iter!=threads.end() )
 	{
+		curr_thread_tid = iter->second;
 	    return iter->second;
 	}
 
@@ -861,6 +1095,7 @@ THREAD_ID CServer::getThreadID(void)
 
 	threads.insert( std::pair<std::thread::id, THREAD_ID>( ct, curr_thread_id) );
 
+	curr_thread_tid = curr_thread_id;
 	return curr_thread_id;
 #else //_WIN32
 	IScopedLock lock(thread_mutex);
@@ -870,6 +1105,7 @@ THREAD_ID CServer::getThreadID(void)
 	
 	if(iter!=threads.end() )
 	{
+		curr_thread_tid = iter->second;
 	    return iter->second;
 	}
 
@@ -879,6 +1115,7 @@ THREAD_ID CServer::getThreadID(void)
 
 	threads.insert( std::pair<pthread_t, THREAD_ID>( ct, curr_thread_id) );
 
+	curr_thread_tid = curr_thread_id;
 	return curr_thread_id;
 #endif //_WIN32
 }
@@ -908,6 +1145,7 @@ bool CServer::openDatabase(std::string pFile, DATABASE_ID pIdentifier, const str
 	*ndb->lock_count = 0;
 	ndb->unlock_cond.reset(createCondition());
 	ndb->params = params;
+	ndb->max_pool_size = static_cast<size_t>((std::max)(0, watoi(getServerParameter("database_pool_size", "4"))));
 	databases.insert( std::pair<DATABASE_ID, SDatabase* >(pIdentifier, ndb)  );
 
 	return true;
@@ -915,6 +1153,16 @@ bool CServer::openDatabase(std::string pFile, DATABASE_ID pIdentifier, const str
 
 IDatabase* CServer::getDatabase(THREAD_ID tid, DATABASE_ID pIdentifier)
 {
+	SThreadDbCache& db_cache = thread_db_cache;
+	if(db_cache.tid==tid
+		&& pIdentifier>=0
+		&& static_cast<size_t>(pIdentifier)<db_cache.dbs.size()
+		&& db_cache.dbs[pIdentifier]!=NULL
+		&& db_cache.generation==db_generation)
+	{
+		return db_cache.dbs[pIdentifier];
+	}
+
 	IScopedLock lock(db_mutex);
 
 	std::map<DATABASE_ID, SDatabase* >::iterator database_iter=databases.find(pIdentifier);
@@ -925,7 +1173,16 @@ IDatabase* CServer::getDatabase(THREAD_ID tid, DATABASE_ID pIdentifier)
 	}
 
 	std::map<THREAD_ID, IDatabaseInt*>::iterator thread_iter=database_iter->second->tmap.find( tid );
-	if( thread_iter==database_iter->second->tmap.end() )
+	if( thread_iter==database_iter->second->tmap.end()
+		&& !database_iter->second->pool.empty() )
+	{
+		IDatabaseInt *db=database_iter->second->pool.back();
+		database_iter->second->pool.pop_back();
+		database_iter->second->tmap.insert(std::pair< THREAD_ID, IDatabaseInt* >(tid, db));
+		addThreadDbCache(tid, pIdentifier, db);
+		return db;
+	}
+	else if( thread_iter==database_iter->second->tmap.end() )
 	{
 		IDatabaseInt *db=database_iter->second->factory->createDatabase();
 		std::pair<std::map<THREAD_ID, IDatabaseInt*>::iterator, bool> ins = 
@@ -945,14 +1202,44 @@ IDatabase* CServer::getDatabase(THREAD_ID tid, DATABASE_ID pIdentifier)
 			return NULL;
 		}
 
+		lock.relock(db_mutex);
+		addThreadDbCache(tid, pIdentifier, db);
+
 		return db;
 	}
 	else
 	{
+		addThreadDbCache(tid, pIdentifier, thread_iter->second);
 		return thread_iter->second;
 	}
 }
 
+void CServer::addThreadDbCache(THREAD_ID tid, DATABASE_ID pIdentifier, IDatabaseInt* db)
+{
+	if(tid!=getThreadID()
+		|| pIdentifier<0
+		|| pIdentifier>=max_cached_database_id)
+	{
+		return;
+	}
+
+	SThreadDbCache& db_cache = thread_db_cache;
+	if(db_cache.tid!=tid
+		|| db_cache.generation!=db_generation)
+	{
+		db_cache.dbs.clear();
+		db_cache.tid=tid;
+		db_cache.generation=db_generation;
+	}
+
+	if(static_cast<size_t>(pIdentifier)>=db_cache.dbs.size())
+	{
+		db_cache.dbs.resize(pIdentifier+1);
+	}
+
+	db_cache.dbs[pIdentifier]=db;
+}
+
 void CServer::clearDatabases(THREAD_ID tid)
 {
 	IScopedLock lock(db_mutex);
@@ -2165,7 +2452,7 @@ std::string CServer::secureRandomString(size_t len)
 
 void CServer::setLogCircularBufferSize(size_t size)
 {
-	IScopedLock lock(log_mutex);
+	IScopedLock lock(circular_log_mutex);
 
 	circular_log_buffer.resize(size);
 
@@ -2174,7 +2461,7 @@ void CServer::setLogCircularBufferSize(size_t size)
 
 std::vector<SCircularLogEntry> CServer::getCicularLogBuffer( size_t minid )
 {
-	IScopedLock lock(log_mutex);
+	IScopedLock lock(circular_log_mutex);
 
 	if(minid==std::string::npos)
 	{
@@ -16,6 +16,7 @@
 #include <vector>
 #include <fstream>
 #include <memory>
+#include <atomic>
 
 typedef void(*LOADACTIONS)(IServer*);
 typedef void(*UNLOADACTIONS)(void);
@@ -37,12 +38,15 @@ class IOutputStream;
 struct SDatabase
 {
 	SDatabase(IDatabaseFactory *factory, const std::string &file)
-		: factory(factory), file(file), allocation_chunk_size(std::string::npos)
+		: factory(factory), file(file), max_pool_size(0), allocation_chunk_size(std::string::npos)
 	{}
 
 	IDatabaseFactory *factory;
 	std::string file;
 	std::map<THREAD_ID, IDatabaseInt*> tmap;
+	//Connections of finished threads for reuse
+	std::vector<IDatabaseInt*> pool;
+	size_t max_pool_size;
 	std::vector<std::pair<std::string,std::string> > attach;
 	size_t allocation_chunk_size;
 	std::unique_ptr<ISharedMutex> single_user_mutex;
@@ -221,9 +225,27 @@ public:
 
 	void mallocFlushTcache();
 
+	//Writes log entries to console and log file in a background thread.
+	//Has to be started after daemonizing (fork)
+	void startLogWriter();
+	void stopLogWriter();
+	void runLogWriter();
+
 private:
 
+	struct SLogQueueEntry
+	{
+		SLogQueueEntry(const std::string& msg, int loglevel, time_t rawtime)
+			: msg(msg), loglevel(loglevel), rawtime(rawtime) {}
+
+		std::string msg;
+		int loglevel;
+		time_t rawtime;
+	};
+
 	void logToCircularBuffer(const std::string& msg, int loglevel);
+	void writeLogEntry(const std::string& msg, int loglevel, time_t rawtime);
+	void flushLog();
 
 	bool UnloadDLLs(void);
 	void UnloadDLLs2(void);
@@ -238,6 +260,12 @@ private:
 	std::fstream logfile;
 
 	IMutex* log_mutex;
+	IMutex* circular_log_mutex;
+	IMutex* log_queue_mutex;
+	ICondition* log_queue_cond;
+	std::vector<SLogQueueEntry> log_queue;
+	bool log_writer_running;
+	bool log_writer_exit;
 	IMutex* action_mutex;
 	IMutex* web_socket_mutex;
 	IMutex* requests_mutex;
@@ -271,7 +299,12 @@ private:
 	std::map<pthread_t, THREAD_ID> threads;
 #endif
 
+	void addThreadDbCache(THREAD_ID tid, DATABASE_ID pIdentifier, IDatabaseInt* db);
+
 	std::map<DATABASE_ID, SDatabase*> databases;
+	//Incremented if database connections of other threads are destroyed.
+	//Invalidates the per-thread connection caches
+	std::atomic<size_t> db_generation;
 
 	CSessionMgr *sessmgr;
 
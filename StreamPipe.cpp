@@ -281,6 +281,15 @@ bool CStreamPipe::isReadable(int timeoutms)
 	}
 }
 
+int CStreamPipe::getPollFd()
+{
+#ifdef _WIN32
+	return -1;
+#else
+	return s;
+#endif
+}
+
 bool CStreamPipe::isReadOrWritable(int timeoutms)
 {
 	if (!doThrottle(0, false, false))
@@ -17,6 +17,7 @@ public:
 
 	virtual bool isWritable(int timeoutms);
 	virtual bool isReadable(int timeoutms);
+	virtual int getPollFd();
 	virtual bool isReadOrWritable(int timeoutms);
 
 	virtual bool hasError(void);
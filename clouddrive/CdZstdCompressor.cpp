@@ -18,7 +18,7 @@
 
 #include "CdZstdCompressor.h"
 
-CdZstdCompressor::CdZstdCompressor(int compression_level, unsigned int compression_id)
+CdZstdCompressor::CdZstdCompressor(int compression_level, unsigned int compression_id, int64 src_size)
 	: cctx(ZSTD_createCCtx()), compression_id(compression_id), inBuffer(), outBuffer()
 {
 	if (cctx == nullptr)
@@ -38,6 +38,17 @@ CdZstdCompressor::CdZstdCompressor(int compression_level, unsigned int compressi
 	{
 		Server->Log(std::string("Error setting zstd compression flag. ") + ZSTD_getErrorName(err), LL_ERROR);
 	}
+
+	if (src_size >= 0)
+	{
+		//Lets zstd size its window and tables for small (metadata) objects
+		err = ZSTD_CCtx_setPledgedSrcSize(cctx, static_cast<unsigned long long>(src_size));
+
+		if (ZSTD_isError(err))
+		{
+			Server->Log(std::string("Error setting zstd pledged source size. ") + ZSTD_getErrorName(err), LL_ERROR);
+		}
+	}
 }
 
 CdZstdCompressor::~CdZstdCompressor()
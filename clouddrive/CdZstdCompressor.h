@@ -6,7 +6,7 @@
 class CdZstdCompressor : public ICompressor
 {
 public:
-	CdZstdCompressor(int compression_level, unsigned int compression_id);
+	CdZstdCompressor(int compression_level, unsigned int compression_id, int64 src_size = -1);
 	~CdZstdCompressor();
 
 	// Inherited via ICompressor
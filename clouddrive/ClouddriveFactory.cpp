@@ -65,9 +65,11 @@ IFile* ClouddriveFactory::createCloudFile(IBackupFileSystem* cachefs, CloudSetti
 	{
 		try
 		{
-			online_kv_store = new KvStoreFrontend(settings.s3_settings.cache_db_path,
+			KvStoreFrontend* frontend = new KvStoreFrontend(settings.s3_settings.cache_db_path,
 				backend, !check_only, std::string(), std::string(), nullptr,
 				std::string(), false, false, cachefs);
+			frontend->set_content_dedup(settings.content_dedup);
+			online_kv_store = frontend;
 		}
 		catch (const std::exception&)
 		{
@@ -23,12 +23,82 @@
 #include "CdZstdCompressor.h"
 #include "../urbackupcommon/os_functions.h"
 #include "../urbackupcommon/events.h"
+#include <atomic>
+#include <math.h>
 
 using namespace CryptoPPCompat;
 
 namespace
 {
 	ICompressEncryptFactory* compress_encrypt_factory;
+
+	std::atomic<size_t> active_compressors(0);
+
+	const size_t entropy_sample_size = 8 * 1024;
+	const size_t entropy_num_samples = 4;
+	const double entropy_incompressible_bits = 7.9;
+
+	//Estimates the byte entropy of a few samples spread over the file.
+	//Returns true if all of them look like already compressed or encrypted data
+	bool is_incompressible(IFile* file, int64 file_size)
+	{
+		if (file_size < static_cast<int64>(entropy_sample_size * 2))
+			return false;
+
+		std::vector<char> buf(entropy_sample_size);
+		int64 stride = (file_size - static_cast<int64>(entropy_sample_size)) / (entropy_num_samples - 1);
+
+		for (size_t i = 0; i < entropy_num_samples; ++i)
+		{
+			int64 pos = stride * static_cast<int64>(i);
+			bool has_error = false;
+			_u32 read = file->Read(pos, buf.data(), static_cast<_u32>(buf.size()), &has_error);
+			if (has_error || read != buf.size())
+				return false;
+
+			size_t counts[256] = {};
+			for (size_t j = 0; j < read; ++j)
+			{
+				++counts[static_cast<unsigned char>(buf[j])];
+			}
+
+			double entropy = 0;
+			for (size_t j = 0; j < 256; ++j)
+			{
+				if (counts[j] > 0)
+				{
+					double p = static_cast<double>(counts[j]) / read;
+					entropy -= p * log2(p);
+				}
+			}
+
+			if (entropy < entropy_incompressible_bits)
+				return false;
+		}
+
+		return true;
+	}
+
+	size_t cpu_headroom_limit(bool metadata)
+	{
+		size_t num_cpus = (std::max)(os_get_num_cpus(), static_cast<size_t>(1));
+		//Metadata objects are small and read back often, so they keep their level longer
+		return metadata ? 2 * num_cpus : num_cpus;
+	}
+
+	//Lowers the zstd level if there are more concurrent compressions than CPUs
+	int adapt_zstd_level(int level, bool metadata)
+	{
+		size_t limit = cpu_headroom_limit(metadata);
+		size_t active = active_compressors;
+
+		if (active >= 2 * limit)
+			return 1;
+		else if (active >= limit)
+			return (std::max)(level / 2, 1);
+
+		return level;
+	}
 }
 
 void init_compress_encrypt_factory()
@@ -115,16 +185,31 @@ bool read_generation( IFile* file, int64 offset, int64& generation)
 	return true;
 }
 
-ICompressAndEncrypt* CompressEncryptFactory::createCompressAndEncrypt(const std::string& encryption_key, IFile* file, IOnlineKvStore* online_kv_store, unsigned int compression_id)
+ICompressAndEncrypt* CompressEncryptFactory::createCompressAndEncrypt(const std::string& encryption_key, IFile* file, IOnlineKvStore* online_kv_store, unsigned int compression_id, bool metadata)
 {
+	int64 file_size = file->Size();
+
+	if (compression_id != CompressionNone
+		&& is_incompressible(file, file_size))
+	{
+		compression_id = CompressionNone;
+	}
+
 	ICompressor* compressor;
 	switch (compression_id)
 	{
 	case CompressionLzma5:
 #ifdef WITH_LZMA
-		compressor = new LzmaCompressor;
+		if (active_compressors < cpu_headroom_limit(metadata))
+		{
+			compressor = new LzmaCompressor;
+		}
+		else
+		{
+			compressor = new CdZstdCompressor(adapt_zstd_level(9, metadata), CompressionZstd3, file_size);
+		}
 #else
-		compressor = new CdZstdCompressor(17, CompressionZstd3);
+		compressor = new CdZstdCompressor(adapt_zstd_level(17, metadata), CompressionZstd3, file_size);
 #endif
 		break;
 
@@ -146,7 +231,7 @@ ICompressAndEncrypt* CompressEncryptFactory::createCompressAndEncrypt(const std:
 		case CompressionZstd7:
 			level = 7;
 		}
-		compressor = new CdZstdCompressor(level, CompressionZstd3);
+		compressor = new CdZstdCompressor(adapt_zstd_level(level, metadata), CompressionZstd3, file_size);
 	} break;
 	case CompressionNone:
 		compressor = nullptr;
@@ -216,6 +301,16 @@ CompressAndEncrypt::CompressAndEncrypt( const std::string& encryption_key, IFile
 		compressed_buffer.resize(enc_buffer_size);
 
 		compressor->setOut(compressed_buffer.data(), compressed_buffer.size());
+
+		++active_compressors;
+	}
+}
+
+CompressAndEncrypt::~CompressAndEncrypt()
+{
+	if (compressor)
+	{
+		--active_compressors;
 	}
 }
 
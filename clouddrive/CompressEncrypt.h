@@ -7,7 +7,7 @@
 class CompressEncryptFactory : public ICompressEncryptFactory
 {
 public:
-	ICompressAndEncrypt* createCompressAndEncrypt(const std::string& encryption_key, IFile* file, IOnlineKvStore* online_kv_store, unsigned int compression_id);
+	ICompressAndEncrypt* createCompressAndEncrypt(const std::string& encryption_key, IFile* file, IOnlineKvStore* online_kv_store, unsigned int compression_id, bool metadata);
 	IDecryptAndDecompress* createDecryptAndDecompress(const std::string& encryption_key, IFile* output_file);
 };
 
@@ -56,6 +56,7 @@ class CompressAndEncrypt : public ICompressAndEncrypt
 {
 public:
 	CompressAndEncrypt(const std::string& encryption_key, IFile* file, IOnlineKvStore* online_kv_store, ICompressor* compressor);
+	~CompressAndEncrypt();
 
 	size_t read(char* buffer, size_t buffer_size);
 
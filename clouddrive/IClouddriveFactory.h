@@ -61,6 +61,7 @@ public:
 		bool with_submitted_files = true;
 		bool only_memfiles = false;
 		bool background_worker_manual_run = true;
+		bool content_dedup = false;
 		std::string cache_img_path;
 		
 		CloudEndpoint endpoint;
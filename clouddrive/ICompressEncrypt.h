@@ -43,7 +43,7 @@ std::string CompressionMethodToBtrfsString(unsigned int cmeth);
 class ICompressEncryptFactory : public IObject
 {
 public:
-	virtual ICompressAndEncrypt* createCompressAndEncrypt(const std::string& encryption_key, IFile* file, IOnlineKvStore* online_kv_store, unsigned int compression_id) = 0;
+	virtual ICompressAndEncrypt* createCompressAndEncrypt(const std::string& encryption_key, IFile* file, IOnlineKvStore* online_kv_store, unsigned int compression_id, bool metadata) = 0;
 	virtual IDecryptAndDecompress* createDecryptAndDecompress(const std::string& encryption_key, IFile* output_file) = 0;
 };
 
@@ -667,7 +667,7 @@ bool KvStoreBackendS3::put( const std::string& key, IFsFile* src,
 {
 	src->Seek(0);
 
-	unsigned int curr_comp_method = (flags & IKvStoreBackend::GetMetadata) > 0 ? comp_method_metadata
+	unsigned int curr_comp_method = (flags & IKvStoreBackend::PutMetadata) > 0 ? comp_method_metadata
 		: comp_method;
 
 	std::string local_md5;
@@ -693,7 +693,7 @@ bool KvStoreBackendS3::put( const std::string& key, IFsFile* src,
 		}
 		
 		std::unique_ptr<ICompressAndEncrypt> compress_encrypt(compress_encrypt_factory->createCompressAndEncrypt(encryption_key, 
-			src, online_kv_store, curr_comp_method));
+			src, online_kv_store, curr_comp_method, (flags & IKvStoreBackend::PutMetadata) > 0));
 
 		std::vector<char> buffer;
 		buffer.resize(32768);
@@ -128,6 +128,32 @@
 *			value TEXT )
 */
 
+/**
+* @-SQLGenTempSetup
+* @sql
+*		CREATE TABLE IF NOT EXISTS clouddrive_content (
+*				cd_id INTEGER,
+*				chash BLOB,
+*				trans_id INTEGER,
+*				tkey BLOB,
+*				md5sum BLOB,
+*				size INTEGER,
+*				refcount INTEGER,
+*				PRIMARY KEY(cd_id, chash) )
+*/
+
+/**
+* @-SQLGenTempSetup
+* @sql
+*		CREATE TABLE IF NOT EXISTS clouddrive_content_refs (
+*				cd_id INTEGER,
+*				trans_id INTEGER,
+*				tkey BLOB,
+*				chash BLOB,
+*				alias INTEGER,
+*				PRIMARY KEY(cd_id, tkey, trans_id) )
+*/
+
 KvStoreDao::KvStoreDao( IDatabase *db )
 	: db(db)
 {
@@ -241,6 +267,18 @@ void KvStoreDao::prepareQueries()
 	q_updateGenerationCd=nullptr;
 	q_getLowerTransidObject=nullptr;
 	q_getLowerTransidObjectCd=nullptr;
+	q_createContentTable=nullptr;
+	q_createContentRefTable=nullptr;
+	q_getContent=nullptr;
+	q_addContent=nullptr;
+	q_incContentRefcount=nullptr;
+	q_decContentRefcount=nullptr;
+	q_retireContent=nullptr;
+	q_deleteContent=nullptr;
+	q_getUnreferencedContent=nullptr;
+	q_getContentRef=nullptr;
+	q_addContentRef=nullptr;
+	q_deleteContentRef=nullptr;
 }
 
 //@-SQLGenDestruction
@@ -350,6 +388,18 @@ KvStoreDao::~KvStoreDao()
 	db->destroyQuery(q_updateGenerationCd);
 	db->destroyQuery(q_getLowerTransidObject);
 	db->destroyQuery(q_getLowerTransidObjectCd);
+	db->destroyQuery(q_createContentTable);
+	db->destroyQuery(q_createContentRefTable);
+	db->destroyQuery(q_getContent);
+	db->destroyQuery(q_addContent);
+	db->destroyQuery(q_incContentRefcount);
+	db->destroyQuery(q_decContentRefcount);
+	db->destroyQuery(q_retireContent);
+	db->destroyQuery(q_deleteContent);
+	db->destroyQuery(q_getUnreferencedContent);
+	db->destroyQuery(q_getContentRef);
+	db->destroyQuery(q_addContentRef);
+	db->destroyQuery(q_deleteContentRef);
 }
 
 IDatabase * KvStoreDao::getDb()
@@ -370,6 +420,9 @@ void KvStoreDao::createTables()
 	createTransactionTableCd();
 	createObjectCdTransIdIdx();
 	createGenerationTableCd();
+
+	createContentTable();
+	createContentRefTable();
 }
 
 /**
@@ -2785,3 +2838,285 @@ KvStoreDao::CondInt64 KvStoreDao::getLowerTransidObjectCd(int64 cd_id, const std
 	return ret;
 }
 
+/**
+* @-SQLGenAccess
+* @func void KvStoreDao::createContentTable
+* @sql
+*	CREATE TABLE IF NOT EXISTS clouddrive_content (
+*				cd_id INTEGER,
+*				chash BLOB,
+*				trans_id INTEGER,
+*				tkey BLOB,
+*				md5sum BLOB,
+*				size INTEGER,
+*				refcount INTEGER,
+*				PRIMARY KEY(cd_id, chash) )
+*/
+void KvStoreDao::createContentTable(void)
+{
+	if(q_createContentTable==nullptr)
+	{
+		q_createContentTable=db->Prepare("CREATE TABLE IF NOT EXISTS clouddrive_content ( cd_id INTEGER, chash BLOB, trans_id INTEGER, tkey BLOB, md5sum BLOB, size INTEGER, refcount INTEGER, PRIMARY KEY(cd_id, chash) )", false);
+	}
+	q_createContentTable->Write();
+}
+
+/**
+* @-SQLGenAccess
+* @func void KvStoreDao::createContentRefTable
+* @sql
+*	CREATE TABLE IF NOT EXISTS clouddrive_content_refs (
+*				cd_id INTEGER,
+*				trans_id INTEGER,
+*				tkey BLOB,
+*				chash BLOB,
+*				alias INTEGER,
+*				PRIMARY KEY(cd_id, tkey, trans_id) )
+*/
+void KvStoreDao::createContentRefTable(void)
+{
+	if(q_createContentRefTable==nullptr)
+	{
+		q_createContentRefTable=db->Prepare("CREATE TABLE IF NOT EXISTS clouddrive_content_refs ( cd_id INTEGER, trans_id INTEGER, tkey BLOB, chash BLOB, alias INTEGER, PRIMARY KEY(cd_id, tkey, trans_id) )", false);
+	}
+	q_createContentRefTable->Write();
+}
+
+/**
+* @-SQLGenAccess
+* @func CdContent KvStoreDao::getContent
+* @return int64 trans_id, blob tkey, blob md5sum, int64 size, int64 refcount
+* @sql
+*		SELECT trans_id, tkey, md5sum, size, refcount FROM clouddrive_content
+*			WHERE cd_id=:cd_id(int64) AND chash=:chash(blob)
+*/
+KvStoreDao::CdContent KvStoreDao::getContent(int64 cd_id, const std::string& chash)
+{
+	if(q_getContent==nullptr)
+	{
+		q_getContent=db->Prepare("SELECT trans_id, tkey, md5sum, size, refcount FROM clouddrive_content WHERE cd_id=? AND chash=?", false);
+	}
+	q_getContent->Bind(cd_id);
+	q_getContent->Bind(chash.c_str(), (_u32)chash.size());
+	db_results res=q_getContent->Read();
+	q_getContent->Reset();
+	CdContent ret = { false, 0, "", "", 0, 0 };
+	if(!res.empty())
+	{
+		ret.exists=true;
+		ret.trans_id=watoi64(res[0]["trans_id"]);
+		ret.tkey=res[0]["tkey"];
+		ret.md5sum=res[0]["md5sum"];
+		ret.size=watoi64(res[0]["size"]);
+		ret.refcount=watoi64(res[0]["refcount"]);
+	}
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func bool KvStoreDao::addContent
+* @sql
+*		INSERT OR IGNORE INTO clouddrive_content (cd_id, chash, trans_id, tkey, md5sum, size, refcount)
+*			VALUES (:cd_id(int64), :chash(blob), :trans_id(int64), :tkey(blob), :md5sum(blob), :size(int64), 1)
+*/
+bool KvStoreDao::addContent(int64 cd_id, const std::string& chash, int64 trans_id, const std::string& tkey, const std::string& md5sum, int64 size)
+{
+	if(q_addContent==nullptr)
+	{
+		q_addContent=db->Prepare("INSERT OR IGNORE INTO clouddrive_content (cd_id, chash, trans_id, tkey, md5sum, size, refcount) VALUES (?, ?, ?, ?, ?, ?, 1)", false);
+	}
+	q_addContent->Bind(cd_id);
+	q_addContent->Bind(chash.c_str(), (_u32)chash.size());
+	q_addContent->Bind(trans_id);
+	q_addContent->Bind(tkey.c_str(), (_u32)tkey.size());
+	q_addContent->Bind(md5sum.c_str(), (_u32)md5sum.size());
+	q_addContent->Bind(size);
+	bool ret = q_addContent->Write();
+	q_addContent->Reset();
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func bool KvStoreDao::incContentRefcount
+* @sql
+*		UPDATE clouddrive_content SET refcount=refcount+1
+*			WHERE cd_id=:cd_id(int64) AND chash=:chash(blob) AND refcount>0
+*/
+bool KvStoreDao::incContentRefcount(int64 cd_id, const std::string& chash)
+{
+	if(q_incContentRefcount==nullptr)
+	{
+		q_incContentRefcount=db->Prepare("UPDATE clouddrive_content SET refcount=refcount+1 WHERE cd_id=? AND chash=? AND refcount>0", false);
+	}
+	q_incContentRefcount->Bind(cd_id);
+	q_incContentRefcount->Bind(chash.c_str(), (_u32)chash.size());
+	bool ret = q_incContentRefcount->Write();
+	q_incContentRefcount->Reset();
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func bool KvStoreDao::decContentRefcount
+* @sql
+*		UPDATE clouddrive_content SET refcount=refcount-1
+*			WHERE cd_id=:cd_id(int64) AND chash=:chash(blob) AND refcount>0
+*/
+bool KvStoreDao::decContentRefcount(int64 cd_id, const std::string& chash)
+{
+	if(q_decContentRefcount==nullptr)
+	{
+		q_decContentRefcount=db->Prepare("UPDATE clouddrive_content SET refcount=refcount-1 WHERE cd_id=? AND chash=? AND refcount>0", false);
+	}
+	q_decContentRefcount->Bind(cd_id);
+	q_decContentRefcount->Bind(chash.c_str(), (_u32)chash.size());
+	bool ret = q_decContentRefcount->Write();
+	q_decContentRefcount->Reset();
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func bool KvStoreDao::retireContent
+* @sql
+*		UPDATE clouddrive_content SET refcount=0
+*			WHERE cd_id=:cd_id(int64) AND chash=:chash(blob) AND refcount=1
+*/
+bool KvStoreDao::retireContent(int64 cd_id, const std::string& chash)
+{
+	if(q_retireContent==nullptr)
+	{
+		q_retireContent=db->Prepare("UPDATE clouddrive_content SET refcount=0 WHERE cd_id=? AND chash=? AND refcount=1", false);
+	}
+	q_retireContent->Bind(cd_id);
+	q_retireContent->Bind(chash.c_str(), (_u32)chash.size());
+	bool ret = q_retireContent->Write();
+	q_retireContent->Reset();
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func bool KvStoreDao::deleteContent
+* @sql
+*		DELETE FROM clouddrive_content WHERE cd_id=:cd_id(int64) AND chash=:chash(blob)
+*/
+bool KvStoreDao::deleteContent(int64 cd_id, const std::string& chash)
+{
+	if(q_deleteContent==nullptr)
+	{
+		q_deleteContent=db->Prepare("DELETE FROM clouddrive_content WHERE cd_id=? AND chash=?", false);
+	}
+	q_deleteContent->Bind(cd_id);
+	q_deleteContent->Bind(chash.c_str(), (_u32)chash.size());
+	bool ret = q_deleteContent->Write();
+	q_deleteContent->Reset();
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func vector<CdUnrefContent> KvStoreDao::getUnreferencedContent
+* @return blob chash, int64 trans_id, blob tkey, blob md5sum
+* @sql
+*		SELECT chash, trans_id, tkey, md5sum FROM clouddrive_content c
+*			WHERE cd_id=:cd_id(int64) AND refcount<=0
+*				AND NOT EXISTS (SELECT 1 FROM clouddrive_content_refs r
+*					WHERE r.cd_id=c.cd_id AND r.trans_id=c.trans_id AND r.tkey=c.tkey)
+*			ORDER BY trans_id ASC, tkey ASC
+*/
+std::vector<KvStoreDao::CdUnrefContent> KvStoreDao::getUnreferencedContent(int64 cd_id)
+{
+	if(q_getUnreferencedContent==nullptr)
+	{
+		q_getUnreferencedContent=db->Prepare("SELECT chash, trans_id, tkey, md5sum FROM clouddrive_content c WHERE cd_id=? AND refcount<=0 AND NOT EXISTS (SELECT 1 FROM clouddrive_content_refs r WHERE r.cd_id=c.cd_id AND r.trans_id=c.trans_id AND r.tkey=c.tkey) ORDER BY trans_id ASC, tkey ASC", false);
+	}
+	q_getUnreferencedContent->Bind(cd_id);
+	db_results res=q_getUnreferencedContent->Read();
+	q_getUnreferencedContent->Reset();
+	std::vector<KvStoreDao::CdUnrefContent> ret;
+	ret.resize(res.size());
+	for(size_t i=0;i<res.size();++i)
+	{
+		ret[i].chash=res[i]["chash"];
+		ret[i].trans_id=watoi64(res[i]["trans_id"]);
+		ret[i].tkey=res[i]["tkey"];
+		ret[i].md5sum=res[i]["md5sum"];
+	}
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func CdContentRef KvStoreDao::getContentRef
+* @return blob chash, int alias
+* @sql
+*		SELECT chash, alias FROM clouddrive_content_refs
+*			WHERE cd_id=:cd_id(int64) AND trans_id=:trans_id(int64) AND tkey=:tkey(blob)
+*/
+KvStoreDao::CdContentRef KvStoreDao::getContentRef(int64 cd_id, int64 trans_id, const std::string& tkey)
+{
+	if(q_getContentRef==nullptr)
+	{
+		q_getContentRef=db->Prepare("SELECT chash, alias FROM clouddrive_content_refs WHERE cd_id=? AND trans_id=? AND tkey=?", false);
+	}
+	q_getContentRef->Bind(cd_id);
+	q_getContentRef->Bind(trans_id);
+	q_getContentRef->Bind(tkey.c_str(), (_u32)tkey.size());
+	db_results res=q_getContentRef->Read();
+	q_getContentRef->Reset();
+	CdContentRef ret = { false, "", 0 };
+	if(!res.empty())
+	{
+		ret.exists=true;
+		ret.chash=res[0]["chash"];
+		ret.alias=watoi(res[0]["alias"]);
+	}
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func bool KvStoreDao::addContentRef
+* @sql
+*		INSERT OR REPLACE INTO clouddrive_content_refs (cd_id, trans_id, tkey, chash, alias)
+*			VALUES (:cd_id(int64), :trans_id(int64), :tkey(blob), :chash(blob), :alias(int))
+*/
+bool KvStoreDao::addContentRef(int64 cd_id, int64 trans_id, const std::string& tkey, const std::string& chash, int alias)
+{
+	if(q_addContentRef==nullptr)
+	{
+		q_addContentRef=db->Prepare("INSERT OR REPLACE INTO clouddrive_content_refs (cd_id, trans_id, tkey, chash, alias) VALUES (?, ?, ?, ?, ?)", false);
+	}
+	q_addContentRef->Bind(cd_id);
+	q_addContentRef->Bind(trans_id);
+	q_addContentRef->Bind(tkey.c_str(), (_u32)tkey.size());
+	q_addContentRef->Bind(chash.c_str(), (_u32)chash.size());
+	q_addContentRef->Bind(alias);
+	bool ret = q_addContentRef->Write();
+	q_addContentRef->Reset();
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func bool KvStoreDao::deleteContentRef
+* @sql
+*		DELETE FROM clouddrive_content_refs
+*			WHERE cd_id=:cd_id(int64) AND trans_id=:trans_id(int64) AND tkey=:tkey(blob)
+*/
+bool KvStoreDao::deleteContentRef(int64 cd_id, int64 trans_id, const std::string& tkey)
+{
+	if(q_deleteContentRef==nullptr)
+	{
+		q_deleteContentRef=db->Prepare("DELETE FROM clouddrive_content_refs WHERE cd_id=? AND trans_id=? AND tkey=?", false);
+	}
+	q_deleteContentRef->Bind(cd_id);
+	q_deleteContentRef->Bind(trans_id);
+	q_deleteContentRef->Bind(tkey.c_str(), (_u32)tkey.size());
+	bool ret = q_deleteContentRef->Write();
+	q_deleteContentRef->Reset();
+	return ret;
+}
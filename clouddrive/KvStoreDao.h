@@ -40,6 +40,21 @@ public:
 		std::string md5sum;
 		int64 size;
 	};
+	struct CdContent
+	{
+		bool exists;
+		int64 trans_id;
+		std::string tkey;
+		std::string md5sum;
+		int64 size;
+		int64 refcount;
+	};
+	struct CdContentRef
+	{
+		bool exists;
+		std::string chash;
+		int alias;
+	};
 	struct CdObject
 	{
 		bool exists;
@@ -55,6 +70,13 @@ public:
 		int64 size;
 		std::string md5sum;
 	};
+	struct CdUnrefContent
+	{
+		std::string chash;
+		int64 trans_id;
+		std::string tkey;
+		std::string md5sum;
+	};
 	struct CondInt64
 	{
 		bool exists;
@@ -209,6 +231,18 @@ public:
 	bool updateGenerationCd(int64 cd_id, int64 generation);
 	CondInt64 getLowerTransidObject(const std::string& tkey, int64 transid);
 	CondInt64 getLowerTransidObjectCd(int64 cd_id, const std::string& tkey, int64 transid);
+	void createContentTable(void);
+	void createContentRefTable(void);
+	CdContent getContent(int64 cd_id, const std::string& chash);
+	bool addContent(int64 cd_id, const std::string& chash, int64 trans_id, const std::string& tkey, const std::string& md5sum, int64 size);
+	bool incContentRefcount(int64 cd_id, const std::string& chash);
+	bool decContentRefcount(int64 cd_id, const std::string& chash);
+	bool retireContent(int64 cd_id, const std::string& chash);
+	bool deleteContent(int64 cd_id, const std::string& chash);
+	std::vector<CdUnrefContent> getUnreferencedContent(int64 cd_id);
+	CdContentRef getContentRef(int64 cd_id, int64 trans_id, const std::string& tkey);
+	bool addContentRef(int64 cd_id, int64 trans_id, const std::string& tkey, const std::string& chash, int alias);
+	bool deleteContentRef(int64 cd_id, int64 trans_id, const std::string& tkey);
 	//@-SQLGenFunctionsEnd
 
 	IQuery* getUpdateGenerationQuery();
@@ -320,6 +354,18 @@ private:
 	IQuery* q_updateGenerationCd;
 	IQuery* q_getLowerTransidObject;
 	IQuery* q_getLowerTransidObjectCd;
+	IQuery* q_createContentTable;
+	IQuery* q_createContentRefTable;
+	IQuery* q_getContent;
+	IQuery* q_addContent;
+	IQuery* q_incContentRefcount;
+	IQuery* q_decContentRefcount;
+	IQuery* q_retireContent;
+	IQuery* q_deleteContent;
+	IQuery* q_getUnreferencedContent;
+	IQuery* q_getContentRef;
+	IQuery* q_addContentRef;
+	IQuery* q_deleteContentRef;
 	//@-SQLGenVariablesEnd
 
 	void prepareQueries();
@@ -56,6 +56,8 @@
 #include <sys/file.h>
 #endif
 
+using namespace CryptoPPCompat;
+
 //#define ASSERT_CHECK_DELETED
 //#define ASSERT_CHECK_DELETED_NO_LOCINFO
 #define WITH_PUT_CURR_DEL
@@ -175,7 +177,7 @@ KvStoreFrontend::KvStoreFrontend(const std::string& db_path,
 	mirror_curr_pos(-1), mirror_state(-1), mirror_curr_total(-1), mirror_items(-1),
 	objects_total_size(0), objects_total_num(0), objects_init_complete(false),
 	objects_init_ticket(ILLEGAL_THREADPOOL_TICKET), allow_import(allow_import),
-	cachefs(cachefs)
+	cachefs(cachefs), content_dedup(false), content_index(false)
 {
 	backend->setFrontend(this, false);
 
@@ -208,6 +210,8 @@ KvStoreFrontend::KvStoreFrontend(const std::string& db_path,
 	add_created_column();
 	add_cd_id_tasks_column();
 
+	content_index = dao.getMiscValue("content_dedup").value == "1";
+
 	if (backend_mirror != nullptr)
 	{
 		add_mirrored_column();
@@ -664,6 +668,19 @@ IFsFile* KvStoreFrontend::get(int64 cd_id, const std::string& key, int64 transid
 	bool from_mirror = false;
 
 	std::string bkey = prefixKey(encodeKey(cd_id, key, cd_object.trans_id));
+
+	bool is_alias = false;
+	if (content_index)
+	{
+		KvStoreDao::CdContent content;
+		if (get_content_alias(dao, cd_id, cd_object.trans_id, key, content))
+		{
+			bkey = prefixKey(encodeKey(cd_id, content.tkey, content.trans_id));
+			cd_object.md5sum = content.md5sum;
+			is_alias = true;
+		}
+	}
+
 	if (!backend->get(bkey, cd_object.md5sum,
 		flags, allow_error_event, ret, ret_md5sum, get_status))
 	{
@@ -691,7 +708,8 @@ IFsFile* KvStoreFrontend::get(int64 cd_id, const std::string& key, int64 transid
 	}
 
 	if (ret_md5sum != cd_object.md5sum
-		&& !from_mirror)
+		&& !from_mirror
+		&& !is_alias)
 	{
 		DBScopedSynchronous synchronous(dao.getDb());
 		if(cd_id==0)
@@ -795,6 +813,11 @@ bool KvStoreFrontend::reset(const std::string & key, int64 transid)
 
 	--objects_total_num;
 
+	if (content_index)
+	{
+		release_content_ref(dao, 0, cd_object.trans_id, key);
+	}
+
 	return dao.deleteObject(cd_object.trans_id, key);
 }
 
@@ -874,6 +897,63 @@ bool KvStoreFrontend::put(int64 cd_id, const std::string& key, int64 transid,
 			--objects_total_num;
 	}
 
+	std::string chash;
+	int64 src_size = 0;
+	KvStoreDao::CdContent dedup_content;
+	dedup_content.exists = false;
+	if (content_dedup
+		&& !(cflags & IOnlineKvStore::PutAlreadyCompressedEncrypted))
+	{
+		src_size = src->Size();
+		chash = content_hash(src);
+
+		KvStoreDao dao(getDatabase());
+		DBScopedSynchronous synchronous(dao.getDb());
+
+		bool has_ref;
+		retire_content(dao, cd_id, transid, key, has_ref);
+		if (has_ref)
+			release_content_ref(dao, cd_id, transid, key);
+
+		if (!chash.empty())
+		{
+			dedup_content = dao.getContent(cd_id, chash);
+
+			if (dedup_content.exists
+				&& (dedup_content.size != src_size
+					|| dedup_content.refcount <= 0) )
+			{
+				dedup_content.exists = false;
+			}
+
+			if (dedup_content.exists)
+			{
+				//Only reference data of completed transactions. Those are never overwritten in place
+				KvStoreDao::STransactionProperties trans_props = cd_id == 0 ?
+					dao.getTransactionProperties(dedup_content.trans_id) :
+					dao.getTransactionPropertiesCd(cd_id, dedup_content.trans_id);
+				if (!trans_props.exists
+					|| trans_props.completed == 0)
+				{
+					dedup_content.exists = false;
+				}
+			}
+
+			if (dedup_content.exists)
+			{
+				dao.incContentRefcount(cd_id, chash);
+				if (dao.getDb()->getLastChanges() > 0)
+				{
+					dao.addContentRef(cd_id, transid, key, chash, 1);
+				}
+				else
+				{
+					dedup_content.exists = false;
+				}
+			}
+		}
+	}
+
 	int64 object_id;
 	if(!backend->has_transactions())
 	{
@@ -894,7 +974,31 @@ bool KvStoreFrontend::put(int64 cd_id, const std::string& key, int64 transid,
 		put_flags |= IKvStoreBackend::PutMetadata;
 	std::string md5sum;
 	compressed_size = 0;
-	bool ret = backend->put(tkey, src, put_flags, allow_error_event, md5sum, compressed_size);
+	bool ret;
+	if (dedup_content.exists)
+	{
+		Server->Log("Object key=" + bytesToHex(key) + " has same content as key=" + bytesToHex(dedup_content.tkey) +
+			" transid " + convert(dedup_content.trans_id) + ". Referencing it.", LL_DEBUG);
+		md5sum = dedup_content.md5sum;
+		ret = true;
+	}
+	else
+	{
+		ret = backend->put(tkey, src, put_flags, allow_error_event, md5sum, compressed_size);
+	}
+
+	if (ret
+		&& !chash.empty()
+		&& !dedup_content.exists)
+	{
+		KvStoreDao dao(getDatabase());
+		DBScopedSynchronous synchronous(dao.getDb());
+		dao.addContent(cd_id, chash, transid, key, md5sum, src_size);
+		if (dao.getDb()->getLastChanges() > 0)
+		{
+			dao.addContentRef(cd_id, transid, key, chash, 0);
+		}
+	}
 
 	if(ret)
 	{
@@ -1209,6 +1313,16 @@ bool KvStoreFrontend::del(int64 cd_id, const std::vector<std::string>& keys, int
 
 			if (no_reset && cd_object.exists)
 				++total_del_num;
+
+			bool has_ref;
+			if (cd_object.exists
+				&& content_index
+				&& !retire_content(dao, cd_id, transid, keys[idx], has_ref))
+			{
+				//Data is referenced by other objects. Only the reference gets removed
+				cd_object.exists = false;
+				++idx;
+			}
 		}
 
 		if (idx >= keys.size())
@@ -1248,6 +1362,9 @@ bool KvStoreFrontend::del(int64 cd_id, const std::vector<std::string>& keys, int
 					dao.addDelMarkerObject(transid, keys[i]);
 				else
 					dao.addDelMarkerObjectCd(cd_id, transid, keys[i]);
+
+				if (content_index)
+					release_content_ref(dao, cd_id, transid, keys[i]);
 			}
 		}
 		db->freeMemory();
@@ -2220,6 +2337,27 @@ void KvStoreFrontend::submit_del_post_flush()
 	dao.setMiscValue("submit_del_done", "1");
 }
 
+void KvStoreFrontend::set_content_dedup(bool b)
+{
+	if (b
+		&& (backend->has_transactions()
+			|| backend_mirror != nullptr))
+	{
+		Server->Log("Content deduplication is not supported with this backend configuration", LL_WARNING);
+		b = false;
+	}
+
+	content_dedup = b;
+
+	if (b && !content_index)
+	{
+		//Once enabled, deletion has to honor content references for the lifetime of the db
+		KvStoreDao dao(getDatabase());
+		dao.setMiscValue("content_dedup", "1");
+		content_index = true;
+	}
+}
+
 bool KvStoreFrontend::backend_del_parallel(const std::vector<IKvStoreBackend::key_next_fun_t>& key_next_funs,
 	const std::vector<IKvStoreBackend::locinfo_next_fun_t>& locinfo_next_funs,
 	bool background_queue)
@@ -2390,6 +2528,94 @@ bool KvStoreFrontend::update_total_num(int64 num)
 	return true;
 }
 
+std::string KvStoreFrontend::content_hash(IFsFile* src)
+{
+	CryptoPP::SHA256 sha;
+	std::vector<char> buf(512 * 1024);
+	int64 size = src->Size();
+	int64 pos = 0;
+	while (pos < size)
+	{
+		_u32 toread = static_cast<_u32>((std::min)(size - pos, static_cast<int64>(buf.size())));
+		bool has_error = false;
+		_u32 read = src->Read(pos, buf.data(), toread, &has_error);
+		if (has_error || read == 0)
+		{
+			Server->Log("Error reading from file while hashing content. " + os_last_error_str(), LL_WARNING);
+			return std::string();
+		}
+		sha.Update(reinterpret_cast<const byte*>(buf.data()), read);
+		pos += read;
+	}
+
+	std::string ret;
+	ret.resize(CryptoPP::SHA256::DIGESTSIZE);
+	sha.Final(reinterpret_cast<byte*>(&ret[0]));
+	return ret;
+}
+
+bool KvStoreFrontend::get_content_alias(KvStoreDao& dao, int64 cd_id, int64 transid, const std::string& key, KvStoreDao::CdContent& content)
+{
+	KvStoreDao::CdContentRef ref = dao.getContentRef(cd_id, transid, key);
+	if (!ref.exists
+		|| !ref.alias)
+		return false;
+
+	content = dao.getContent(cd_id, ref.chash);
+	return content.exists;
+}
+
+bool KvStoreFrontend::retire_content(KvStoreDao& dao, int64 cd_id, int64 transid, const std::string& key, bool& has_ref)
+{
+	has_ref = false;
+	KvStoreDao::CdContentRef ref = dao.getContentRef(cd_id, transid, key);
+	if (!ref.exists)
+		return true;
+
+	has_ref = true;
+
+	if (ref.alias)
+	{
+		//Data is owned by another object
+		return false;
+	}
+
+	KvStoreDao::CdContent content = dao.getContent(cd_id, ref.chash);
+	if (!content.exists)
+		return true;
+
+	if (content.refcount <= 0)
+		return true;
+
+	//Only the owner itself references the data. Make sure no new alias is added
+	//while the backend object is being deleted
+	dao.retireContent(cd_id, ref.chash);
+	return dao.getDb()->getLastChanges() > 0;
+}
+
+void KvStoreFrontend::release_content_ref(KvStoreDao& dao, int64 cd_id, int64 transid, const std::string& key)
+{
+	KvStoreDao::CdContentRef ref = dao.getContentRef(cd_id, transid, key);
+	if (!ref.exists)
+		return;
+
+	dao.deleteContentRef(cd_id, transid, key);
+
+	KvStoreDao::CdContent content = dao.getContent(cd_id, ref.chash);
+	if (!content.exists)
+		return;
+
+	if (!ref.alias
+		&& content.refcount <= 0)
+	{
+		dao.deleteContent(cd_id, ref.chash);
+	}
+	else
+	{
+		dao.decContentRefcount(cd_id, ref.chash);
+	}
+}
+
 const unsigned int del_mirror_magic = 0x4A00B231;
 
 bool KvStoreFrontend::log_del_mirror(const std::string & fn)
@@ -2821,6 +3047,26 @@ bool KvStoreFrontend::BackgroundWorker::removeOldObjects(KvStoreDao& dao,
 	int64 delete_num = 0;
 
 	bool has_object = false;
+
+	std::vector<std::pair<int64, std::string> > content_refs;
+	std::vector<KvStoreDao::CdUnrefContent> unref_content;
+	if (frontend->content_index
+		&& !backend->ordered_del())
+	{
+		unref_content = dao.getUnreferencedContent(cd_id);
+
+		for (KvStoreDao::CdUnrefContent& content : unref_content)
+		{
+			Server->Log("Deleting unreferenced content object " + bytesToHex(content.tkey) + " transid " + convert(content.trans_id) + " cd_id " + convert(cd_id), LL_INFO);
+
+			if (backend->del_with_location_info())
+				object_collector.add(content.trans_id, content.tkey, get_locinfo(content.md5sum), false);
+			else
+				object_collector.add(content.trans_id, content.tkey, false);
+
+			has_object = true;
+		}
+	}
 	if (backend->del_with_location_info())
 	{
 		/*std::vector<KvStoreDao::CdDelObjectMd5> deletable_objects;
@@ -2895,6 +3141,20 @@ bool KvStoreFrontend::BackgroundWorker::removeOldObjects(KvStoreDao& dao,
 
 				Server->Log("Deleting object (1) " + bytesToHex(reinterpret_cast<const unsigned char*>(deletable_object.tkey.c_str()), deletable_object.tkey.size()) + " transid " + convert(deletable_object.trans_id)+" cd_id "+convert(cd_id), LL_INFO);
 
+				bool has_ref;
+				if (frontend->content_index
+					&& !frontend->retire_content(dao, cd_id, deletable_object.trans_id, deletable_object.tkey, has_ref))
+				{
+					content_refs.push_back(std::make_pair(deletable_object.trans_id, deletable_object.tkey));
+					has_object = true;
+					continue;
+				}
+				else if (frontend->content_index
+					&& has_ref)
+				{
+					content_refs.push_back(std::make_pair(deletable_object.trans_id, deletable_object.tkey));
+				}
+
 				object_collector.add(
 					deletable_object.trans_id,
 					deletable_object.tkey,
@@ -2973,6 +3233,20 @@ bool KvStoreFrontend::BackgroundWorker::removeOldObjects(KvStoreDao& dao,
 
 				Server->Log("Deleting object (1) " + bytesToHex(reinterpret_cast<const unsigned char*>(deletable_object.tkey.c_str()), deletable_object.tkey.size()) + " transid " + convert(deletable_object.trans_id)+" cd_id "+convert(cd_id), LL_INFO);
 
+				bool has_ref;
+				if (frontend->content_index
+					&& !frontend->retire_content(dao, cd_id, deletable_object.trans_id, deletable_object.tkey, has_ref))
+				{
+					content_refs.push_back(std::make_pair(deletable_object.trans_id, deletable_object.tkey));
+					has_object = true;
+					continue;
+				}
+				else if (frontend->content_index
+					&& has_ref)
+				{
+					content_refs.push_back(std::make_pair(deletable_object.trans_id, deletable_object.tkey));
+				}
+
 				object_collector.add(
 					deletable_object.trans_id,
 					deletable_object.tkey,
@@ -3035,6 +3309,8 @@ bool KvStoreFrontend::BackgroundWorker::removeOldObjects(KvStoreDao& dao,
 			}
 #endif
 
+			DBScopedWriteTransaction content_transaction(frontend->content_index ? dao.getDb() : nullptr);
+
 			if (cd_id == 0)
 			{
 				for (int64 trans_id : trans_ids)
@@ -3059,6 +3335,16 @@ bool KvStoreFrontend::BackgroundWorker::removeOldObjects(KvStoreDao& dao,
 					}
 				}
 			}
+
+			for (std::pair<int64, std::string>& content_ref : content_refs)
+			{
+				frontend->release_content_ref(dao, cd_id, content_ref.first, content_ref.second);
+			}
+
+			for (KvStoreDao::CdUnrefContent& content : unref_content)
+			{
+				dao.deleteContent(cd_id, content.chash);
+			}
 		}
 
 		for (int64 trans_id : trans_ids)
@@ -3136,6 +3422,7 @@ bool KvStoreFrontend::BackgroundWorker::removeTransaction(KvStoreDao& dao, int64
 	bool has_object = false;
 	int64 delete_size = 0;
 	int64 delete_num = 0;
+	std::vector<std::string> content_refs;
 
 	std::string mirrored = "";
 	if (frontend->backend_mirror != nullptr)
@@ -3179,6 +3466,19 @@ bool KvStoreFrontend::BackgroundWorker::removeTransaction(KvStoreDao& dao, int64
 					bytesToHex(reinterpret_cast<const unsigned char*>(trans_object.tkey.c_str()),
 						trans_object.tkey.size()) + " transid " + convert(trans_id)+" cd_id "+convert(cd_id), LL_INFO);
 
+				bool has_ref;
+				if (frontend->content_index
+					&& !frontend->retire_content(dao, cd_id, trans_id, trans_object.tkey, has_ref))
+				{
+					content_refs.push_back(trans_object.tkey);
+					continue;
+				}
+				else if (frontend->content_index
+					&& has_ref)
+				{
+					content_refs.push_back(trans_object.tkey);
+				}
+
 				object_collector.add(-1,
 					trans_object.tkey,
 					get_locinfo(trans_object.md5sum),
@@ -3221,6 +3521,19 @@ bool KvStoreFrontend::BackgroundWorker::removeTransaction(KvStoreDao& dao, int64
 				}
 
 				Server->Log("Deleting object (2) " + bytesToHex(reinterpret_cast<const unsigned char*>(trans_object.c_str()), trans_object.size()) + " transid " + convert(trans_id)+" cd_id "+convert(cd_id), LL_INFO);
+				bool has_ref;
+				if (frontend->content_index
+					&& !frontend->retire_content(dao, cd_id, trans_id, trans_object, has_ref))
+				{
+					content_refs.push_back(trans_object);
+					continue;
+				}
+				else if (frontend->content_index
+					&& has_ref)
+				{
+					content_refs.push_back(trans_object);
+				}
+
 				object_collector.add(-1,
 					trans_object,
 					mirrored);
@@ -3342,6 +3655,8 @@ bool KvStoreFrontend::BackgroundWorker::removeTransaction(KvStoreDao& dao, int64
 			}
 #endif
 
+			DBScopedWriteTransaction content_transaction(frontend->content_index ? dao.getDb() : nullptr);
+
 			if (cd_id == 0)
 			{
 				if (!dao.deleteTransactionObjects(trans_id))
@@ -3360,6 +3675,11 @@ bool KvStoreFrontend::BackgroundWorker::removeTransaction(KvStoreDao& dao, int64
 					return false;
 				}
 			}
+
+			for (std::string& content_ref : content_refs)
+			{
+				frontend->release_content_ref(dao, cd_id, trans_id, content_ref);
+			}
 		}
 		object_collector_size = 0;
 		object_collector_size_uncompressed = 0;
@@ -3657,6 +3977,14 @@ void KvStoreFrontend::ScrubWorker::operator()()
 				continue;
 			}
 
+			KvStoreDao::CdContent content;
+			if (frontend->content_index
+				&& frontend->get_content_alias(dao, 0, result.trans_id, result.tkey, content))
+			{
+				//Data is scrubbed via the object owning it
+				continue;
+			}
+
 			scrub_queue.add(result);
 		}
 
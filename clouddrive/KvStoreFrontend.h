@@ -201,6 +201,8 @@ public:
 
 	virtual void submit_del_post_flush() override;
 
+	void set_content_dedup(bool b);
+
 private:
 	bool backend_del_parallel(const std::vector<IKvStoreBackend::key_next_fun_t>& key_next_funs,
 		const std::vector<IKvStoreBackend::locinfo_next_fun_t>& locinfo_next_funs,
@@ -218,6 +220,14 @@ private:
 
 	bool update_total_num(int64 num);
 
+	std::string content_hash(IFsFile* src);
+
+	bool get_content_alias(KvStoreDao& dao, int64 cd_id, int64 transid, const std::string& key, KvStoreDao::CdContent& content);
+
+	bool retire_content(KvStoreDao& dao, int64 cd_id, int64 transid, const std::string& key, bool& has_ref);
+
+	void release_content_ref(KvStoreDao& dao, int64 cd_id, int64 transid, const std::string& key);
+
 	class BackgroundWorker : public IThread
 	{
 	public:
@@ -729,4 +739,7 @@ private:
 	bool allow_import;
 
 	IBackupFileSystem* cachefs;
+
+	bool content_dedup;
+	bool content_index;
 };
\ No newline at end of file
@@ -188,49 +188,49 @@ namespace
 		return cachefs->setXAttr(path, "user.cs", val);
 	}
 
-	TransactionalKvStore::SCacheVal* cache_get(common::lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
+	TransactionalKvStore::SCacheVal* cache_get(common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
 		const std::string& key, std::unique_lock<cache_mutex_t>& lock, bool bring_front = true)
 	{
 		assert(lock.owns_lock());
 		return lru_cache.get(key, bring_front);
 	}
 
-	void cache_put(common::lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
+	void cache_put(common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
 		const std::string& key, TransactionalKvStore::SCacheVal val, std::unique_lock<cache_mutex_t>& lock)
 	{
 		assert(lock.owns_lock());
 		lru_cache.put(key, val);
 	}
 
-	void cache_put_back(common::lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
+	void cache_put_back(common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
 		const std::string& key, TransactionalKvStore::SCacheVal val, std::unique_lock<cache_mutex_t>& lock)
 	{
 		assert(lock.owns_lock());
 		lru_cache.put_back(key, val);
 	}
 
-	void cache_del(common::lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
+	void cache_del(common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
 		const std::string& key, std::unique_lock<cache_mutex_t>& lock)
 	{
 		assert(lock.owns_lock());
 		lru_cache.del(key);
 	}
 
-	std::pair<std::string, TransactionalKvStore::SCacheVal> cache_eviction_candidate(common::lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
+	std::pair<std::string, TransactionalKvStore::SCacheVal> cache_eviction_candidate(common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
 		std::unique_lock<cache_mutex_t>& lock, size_t skip = 0)
 	{
 		assert(lock.owns_lock());
 		return lru_cache.eviction_candidate(skip);
 	}
 
-	std::list<std::pair<std::string const *, TransactionalKvStore::SCacheVal> >::iterator cache_eviction_iterator_start(common::lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
+	common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>::list_t::iterator cache_eviction_iterator_start(common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
 		std::unique_lock<cache_mutex_t>& lock)
 	{
 		assert(lock.owns_lock());
 		return lru_cache.eviction_iterator_start();
 	}
 
-	std::list<std::pair<std::string const *, TransactionalKvStore::SCacheVal> >::iterator cache_eviction_iterator_finish(common::lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
+	common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>::list_t::iterator cache_eviction_iterator_finish(common::hash_lrucache<std::string, TransactionalKvStore::SCacheVal>& lru_cache,
 		std::unique_lock<cache_mutex_t>& lock)
 	{
 		assert(lock.owns_lock());
@@ -3484,14 +3484,14 @@ void TransactionalKvStore::operator()()
 			evict_use_chances = false;
 		}
 
-		common::lrucache<std::string, SCacheVal>* evict_target_cache = &lru_cache;
+		common::hash_lrucache<std::string, SCacheVal>* evict_target_cache = &lru_cache;
 
 		if (comp_bytes>0)
 		{
 			evict_target_cache = &compressed_items;
 		}
 
-		std::list<std::pair<std::string const *, SCacheVal> >::iterator evict_it;
+		common::hash_lrucache<std::string, SCacheVal>::list_t::iterator evict_it;
 
 		int64 orig_cachesize = cachesize;
 		int64 curr_cachesize = orig_cachesize;
@@ -3554,7 +3554,7 @@ void TransactionalKvStore::operator()()
 				curr_doubled = true;
 			}
 			
-			std::vector<std::list<std::pair<std::string const *, SCacheVal> >::iterator> cache_move_front;
+			std::vector<common::hash_lrucache<std::string, SCacheVal>::list_t::iterator> cache_move_front;
 			bool used_chance;
 			if(n_evicting<evict_queue_depth)
 			{
@@ -3680,7 +3680,7 @@ void TransactionalKvStore::operator()()
 					curr_doubled = true;
 				}
 
-				std::list<std::pair<std::string const *, SCacheVal> >::iterator
+				common::hash_lrucache<std::string, SCacheVal>::list_t::iterator
 					compress_it = cache_eviction_iterator_start(lru_cache, lock);
 
 				if (compress_it != cache_eviction_iterator_finish(lru_cache, lock))
@@ -4141,9 +4141,9 @@ std::string TransactionalKvStore::basepath2()
 }
 
 bool TransactionalKvStore::evict_one(std::unique_lock<cache_mutex_t>& cache_lock, bool break_on_skip, bool only_non_dirty,
-	std::list<std::pair<std::string const *, SCacheVal> >::iterator& evict_it,
-	common::lrucache<std::string, SCacheVal>& target_cache, bool use_chances, int64& freed_space,
-	bool& run_del_items, std::vector<std::list<std::pair<std::string const *, SCacheVal> >::iterator>& move_front,
+	common::hash_lrucache<std::string, SCacheVal>::list_t::iterator& evict_it,
+	common::hash_lrucache<std::string, SCacheVal>& target_cache, bool use_chances, int64& freed_space,
+	bool& run_del_items, std::vector<common::hash_lrucache<std::string, SCacheVal>::list_t::iterator>& move_front,
 	bool& used_chance)
 {
 	used_chance = false;
@@ -4277,7 +4277,7 @@ bool TransactionalKvStore::evict_one(std::unique_lock<cache_mutex_t>& cache_lock
 	return !last;
 }
 
-void TransactionalKvStore::evict_move_front(common::lrucache<std::string, SCacheVal>& target_cache, std::vector<std::list<std::pair<std::string const*, SCacheVal>>::iterator>& move_front)
+void TransactionalKvStore::evict_move_front(common::hash_lrucache<std::string, SCacheVal>& target_cache, std::vector<common::hash_lrucache<std::string, SCacheVal>::list_t::iterator>& move_front)
 {
 	for (auto it : move_front)
 	{
@@ -4286,8 +4286,8 @@ void TransactionalKvStore::evict_move_front(common::lrucache<std::string, SCache
 }
 
 void TransactionalKvStore::evict_item(const std::string & key, bool dirty,
-	common::lrucache<std::string, SCacheVal>& target_cache,
-	std::list<std::pair<std::string const *, SCacheVal> >::iterator* evict_it,
+	common::hash_lrucache<std::string, SCacheVal>& target_cache,
+	common::hash_lrucache<std::string, SCacheVal>::list_t::iterator* evict_it,
 	std::unique_lock<cache_mutex_t>& cache_lock, const std::string& from, int64& freed_space)
 {
 	bool compressed = (&target_cache == &compressed_items);
@@ -4663,7 +4663,7 @@ void TransactionalKvStore::check_deleted(int64 transid, const std::string & key,
 }
 
 bool TransactionalKvStore::compress_one(std::unique_lock<cache_mutex_t>& cache_lock,
-	std::list<std::pair<std::string const *, SCacheVal> >::iterator& compress_it)
+	common::hash_lrucache<std::string, SCacheVal>::list_t::iterator& compress_it)
 {
 	while(true)
 	{
@@ -5154,8 +5154,8 @@ bool TransactionalKvStore::item_submitted( std::list<SSubmissionItem>::iterator
 			item_path += ".comp";
 		}
 		
-		common::lrucache<std::string, SCacheVal>* target_cache = &lru_cache;
-		common::lrucache<std::string, SCacheVal>* other_target_cache = &compressed_items;
+		common::hash_lrucache<std::string, SCacheVal>* target_cache = &lru_cache;
+		common::hash_lrucache<std::string, SCacheVal>* other_target_cache = &compressed_items;
 		
 		if(it->compressed)
 		{
@@ -5994,7 +5994,7 @@ bool TransactionalKvStore::write_to_dirty_file(std::unique_lock<cache_mutex_t>&
 		std::scoped_lock dirty_lock(dirty_item_mutex);
 		std::scoped_lock memfile_lock(memfiles_mutex);
 
-		for (common::lrucache<std::string, SCacheVal>::list_t::iterator it = lru_cache.get_list().begin();
+		for (common::hash_lrucache<std::string, SCacheVal>::list_t::iterator it = lru_cache.get_list().begin();
 			!compressed || it != compressed_items.get_list().end();)
 		{
 			if (compressed || it != lru_cache.get_list().end())
@@ -6733,7 +6733,7 @@ void TransactionalKvStore::reset()
 #ifdef DIRTY_ITEM_CHECK
 	std::map<std::string, size_t> curr_dirty_item_keys = dirty_items[transid];
 #endif
-	for(common::lrucache<std::string, SCacheVal>::list_t::iterator it=lru_cache.get_list().begin();
+	for(common::hash_lrucache<std::string, SCacheVal>::list_t::iterator it=lru_cache.get_list().begin();
 		!compressed || it!=lru_cache.get_list().end();)
 	{
 		if(compressed || it!=lru_cache.get_list().end())
@@ -7057,7 +7057,7 @@ void TransactionalKvStore::shrink_mem()
 
 	evict_non_dirty_memfiles = true;
 
-	common::lrucache<std::string, SFdKey>::list_t::iterator it = fd_cache.eviction_iterator_start();
+	common::hash_lrucache<std::string, SFdKey>::list_t::iterator it = fd_cache.eviction_iterator_start();
 	if (it == fd_cache.eviction_iterator_finish())
 	{
 		return;
@@ -7462,7 +7462,10 @@ bool TransactionalKvStore::compress_item( const std::string& key, int64 transact
 
 	ScopedDeleteFile del_comp_f(dst);
 
-	std::unique_ptr<ICompressAndEncrypt> compress_encrypt(compress_encrypt_factory->createCompressAndEncrypt(encryption_key, src, online_kv_store, background_comp_method));
+	bool metadata = num_second_chances_cb != nullptr
+		&& num_second_chances_cb->is_metadata(key);
+
+	std::unique_ptr<ICompressAndEncrypt> compress_encrypt(compress_encrypt_factory->createCompressAndEncrypt(encryption_key, src, online_kv_store, background_comp_method, metadata));
 
 	std::vector<char> buf;
 	buf.resize(32768);
@@ -8644,8 +8647,8 @@ void TransactionalKvStore::RegularSubmitBundleThread::regular_submit_bundle(std:
 			it = &kv_store->submit_bundle[i].first;
 			if (kv_store->submit_bundle[i].second)
 			{
-				common::lrucache<std::string, SCacheVal>* target_cache = &kv_store->lru_cache;
-				common::lrucache<std::string, SCacheVal>* other_target_cache = &kv_store->compressed_items;
+				common::hash_lrucache<std::string, SCacheVal>* target_cache = &kv_store->lru_cache;
+				common::hash_lrucache<std::string, SCacheVal>* other_target_cache = &kv_store->compressed_items;
 
 				if (it->compressed)
 				{
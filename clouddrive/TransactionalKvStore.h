@@ -1,7 +1,7 @@
 #pragma once
 #include <list>
 #include <atomic>
-#include "../common/lrucache.h"
+#include "../common/hash_lrucache.h"
 #include "../Interface/Thread.h"
 #include "../Interface/Types.h"
 #include "../Interface/Mutex.h"
@@ -366,18 +366,18 @@ private:
 	std::string hexpath(const std::string& key);
 
 	bool evict_one(std::unique_lock<cache_mutex_t>& cache_lock, bool break_on_skip, bool only_non_dirty,
-		std::list<std::pair<std::string const *, SCacheVal> >::iterator& evict_it,
-		common::lrucache<std::string, SCacheVal>& target_cache, bool use_chances,
+		common::hash_lrucache<std::string, SCacheVal>::list_t::iterator& evict_it,
+		common::hash_lrucache<std::string, SCacheVal>& target_cache, bool use_chances,
 		int64& freed_space,
-		bool& run_del_items, std::vector<std::list<std::pair<std::string const *, SCacheVal> >::iterator>& move_front,
+		bool& run_del_items, std::vector<common::hash_lrucache<std::string, SCacheVal>::list_t::iterator>& move_front,
 		bool& used_chance);
 
-	void evict_move_front(common::lrucache<std::string, SCacheVal>& target_cache,
-		std::vector<std::list<std::pair<std::string const *, SCacheVal> >::iterator>& move_front);
+	void evict_move_front(common::hash_lrucache<std::string, SCacheVal>& target_cache,
+		std::vector<common::hash_lrucache<std::string, SCacheVal>::list_t::iterator>& move_front);
 
 	void evict_item(const std::string& key, bool dirty,
-		common::lrucache<std::string, SCacheVal>& target_cache,
-		std::list<std::pair<std::string const *, SCacheVal> >::iterator* evict_it,
+		common::hash_lrucache<std::string, SCacheVal>& target_cache,
+		common::hash_lrucache<std::string, SCacheVal>::list_t::iterator* evict_it,
 		std::unique_lock<cache_mutex_t>& cache_lock, const std::string& from, int64& freed_space);
 
 	bool evict_memfiles(std::unique_lock<cache_mutex_t>& cache_lock, bool evict_dirty);
@@ -385,7 +385,7 @@ private:
 	void check_deleted(int64 transid, const std::string& key, bool comp);
 
 	bool compress_one(std::unique_lock<cache_mutex_t>& cache_lock,
-		std::list<std::pair<std::string const *, SCacheVal> >::iterator& compress_it);
+		common::hash_lrucache<std::string, SCacheVal>::list_t::iterator& compress_it);
 
 	std::list<SSubmissionItem>::iterator next_submission_item(bool no_compress, bool prefer_non_delete, bool prefer_mem, std::string& path, bool& p_do_stop, SMemFile*& memf);
 
@@ -663,7 +663,7 @@ private:
 	}
 #endif
 
-	common::lrucache<std::string, SCacheVal> lru_cache;
+	common::hash_lrucache<std::string, SCacheVal> lru_cache;
 	std::map<std::string, SFdKey> open_files;
 	std::map<IFsFile*, ReadOnlyFileWrapper*> read_only_open_files;
 	std::map<std::string, int> preload_once_items;
@@ -677,7 +677,7 @@ private:
 	std::map<int64, std::map<std::string, int64> > dirty_items_size;
 #endif
 	std::map<int64, size_t> num_delete_items;
-	common::lrucache<std::string, SFdKey> fd_cache;
+	common::hash_lrucache<std::string, SFdKey> fd_cache;
 	cache_mutex_t cache_mutex;
 	std::recursive_mutex submission_mutex;
 	std::recursive_mutex dirty_item_mutex;
@@ -685,7 +685,7 @@ private:
 	std::set<std::string> queued_dels;
 	std::map<std::string, size_t> in_retrieval;
 	std::condition_variable_any retrieval_cond;
-	common::lrucache<std::string, SCacheVal> compressed_items;
+	common::hash_lrucache<std::string, SCacheVal> compressed_items;
 	std::set<std::string> dirty_evicted_items;
 	std::map<int64, std::set<std::string> > nosubmit_dirty_items;
 	std::set<std::string> nosubmit_untouched_items;
@@ -697,7 +697,7 @@ private:
 	std::vector<SFile> transactions;
 	std::unique_ptr<IMutex> evicted_mutex;
 	std::recursive_mutex memfiles_mutex;
-	common::lrucache<std::pair<int64, std::string>, SMemFile> memfiles;
+	common::hash_lrucache<std::pair<int64, std::string>, SMemFile> memfiles;
 	std::vector<std::pair<int64, std::unique_ptr<Bitmap> > > memfile_stat_bitmaps;
 	std::map<int64, size_t> num_mem_files;
 	relaxed_atomic<int64> memfile_size;
@@ -0,0 +1,609 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#pragma once
+#include <vector>
+#include <utility>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stddef.h>
+#include <stdlib.h>
+
+namespace common
+{
+
+template<typename K>
+struct lru_hash
+{
+	size_t operator()(const K& k) const
+	{
+		return std::hash<K>()(k);
+	}
+};
+
+template<typename A, typename B>
+struct lru_hash<std::pair<A, B> >
+{
+	size_t operator()(const std::pair<A, B>& k) const
+	{
+		size_t h = lru_hash<A>()(k.first);
+		return h ^ (lru_hash<B>()(k.second) + static_cast<size_t>(0x9e3779b9UL) + (h << 6) + (h >> 2));
+	}
+};
+
+/**
+* Same interface as common::lrucache, but keys are looked up via an open addressing
+* hash table (linear probing, backward shift deletion) and the LRU order is an
+* intrusive doubly linked list of nodes allocated from fixed size slabs.
+* Node addresses are stable, so list iterators stay valid until the element
+* is removed, like with std::list.
+*/
+template<typename K, typename V, typename H = lru_hash<K> >
+class hash_lrucache
+{
+	struct link
+	{
+		link* prev;
+		link* next;
+	};
+
+	struct node : public link
+	{
+		node(const K& key, const V& v, size_t hash)
+			: item(static_cast<K const*>(NULL), v), hash(hash), key(key)
+		{
+			item.first = &this->key;
+		}
+
+		std::pair<K const*, V> item;
+		size_t hash;
+		K key;
+	};
+
+	struct slot
+	{
+		size_t hash;
+		node* n;
+	};
+
+	static const size_t slab_size = 256;
+
+public:
+	class list_t
+	{
+	public:
+		class iterator
+		{
+		public:
+			typedef std::bidirectional_iterator_tag iterator_category;
+			typedef std::pair<K const*, V> value_type;
+			typedef ptrdiff_t difference_type;
+			typedef value_type* pointer;
+			typedef value_type& reference;
+
+			iterator()
+				: l(NULL) {}
+
+			explicit iterator(link* l)
+				: l(l) {}
+
+			reference operator*() const
+			{
+				return static_cast<node*>(l)->item;
+			}
+
+			pointer operator->() const
+			{
+				return &static_cast<node*>(l)->item;
+			}
+
+			iterator& operator++()
+			{
+				l = l->next;
+				return *this;
+			}
+
+			iterator operator++(int)
+			{
+				iterator ret = *this;
+				l = l->next;
+				return ret;
+			}
+
+			iterator& operator--()
+			{
+				l = l->prev;
+				return *this;
+			}
+
+			iterator operator--(int)
+			{
+				iterator ret = *this;
+				l = l->prev;
+				return ret;
+			}
+
+			bool operator==(const iterator& other) const
+			{
+				return l == other.l;
+			}
+
+			bool operator!=(const iterator& other) const
+			{
+				return l != other.l;
+			}
+
+		private:
+			link* l;
+			friend class hash_lrucache;
+		};
+
+		iterator begin()
+		{
+			return iterator(head.next);
+		}
+
+		iterator end()
+		{
+			return iterator(&head);
+		}
+
+		size_t size() const
+		{
+			return n_items;
+		}
+
+		bool empty() const
+		{
+			return n_items == 0;
+		}
+
+	private:
+		list_t()
+			: n_items(0)
+		{
+			head.prev = &head;
+			head.next = &head;
+		}
+
+		list_t(const list_t&);
+		list_t& operator=(const list_t&);
+
+		link head;
+		size_t n_items;
+		friend class hash_lrucache;
+	};
+
+	hash_lrucache()
+		: free_nodes(NULL), slab_used(slab_size)
+	{}
+
+	~hash_lrucache()
+	{
+		clear();
+		for (size_t i = 0; i < slabs.size(); ++i)
+		{
+			::operator delete(slabs[i]);
+		}
+	}
+
+	void put(const K& key, const V& v)
+	{
+		size_t hash = hash_key(key);
+		size_t idx;
+		if (find_slot(key, hash, idx))
+		{
+			node* n = table[idx].n;
+			bring_to_front(n);
+			n->item.second = v;
+		}
+		else
+		{
+			node* n = insert_new(key, v, hash);
+			link_after(&lru_list.head, n);
+		}
+	}
+
+	void put_after(const K& key, const K& put_key, const V& v)
+	{
+		size_t idx_after;
+		if (find_slot(key, hash_key(key), idx_after))
+		{
+			node* n_after = table[idx_after].n;
+			size_t put_hash = hash_key(put_key);
+			size_t idx;
+			if (find_slot(put_key, put_hash, idx))
+			{
+				node* n = table[idx].n;
+				if (n != n_after)
+				{
+					unlink(n);
+					link_after(n_after->prev, n);
+				}
+			}
+			else
+			{
+				node* n = insert_new(put_key, v, put_hash);
+				link_after(n_after->prev, n);
+			}
+		}
+		else
+		{
+			put(put_key, v);
+		}
+	}
+
+	void put_back(const K& key, const V& v)
+	{
+		size_t hash = hash_key(key);
+		size_t idx;
+		if (find_slot(key, hash, idx))
+		{
+			table[idx].n->item.second = v;
+		}
+		else
+		{
+			node* n = insert_new(key, v, hash);
+			link_after(lru_list.head.prev, n);
+		}
+	}
+
+	bool change_key(const K& old_key, const K& new_key)
+	{
+		size_t idx;
+		if (find_slot(old_key, hash_key(old_key), idx))
+		{
+			node* n = table[idx].n;
+			erase_slot(idx);
+			n->key = new_key;
+			n->hash = hash_key(new_key);
+			insert_slot(n);
+			return true;
+		}
+		return false;
+	}
+
+	bool check()
+	{
+		size_t n_list = 0;
+		for (link* l = lru_list.head.next; l != &lru_list.head; l = l->next)
+		{
+			node* n = static_cast<node*>(l);
+			if (n->item.first != &n->key)
+				return false;
+
+			if (l->next->prev != l)
+				return false;
+
+			size_t idx;
+			if (!find_slot(n->key, n->hash, idx)
+				|| table[idx].n != n)
+				return false;
+
+			++n_list;
+		}
+
+		size_t n_table = 0;
+		for (size_t i = 0; i < table.size(); ++i)
+		{
+			if (table[i].n != NULL)
+			{
+				if (table[i].hash != table[i].n->hash)
+					return false;
+				++n_table;
+			}
+		}
+
+		return n_list == lru_list.n_items
+			&& n_table == lru_list.n_items;
+	}
+
+	size_t size() const
+	{
+		return lru_list.n_items;
+	}
+
+	bool empty() const
+	{
+		return lru_list.n_items == 0;
+	}
+
+	V* get(const K& key, bool bring_front = true)
+	{
+		size_t idx;
+		if (find_slot(key, hash_key(key), idx))
+		{
+			node* n = table[idx].n;
+			if (bring_front)
+			{
+				bring_to_front(n);
+			}
+
+			return &n->item.second;
+		}
+		else
+		{
+			return reinterpret_cast<V*>(0);
+		}
+	}
+
+	bool has_key(const K& key)
+	{
+		size_t idx;
+		return find_slot(key, hash_key(key), idx);
+	}
+
+	std::pair<K, V> evict_one()
+	{
+		if (!lru_list.empty())
+		{
+			node* n = static_cast<node*>(lru_list.head.prev);
+
+			std::pair<K, V> ret(n->key, n->item.second);
+
+			remove_node(n);
+
+			return ret;
+		}
+		else
+		{
+			return std::pair<K, V>();
+		}
+	}
+
+	typename list_t::iterator eviction_iterator_start()
+	{
+		return lru_list.end();
+	}
+
+	typename list_t::iterator eviction_iterator_finish()
+	{
+		return lru_list.begin();
+	}
+
+	std::pair<K, V> eviction_candidate(size_t skip = 0)
+	{
+		if (!lru_list.empty())
+		{
+			link* l = lru_list.head.prev;
+
+			for (size_t i = 0; i < skip; ++i)
+			{
+				if (l == lru_list.head.next)
+				{
+					return std::pair<K, V>();
+				}
+
+				l = l->prev;
+			}
+
+			node* n = static_cast<node*>(l);
+			return std::make_pair(n->key, n->item.second);
+		}
+		else
+		{
+			return std::pair<K, V>();
+		}
+	}
+
+	void del(const K& key)
+	{
+		size_t idx;
+		if (find_slot(key, hash_key(key), idx))
+		{
+			node* n = table[idx].n;
+			erase_slot(idx);
+			unlink(n);
+			free_node(n);
+		}
+	}
+
+	list_t& get_list()
+	{
+		return lru_list;
+	}
+
+	void clear()
+	{
+		link* l = lru_list.head.next;
+		while (l != &lru_list.head)
+		{
+			link* next = l->next;
+			free_node(static_cast<node*>(l));
+			l = next;
+		}
+		lru_list.head.prev = &lru_list.head;
+		lru_list.head.next = &lru_list.head;
+		lru_list.n_items = 0;
+		table.clear();
+	}
+
+	void bring_to_front(typename list_t::iterator it)
+	{
+		bring_to_front(static_cast<node*>(it.l));
+	}
+
+private:
+	hash_lrucache(const hash_lrucache&);
+	hash_lrucache& operator=(const hash_lrucache&);
+
+	size_t hash_key(const K& key) const
+	{
+		unsigned long long h = H()(key);
+		//std::hash is the identity for integers on some platforms,
+		//so mix the bits before using the low bits as table index
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return static_cast<size_t>(h);
+	}
+
+	bool find_slot(const K& key, size_t hash, size_t& idx) const
+	{
+		if (table.empty())
+			return false;
+
+		size_t mask = table.size() - 1;
+		for (idx = hash & mask; table[idx].n != NULL; idx = (idx + 1) & mask)
+		{
+			if (table[idx].hash == hash
+				&& table[idx].n->key == key)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void insert_slot(node* n)
+	{
+		if ((lru_list.n_items + 1) * 10 > table.size() * 7)
+		{
+			rehash(table.empty() ? 16 : table.size() * 2);
+		}
+
+		size_t mask = table.size() - 1;
+		size_t idx = n->hash & mask;
+		while (table[idx].n != NULL)
+		{
+			idx = (idx + 1) & mask;
+		}
+		table[idx].hash = n->hash;
+		table[idx].n = n;
+	}
+
+	void erase_slot(size_t idx)
+	{
+		size_t mask = table.size() - 1;
+		size_t next = (idx + 1) & mask;
+		while (table[next].n != NULL)
+		{
+			size_t ideal = table[next].hash & mask;
+			//move entry back if the hole lies on its probe sequence
+			if (((next - ideal) & mask) >= ((next - idx) & mask))
+			{
+				table[idx] = table[next];
+				idx = next;
+			}
+			next = (next + 1) & mask;
+		}
+		table[idx].n = NULL;
+	}
+
+	void rehash(size_t new_size)
+	{
+		std::vector<slot> old_table;
+		old_table.swap(table);
+		slot empty_slot = { 0, NULL };
+		table.resize(new_size, empty_slot);
+		size_t mask = new_size - 1;
+		for (size_t i = 0; i < old_table.size(); ++i)
+		{
+			if (old_table[i].n != NULL)
+			{
+				size_t idx = old_table[i].hash & mask;
+				while (table[idx].n != NULL)
+				{
+					idx = (idx + 1) & mask;
+				}
+				table[idx] = old_table[i];
+			}
+		}
+	}
+
+	node* insert_new(const K& key, const V& v, size_t hash)
+	{
+		node* n = alloc_node(key, v, hash);
+		insert_slot(n);
+		return n;
+	}
+
+	void remove_node(node* n)
+	{
+		size_t idx;
+		if (!find_slot(n->key, n->hash, idx))
+			abort();
+		erase_slot(idx);
+		unlink(n);
+		free_node(n);
+	}
+
+	void link_after(link* pos, node* n)
+	{
+		n->prev = pos;
+		n->next = pos->next;
+		pos->next->prev = n;
+		pos->next = n;
+		++lru_list.n_items;
+	}
+
+	void unlink(node* n)
+	{
+		n->prev->next = n->next;
+		n->next->prev = n->prev;
+		--lru_list.n_items;
+	}
+
+	void bring_to_front(node* n)
+	{
+		if (lru_list.head.next != n)
+		{
+			unlink(n);
+			link_after(&lru_list.head, n);
+		}
+	}
+
+	node* alloc_node(const K& key, const V& v, size_t hash)
+	{
+		void* mem;
+		if (free_nodes != NULL)
+		{
+			mem = free_nodes;
+			free_nodes = free_nodes->next;
+		}
+		else
+		{
+			if (slab_used == slab_size)
+			{
+				slabs.push_back(::operator new(sizeof(node)*slab_size));
+				slab_used = 0;
+			}
+			mem = static_cast<char*>(slabs.back()) + sizeof(node)*slab_used;
+			++slab_used;
+		}
+		return new(mem) node(key, v, hash);
+	}
+
+	void free_node(node* n)
+	{
+		void* mem = n;
+		n->~node();
+		link* l = new(mem) link;
+		l->next = free_nodes;
+		free_nodes = l;
+	}
+
+	list_t lru_list;
+	std::vector<slot> table;
+	std::vector<void*> slabs;
+	link* free_nodes;
+	size_t slab_used;
+};
+
+}
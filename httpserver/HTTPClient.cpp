@@ -18,6 +18,8 @@
 
 #include "../vld.h"
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include "HTTPClient.h"
 #include "../Interface/Pipe.h"
 #include "../Interface/Thread.h"
@@ -43,6 +45,10 @@ const int HTTP_STATE_DONE=6;
 const int HTTP_STATE_WEBSOCKET = 7;
 
 const int HTTP_MAX_KEEPALIVE=15000;
+const int HTTP_MAX_KEEPALIVE_REQUESTS=95;
+const size_t HTTP_MAX_LINE_SIZE=64*1024;
+const size_t HTTP_MAX_HEADER_COUNT=200;
+const size_t HTTP_MAX_CONTENT_SIZE=256*1024*1024;
 
 IMutex *CHTTPClient::share_mutex=nullptr;
 std::map<std::string, SShareProxy> CHTTPClient::shared_connections;
@@ -53,7 +59,9 @@ void CHTTPClient::Init(THREAD_ID pTID, IPipe *pPipe, const std::string& pEndpoin
 	pipe=pPipe;
 	do_quit=false;
 	http_g_state=HTTP_STATE_COMMAND;
-	http_state=0;
+	http_version=10;
+	http_buffer_pos=0;
+	http_keepalive=false;
 	request_num=0;
 	request_ticket=ILLEGAL_THREADPOOL_TICKET;
 	fileupload=false;
@@ -86,45 +94,114 @@ void CHTTPClient::ReceivePackets(IRunOtherCallback* run_other)
 	size_t rc=pipe->Read(&data);
 	if( rc>0 )
 	{
-		for(size_t i=0;i<rc;++i)
+		if(http_buffer.empty())
 		{
-			char ch=data[i];
-			switch(http_g_state)
+			http_buffer.swap(data);
+		}
+		else
+		{
+			http_buffer.append(data);
+		}
+
+		if(http_g_state==HTTP_STATE_WAIT_FOR_THREAD)
+		{
+			//Pipelined request. Processed once the current request is done
+			if(http_buffer.size()-http_buffer_pos>HTTP_MAX_LINE_SIZE*HTTP_MAX_HEADER_COUNT)
+			{
+				do_quit=true;
+			}
+			return;
+		}
+
+		processBuffer();
+	}
+	else
+	{
+		do_quit=true;
+	}
+}
+
+void CHTTPClient::processBuffer(void)
+{
+	while(!do_quit)
+	{
+		if(http_g_state==HTTP_STATE_KEEPALIVE)
+		{
+			if(http_buffer_pos>=http_buffer.size())
 			{
-			case HTTP_STATE_KEEPALIVE:
-				reset();
-				http_g_state=HTTP_STATE_COMMAND;
-				//fallthrough
-			case HTTP_STATE_COMMAND:
-				processCommand(ch);
-				break;
-			case HTTP_STATE_HEADER:
-				processHeader(ch);
-				break;
-			case HTTP_STATE_CONTENT:
-				processContent(ch);
 				break;
 			}
 
-			if(http_g_state==HTTP_STATE_READY )
+			reset();
+			http_g_state=HTTP_STATE_COMMAND;
+		}
+
+		if(http_g_state==HTTP_STATE_COMMAND
+			|| http_g_state==HTTP_STATE_HEADER)
+		{
+			size_t line_end=http_buffer.find('\n', http_buffer_pos);
+			if(line_end==std::string::npos)
 			{
-				if(	processRequest() )
+				if(http_buffer.size()-http_buffer_pos>HTTP_MAX_LINE_SIZE)
 				{
-					if (http_g_state != HTTP_STATE_WEBSOCKET)
-						http_g_state = HTTP_STATE_WAIT_FOR_THREAD;
-					
-				}
-				else
 					do_quit=true;
+				}
+				break;
+			}
+
+			const char* line=http_buffer.data()+http_buffer_pos;
+			size_t len=line_end-http_buffer_pos;
+			if(len>0 && line[len-1]=='\r')
+			{
+				--len;
+			}
+			http_buffer_pos=line_end+1;
+
+			if(http_g_state==HTTP_STATE_COMMAND)
+			{
+				processCommand(line, len);
+			}
+			else
+			{
+				processHeader(line, len);
+			}
+		}
+		else if(http_g_state==HTTP_STATE_CONTENT)
+		{
+			processContent();
 
+			if(http_g_state==HTTP_STATE_CONTENT)
+			{
 				break;
 			}
+		}
+		else if(http_g_state==HTTP_STATE_READY)
+		{
+			if(	processRequest() )
+			{
+				if (http_g_state != HTTP_STATE_WEBSOCKET)
+					http_g_state = HTTP_STATE_WAIT_FOR_THREAD;
+			}
+			else
+				do_quit=true;
 
+			break;
+		}
+		else
+		{
+			break;
 		}
 	}
-	else
+
+	if(http_buffer_pos>=http_buffer.size())
 	{
-		do_quit=true;
+		http_buffer.clear();
+		http_buffer_pos=0;
+	}
+	else if(http_buffer_pos>HTTP_MAX_LINE_SIZE)
+	{
+		http_buffer.erase(0, http_buffer_pos);
+		http_buffer_pos=0;
 	}
 }
 
@@ -167,6 +244,15 @@ bool CHTTPClient::Run(IRunOtherCallback* run_other)
 			delete request_handler;
 			request_handler=nullptr;
 
+			if(http_keepalive && !do_quit)
+			{
+				http_g_state=HTTP_STATE_KEEPALIVE;
+				http_keepalive_start=Server->getTimeMS();
+				http_keepalive_count=HTTP_MAX_KEEPALIVE;
+
+				processBuffer();
+			}
+
 			if(!http_service->getProxyServer().empty() && http_service->getShareProxyConnections()==1)
 			{
 				IScopedLock lock(share_mutex);
@@ -254,129 +340,116 @@ bool CHTTPClient::Run(IRunOtherCallback* run_other)
 	return true;
 }
 
-void CHTTPClient::processCommand(char ch)
+void CHTTPClient::processCommand(const char* line, size_t len)
 {
-	switch(http_state)
+	size_t pos=0;
+	while(pos<len && line[pos]==' ')
+		++pos;
+
+	if(pos>=len)
 	{
-	case 0:
-		if( ch!=' ' )
-			http_state=1;
-		else
-			break;
-	case 1:
-		if( ch==' ' && !http_method.empty() )
-			http_state=2;
-		else if( ch!=' ' )
-			http_method+=(char)toupper(ch);
-		break;
-	case 2:
-		if( ch!=' ' && ch!='\r' && ch!='\n' )
-		{
-			tmp+=ch;
-			break;
-		}
-		else if( (ch==' ' || ch=='\r' || ch=='\n' ) && !tmp.empty() )
-		{
-			if( tmp=="HTTP/1.0" )
-				http_version=10;
-			else if( tmp=="HTTP/1.1" )
-				http_version=11;
-			else
-			{
-				if( tmp.size()>http_query.size() )
-					http_query=tmp;
-			}
-			tmp.clear();
+		//Empty line between requests
+		return;
+	}
 
-			if( ch=='\r' || ch=='\n'  )
-				http_state=4;
-			else
-				break;
-		}
-	case 3:
-		if( ch=='\n' )
-			http_state=4;
-		else if( ch=='\r' )
+	const char* method_end=static_cast<const char*>(memchr(line+pos, ' ', len-pos));
+	size_t method_len=(method_end!=nullptr ? method_end-line : len)-pos;
+	http_method.assign(line+pos, method_len);
+	for(size_t i=0;i<http_method.size();++i)
+		http_method[i]=(char)toupper(http_method[i]);
+	pos+=method_len;
+
+	while(pos<len)
+	{
+		while(pos<len && line[pos]==' ')
+			++pos;
+
+		if(pos>=len)
 			break;
-	case 4:
-		http_g_state=HTTP_STATE_HEADER;
-		http_state=0;
-		tmp.clear();
+
+		const char* tok_end=static_cast<const char*>(memchr(line+pos, ' ', len-pos));
+		size_t tok_len=(tok_end!=nullptr ? tok_end-line : len)-pos;
+
+		if(tok_len==8 && memcmp(line+pos, "HTTP/1.0", 8)==0)
+			http_version=10;
+		else if(tok_len==8 && memcmp(line+pos, "HTTP/1.1", 8)==0)
+			http_version=11;
+		else if(tok_len>http_query.size())
+			http_query.assign(line+pos, tok_len);
+
+		pos+=tok_len;
 	}
+
+	http_g_state=HTTP_STATE_HEADER;
 }
 
-void CHTTPClient::processHeader(char ch)
+void CHTTPClient::processHeader(const char* line, size_t len)
 {
-	switch(http_state)
+	if(len==0)
 	{
-	case 0:
-		if( ch=='\r' || ch=='\n' )
-			http_state=1;
-		else 
-		{
-			if( ch!=':' )
-				http_header_key+=(char)toupper(ch);
-			else
-			{
-				http_state=3;
-			}
-			break;
-		}
-	case 1:
-		if( ch=='\n' )
-			http_state=2;
-		else
-			break;
-	case 2:
 		if( http_method=="POST")
 		{
 			str_map::iterator iter=http_params.find("CONTENT-LENGTH");
 			if( iter!=http_params.end() )
 			{
-				http_remaining_content=atoi(iter->second.c_str() );
+				std::string content_length=trim(iter->second);
+				if(content_length.empty() || content_length.size()>10
+					|| content_length.find_first_not_of("0123456789")!=std::string::npos)
+				{
+					do_quit=true;
+					return;
+				}
+
+				int64 content_size=watoi64(content_length);
+				if(content_size>static_cast<int64>(HTTP_MAX_CONTENT_SIZE))
+				{
+					Server->Log("HTTP request content too large ("+convert(content_size)+" bytes). Closing connection.", LL_WARNING);
+					do_quit=true;
+					return;
+				}
+
+				http_remaining_content=static_cast<size_t>(content_size);
 				if( http_remaining_content>0 )
 				{
 					http_g_state=HTTP_STATE_CONTENT;
-					break;
+					return;
 				}
 			}
 		}
 		http_g_state=HTTP_STATE_READY;
-		break;
+		return;
+	}
 
-	case 3:
-		if( ch!=' ')
-			http_state=4;
-		else
-			break;
-	case 4:
-		if( ch!='\r' && ch!='\n' )
-		{
-			tmp+=ch;
-			break;
-		}
-		else
-		{
-			http_params.insert(std::pair<std::string, std::string>(http_header_key, tmp) );
-			tmp.clear();
-			http_header_key.clear();
-			http_state=5;
-		}
-	case 5:
-		if( ch=='\n' )
-			http_state=0;
-		else
-			break;
+	if(http_params.size()>=HTTP_MAX_HEADER_COUNT)
+	{
+		do_quit=true;
+		return;
 	}
-}
 
-void CHTTPClient::processContent(char ch)
-{
-	if( http_remaining_content>0 )
+	const char* sep=static_cast<const char*>(memchr(line, ':', len));
+	if(sep==nullptr)
 	{
-		http_content+=ch;
-		--http_remaining_content;
+		return;
 	}
+
+	std::string key(line, sep-line);
+	for(size_t i=0;i<key.size();++i)
+		key[i]=(char)toupper(key[i]);
+
+	size_t pos=sep-line+1;
+	while(pos<len && line[pos]==' ')
+		++pos;
+
+	http_params.insert(std::pair<std::string, std::string>(key, std::string(line+pos, len-pos)) );
+}
+
+void CHTTPClient::processContent(void)
+{
+	size_t tc=(std::min)(http_remaining_content, http_buffer.size()-http_buffer_pos);
+	http_content.append(http_buffer, http_buffer_pos, tc);
+	http_buffer_pos+=tc;
+	http_remaining_content-=tc;
+
 	if( http_remaining_content<=0 )
 	{
 		http_g_state=HTTP_STATE_READY;
@@ -459,6 +532,7 @@ bool CHTTPClient::processRequest(void)
 {
 	//Server->Log("Parsing done... starting handling request_num: "+convert(request_num)+" "+convert(Server->getTimeMS()), LL_INFO);
 	++request_num;
+	http_keepalive=false;
 	if(!allowed_urls.empty())
 	{
 		bool found=false;
@@ -568,7 +642,8 @@ bool CHTTPClient::processRequest(void)
 #ifdef _WIN32
 			rp = greplace("\\", "_", rp);
 #endif
-			CHTTPFile *file_handler=new CHTTPFile(http_service->getRoot()+rp, pipe);
+			http_keepalive=wantKeepAlive();
+			CHTTPFile *file_handler=new CHTTPFile(http_service->getRoot()+rp, pipe, http_params, http_keepalive);
 			request_ticket=Server->getThreadPool()->execute(file_handler, "http file request");
 			request_handler=file_handler;
 			return true;
@@ -587,15 +662,39 @@ bool CHTTPClient::processRequest(void)
 		return false;
 }
 
+bool CHTTPClient::wantKeepAlive(void)
+{
+	//Only static files have a Content-Length. Action responses end with the connection
+	if(request_num>=HTTP_MAX_KEEPALIVE_REQUESTS)
+	{
+		return false;
+	}
+
+	std::string connection;
+	str_map::iterator iter=http_params.find("CONNECTION");
+	if(iter!=http_params.end())
+	{
+		connection=strlower(iter->second);
+	}
+
+	if(http_version>=11)
+	{
+		return connection.find("close")==std::string::npos;
+	}
+	else
+	{
+		return connection.find("keep-alive")!=std::string::npos;
+	}
+}
+
 void CHTTPClient::reset(void)
 {
 	http_params.clear();
 	http_method.clear();
 	http_query.clear();
 	http_content.clear();
-	http_state=0;
-	tmp.clear();
-	http_header_key.clear();
+	http_version=10;
+	http_keepalive=false;
 	request_ticket=ILLEGAL_THREADPOOL_TICKET;
 	fileupload=false;
 }
@@ -33,10 +33,12 @@ public:
 
 private:
 
-	inline void processCommand(char ch);
-	inline void processHeader(char ch);
-	inline void processContent(char ch);
+	inline void processBuffer(void);
+	inline void processCommand(const char* line, size_t len);
+	inline void processHeader(const char* line, size_t len);
+	inline void processContent(void);
 	inline bool processRequest(void);
+	inline bool wantKeepAlive(void);
 	inline void reset(void);
 
 	inline void WaitForRemove(void);
@@ -51,12 +53,13 @@ private:
 	std::string http_content;
 	int http_version;
 	int http_g_state;
-	int http_state;
-	unsigned int http_keepalive_start;
+	int64 http_keepalive_start;
 	unsigned int http_keepalive_count;
 	size_t http_remaining_content;
-	std::string tmp;
-	std::string http_header_key;
+	//Received data. Parsed up to http_buffer_pos
+	std::string http_buffer;
+	size_t http_buffer_pos;
+	bool http_keepalive;
 	bool fileupload;
 	std::string endpoint;
 
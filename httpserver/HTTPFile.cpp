@@ -17,6 +17,7 @@
 **************************************************************************/
 
 #include "HTTPFile.h"
+#include "HTTPFileCache.h"
 #include "MIMEType.h"
 #include "IndexFiles.h"
 
@@ -28,10 +29,12 @@
 
 #define FP_READ_SIZE 8192
 
-CHTTPFile::CHTTPFile(std::string pFilename, IPipe *pOutput)
+CHTTPFile::CHTTPFile(std::string pFilename, IPipe *pOutput, const str_map& pRawPARAMS, bool pKeepAlive)
 {
 	filename=pFilename;
 	output=pOutput;
+	RawPARAMS=pRawPARAMS;
+	keep_alive=pKeepAlive;
 }
 
 std::string CHTTPFile::getContentType(void)
@@ -40,9 +43,83 @@ std::string CHTTPFile::getContentType(void)
 	return MIMEType::getMIMEType(ext);
 }
 
+std::string CHTTPFile::getCacheHeader(void)
+{
+	if (ExtractFileName(filename).find(".chash-")!=std::string::npos)
+	{
+		return "Cache-Control: max-age=365000000, immutable";
+	}
+	return "Cache-Control: no-cache";
+}
+
+std::string CHTTPFile::getConnectionHeader(void)
+{
+	if(keep_alive)
+	{
+		return "Connection: Keep-Alive\r\nKeep-Alive: timeout=15, max=95";
+	}
+	return "Connection: Close";
+}
+
+void CHTTPFile::sendCached(const SCachedHTTPFile& file)
+{
+	filename=file.filename;
+
+	str_map::iterator it_none_match=RawPARAMS.find("IF-NONE-MATCH");
+	if(it_none_match!=RawPARAMS.end()
+		&& it_none_match->second==file.etag)
+	{
+		output->Write("HTTP/1.1 304 Not Modified\r\nServer: CS\r\nETag: "+file.etag+"\r\n"+getCacheHeader()+"\r\n"+getConnectionHeader()+"\r\n\r\n");
+		return;
+	}
+
+	std::string accept_encoding;
+	str_map::iterator it_accept_encoding=RawPARAMS.find("ACCEPT-ENCODING");
+	if(it_accept_encoding!=RawPARAMS.end())
+	{
+		accept_encoding=strlower(it_accept_encoding->second);
+	}
+
+	const std::string* data=&file.data;
+	std::string content_encoding;
+	if(!file.br_data.empty()
+		&& accept_encoding.find("br")!=std::string::npos)
+	{
+		data=&file.br_data;
+		content_encoding="Content-Encoding: br\r\n";
+	}
+	else if(!file.gzip_data.empty()
+		&& accept_encoding.find("gzip")!=std::string::npos)
+	{
+		data=&file.gzip_data;
+		content_encoding="Content-Encoding: gzip\r\n";
+	}
+
+	std::string header="HTTP/1.1 200 ok\r\nServer: CS\r\nContent-Type: "+file.content_type+"\r\n"+getCacheHeader()+"\r\nETag: "+file.etag+"\r\n"
+		+content_encoding+"Vary: Accept-Encoding\r\n"+getConnectionHeader()+"\r\nContent-Length: "+convert(data->size())+"\r\n\r\n";
+
+	if(data->size()<FP_READ_SIZE*8)
+	{
+		output->Write(header+*data);
+	}
+	else
+	{
+		output->Write(header, -1, false);
+		output->Write(*data);
+	}
+}
+
 void CHTTPFile::operator ()(void)
 {
 	Server->Log("Sending file \""+filename+"\"", LL_DEBUG);
+
+	std::shared_ptr<SCachedHTTPFile> cached_file=CHTTPFileCache::get(filename);
+	if(cached_file)
+	{
+		sendCached(*cached_file);
+		return;
+	}
+
 	IFile *fp=Server->openFile(filename);
 
 	if( fp==nullptr )
@@ -70,13 +147,7 @@ void CHTTPFile::operator ()(void)
 
 	std::string status="HTTP/1.1 200 ok\r\n";
 
-	std::string cache_header = "Cache-Control: no-cache";
-	if (ExtractFileName(filename).find(".chash-")!=std::string::npos)
-	{
-		cache_header = "Cache-Control: max-age=365000000, immutable";
-	}
-
-	std::string header="Server: CS\r\nContent-Type: "+ct+"\r\n"+cache_header+"\r\nConnection: Keep-Alive\r\nKeep-Alive: timeout=15, max=95\r\nContent-Length: "+convert(fp->Size())+"\r\n\r\n";
+	std::string header="Server: CS\r\nContent-Type: "+ct+"\r\n"+getCacheHeader()+"\r\n"+getConnectionHeader()+"\r\nContent-Length: "+convert(fp->Size())+"\r\n\r\n";
 
 	Server->Log("Sending file: "+filename, LL_DEBUG);
 	output->Write(status+header);
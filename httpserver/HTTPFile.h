@@ -1,19 +1,28 @@
 #include "../Interface/Thread.h"
 #include "../Interface/Object.h"
 
+#include "../Interface/Types.h"
+
 #include <string>
 
 class IPipe;
+struct SCachedHTTPFile;
 
 class CHTTPFile : public IThread, public IObject
 {
 public:
-	CHTTPFile(std::string pFilename, IPipe *pOutput);
+	CHTTPFile(std::string pFilename, IPipe *pOutput, const str_map& pRawPARAMS, bool pKeepAlive);
 	std::string getContentType(void);
 	std::string getIndexFiles(void);
 	void operator()(void);
 
 private:
+	void sendCached(const SCachedHTTPFile& file);
+	std::string getCacheHeader(void);
+	std::string getConnectionHeader(void);
+
 	std::string filename;
 	IPipe *output;
+	str_map RawPARAMS;
+	bool keep_alive;
 };
@@ -0,0 +1,221 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "HTTPFileCache.h"
+#include "MIMEType.h"
+#include "IndexFiles.h"
+
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../stringtools.h"
+#include "../urbackupcommon/os_functions.h"
+
+#include <zlib.h>
+
+IMutex* CHTTPFileCache::mutex=nullptr;
+std::map<std::string, std::shared_ptr<SCachedHTTPFile> > CHTTPFileCache::files;
+size_t CHTTPFileCache::cache_size=0;
+
+namespace
+{
+	const int64 max_cached_file_size = 4*1024*1024;
+	const size_t max_cache_size = 64*1024*1024;
+
+	bool isCompressible(const std::string& content_type)
+	{
+		return next(content_type, 0, "text/")
+			|| content_type.find("javascript")!=std::string::npos
+			|| content_type.find("json")!=std::string::npos
+			|| content_type.find("xml")!=std::string::npos;
+	}
+
+	size_t cachedSize(const SCachedHTTPFile& file)
+	{
+		return file.data.size() + file.gzip_data.size() + file.br_data.size();
+	}
+}
+
+void CHTTPFileCache::init_mutex(void)
+{
+	mutex=Server->createMutex();
+}
+
+void CHTTPFileCache::destroy_mutex(void)
+{
+	Server->destroy(mutex);
+}
+
+std::shared_ptr<SCachedHTTPFile> CHTTPFileCache::get(const std::string& filename)
+{
+	std::string fn = filename;
+	SFile metadata = getFileMetadata(fn);
+	if(metadata.isdir)
+	{
+		const std::vector<std::string> idxf=IndexFiles::getIndexFiles();
+		for(size_t i=0;i<idxf.size();++i)
+		{
+			metadata = getFileMetadata(filename+"/"+idxf[i]);
+			if(!metadata.isdir
+				&& metadata.last_modified!=0)
+			{
+				fn = filename+"/"+idxf[i];
+				break;
+			}
+		}
+	}
+
+	if(metadata.isdir
+		|| metadata.isspecialf
+		|| metadata.last_modified==0
+		|| metadata.size>max_cached_file_size)
+	{
+		return std::shared_ptr<SCachedHTTPFile>();
+	}
+
+	{
+		IScopedLock lock(mutex);
+		std::map<std::string, std::shared_ptr<SCachedHTTPFile> >::iterator it=files.find(fn);
+		if(it!=files.end())
+		{
+			if(it->second->last_modified==metadata.last_modified
+				&& static_cast<int64>(it->second->data.size())==metadata.size)
+			{
+				return it->second;
+			}
+
+			cache_size-=cachedSize(*it->second);
+			files.erase(it);
+		}
+	}
+
+	std::shared_ptr<SCachedHTTPFile> ret = load(fn, metadata.size, metadata.last_modified);
+	if(!ret)
+	{
+		return ret;
+	}
+
+	IScopedLock lock(mutex);
+	if(cache_size+cachedSize(*ret)<=max_cache_size
+		&& files.find(fn)==files.end())
+	{
+		files[fn]=ret;
+		cache_size+=cachedSize(*ret);
+	}
+
+	return ret;
+}
+
+std::shared_ptr<SCachedHTTPFile> CHTTPFileCache::load(const std::string& filename, int64 filesize, int64 last_modified)
+{
+	std::shared_ptr<SCachedHTTPFile> ret(new SCachedHTTPFile);
+	ret->filename=filename;
+	ret->last_modified=last_modified;
+	ret->content_type=MIMEType::getMIMEType(findextension(filename));
+
+	if(!readFile(filename, ret->data)
+		|| static_cast<int64>(ret->data.size())!=filesize)
+	{
+		return std::shared_ptr<SCachedHTTPFile>();
+	}
+
+	ret->etag="\""+convert(filesize)+"-"+convert(last_modified)+"\"";
+
+	SFile br_metadata = getFileMetadata(filename+".br");
+	if(br_metadata.last_modified>=last_modified
+		&& readFile(filename+".br", ret->br_data)
+		&& ret->br_data.size()>=ret->data.size())
+	{
+		ret->br_data.clear();
+	}
+
+	SFile gz_metadata = getFileMetadata(filename+".gz");
+	if(gz_metadata.last_modified>=last_modified
+		&& readFile(filename+".gz", ret->gzip_data))
+	{
+		if(ret->gzip_data.size()>=ret->data.size())
+		{
+			ret->gzip_data.clear();
+		}
+	}
+	else if(isCompressible(ret->content_type))
+	{
+		if(!gzipCompress(ret->data, ret->gzip_data)
+			|| ret->gzip_data.size()>=ret->data.size())
+		{
+			ret->gzip_data.clear();
+		}
+	}
+
+	return ret;
+}
+
+bool CHTTPFileCache::readFile(const std::string& filename, std::string& data)
+{
+	IFile *fp=Server->openFile(filename);
+	if(fp==nullptr)
+	{
+		return false;
+	}
+
+	int64 fsize=fp->Size();
+	if(fsize<0 || fsize>max_cached_file_size)
+	{
+		Server->destroy(fp);
+		return false;
+	}
+
+	data.resize(static_cast<size_t>(fsize));
+	bool has_error=false;
+	if(!data.empty()
+		&& fp->Read(&data[0], static_cast<_u32>(data.size()), &has_error)!=data.size())
+	{
+		has_error=true;
+	}
+
+	Server->destroy(fp);
+
+	if(has_error)
+	{
+		data.clear();
+		return false;
+	}
+	return true;
+}
+
+bool CHTTPFileCache::gzipCompress(const std::string& data, std::string& ret)
+{
+	z_stream strm = {};
+	//15+16: zlib with gzip header
+	if(deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, 15+16, 9, Z_DEFAULT_STRATEGY)!=Z_OK)
+	{
+		return false;
+	}
+
+	ret.resize(deflateBound(&strm, static_cast<uLong>(data.size())));
+
+	strm.next_in=reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	strm.avail_in=static_cast<uInt>(data.size());
+	strm.next_out=reinterpret_cast<Bytef*>(&ret[0]);
+	strm.avail_out=static_cast<uInt>(ret.size());
+
+	int rc=deflate(&strm, Z_FINISH);
+	ret.resize(strm.total_out);
+	deflateEnd(&strm);
+
+	return rc==Z_STREAM_END;
+}
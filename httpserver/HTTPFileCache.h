@@ -0,0 +1,41 @@
+#include <string>
+#include <map>
+#include <memory>
+#include "../Interface/Types.h"
+#include "../Interface/Mutex.h"
+
+struct SCachedHTTPFile
+{
+	std::string filename;
+	std::string content_type;
+	std::string etag;
+	int64 last_modified;
+	std::string data;
+	std::string gzip_data;
+	std::string br_data;
+};
+
+/**
+* In-memory cache of the static files of the web interface. Files are
+* revalidated via size and modification time on every request. Compressed
+* variants are read from <file>.br/<file>.gz if they exist, otherwise a gzip
+* variant is created for compressible content types.
+*/
+class CHTTPFileCache
+{
+public:
+	static void init_mutex(void);
+	static void destroy_mutex(void);
+
+	//Returns nullptr if the file does not exist or is too large to be cached
+	static std::shared_ptr<SCachedHTTPFile> get(const std::string& filename);
+
+private:
+	static std::shared_ptr<SCachedHTTPFile> load(const std::string& filename, int64 filesize, int64 last_modified);
+	static bool readFile(const std::string& filename, std::string& data);
+	static bool gzipCompress(const std::string& data, std::string& ret);
+
+	static IMutex* mutex;
+	static std::map<std::string, std::shared_ptr<SCachedHTTPFile> > files;
+	static size_t cache_size;
+};
@@ -473,6 +473,8 @@ int main_fkt(int argc, char *argv[])
 		Server->setLogLevel(LL_DEBUG);
 	}
 
+	Server->startLogWriter();
+
 #ifndef _WIN32
 	if( !daemon_user.empty() && (getuid()==0 || geteuid()==0) )
 	{
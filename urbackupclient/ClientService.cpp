@@ -47,6 +47,7 @@
 #include "LocalFullFileBackup.h"
 #include "LocalIncrFileBackup.h"
 #include "file_permissions.h"
+#include "../urbackupcommon/image_restore_stream.h"
 
 #include <memory.h>
 #include <stdlib.h>
@@ -3068,8 +3069,20 @@ void ClientConnector::downloadImage(str_map params, IScopedLock& backup_mutex_lo
 			token_param = "&token=" + EscapeParamString(params["token"]);
 		}
 
+		//The restore tool asks for extents. Older servers only send blocks
+		bool tool_extents = params["extents"] == "1";
+		std::string extents_param;
+		if (tool_extents && restore_version >= 2)
+		{
+			extents_param = "&extents=1";
+			if (!params["compress"].empty())
+			{
+				extents_param += "&compress=" + EscapeParamString(params["compress"]);
+			}
+		}
+
 		sendChannelPacket(channel_pipes[i], "DOWNLOAD IMAGE with_used_bytes=1&img_id=" 
-			+ params["img_id"] + "&time=" + params["time"] + "&mbr=" + params["mbr"] + offset + token_param);
+			+ params["img_id"] + "&time=" + params["time"] + "&mbr=" + params["mbr"] + offset + token_param + extents_param);
 		
 		Server->Log("Downloading from channel "+convert((int)i), LL_DEBUG);
 
@@ -3103,6 +3116,24 @@ void ClientConnector::downloadImage(str_map params, IScopedLock& backup_mutex_lo
 			return;
 		}
 
+		std::unique_ptr<image_restore::ExtentStreamParser> extent_parser;
+		if (tool_extents)
+		{
+			int64 stream_format = extents_param.empty() ? image_restore::stream_format_blocks : image_restore::stream_format_extents;
+			if (!pipe->Write((char*)&stream_format, sizeof(stream_format), (int)receive_timeouttime))
+			{
+				Server->Log("Could not write to pipe! downloadImage-6", LL_ERROR);
+				backup_mutex_lock.relock(backup_mutex);
+				removeChannelpipe(c);
+				return;
+			}
+
+			if (!extents_param.empty())
+			{
+				extent_parser.reset(new image_restore::ExtentStreamParser);
+			}
+		}
+
 		const size_t c_buffer_size=32768;
 		const unsigned int c_blocksize=4096;
 		char buf[c_buffer_size];
@@ -3214,46 +3245,75 @@ void ClientConnector::downloadImage(str_map params, IScopedLock& backup_mutex_lo
 			if(r!=0)
 				r+=off;
 			off=0;			
-			while(true)
+			if(extent_parser.get()!=nullptr)
 			{
-				if( blockleft==0 )
+				size_t poff=0;
+				while(poff<r)
 				{
-					if(r-off>=sizeof(_i64) )
+					poff+=extent_parser->add(&buf[poff], r-poff);
+					if(extent_parser->hasExtent())
 					{
-						blockleft=c_blocksize;
-						_i64 s;
-						memcpy((char*)&s, &buf[off], sizeof(_i64) );
-						if(s>imgsize
-							&& s!= 0x7fffffffffffffffLL)
-						{
-							Server->Log("invalid seek value: "+convert(s), LL_ERROR);
-						}
-						off+=sizeof(_i64);
-						pos=s;
+						pos=extent_parser->getPos();
+						received_bytes+=extent_parser->getLen();
+						extent_parser->nextExtent();
 					}
-					else if(r-off>0)
+					else if(extent_parser->isFinished())
 					{
-						memmove(buf, &buf[off], r-off);
-						off=(_u32)r-off;
+						pos=image_restore::stream_end;
 						break;
 					}
-					else
+					else if(extent_parser->hasError())
 					{
-						off=0;
-						break;
+						Server->Log("Invalid image restore extent", LL_ERROR);
+						backup_mutex_lock.relock(backup_mutex);
+						removeChannelpipe(c);
+						return;
 					}
 				}
-				else
+			}
+			else
+			{
+				while(true)
 				{
-					unsigned int available=(std::min)((unsigned int)r-off, blockleft);
-					read+=available;
-					blockleft-=available;
-					off+=available;
-					received_bytes += available;
-					if(off>=r)
+					if( blockleft==0 )
 					{
-						off=0;
-						break;
+						if(r-off>=sizeof(_i64) )
+						{
+							blockleft=c_blocksize;
+							_i64 s;
+							memcpy((char*)&s, &buf[off], sizeof(_i64) );
+							if(s>imgsize
+								&& s!= 0x7fffffffffffffffLL)
+							{
+								Server->Log("invalid seek value: "+convert(s), LL_ERROR);
+							}
+							off+=sizeof(_i64);
+							pos=s;
+						}
+						else if(r-off>0)
+						{
+							memmove(buf, &buf[off], r-off);
+							off=(_u32)r-off;
+							break;
+						}
+						else
+						{
+							off=0;
+							break;
+						}
+					}
+					else
+					{
+						unsigned int available=(std::min)((unsigned int)r-off, blockleft);
+						read+=available;
+						blockleft-=available;
+						off+=available;
+						received_bytes += available;
+						if(off>=r)
+						{
+							off=0;
+							break;
+						}
 					}
 				}
 			}
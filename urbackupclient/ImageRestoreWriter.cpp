@@ -0,0 +1,251 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "ImageRestoreWriter.h"
+#include "../Interface/Server.h"
+#include "../Interface/Thread.h"
+#include "../stringtools.h"
+#include "../urbackupcommon/os_functions.h"
+#include <string.h>
+#ifndef NO_ZSTD_COMPRESSION
+#include <zstd.h>
+#endif
+
+namespace
+{
+	const size_t c_io_alignment = 4096;
+
+	class ImageRestoreWriterThread : public IThread
+	{
+	public:
+		ImageRestoreWriterThread(ImageRestoreWriter* writer)
+			: writer(writer)
+		{}
+
+		void operator()()
+		{
+			writer->writerThread();
+			delete this;
+		}
+
+	private:
+		ImageRestoreWriter* writer;
+	};
+
+	char* alignedPtr(std::vector<char>& buffer)
+	{
+		size_t misalign = reinterpret_cast<size_t>(buffer.data()) % c_io_alignment;
+		return buffer.data() + (misalign == 0 ? 0 : (c_io_alignment - misalign));
+	}
+}
+
+ImageRestoreWriter::ImageRestoreWriter(IFile* out_file, size_t n_threads, bool direct_io)
+	: out_file(out_file), direct_io(direct_io), mutex(Server->createMutex()), cond(Server->createCondition()),
+	max_queued(n_threads * 4), in_progress(0), do_stop(false), has_error(false),
+	next_seq(0), next_done_seq(0), written_pos(-1)
+{
+	for (size_t i = 0; i < n_threads; ++i)
+	{
+		tickets.push_back(Server->getThreadPool()->execute(new ImageRestoreWriterThread(this), "image restore write"));
+	}
+}
+
+ImageRestoreWriter::~ImageRestoreWriter()
+{
+	{
+		IScopedLock lock(mutex.get());
+		do_stop = true;
+		cond->notify_all();
+	}
+
+	Server->getThreadPool()->waitFor(tickets);
+
+	for (size_t i = 0; i < queue.size(); ++i)
+	{
+		delete queue[i];
+	}
+}
+
+bool ImageRestoreWriter::addExtent(int64 pos, const char* data, _u32 len, _u32 comp_len)
+{
+	SExtent* extent = new SExtent;
+	extent->pos = pos;
+	extent->len = len;
+	extent->comp_len = comp_len;
+	extent->data.assign(data, data + comp_len);
+
+	IScopedLock lock(mutex.get());
+	while (!has_error
+		&& queue.size() >= max_queued)
+	{
+		cond->wait(&lock);
+	}
+
+	if (has_error)
+	{
+		delete extent;
+		return false;
+	}
+
+	extent->seq = next_seq++;
+	queue.push_back(extent);
+	cond->notify_all();
+
+	return true;
+}
+
+bool ImageRestoreWriter::finish()
+{
+	IScopedLock lock(mutex.get());
+	while (!has_error
+		&& (!queue.empty() || in_progress > 0))
+	{
+		cond->wait(&lock);
+	}
+	return !has_error;
+}
+
+bool ImageRestoreWriter::hasError()
+{
+	IScopedLock lock(mutex.get());
+	return has_error;
+}
+
+int64 ImageRestoreWriter::getWrittenPos()
+{
+	IScopedLock lock(mutex.get());
+	return written_pos;
+}
+
+void ImageRestoreWriter::writerThread()
+{
+	std::vector<char> buffer;
+
+#ifndef NO_ZSTD_COMPRESSION
+	std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+	void* dctx_ptr = dctx.get();
+#else
+	void* dctx_ptr = nullptr;
+#endif
+
+	while (true)
+	{
+		SExtent* extent;
+		{
+			IScopedLock lock(mutex.get());
+			while (!do_stop
+				&& !has_error
+				&& queue.empty())
+			{
+				cond->wait(&lock);
+			}
+
+			if (do_stop
+				|| has_error)
+			{
+				return;
+			}
+
+			extent = queue.front();
+			queue.pop_front();
+			++in_progress;
+			cond->notify_all();
+		}
+
+		bool ok = writeExtent(*extent, buffer, dctx_ptr);
+
+		IScopedLock lock(mutex.get());
+		--in_progress;
+
+		if (!ok)
+		{
+			has_error = true;
+		}
+		else
+		{
+			done_extents[extent->seq] = extent->pos + extent->len;
+
+			std::map<size_t, int64>::iterator it;
+			while ((it = done_extents.find(next_done_seq)) != done_extents.end())
+			{
+				written_pos = it->second;
+				done_extents.erase(it);
+				++next_done_seq;
+			}
+		}
+
+		delete extent;
+		cond->notify_all();
+	}
+}
+
+bool ImageRestoreWriter::writeExtent(SExtent& extent, std::vector<char>& buffer, void* dctx)
+{
+	const char* data = extent.data.data();
+
+	if (extent.comp_len < extent.len
+		|| direct_io)
+	{
+		if (buffer.size() < extent.len + c_io_alignment)
+		{
+			buffer.resize(extent.len + c_io_alignment);
+		}
+
+		char* out_buf = alignedPtr(buffer);
+
+		if (extent.comp_len < extent.len)
+		{
+#ifndef NO_ZSTD_COMPRESSION
+			size_t rc = ZSTD_decompressDCtx(static_cast<ZSTD_DCtx*>(dctx), out_buf, extent.len,
+				extent.data.data(), extent.comp_len);
+			if (ZSTD_isError(rc)
+				|| rc != extent.len)
+			{
+				Server->Log("Decompressing image data at position " + convert(extent.pos) + " failed"
+					+ (ZSTD_isError(rc) ? (std::string(". ") + ZSTD_getErrorName(rc)) : std::string()), LL_ERROR);
+				return false;
+			}
+#else
+			Server->Log("Received compressed image data, but compression is not supported", LL_ERROR);
+			return false;
+#endif
+		}
+		else
+		{
+			memcpy(out_buf, extent.data.data(), extent.len);
+		}
+
+		data = out_buf;
+	}
+
+	_u32 woff = 0;
+	do
+	{
+		bool has_write_error = false;
+		_u32 w = out_file->Write(extent.pos + woff, data + woff, extent.len - woff, &has_write_error);
+		if (w == 0
+			|| has_write_error)
+		{
+			Server->Log("Writing to output file failed at position " + convert(extent.pos + woff) + ". " + os_last_error_str(), LL_ERROR);
+			return false;
+		}
+		woff += w;
+	} while (woff < extent.len);
+
+	return true;
+}
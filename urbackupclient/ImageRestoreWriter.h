@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../Interface/File.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include "../Interface/ThreadPool.h"
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+/**
+* Decompresses and writes the extents of an image restore stream to the
+* output device with several threads. Extents are written with positional
+* writes, so the threads do not need to coordinate. If direct_io is set the
+* buffers are aligned and all writes have to be a multiple of the block size.
+*/
+class ImageRestoreWriter
+{
+public:
+	ImageRestoreWriter(IFile* out_file, size_t n_threads, bool direct_io);
+	~ImageRestoreWriter();
+
+	//Blocks if too many extents are queued
+	bool addExtent(int64 pos, const char* data, _u32 len, _u32 comp_len);
+
+	//Waits until all queued extents are written
+	bool finish();
+
+	bool hasError();
+
+	//All data before this position is written
+	int64 getWrittenPos();
+
+	void writerThread();
+
+private:
+	ImageRestoreWriter(const ImageRestoreWriter& other);
+	ImageRestoreWriter& operator=(const ImageRestoreWriter& other);
+
+	struct SExtent
+	{
+		size_t seq;
+		int64 pos;
+		_u32 len;
+		_u32 comp_len;
+		std::vector<char> data;
+	};
+
+	bool writeExtent(SExtent& extent, std::vector<char>& buffer, void* dctx);
+
+	IFile* out_file;
+	bool direct_io;
+
+	std::unique_ptr<IMutex> mutex;
+	std::unique_ptr<ICondition> cond;
+
+	std::deque<SExtent*> queue;
+	size_t max_queued;
+	size_t in_progress;
+	bool do_stop;
+	bool has_error;
+
+	size_t next_seq;
+	size_t next_done_seq;
+	std::map<size_t, int64> done_extents;
+	int64 written_pos;
+
+	std::vector<THREADPOOL_TICKET> tickets;
+};
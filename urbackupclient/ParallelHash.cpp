@@ -236,7 +236,8 @@ bool ParallelHash::hashFile(int64 working_file_id, CRData & data, ClientDAO& cli
 		if (!data.getVarInt(&dir_id)
 			|| !data.getStr2(&dir.dir)
 			|| !data.getInt(&dir.tgroup)
-			|| !data.getStr2(&dir.snapshot_dir))
+			|| !data.getStr2(&dir.snapshot_dir)
+			|| !data.getStr2(&dir.hash_cache_vol))
 		{
 			assert(false);
 			return false;
@@ -332,6 +333,21 @@ bool ParallelHash::hashFile(int64 working_file_id, CRData & data, ClientDAO& cli
 		return false;
 	}
 
+	int64 inode;
+	int64 fsize;
+	int64 last_modified;
+	int64 created;
+	int64 change_indicator;
+	if (!data.getInt64(&inode)
+		|| !data.getVarInt(&fsize)
+		|| !data.getVarInt(&last_modified)
+		|| !data.getVarInt(&created)
+		|| !data.getInt64(&change_indicator))
+	{
+		assert(false);
+		return false;
+	}
+
 	SCurrDir* dir;
 	{
 		IScopedLock lock(mutex.get());
@@ -407,6 +423,14 @@ bool ParallelHash::hashFile(int64 working_file_id, CRData & data, ClientDAO& cli
 		ph_action = " (Calculated sha512 hash)";
 	}
 
+	if (inode != 0
+		&& !dir->hash_cache_vol.empty()
+		&& !fandhash.hash.empty())
+	{
+		addHashCacheBuffer(clientdao, SHashCacheItem(dir->hash_cache_vol, inode,
+			fsize, last_modified, created, change_indicator, fandhash.hash));
+	}
+
 	CWData wdata;
 	wdata.addUShort(0);
 	wdata.addChar(1);
@@ -601,6 +625,26 @@ void ParallelHash::addModifyFileBuffer(ClientDAO& clientdao, const std::string &
 	}
 }
 
+void ParallelHash::addHashCacheBuffer(ClientDAO& clientdao, const SHashCacheItem& item)
+{
+	IScopedLock lock(modify_file_buffer_mutex.get());
+
+	modify_file_buffer_size += sizeof(SHashCacheItem) + item.vol.size() + item.hash.size();
+
+	hash_cache_buffer.push_back(item);
+
+	if (last_file_buffer_commit_time == 0)
+	{
+		last_file_buffer_commit_time = Server->getTimeMS();
+	}
+
+	if (modify_file_buffer_size>max_modify_file_buffer_size
+		|| Server->getTimeMS() - last_file_buffer_commit_time>file_buffer_commit_interval)
+	{
+		commitModifyFileBuffer(clientdao);
+	}
+}
+
 void ParallelHash::commitModifyFileBuffer(ClientDAO& clientdao)
 {
 	DBScopedWriteTransaction trans(clientdao.getDatabase());
@@ -618,7 +662,15 @@ void ParallelHash::commitModifyFileBuffer(ClientDAO& clientdao)
 		}
 	}
 
+	for (size_t i = 0; i < hash_cache_buffer.size(); ++i)
+	{
+		clientdao.addHashCacheEntry(hash_cache_buffer[i].vol, hash_cache_buffer[i].inode, hash_cache_buffer[i].size,
+			hash_cache_buffer[i].mtime, hash_cache_buffer[i].ctime, hash_cache_buffer[i].change_indicator,
+			sha_version, hash_cache_buffer[i].hash);
+	}
+
 	modify_file_buffer.clear();
+	hash_cache_buffer.clear();
 	modify_file_buffer_size = 0;
 	last_file_buffer_commit_time = Server->getTimeMS();
 }
@@ -44,6 +44,7 @@ private:
 		int tgroup;
 		std::string dir;
 		std::string snapshot_dir;
+		std::string hash_cache_vol;
 		std::vector<SFileAndHash> files;
 		int64 target_generation;
 		int64 dir_target_nfiles;
@@ -54,6 +55,7 @@ private:
 	bool finishDir(ParallelHash::SCurrDir* dir, ClientDAO& clientdao, const int64& target_generation, int64& id);
 	bool addToStdoutBuf(const char* ptr, size_t size);
 	void addModifyFileBuffer(ClientDAO& clientdao, const std::string& path, int tgroup, const std::vector<SFileAndHash>& files, int64 target_generation, bool insert);
+	void addHashCacheBuffer(ClientDAO& clientdao, const SHashCacheItem& item);
 	void commitModifyFileBuffer(ClientDAO& clientdao);
 	size_t calcBufferSize(const std::string &path, const std::vector<SFileAndHash> &data);
 	void runExtraThread();
@@ -96,6 +98,7 @@ private:
 
 	std::unique_ptr<IMutex> modify_file_buffer_mutex;
 	std::vector< SBufferItem > modify_file_buffer;
+	std::vector< SHashCacheItem > hash_cache_buffer;
 	size_t modify_file_buffer_size;
 	int64 last_file_buffer_commit_time;
 	size_t extra_n_threads;
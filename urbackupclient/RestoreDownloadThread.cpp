@@ -31,10 +31,12 @@ namespace
 }
 
 RestoreDownloadThread::RestoreDownloadThread( FileClient& fc, FileClientChunked& fc_chunked, const std::string& client_token, str_map& metadata_path_mapping,
+	IMutex* metadata_path_mapping_mutex,
 	RestoreFiles& restore_files)
 	: fc(fc), fc_chunked(fc_chunked), queue_size(0), all_downloads_ok(true),
 	mutex(Server->createMutex()), cond(Server->createCondition()), skipping(false), is_offline(false),
-	client_token(client_token), metadata_path_mapping(metadata_path_mapping), restore_files(restore_files)
+	client_token(client_token), metadata_path_mapping(metadata_path_mapping),
+	metadata_path_mapping_mutex(metadata_path_mapping_mutex), restore_files(restore_files)
 {
 
 }
@@ -121,16 +123,6 @@ void RestoreDownloadThread::operator()()
 			is_offline=true;
 		}
 	}
-
-	if(!is_offline && !skipping)
-	{
-		_u32 rc = fc.InformMetadataStreamEnd(client_token, 3);
-
-		if(rc!=ERR_SUCCESS)
-		{
-			Server->Log("Error informing client about metadata stream end. Errorcode: "+fc.getErrorString(rc)+" ("+convert(rc)+")", LL_ERROR);
-		}
-	}
 }
 
 void RestoreDownloadThread::addToQueueFull( size_t id, const std::string &remotefn, const std::string &destfn,
@@ -240,6 +232,8 @@ bool RestoreDownloadThread::load_file( SQueueItem todl )
 			if (dest_f.get() != NULL)
 			{
 				rename_queue.push_back(std::make_pair(todl.destfn, old_destfn));
+
+				IScopedLock mapping_lock(metadata_path_mapping_mutex);
 				metadata_path_mapping[old_destfn] = todl.destfn;
 			}
 		}
@@ -473,6 +467,24 @@ bool RestoreDownloadThread::hasError()
     return !download_nok_ids.empty();
 }
 
+bool RestoreDownloadThread::isOffline()
+{
+	IScopedLock lock(mutex.get());
+	return is_offline || skipping;
+}
+
+size_t RestoreDownloadThread::queueSize()
+{
+	IScopedLock lock(mutex.get());
+	return queue_size;
+}
+
+bool RestoreDownloadThread::queueHalfFull()
+{
+	IScopedLock lock(mutex.get());
+	return queue_size > max_queue_size / 2;
+}
+
 void RestoreDownloadThread::log(const std::string & msg, int loglevel)
 {
 	restore_files.log(msg, loglevel);
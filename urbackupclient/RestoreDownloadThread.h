@@ -62,7 +62,7 @@ class RestoreDownloadThread : public IThread, public FileClient::QueueCallback,
 {
 public:
 	RestoreDownloadThread(FileClient& fc, FileClientChunked& fc_chunked, const std::string& client_token, str_map& metadata_path_mapping,
-		RestoreFiles& restore_files);
+		IMutex* metadata_path_mapping_mutex, RestoreFiles& restore_files);
 
 	void operator()();
 
@@ -94,6 +94,13 @@ public:
 
     bool hasError();
 
+	//Offline or skipping the rest of the queue
+	bool isOffline();
+
+	size_t queueSize();
+
+	bool queueHalfFull();
+
 	std::vector<std::pair<std::string, std::string> > getRenameQueue();
 
 	bool isRenamedFile(const std::string& fn);
@@ -123,6 +130,7 @@ private:
 
 	std::vector<std::pair<std::string, std::string> > rename_queue;
 	str_map& metadata_path_mapping;
+	IMutex* metadata_path_mapping_mutex;
 	std::set<std::string> renamed_files;
 	RestoreFiles& restore_files;
 };
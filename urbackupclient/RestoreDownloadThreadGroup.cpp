@@ -0,0 +1,238 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "RestoreDownloadThreadGroup.h"
+#include "RestoreFiles.h"
+#include "../stringtools.h"
+#include "../urbackupcommon/os_functions.h"
+
+RestoreDownloadThreadGroup::RestoreDownloadThreadGroup(FileClient& fc, FileClientChunked& fc_chunked, const std::string& client_token,
+	str_map& metadata_path_mapping, RestoreFiles& restore_files, size_t n_threads)
+	: fc(fc), fc_chunked(fc_chunked), client_token(client_token), metadata_path_mapping(metadata_path_mapping),
+	metadata_path_mapping_mutex(Server->createMutex()), curr_thread(0), joined(false)
+{
+	for (size_t i = 0; i < n_threads; ++i)
+	{
+		SRestoreDlThread dl_thread;
+
+		FileClient* curr_fc;
+		FileClientChunked* curr_fc_chunked;
+		if (i == 0)
+		{
+			curr_fc = &fc;
+			curr_fc_chunked = &fc_chunked;
+			dl_thread.fc = nullptr;
+			dl_thread.fc_chunked = nullptr;
+			dl_thread.tcpstack = nullptr;
+		}
+		else
+		{
+			IPipe* np = restore_files.new_fileclient_connection();
+			if (np == nullptr)
+			{
+				restore_files.log("Failed to connect FileClient " + convert(i) + " for restore", LL_WARNING);
+				break;
+			}
+
+			curr_fc = new FileClient(false, client_token, 3, true, &restore_files, nullptr);
+			curr_fc->Connect(np);
+			curr_fc->setProgressLogCallback(&restore_files);
+
+			IPipe* np_chunked = restore_files.new_fileclient_connection();
+			if (np_chunked == nullptr)
+			{
+				restore_files.log("Failed to connect chunked FileClient " + convert(i) + " for restore", LL_WARNING);
+				delete curr_fc;
+				break;
+			}
+
+			//The tcp stack keeps the partially received packet, so each chunked client needs its own
+			CTCPStack* tcpstack = new CTCPStack(true);
+			curr_fc_chunked = new FileClientChunked(np_chunked, true, tcpstack, &restore_files,
+				nullptr, client_token, nullptr);
+			curr_fc_chunked->setProgressLogCallback(&restore_files);
+
+			dl_thread.fc = curr_fc;
+			dl_thread.fc_chunked = curr_fc_chunked;
+			dl_thread.tcpstack = tcpstack;
+		}
+
+		dl_thread.dl_thread = new RestoreDownloadThread(*curr_fc, *curr_fc_chunked, client_token, metadata_path_mapping,
+			metadata_path_mapping_mutex.get(), restore_files);
+
+		tickets.push_back(Server->getThreadPool()->execute(dl_thread.dl_thread, "file restore download" + (i > 0 ? convert(i) : std::string())));
+
+		dl_threads.push_back(dl_thread);
+	}
+}
+
+RestoreDownloadThreadGroup::~RestoreDownloadThreadGroup()
+{
+	for (size_t i = 0; i < dl_threads.size(); ++i)
+	{
+		SRestoreDlThread& dl_thread = dl_threads[i];
+		delete dl_thread.dl_thread;
+		delete dl_thread.fc_chunked;
+		delete dl_thread.tcpstack;
+		delete dl_thread.fc;
+	}
+}
+
+void RestoreDownloadThreadGroup::addToQueueFull(size_t id, const std::string& remotefn, const std::string& destfn, _i64 predicted_filesize,
+	const FileMetadata& metadata, bool is_script, bool metadata_only, size_t folder_items, IFsFile* orig_file)
+{
+	getDirThread(destfn)->addToQueueFull(id, remotefn, destfn, predicted_filesize, metadata,
+		is_script, metadata_only, folder_items, orig_file);
+}
+
+void RestoreDownloadThreadGroup::addToQueueChunked(size_t id, const std::string& remotefn, const std::string& destfn, _i64 predicted_filesize,
+	const FileMetadata& metadata, bool is_script, IFsFile* orig_file, IFile* chunkhashes)
+{
+	getDirThread(destfn)->addToQueueChunked(id, remotefn, destfn, predicted_filesize, metadata,
+		is_script, orig_file, chunkhashes);
+}
+
+void RestoreDownloadThreadGroup::queueSkip()
+{
+	for (size_t i = 0; i < dl_threads.size(); ++i)
+	{
+		dl_threads[i].dl_thread->queueSkip();
+	}
+}
+
+void RestoreDownloadThreadGroup::queueStop()
+{
+	for (size_t i = 0; i < dl_threads.size(); ++i)
+	{
+		dl_threads[i].dl_thread->queueStop();
+	}
+}
+
+bool RestoreDownloadThreadGroup::join(int waitms)
+{
+	if (!Server->getThreadPool()->waitFor(tickets, waitms))
+	{
+		return false;
+	}
+
+	if (!joined)
+	{
+		joined = true;
+
+		for (size_t i = 0; i < dl_threads.size(); ++i)
+		{
+			if (dl_threads[i].dl_thread->isOffline())
+			{
+				return true;
+			}
+		}
+
+		_u32 rc = fc.InformMetadataStreamEnd(client_token, 3);
+
+		if (rc != ERR_SUCCESS)
+		{
+			Server->Log("Error informing client about metadata stream end. Errorcode: " + fc.getErrorString(rc) + " (" + convert(rc) + ")", LL_ERROR);
+		}
+	}
+
+	return true;
+}
+
+bool RestoreDownloadThreadGroup::hasError()
+{
+	for (size_t i = 0; i < dl_threads.size(); ++i)
+	{
+		if (dl_threads[i].dl_thread->hasError())
+			return true;
+	}
+	return false;
+}
+
+std::vector<std::pair<std::string, std::string> > RestoreDownloadThreadGroup::getRenameQueue()
+{
+	std::vector<std::pair<std::string, std::string> > ret;
+	for (size_t i = 0; i < dl_threads.size(); ++i)
+	{
+		std::vector<std::pair<std::string, std::string> > rename_queue = dl_threads[i].dl_thread->getRenameQueue();
+		ret.insert(ret.end(), rename_queue.begin(), rename_queue.end());
+	}
+	return ret;
+}
+
+bool RestoreDownloadThreadGroup::isRenamedFile(const std::string& fn)
+{
+	for (size_t i = 0; i < dl_threads.size(); ++i)
+	{
+		if (dl_threads[i].dl_thread->isRenamedFile(fn))
+			return true;
+	}
+	return false;
+}
+
+void RestoreDownloadThreadGroup::addMetadataPathMapping(const std::string& path, const std::string& mapped_path)
+{
+	IScopedLock lock(metadata_path_mapping_mutex.get());
+	metadata_path_mapping[path] = mapped_path;
+}
+
+_i64 RestoreDownloadThreadGroup::getReceivedDataBytes(bool with_sparse)
+{
+	_i64 ret = fc.getReceivedDataBytes(with_sparse) + fc_chunked.getReceivedDataBytes(with_sparse);
+	for (size_t i = 1; i < dl_threads.size(); ++i)
+	{
+		ret += dl_threads[i].fc->getReceivedDataBytes(with_sparse)
+			+ dl_threads[i].fc_chunked->getReceivedDataBytes(with_sparse);
+	}
+	return ret;
+}
+
+_i64 RestoreDownloadThreadGroup::getTransferredBytes()
+{
+	_i64 ret = fc.getTransferredBytes() + fc_chunked.getTransferredBytes();
+	for (size_t i = 1; i < dl_threads.size(); ++i)
+	{
+		ret += dl_threads[i].fc->getTransferredBytes()
+			+ dl_threads[i].fc_chunked->getTransferredBytes();
+	}
+	return ret;
+}
+
+RestoreDownloadThread* RestoreDownloadThreadGroup::getDirThread(const std::string& destfn)
+{
+	std::string dir = ExtractFilePath(destfn, os_file_sep());
+
+	if (dir != curr_dir
+		|| dl_threads[curr_thread].dl_thread->queueHalfFull())
+	{
+		curr_dir = dir;
+
+		size_t queue_size = dl_threads[0].dl_thread->queueSize();
+		curr_thread = 0;
+		for (size_t i = 1; i < dl_threads.size(); ++i)
+		{
+			size_t curr_queue_size = dl_threads[i].dl_thread->queueSize();
+			if (curr_queue_size < queue_size)
+			{
+				queue_size = curr_queue_size;
+				curr_thread = i;
+			}
+		}
+	}
+
+	return dl_threads[curr_thread].dl_thread;
+}
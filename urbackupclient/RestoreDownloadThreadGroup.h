@@ -0,0 +1,68 @@
+#pragma once
+
+#include "RestoreDownloadThread.h"
+#include "../Interface/ThreadPool.h"
+#include "../urbackupcommon/fileclient/tcpstack.h"
+
+/**
+* Downloads the files of a restore with several download threads, each with its
+* own connections to the server. The files of one directory are downloaded by
+* the same thread, as long as its queue is not too long.
+*/
+class RestoreDownloadThreadGroup
+{
+public:
+	RestoreDownloadThreadGroup(FileClient& fc, FileClientChunked& fc_chunked, const std::string& client_token, str_map& metadata_path_mapping,
+		RestoreFiles& restore_files, size_t n_threads);
+
+	~RestoreDownloadThreadGroup();
+
+	void addToQueueFull(size_t id, const std::string &remotefn, const std::string &destfn,
+		_i64 predicted_filesize, const FileMetadata& metadata, bool is_script, bool metadata_only, size_t folder_items, IFsFile* orig_file);
+
+	void addToQueueChunked(size_t id, const std::string &remotefn, const std::string &destfn,
+		_i64 predicted_filesize, const FileMetadata& metadata, bool is_script, IFsFile* orig_file, IFile* chunkhashes);
+
+	void queueSkip();
+
+	void queueStop();
+
+	//Informs the server about the metadata stream end once all threads are finished
+	bool join(int waitms);
+
+	bool hasError();
+
+	std::vector<std::pair<std::string, std::string> > getRenameQueue();
+
+	bool isRenamedFile(const std::string& fn);
+
+	void addMetadataPathMapping(const std::string& path, const std::string& mapped_path);
+
+	_i64 getReceivedDataBytes(bool with_sparse);
+
+	_i64 getTransferredBytes();
+
+private:
+	RestoreDownloadThread* getDirThread(const std::string& destfn);
+
+	struct SRestoreDlThread
+	{
+		RestoreDownloadThread* dl_thread;
+		FileClient* fc;
+		FileClientChunked* fc_chunked;
+		CTCPStack* tcpstack;
+	};
+
+	std::vector<SRestoreDlThread> dl_threads;
+	std::vector<THREADPOOL_TICKET> tickets;
+
+	FileClient& fc;
+	FileClientChunked& fc_chunked;
+	const std::string& client_token;
+	str_map& metadata_path_mapping;
+	std::unique_ptr<IMutex> metadata_path_mapping_mutex;
+
+	std::string curr_dir;
+	size_t curr_thread;
+	bool joined;
+};
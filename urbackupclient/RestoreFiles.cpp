@@ -20,7 +20,7 @@
 #include "ClientService.h"
 #include "../stringtools.h"
 #include "../urbackupcommon/filelist_utils.h"
-#include "RestoreDownloadThread.h"
+#include "RestoreDownloadThreadGroup.h"
 #include "../urbackupcommon/fileclient/FileClientChunked.h"
 #include "../urbackupcommon/fileclient/tcpstack.h"
 #include "../Interface/Server.h"
@@ -987,8 +987,10 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
 	std::string share_path;
 	std::string server_path = "clientdl";
 
-	std::unique_ptr<RestoreDownloadThread> restore_download(new RestoreDownloadThread(fc, *fc_chunked, client_token, metadata_path_mapping, *this));
-    THREADPOOL_TICKET restore_download_ticket = Server->getThreadPool()->execute(restore_download.get(), "file restore download");
+	size_t n_download_threads = (std::max)(1, watoi(Server->getServerParameter("restore_download_threads", "4")));
+
+	std::unique_ptr<RestoreDownloadThreadGroup> restore_download(new RestoreDownloadThreadGroup(fc, *fc_chunked, client_token,
+		metadata_path_mapping, *this, n_download_threads));
 
 	std::string curr_files_dir;
 	std::vector<SFileAndHash> curr_files;
@@ -1136,12 +1138,12 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
 					}
 					else
 					{
-						int64 done_bytes = fc.getReceivedDataBytes(true) + fc_chunked->getReceivedDataBytes(true) + skipped_bytes;
+						int64 done_bytes = restore_download->getReceivedDataBytes(true) + skipped_bytes;
 						int pcdone = (std::min)(100,(int)(((float)done_bytes)/((float)total_size/100.f)+0.5f));
 						restore_updater.update_pc(pcdone, total_size, done_bytes);
 					}
 
-					calculateDownloadSpeed(fc, fc_chunked.get());
+					calculateDownloadSpeed(*restore_download);
 				}
 
 				if(!data.isdir || data.name!="..")
@@ -1495,7 +1497,7 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
 
 								if (orig_file->getFilename() != os_file_prefix(local_fn))
 								{
-									metadata_path_mapping[local_fn] = orig_file->getFilename();
+									restore_download->addMetadataPathMapping(local_fn, orig_file->getFilename());
 								}
 							}
 							use_open_fallback = false;
@@ -1555,7 +1557,7 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
 							if (orig_file.get() != NULL)
 							{
 								rename_queue.push_back(std::make_pair(local_fn, old_local_fn));
-								metadata_path_mapping[old_local_fn] = local_fn;
+								restore_download->addMetadataPathMapping(old_local_fn, local_fn);
 								folder_files.top().push_back(strlower(ExtractFileName(local_fn, os_file_sep())));
 								if (!change_file_permissions_admin_only(os_file_prefix(local_fn)))
 								{
@@ -1788,7 +1790,7 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
 
     restore_download->queueStop();
 
-    while(!Server->getThreadPool()->waitFor(restore_download_ticket, 1000))
+    while(!restore_download->join(1000))
     {
         if(total_size==0)
         {
@@ -1796,12 +1798,12 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
         }
         else
         {
-			int64 done_bytes = fc.getReceivedDataBytes(true) + fc_chunked->getReceivedDataBytes(true) + skipped_bytes;
+			int64 done_bytes = restore_download->getReceivedDataBytes(true) + skipped_bytes;
             int pcdone = (std::min)(100,(int)(((float)done_bytes)/((float)total_size/100.f)+0.5f));
 			restore_updater.update_pc(pcdone, total_size, done_bytes);
         }
 
-		calculateDownloadSpeed(fc, fc_chunked.get());
+		calculateDownloadSpeed(*restore_download);
     }
 
 #ifdef _WIN32
@@ -1899,7 +1901,7 @@ void RestoreFiles::restore_failed(client::FileMetadataDownloadThread& metadata_t
 	ClientConnector::restoreDone(log_id, status_id, restore_id, false, server_token);
 }
 
-bool RestoreFiles::removeFiles( std::string restore_path, std::string share_path, RestoreDownloadThread* restore_download,
+bool RestoreFiles::removeFiles( std::string restore_path, std::string share_path, RestoreDownloadThreadGroup* restore_download,
 	std::stack<std::vector<std::string> > &folder_files, std::vector<std::string> &deletion_queue, bool& has_include_exclude,
 	const std::vector<int64>& tids, ClientDAO* clientdao, tokens::TokenCache& cache)
 {
@@ -2104,7 +2106,7 @@ bool RestoreFiles::renameFilesOnRestart( std::vector<std::pair<std::string, std:
 #endif
 }
 
-void RestoreFiles::calculateDownloadSpeed(FileClient & fc, FileClientChunked * fc_chunked)
+void RestoreFiles::calculateDownloadSpeed(RestoreDownloadThreadGroup& restore_download)
 {
 	int64 ctime = Server->getTimeMS();
 	if (speed_set_time == 0)
@@ -2114,7 +2116,7 @@ void RestoreFiles::calculateDownloadSpeed(FileClient & fc, FileClientChunked * f
 
 	if (ctime - speed_set_time>10000)
 	{
-		int64 received_data_bytes = fc.getTransferredBytes() + (fc_chunked != nullptr ? fc_chunked->getTransferredBytes() : 0);
+		int64 received_data_bytes = restore_download.getTransferredBytes();
 
 		int64 new_bytes = received_data_bytes - last_speed_received_bytes;
 		int64 passed_time = ctime - speed_set_time;
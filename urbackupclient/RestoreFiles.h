@@ -11,7 +11,7 @@
 #include <memory>
 #include <stack>
 
-class RestoreDownloadThread;
+class RestoreDownloadThreadGroup;
 class ScopedRestoreUpdater;
 
 namespace client
@@ -19,7 +19,7 @@ namespace client
 	class FileMetadataDownloadThread;
 }
 
-class RestoreFiles : public IThread, public FileClient::ReconnectionCallback, public FileClientChunked::ReconnectionCallback, FileClient::ProgressLogCallback
+class RestoreFiles : public IThread, public FileClient::ReconnectionCallback, public FileClientChunked::ReconnectionCallback, public FileClient::ProgressLogCallback
 {
 public:
 	RestoreFiles(int facet_id, int64 local_process_id, int64 restore_id, int64 status_id, int64 log_id,
@@ -77,7 +77,7 @@ private:
 
 	bool downloadFiles(FileClient& fc, int64 total_size, ScopedRestoreUpdater& restore_updater, std::map<std::string, IFsFile*>& open_files);
 
-	bool removeFiles( std::string restore_path, std::string share_path, RestoreDownloadThread* restore_download, 
+	bool removeFiles( std::string restore_path, std::string share_path, RestoreDownloadThreadGroup* restore_download, 
 		std::stack<std::vector<std::string> > &folder_files, std::vector<std::string> &deletion_queue, bool& has_include_exclude,
 		const std::vector<int64>& tids, ClientDAO* clientdao, tokens::TokenCache& cache);
 
@@ -91,7 +91,7 @@ private:
 
 	std::unique_ptr<FileClientChunked> createFcChunked();
 
-	void calculateDownloadSpeed(FileClient & fc, FileClientChunked * fc_chunked);
+	void calculateDownloadSpeed(RestoreDownloadThreadGroup& restore_download);
 
 	bool createDirectoryWin(const std::string& dir);
 
@@ -132,6 +132,10 @@ namespace
 	const size_t max_file_buffer_size = 4 * 1024 * 1024;
 	const int64 file_buffer_commit_interval = 120 * 1000;
 	const int64 link_file_min_size = 2048;
+	const int64 hash_cache_default_size = 1000000;
+	const int64 hash_cache_min_age = 60 * 60;
+	const int64 hash_cache_touch_interval = 24 * 60 * 60;
+	const size_t max_hash_cache_buffer_items = 1000;
 }
 
 
@@ -555,7 +559,8 @@ std::string add_trailing_slash(const std::string &strDirName)
 IndexThread::IndexThread(void)
 	: index_error(false), last_filebackup_filetime(0), index_group(-1),
 	with_scripts(false), volumes_cache(nullptr), phash_queue(nullptr),
-	index_backup_dirs_optional(false), sc_refs_cleanup(false)
+	index_backup_dirs_optional(false), sc_refs_cleanup(false),
+	index_hash_cache_time(0)
 {
 	if(filelist_mutex==nullptr)
 		filelist_mutex=Server->createMutex();
@@ -1493,6 +1498,14 @@ IndexThread::IndexErrorInfo IndexThread::indexDirs(bool full_backup, bool simult
 		index_backup_dirs_optional);
 	file_id = 0;
 
+	int64 hash_cache_size = hash_cache_default_size;
+	std::string s_hash_cache_size = Server->getServerParameter("hash_cache_size");
+	if (!s_hash_cache_size.empty())
+	{
+		hash_cache_size = watoi64(s_hash_cache_size);
+	}
+	index_hash_cache_time = Server->getTimeSeconds();
+
 	updateDirs();
 
 	writeTokens();
@@ -1885,11 +1898,19 @@ IndexThread::IndexErrorInfo IndexThread::indexDirs(bool full_backup, bool simult
 							"\". Not using this pattern while indexing this path", LL_DEBUG);
 					}
 					
+					if (calculate_filehashes_on_client
+						&& hash_cache_size > 0)
+					{
+						index_hash_cache_vol = strlower(volume);
+					}
+
 					std::vector<SRecurParams> params_stack;
 					initialCheck(params_stack, std::string::npos,
 						strlower(volume), vssvolume, backup_dirs[i].path, mod_path, backup_dirs[i].tname, outfile, true,
 						backup_dirs[i].flags, !full_backup, backup_dirs[i].symlinked, 0, true, true,
-						index_exclude_dirs, index_include_dirs, std::string());
+						GlobMatcher(index_exclude_dirs), index_include_dirs, std::string());
+
+					index_hash_cache_vol.clear();
 
 					index_exclude_dirs.insert(index_exclude_dirs.end(), rm_exclude_dirs.begin(), rm_exclude_dirs.end());
 				}
@@ -1980,6 +2001,12 @@ IndexThread::IndexErrorInfo IndexThread::indexDirs(bool full_backup, bool simult
 
 	index_hdat_file.reset();
 
+	if (calculate_filehashes_on_client
+		&& hash_cache_size > 0)
+	{
+		cd->pruneHashCache(hash_cache_size);
+	}
+
 #ifdef _WIN32
 	if(!has_stale_shadowcopy
 		&& !has_active_transaction)
@@ -2385,7 +2412,7 @@ void IndexThread::resetFileEntries(void)
 }
 
 bool IndexThread::skipFile(const std::string& filepath, const std::string& namedpath,
-	const std::vector<std::string>& exclude_dirs,
+	const GlobMatcher& exclude_dirs,
 	const std::vector<SIndexInclude>& include_dirs)
 {
 	if( isExcluded(exclude_dirs, filepath) || (!namedpath.empty() && isExcluded(exclude_dirs, namedpath) ) )
@@ -2403,7 +2430,7 @@ bool IndexThread::skipFile(const std::string& filepath, const std::string& named
 
 bool IndexThread::initialCheck(std::vector<SRecurParams>& params_stack, size_t stack_idx, 
 	const std::string& volume, const std::string& vssvolume, std::string orig_dir, std::string dir, std::string named_path, std::fstream &outfile,
-	bool first, int flags, bool use_db, bool symlinked, size_t depth, bool dir_recurse, bool include_exclude_dirs, const std::vector<std::string>& exclude_dirs,
+	bool first, int flags, bool use_db, bool symlinked, size_t depth, bool dir_recurse, bool include_exclude_dirs, const GlobMatcher& exclude_dirs,
 	const std::vector<SIndexInclude>& include_dirs, const std::string& orig_path)
 {
 	index_flags=flags;
@@ -2620,6 +2647,7 @@ bool IndexThread::initialCheck(std::vector<SRecurParams>& params_stack, size_t s
 					wdata.addString2(orig_dir);
 					wdata.addInt(index_group);
 					wdata.addString2(dir);
+					wdata.addString2(index_hash_cache_vol);
 					addToPhashQueue(wdata);
 				}
 
@@ -2629,6 +2657,11 @@ bool IndexThread::initialCheck(std::vector<SRecurParams>& params_stack, size_t s
 				wdata.addVarInt(file_id);
 				wdata.addString2(files[i].name);
 				wdata.addVarInt(phash_dir_id);
+				wdata.addInt64(static_cast<int64>(hashCacheInode(files[i])));
+				wdata.addVarInt(files[i].size);
+				wdata.addVarInt(files[i].last_modified);
+				wdata.addVarInt(files[i].created);
+				wdata.addInt64(static_cast<int64>(files[i].change_indicator));
 				addToPhashQueue(wdata);
 			}
 
@@ -2796,7 +2829,7 @@ bool IndexThread::initialCheck(std::vector<SRecurParams>& params_stack, size_t s
 void IndexThread::initialCheckRecur1(std::vector<SRecurParams>& params_stack, SRecurParams& params, const size_t stack_idx,
 	const std::string & volume, const std::string & vssvolume,
 	std::fstream & outfile, const int flags, const bool use_db, const bool dir_recurse, const bool include_exclude_dirs, 
-	const std::vector<std::string>& exclude_dirs, const std::vector<SIndexInclude>& include_dirs, const std::string& orig_path)
+	const GlobMatcher& exclude_dirs, const std::vector<SIndexInclude>& include_dirs, const std::string& orig_path)
 {
 	params.recur_ret.pos = outfile.tellp();
 	params.recur_ret.file_id_backup = file_id;
@@ -2846,7 +2879,7 @@ void IndexThread::initialCheckRecur1(std::vector<SRecurParams>& params_stack, SR
 void IndexThread::initialCheckRecur2(std::vector<SRecurParams>& params_stack, SRecurParams& params, const size_t stack_idx,
 	const std::string & volume, const std::string & vssvolume,
 	std::fstream & outfile, const int flags, const bool use_db, const bool dir_recurse, const bool include_exclude_dirs,
-	const std::vector<std::string>& exclude_dirs, const std::vector<SIndexInclude>& include_dirs, const std::string& orig_path)
+	const GlobMatcher& exclude_dirs, const std::vector<SIndexInclude>& include_dirs, const std::string& orig_path)
 {
 	addFromLastLiftDepth(params.depth, outfile);
 
@@ -3116,7 +3149,7 @@ bool IndexThread::readBackupScripts(bool full_backup)
 }
 
 bool IndexThread::addMissingHashes(std::vector<SFileAndHash>* dbfiles, std::vector<SFileAndHash>* fsfiles, const std::string &orig_path,
-	const std::string& filepath, const std::string& namedpath, const std::vector<std::string>& exclude_dirs,
+	const std::string& filepath, const std::string& namedpath, const GlobMatcher& exclude_dirs,
 	const std::vector<SIndexInclude>& include_dirs, bool calc_hashes)
 {
 	bool calculated_hash=false;
@@ -3155,12 +3188,20 @@ bool IndexThread::addMissingHashes(std::vector<SFileAndHash>* dbfiles, std::vect
 				}
 			}
 
+			if(needs_hashing
+				&& fsfile.size>= link_file_min_size
+				&& getCachedHash(fsfile))
+			{
+				needs_hashing=false;
+			}
+
 			if(needs_hashing
 				&& calc_hashes
 				&& fsfile.size>= link_file_min_size)
 			{
 				fsfile.hash=getShaBinary(filepath+os_file_sep()+fsfile.name);
 				calculated_hash=true;
+				addCachedHash(fsfile);
 			}
 		}
 	}
@@ -3192,6 +3233,66 @@ bool IndexThread::addMissingHashes(std::vector<SFileAndHash>* dbfiles, std::vect
 	return calculated_hash;
 }
 
+bool IndexThread::getCachedHash(SFileAndHash& fsfile)
+{
+	if (index_hash_cache_vol.empty()
+		|| fsfile.inode == 0)
+	{
+		return false;
+	}
+
+	ClientDAO::SHashCacheEntry cache_entry = cd->getHashCacheEntry(index_hash_cache_vol, static_cast<int64>(fsfile.inode),
+		fsfile.size, fsfile.last_modified, fsfile.created, static_cast<int64>(fsfile.change_indicator), sha_version);
+
+	if (!cache_entry.exists
+		|| cache_entry.hash.empty())
+	{
+		return false;
+	}
+
+	fsfile.hash = cache_entry.hash;
+
+	if (Server->getTimeSeconds() - cache_entry.last_used > hash_cache_touch_interval)
+	{
+		//Re-adding the entry updates its last use time
+		addCachedHash(fsfile);
+	}
+
+	return true;
+}
+
+void IndexThread::addCachedHash(const SFileAndHash& fsfile)
+{
+	uint64 inode = hashCacheInode(fsfile);
+	if (inode == 0
+		|| fsfile.hash.empty())
+	{
+		return;
+	}
+
+	hash_cache_buffer.push_back(SHashCacheItem(index_hash_cache_vol, static_cast<int64>(inode), fsfile.size,
+		fsfile.last_modified, fsfile.created, static_cast<int64>(fsfile.change_indicator), fsfile.hash));
+
+	if (hash_cache_buffer.size() > max_hash_cache_buffer_items)
+	{
+		commitAddFilesBuffer();
+	}
+}
+
+uint64 IndexThread::hashCacheInode(const SFileAndHash& fsfile)
+{
+	//Only cache files which were not modified shortly before indexing started.
+	//Otherwise a modification within the same second (timestamps have second
+	//granularity) would not be noticed. On Linux created is the ctime
+	if (index_hash_cache_vol.empty()
+		|| (std::max)(fsfile.last_modified, fsfile.created) > index_hash_cache_time - hash_cache_min_age)
+	{
+		return 0;
+	}
+
+	return fsfile.inode;
+}
+
 bool IndexThread::hasHash(const std::vector<SFileAndHash>& fsfiles)
 {
 	for (size_t i = 0; i < fsfiles.size(); ++i)
@@ -3213,7 +3314,7 @@ bool IndexThread::hasDirectory(const std::vector<SFileAndHash>& fsfiles)
 }
 
 std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_path, std::string path, const std::string& named_path,
-	bool use_db, const std::string& fn_filter, bool use_db_hashes, const std::vector<std::string>& exclude_dirs,
+	bool use_db, const std::string& fn_filter, bool use_db_hashes, const GlobMatcher& exclude_dirs,
 	const std::vector<SIndexInclude>& include_dirs, int64& target_generation)
 {
 	target_generation = 0;
@@ -3314,6 +3415,9 @@ std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_pat
 					{
 						VSSLog("File is open: " + fs_files[i].name, LL_DEBUG);
 
+						//Timestamps of open files may not be up to date
+						fs_files[i].inode = 0;
+
 						if (fs_files[i].change_indicator == 0)
 							fs_files[i].change_indicator += Server->getRandomNumber();
 
@@ -3340,7 +3444,7 @@ std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_pat
 
 
 		if(calculate_filehashes_on_client
-			&& (phash_queue==nullptr || has_files) )
+			&& (phash_queue==nullptr || has_files || !index_hash_cache_vol.empty()) )
 		{
 			addMissingHashes(has_files ? &db_files : nullptr, &fs_files, orig_path,
 				path, named_path, exclude_dirs, include_dirs, phash_queue==nullptr);
@@ -3427,10 +3531,10 @@ std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_pat
 			}
 
 			if(calculate_filehashes_on_client
-				&& phash_queue==NULL)
+				&& (phash_queue==NULL || !index_hash_cache_vol.empty()) )
 			{
 				addMissingHashes(NULL, &fs_files, orig_path, path, named_path,
-					exclude_dirs, include_dirs, true);
+					exclude_dirs, include_dirs, phash_queue==NULL);
 			}
 
 			addFilesInt(path_lower, get_db_tgroup(), fs_files);
@@ -4578,6 +4682,35 @@ bool IndexThread::isExcluded(const std::vector<std::string>& exclude_dirs, const
 	return false;
 }
 
+bool IndexThread::isExcluded(const GlobMatcher& exclude_dirs, const std::string &path)
+{
+	if (!exclude_dirs.empty())
+	{
+#ifdef _WIN32
+		std::string wpath = path;
+		strupper(&wpath);
+		bool b = exclude_dirs.match(wpath);
+#else
+		bool b = exclude_dirs.match(path);
+#endif
+		if (b)
+		{
+#ifdef __APPLE__
+			logMacOSExclude(path);
+#endif
+			return true;
+		}
+	}
+#ifdef __APPLE__
+	if (isExcludedByXattr(path))
+	{
+		logIsExcludedByXattr(path);
+		return true;
+	}
+#endif
+	return false;
+}
+
 std::vector<std::string> IndexThread::getRmExcludedByPatterns(std::vector<std::string>& exclude_dirs, const std::string & path)
 {
 	std::string wpath = path;
@@ -4867,9 +5000,16 @@ void IndexThread::commitAddFilesBuffer()
 		cd->addFiles(add_file_buffer[i].path, add_file_buffer[i].tgroup, add_file_buffer[i].files,
 			add_file_buffer[i].target_generation);
 	}
+	for (size_t i = 0; i < hash_cache_buffer.size(); ++i)
+	{
+		cd->addHashCacheEntry(hash_cache_buffer[i].vol, hash_cache_buffer[i].inode, hash_cache_buffer[i].size,
+			hash_cache_buffer[i].mtime, hash_cache_buffer[i].ctime, hash_cache_buffer[i].change_indicator,
+			sha_version, hash_cache_buffer[i].hash);
+	}
 	db->EndTransaction();
 
 	add_file_buffer.clear();
+	hash_cache_buffer.clear();
 	add_file_buffer_size=0;
 	last_file_buffer_commit_time=Server->getTimeMS();
 }
@@ -8503,7 +8643,7 @@ void IndexThread::setFlags( unsigned int flags )
 
 bool IndexThread::getAbsSymlinkTarget( const std::string& symlink, const std::string& orig_path,
 	std::string& target, std::string& output_target,
-	const std::vector<std::string>& exclude_dirs,
+	const GlobMatcher& exclude_dirs,
 	const std::vector<SIndexInclude>& include_dirs)
 {
 	if (target.empty())
@@ -8791,7 +8931,7 @@ void IndexThread::filterEncryptedFiles(const std::string & dir, const std::strin
 	}
 }
 
-std::vector<SFileAndHash> IndexThread::convertToFileAndHash( const std::string& orig_dir, const std::string& named_path, const std::vector<std::string>& exclude_dirs,
+std::vector<SFileAndHash> IndexThread::convertToFileAndHash( const std::string& orig_dir, const std::string& named_path, const GlobMatcher& exclude_dirs,
 	const std::vector<SIndexInclude>& include_dirs, const std::vector<SFile> files, const std::string& fn_filter)
 {
 	std::vector<SFileAndHash> ret;
@@ -8828,6 +8968,9 @@ std::vector<SFileAndHash> IndexThread::convertToFileAndHash( const std::string&
 		curr->issym=files[i].issym;
 		curr->isspecialf=files[i].isspecialf;
 		curr->nlinks = files[i].nlinks;
+		curr->inode = files[i].inode;
+		curr->last_modified = files[i].last_modified;
+		curr->created = files[i].created;
 
 		if(curr->issym && with_proper_symlinks
 			&& !skipFile(orig_dir + os_file_sep() + files[i].name, named_path + os_file_sep() + files[i].name,
@@ -8848,7 +8991,7 @@ std::vector<SFileAndHash> IndexThread::convertToFileAndHash( const std::string&
 	return ret;
 }
 
-void IndexThread::handleSymlinks(const std::string& orig_dir, std::string named_path, const std::vector<std::string>& exclude_dirs,
+void IndexThread::handleSymlinks(const std::string& orig_dir, std::string named_path, const GlobMatcher& exclude_dirs,
 	const std::vector<SIndexInclude>& include_dirs, std::vector<SFileAndHash>& files)
 {
 	for (size_t i = 0; i < files.size(); ++i)
@@ -7,6 +7,7 @@
 #include "../Interface/ThreadPool.h"
 #include "../urbackupcommon/os_functions.h"
 #include "../urbackupcommon/filelist_utils.h"
+#include "../urbackupcommon/glob.h"
 #include "clientdao.h"
 #include <map>
 #include "tokens.h"
@@ -389,6 +390,7 @@ public:
 	static std::vector<SIndexInclude> parseIncludePatterns(const std::string& val);
 
 	static bool isExcluded(const std::vector<std::string>& exclude_dirs, const std::string &path);
+	static bool isExcluded(const GlobMatcher& exclude_dirs, const std::string &path);
 	static std::vector<std::string> getRmExcludedByPatterns(std::vector<std::string>& exclude_dirs, const std::string &path);
 	static bool isIncluded(const std::vector<SIndexInclude>& include_dirs, const std::string &path, bool *adding_worthless);
 
@@ -433,16 +435,16 @@ private:
 
 	bool getAbsSymlinkTarget(const std::string& symlink, const std::string& orig_path, 
 		std::string& target, std::string& output_target,
-		const std::vector<std::string>& exclude_dirs,
+		const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs);
 	void addSymlinkBackupDir(const std::string& target, std::string& output_target);
 	bool backupNameInUse(const std::string& name);
 	void removeUnconfirmedSymlinkDirs(size_t off);
 
 	void filterEncryptedFiles(const std::string& dir, const std::string& orig_dir, std::vector<SFile>& files);
-	std::vector<SFileAndHash> convertToFileAndHash(const std::string& orig_dir, const std::string& named_path, const std::vector<std::string>& exclude_dirs,
+	std::vector<SFileAndHash> convertToFileAndHash(const std::string& orig_dir, const std::string& named_path, const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs, const std::vector<SFile> files, const std::string& fn_filter);
-	void handleSymlinks(const std::string& orig_dir, std::string named_path, const std::vector<std::string>& exclude_dirs,
+	void handleSymlinks(const std::string& orig_dir, std::string named_path, const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs, std::vector<SFileAndHash>& files);
 
 	int64 randomChangeIndicator();
@@ -466,7 +468,7 @@ private:
 	static std::string sanitizePattern(const std::string &p);	
 
 	std::vector<SFileAndHash> getFilesProxy(const std::string &orig_path, std::string path, const std::string& named_path, bool use_db, const std::string& fn_filter, bool use_db_hashes,
-		const std::vector<std::string>& exclude_dirs,
+		const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs, int64& target_generation);
 
 	bool start_shadowcopy(SCDirs *dir, bool *onlyref=NULL, bool allow_restart=false, bool simultaneous_other=true, std::vector<SCRef*> no_restart_refs=std::vector<SCRef*>(),
@@ -528,13 +530,19 @@ private:
 	void start_filesrv(void);
 
 	bool skipFile(const std::string& filepath, const std::string& namedpath,
-		const std::vector<std::string>& exclude_dirs,
+		const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs);
 
 	bool addMissingHashes(std::vector<SFileAndHash>* dbfiles, std::vector<SFileAndHash>* fsfiles, const std::string &orig_path,
-		const std::string& filepath, const std::string& namedpath, const std::vector<std::string>& exclude_dirs,
+		const std::string& filepath, const std::string& namedpath, const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs, bool calc_hashes);
 
+	bool getCachedHash(SFileAndHash& fsfile);
+
+	void addCachedHash(const SFileAndHash& fsfile);
+
+	uint64 hashCacheInode(const SFileAndHash& fsfile);
+
 	bool hasHash(const std::vector<SFileAndHash>& fsfiles);
 
 	bool hasDirectory(const std::vector<SFileAndHash>& fsfiles);
@@ -708,6 +716,10 @@ private:
 	int index_c_fs;
 	int index_c_db_update;
 
+	//Volume of the currently indexed backup dir. Empty if the hash cache is disabled
+	std::string index_hash_cache_vol;
+	int64 index_hash_cache_time;
+
 	static volatile bool stop_index;
 
 	std::vector<std::string> index_exclude_dirs;
@@ -735,6 +747,7 @@ private:
 	std::vector< SBufferItem > modify_file_buffer;
 	size_t modify_file_buffer_size;
 	std::vector< SBufferItem > add_file_buffer;
+	std::vector< SHashCacheItem > hash_cache_buffer;
 	size_t add_file_buffer_size;
 
 	int64 last_file_buffer_commit_time;
@@ -867,17 +880,17 @@ private:
 
 	bool initialCheck(std::vector<SRecurParams>& params_stack, size_t stack_idx, const std::string& volume, const std::string& vssvolume, std::string orig_dir, std::string dir, std::string named_path,
 		std::fstream &outfile, bool first, int flags, bool use_db, bool symlinked, size_t depth, bool dir_recurse, bool include_exclude_dirs,
-		const std::vector<std::string>& exclude_dirs,
+		const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs, const std::string& orig_path);
 
 	void initialCheckRecur1(std::vector<SRecurParams>& params_stack, SRecurParams& params, const size_t stack_idx, const std::string& volume, const std::string& vssvolume,
 		std::fstream &outfile, const int flags, const bool use_db, const bool dir_recurse, const bool include_exclude_dirs,
-		const std::vector<std::string>& exclude_dirs,
+		const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs, const std::string& orig_path);
 
 	void initialCheckRecur2(std::vector<SRecurParams>& params_stack, SRecurParams& params, const size_t stack_idx, const std::string& volume, const std::string& vssvolume,
 		std::fstream &outfile, const int flags, const bool use_db, const bool dir_recurse, const bool include_exclude_dirs,
-		const std::vector<std::string>& exclude_dirs,
+		const GlobMatcher& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs, const std::string& orig_path);
 
 	std::unique_ptr<SLastFileList> last_filelist;
@@ -40,6 +40,8 @@
 #include <ws2tcpip.h>
 #endif
 #include "../urbackupcommon/mbrdata.h"
+#include "../urbackupcommon/image_restore_stream.h"
+#include "ImageRestoreWriter.h"
 #include "../fileservplugin/settings.h"
 #include "../fileservplugin/packet_ids.h"
 #include <memory>
@@ -531,6 +533,129 @@ namespace restore
 		return errrc;
 	}
 
+	EDownloadResult downloadImageExtents(std::unique_ptr<IPipe>& client_pipe, std::unique_ptr<IFile>& out_file, _i64 imgsize,
+		int img_id, std::string img_time, std::string outfile, LoginData login_data, DownloadStatus& dl_status, int recur_depth,
+		int64* o_imgsize, int64* o_output_file_size)
+	{
+		std::unique_ptr<IFile> direct_file;
+#ifdef __linux__
+		if (imgsize % 4096 == 0
+			&& Server->getServerParameter("restore_direct_io") != "false")
+		{
+			direct_file.reset(Server->openFile(outfile, MODE_RW_DIRECT));
+		}
+#endif
+		size_t n_threads = (std::max)(1, watoi(Server->getServerParameter("restore_write_threads", "4")));
+
+		EDownloadResult rc = EDownloadResult_Ok;
+		bool retry = false;
+		bool has_data = false;
+		{
+			ImageRestoreWriter writer(direct_file.get() != nullptr ? direct_file.get() : out_file.get(),
+				n_threads, direct_file.get() != nullptr);
+			image_restore::ExtentStreamParser extent_parser;
+			std::vector<char> buf(32768);
+
+			while (rc == EDownloadResult_Ok
+				&& !retry
+				&& !extent_parser.isFinished())
+			{
+				size_t r = client_pipe->Read(buf.data(), buf.size(), 180000);
+				if (r == 0)
+				{
+					retry = true;
+					break;
+				}
+
+				size_t off = 0;
+				while (off < r)
+				{
+					off += extent_parser.add(&buf[off], r - off);
+					if (extent_parser.hasExtent())
+					{
+						if (!restore_retry_ok)
+						{
+							restore_retry_ok = true;
+						}
+
+						if (extent_parser.getLen() > 0)
+						{
+							if (extent_parser.getPos() + extent_parser.getLen() > imgsize)
+							{
+								Server->Log("Invalid extent position: " + convert(extent_parser.getPos()), LL_ERROR);
+								rc = EDownloadResult_WriteFailed;
+								break;
+							}
+
+							if (!writer.addExtent(extent_parser.getPos(), extent_parser.getData(),
+								extent_parser.getLen(), extent_parser.getCompLen()))
+							{
+								rc = EDownloadResult_WriteFailed;
+								break;
+							}
+
+							dl_status.received += extent_parser.getLen();
+						}
+
+						extent_parser.nextExtent();
+					}
+					else if (extent_parser.isFinished())
+					{
+						Server->Log("Restore finished", LL_INFO);
+						break;
+					}
+					else if (extent_parser.hasError())
+					{
+						Server->Log("Invalid extent in image restore stream", LL_ERROR);
+						retry = true;
+						break;
+					}
+				}
+
+				int64 written_pos = writer.getWrittenPos();
+				if (written_pos > dl_status.offset)
+				{
+					dl_status.offset = written_pos;
+					has_data = true;
+				}
+			}
+
+			if (!writer.finish())
+			{
+				Server->Log("Writing to output file failed", LL_ERROR);
+				rc = EDownloadResult_WriteFailed;
+			}
+
+			int64 written_pos = writer.getWrittenPos();
+			if (written_pos > dl_status.offset)
+			{
+				dl_status.offset = written_pos;
+				has_data = true;
+			}
+		}
+
+		if (rc == EDownloadResult_Ok
+			&& retry)
+		{
+			Server->Log("Read Timeout: Retrying", LL_WARNING);
+			client_pipe.reset(nullptr);
+			direct_file.reset(nullptr);
+			out_file.reset(nullptr);
+			if (has_data)
+			{
+				return retryDownload(EDownloadResult_TimeoutError2, img_id, img_time,
+					outfile, false, login_data, dl_status, recur_depth, o_imgsize, o_output_file_size);
+			}
+			else
+			{
+				Server->Log("Read Timeout: No data", LL_ERROR);
+				return EDownloadResult_TimeoutError2;
+			}
+		}
+
+		return rc;
+	}
+
 	EDownloadResult downloadImage(int img_id, std::string img_time, std::string outfile, bool mbr, LoginData login_data,
 		DownloadStatus& dl_status, int recur_depth, int64* o_imgsize, int64* o_output_file_size)
 	{
@@ -562,6 +687,14 @@ namespace restore
 			dl_args = "&token=" + EscapeParamString(login_data.token);
 		}
 
+		if (!mbr)
+		{
+			dl_args += "&extents=1";
+#ifndef NO_ZSTD_COMPRESSION
+			dl_args += "&compress=zstd";
+#endif
+		}
+
 		tcpstack.Send(client_pipe.get(), "DOWNLOAD IMAGE#pw=" + pw + dl_args + "&mbr=" + convert(mbr) + s_offset);
 
 		std::string restore_out = outfile;
@@ -604,6 +737,22 @@ namespace restore
 			return EDownloadResult_DeviceTooSmall;
 		}
 
+		if (!mbr)
+		{
+			int64 stream_format = -1;
+			if (client_pipe->Read((char*)&stream_format, sizeof(stream_format), 60000) != sizeof(stream_format))
+			{
+				Server->Log("Error reading image stream format", LL_ERROR);
+				return EDownloadResult_SizeReadError;
+			}
+
+			if (stream_format == image_restore::stream_format_extents)
+			{
+				return downloadImageExtents(client_pipe, out_file, imgsize, img_id, img_time, outfile,
+					login_data, dl_status, recur_depth, o_imgsize, o_output_file_size);
+			}
+		}
+
 		const size_t c_buffer_size = 32768;
 		const unsigned int c_block_size = 4096;
 
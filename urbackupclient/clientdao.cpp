@@ -114,6 +114,9 @@ void ClientDAO::prepareQueriesGen(void)
 	q_getClientFacetByName=nullptr;
 	q_addClientFacet=nullptr;
 	q_updateClientFacet=nullptr;
+	q_getHashCacheEntry=nullptr;
+	q_addHashCacheEntry=nullptr;
+	q_pruneHashCache=nullptr;
 }
 
 //@-SQLGenDestruction
@@ -138,6 +141,9 @@ void ClientDAO::destroyQueriesGen(void)
 	db->destroyQuery(q_getClientFacetByName);
 	db->destroyQuery(q_addClientFacet);
 	db->destroyQuery(q_updateClientFacet);
+	db->destroyQuery(q_getHashCacheEntry);
+	db->destroyQuery(q_addHashCacheEntry);
+	db->destroyQuery(q_pruneHashCache);
 }
 
 void ClientDAO::restartQueries(void)
@@ -1078,6 +1084,84 @@ void ClientDAO::updateClientFacet(const std::string& server_identity, int id)
 	q_updateClientFacet->Reset();
 }
 
+/**
+* @-SQLGenAccess
+* @func SHashCacheEntry ClientDAO::getHashCacheEntry
+* @return blob hash, int64 last_used
+* @sql
+*    SELECT hash, last_used FROM hash_cache WHERE vol=:vol(string) AND inode=:inode(int64)
+*       AND sha_version=:sha_version(int) AND size=:size(int64) AND mtime=:mtime(int64) AND ctime=:ctime(int64)
+*       AND change_indicator=:change_indicator(int64)
+**/
+ClientDAO::SHashCacheEntry ClientDAO::getHashCacheEntry(const std::string& vol, int64 inode, int64 size, int64 mtime, int64 ctime, int64 change_indicator, int sha_version)
+{
+	if(q_getHashCacheEntry==nullptr)
+	{
+		q_getHashCacheEntry=db->Prepare("SELECT hash, last_used FROM hash_cache WHERE vol=? AND inode=? AND sha_version=? AND size=? AND mtime=? AND ctime=? AND change_indicator=?", false);
+	}
+	q_getHashCacheEntry->Bind(vol);
+	q_getHashCacheEntry->Bind(inode);
+	q_getHashCacheEntry->Bind(sha_version);
+	q_getHashCacheEntry->Bind(size);
+	q_getHashCacheEntry->Bind(mtime);
+	q_getHashCacheEntry->Bind(ctime);
+	q_getHashCacheEntry->Bind(change_indicator);
+	db_results res=q_getHashCacheEntry->Read();
+	q_getHashCacheEntry->Reset();
+	SHashCacheEntry ret = { false, "", 0 };
+	if(!res.empty())
+	{
+		ret.exists=true;
+		ret.hash=res[0]["hash"];
+		ret.last_used=watoi64(res[0]["last_used"]);
+	}
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func void ClientDAO::addHashCacheEntry
+* @sql
+*    INSERT OR REPLACE INTO hash_cache (vol, inode, size, mtime, ctime, change_indicator, sha_version, hash, last_used)
+*     VALUES (:vol(string), :inode(int64), :size(int64), :mtime(int64), :ctime(int64), :change_indicator(int64), :sha_version(int), :hash(blob), strftime('%s', 'now'))
+**/
+void ClientDAO::addHashCacheEntry(const std::string& vol, int64 inode, int64 size, int64 mtime, int64 ctime, int64 change_indicator, int sha_version, const std::string& hash)
+{
+	if(q_addHashCacheEntry==nullptr)
+	{
+		q_addHashCacheEntry=db->Prepare("INSERT OR REPLACE INTO hash_cache (vol, inode, size, mtime, ctime, change_indicator, sha_version, hash, last_used) VALUES (?, ?, ?, ?, ?, ?, ?, ?, strftime('%s', 'now'))", false);
+	}
+	q_addHashCacheEntry->Bind(vol);
+	q_addHashCacheEntry->Bind(inode);
+	q_addHashCacheEntry->Bind(size);
+	q_addHashCacheEntry->Bind(mtime);
+	q_addHashCacheEntry->Bind(ctime);
+	q_addHashCacheEntry->Bind(change_indicator);
+	q_addHashCacheEntry->Bind(sha_version);
+	q_addHashCacheEntry->Bind(hash.c_str(), (_u32)hash.size());
+	q_addHashCacheEntry->Write();
+	q_addHashCacheEntry->Reset();
+}
+
+/**
+* @-SQLGenAccess
+* @func void ClientDAO::pruneHashCache
+* @sql
+*    DELETE FROM hash_cache WHERE rowid IN
+*     (SELECT rowid FROM hash_cache ORDER BY last_used ASC
+*       LIMIT max(0, (SELECT COUNT(*) FROM hash_cache) - :max_entries(int64)) )
+**/
+void ClientDAO::pruneHashCache(int64 max_entries)
+{
+	if(q_pruneHashCache==nullptr)
+	{
+		q_pruneHashCache=db->Prepare("DELETE FROM hash_cache WHERE rowid IN (SELECT rowid FROM hash_cache ORDER BY last_used ASC LIMIT max(0, (SELECT COUNT(*) FROM hash_cache) - ?) )", false);
+	}
+	q_pruneHashCache->Bind(max_entries);
+	q_pruneHashCache->Write();
+	q_pruneHashCache->Reset();
+}
+
 //-------------------
 
 std::vector<std::pair<int, std::string> > getFlagStrMapping()
@@ -88,6 +88,13 @@ struct SShadowCopy
 
 struct SFileAndHash
 {
+	SFileAndHash()
+		: size(0), change_indicator(0), isdir(false),
+		issym(false), isspecialf(false), nlinks(0),
+		inode(0), last_modified(0), created(0)
+	{
+	}
+
 	std::string name;
 	int64 size;
 	uint64 change_indicator;
@@ -97,6 +104,11 @@ struct SFileAndHash
 	bool isspecialf;
 	size_t nlinks;
 
+	//Only set for files from the file system. Key of the hash cache
+	uint64 inode;
+	int64 last_modified;
+	int64 created;
+
 	std::string symlink_target;
 
 	std::string output_symlink_target;
@@ -119,6 +131,21 @@ struct SFileAndHash
 	}
 };
 
+struct SHashCacheItem
+{
+	SHashCacheItem(const std::string& vol, int64 inode, int64 size, int64 mtime, int64 ctime, int64 change_indicator, const std::string& hash)
+		: vol(vol), inode(inode), size(size), mtime(mtime), ctime(ctime), change_indicator(change_indicator), hash(hash)
+	{}
+
+	std::string vol;
+	int64 inode;
+	int64 size;
+	int64 mtime;
+	int64 ctime;
+	int64 change_indicator;
+	std::string hash;
+};
+
 class ClientDAO
 {
 public:
@@ -190,6 +217,12 @@ public:
 		std::string name;
 		std::string server_identity;
 	};
+	struct SHashCacheEntry
+	{
+		bool exists;
+		std::string hash;
+		int64 last_used;
+	};
 	struct SToken
 	{
 		int64 id;
@@ -218,6 +251,9 @@ public:
 	SClientFacet getClientFacetByName(const std::string& name);
 	void addClientFacet(const std::string& name, const std::string& server_identity);
 	void updateClientFacet(const std::string& server_identity, int id);
+	SHashCacheEntry getHashCacheEntry(const std::string& vol, int64 inode, int64 size, int64 mtime, int64 ctime, int64 change_indicator, int sha_version);
+	void addHashCacheEntry(const std::string& vol, int64 inode, int64 size, int64 mtime, int64 ctime, int64 change_indicator, int sha_version, const std::string& hash);
+	void pruneHashCache(int64 max_entries);
 	//@-SQLGenFunctionsEnd
 
 	static std::string escapeGlob(const std::string& input);
@@ -271,6 +307,9 @@ private:
 	IQuery* q_getClientFacetByName;
 	IQuery* q_addClientFacet;
 	IQuery* q_updateClientFacet;
+	IQuery* q_getHashCacheEntry;
+	IQuery* q_addHashCacheEntry;
+	IQuery* q_pruneHashCache;
 	//@-SQLGenVariablesEnd
 
 	bool with_files_tmp;
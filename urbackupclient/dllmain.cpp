@@ -242,6 +242,64 @@ namespace
 
 		exit(0);
 	}
+
+	//Replays a recorded path list (one path per line) against the exclude patterns
+	//with the pattern list and with the compiled matcher
+	void do_glob_benchmark(const std::string& fn)
+	{
+		std::vector<std::string> paths;
+		Tokenize(getFile(fn), paths, "\n");
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			if (!paths[i].empty() && paths[i][paths[i].size() - 1] == '\r')
+			{
+				paths[i].erase(paths[i].size() - 1);
+			}
+		}
+
+		std::vector<std::string> exclude_dirs = IndexThread::buildExcludeList(Server->getServerParameter("glob_benchmark_patterns"));
+		int rounds = (std::max)(1, watoi(Server->getServerParameter("glob_benchmark_rounds", "10")));
+
+		int64 starttime = Server->getTimeMS();
+		GlobMatcher exclude_matcher(exclude_dirs);
+		int64 compile_time = Server->getTimeMS() - starttime;
+
+		size_t list_excluded = 0;
+		starttime = Server->getTimeMS();
+		for (int r = 0; r < rounds; ++r)
+		{
+			for (size_t i = 0; i < paths.size(); ++i)
+			{
+				if (IndexThread::isExcluded(exclude_dirs, paths[i]))
+					++list_excluded;
+			}
+		}
+		int64 list_time = Server->getTimeMS() - starttime;
+
+		size_t matcher_excluded = 0;
+		starttime = Server->getTimeMS();
+		for (int r = 0; r < rounds; ++r)
+		{
+			for (size_t i = 0; i < paths.size(); ++i)
+			{
+				if (IndexThread::isExcluded(exclude_matcher, paths[i]))
+					++matcher_excluded;
+			}
+		}
+		int64 matcher_time = Server->getTimeMS() - starttime;
+
+		std::cout << paths.size() << " paths, " << exclude_dirs.size() << " patterns, " << rounds << " rounds" << std::endl;
+		std::cout << "Pattern list: " << list_time << "ms, " << list_excluded / rounds << " excluded" << std::endl;
+		std::cout << "Compiled matcher: " << matcher_time << "ms (compile " << compile_time << "ms), " << matcher_excluded / rounds << " excluded" << std::endl;
+
+		if (list_excluded != matcher_excluded)
+		{
+			std::cerr << "ERROR: Compiled matcher excluded different paths" << std::endl;
+			exit(1);
+		}
+
+		exit(0);
+	}
 }
 
 
@@ -275,6 +333,13 @@ DLLEXPORT void LoadActions(IServer* pServer)
 		return;
 	}
 
+	std::string glob_benchmark = Server->getServerParameter("glob_benchmark");
+	if (!glob_benchmark.empty())
+	{
+		do_glob_benchmark(glob_benchmark);
+		return;
+	}
+
 	std::string print_dm_file_extents = Server->getServerParameter("print-dm-file-extents");
 	if (!print_dm_file_extents.empty())
 	{
@@ -863,6 +928,12 @@ void update_client28_29(IDatabase* db)
 	ClientConnector::updateDefaultDirsSetting(db, true, 0, false, static_cast<int>(fid));
 }
 
+void update_client29_30(IDatabase* db)
+{
+	db->Write("CREATE TABLE hash_cache (vol TEXT, inode INTEGER, size INTEGER, mtime INTEGER, ctime INTEGER, change_indicator INTEGER, sha_version INTEGER, hash BLOB, last_used INTEGER, PRIMARY KEY(vol, inode, sha_version))");
+	db->Write("CREATE INDEX IF NOT EXISTS hash_cache_last_used_idx ON hash_cache( last_used ASC )");
+}
+
 bool upgrade_client(void)
 {
 	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_CLIENT);
@@ -874,7 +945,7 @@ bool upgrade_client(void)
 		return false;
 	int ver=watoi(res_v[0]["tvalue"]);
 	int old_v;
-	int max_v = 29;
+	int max_v = 30;
 
 	if (ver > max_v)
 	{
@@ -1010,6 +1081,10 @@ bool upgrade_client(void)
 				update_client28_29(db);
 				++ver;
 				break;
+			case 29:
+				update_client29_30(db);
+				++ver;
+				break;
 			default:
 				break;
 		}
@@ -305,6 +305,11 @@ bool CompressedPipe::isReadable(int timeoutms)
 		return cs->isReadable(timeoutms);
 }
 
+int CompressedPipe::getPollFd()
+{
+	return cs->getPollFd();
+}
+
 bool CompressedPipe::hasError(void)
 {
 	return cs->hasError() || has_error;
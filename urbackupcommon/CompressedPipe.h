@@ -31,6 +31,7 @@ public:
 	*/
 	virtual bool isWritable(int timeoutms=0);
 	virtual bool isReadable(int timeoutms=0);
+	virtual int getPollFd();
 
 	virtual bool hasError(void);
 
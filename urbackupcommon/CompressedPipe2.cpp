@@ -438,6 +438,11 @@ bool CompressedPipe2::isReadable(int timeoutms)
 		return cs->isReadable(timeoutms);
 }
 
+int CompressedPipe2::getPollFd()
+{
+	return cs->getPollFd();
+}
+
 bool CompressedPipe2::hasError(void)
 {
 	return cs->hasError() || has_error;
@@ -464,6 +464,11 @@ bool CompressedPipeZstd::isReadable(int timeoutms)
 		return cs->isReadable(timeoutms);
 }
 
+int CompressedPipeZstd::getPollFd()
+{
+	return cs->getPollFd();
+}
+
 bool CompressedPipeZstd::hasError(void)
 {
 	return cs->hasError() || has_error;
@@ -136,6 +136,11 @@ bool InternetServicePipe::isReadable(int timeoutms)
 	return cs->isReadable(timeoutms);
 }
 
+int InternetServicePipe::getPollFd()
+{
+	return cs->getPollFd();
+}
+
 bool InternetServicePipe::hasError(void)
 {
 	return cs->hasError();
@@ -232,6 +232,11 @@ bool InternetServicePipe2::isReadable( int timeoutms/*=0 */ )
 	return cs->isReadable(timeoutms);
 }
 
+int InternetServicePipe2::getPollFd()
+{
+	return cs->getPollFd();
+}
+
 bool InternetServicePipe2::hasError( void )
 {
 	return cs->hasError() || has_error;
@@ -46,6 +46,13 @@ bool parse_backup_url(const std::string& url, const std::string& url_params,
 		settings.cache_img_path = "urbackup/" + cacheid + ".vhdx";
 		settings.s3_settings.cache_db_path = "urbackup/" + cacheid + ".db";
 
+		str_map params;
+		ParseParamStrHttp(url_params, &params);
+
+		auto content_dedup_it = params.find("content_dedup");
+		if (content_dedup_it != params.end())
+			settings.content_dedup = content_dedup_it->second == "1";
+
 		return true;
 	}
 
@@ -35,6 +35,9 @@
  * Initial revision
  */
 
+#include "glob.h"
+#include <algorithm>
+
 #ifndef NEGATE
 #define NEGATE	'^'			/* std cset negation char */
 #endif
@@ -227,4 +230,274 @@ bool test_amatch(void)
 		return false;
 
 	return true;
-}
\ No newline at end of file
+}
+
+namespace
+{
+	bool is_glob_special(char ch)
+	{
+		return ch == '*' || ch == ':' || ch == '?' || ch == '[';
+	}
+
+	//Returns the literal characters of the pattern starting at pos with
+	//escapes resolved. Stops at the first wildcard
+	std::string glob_literal(const std::string& p, size_t& pos)
+	{
+		std::string ret;
+		while (pos < p.size() && !is_glob_special(p[pos]))
+		{
+			if (p[pos] == '\\' && pos + 1 < p.size())
+				++pos;
+			ret += p[pos];
+			++pos;
+		}
+		return ret;
+	}
+
+	size_t skip_stars(const std::string& p, size_t pos)
+	{
+		while (pos < p.size() && p[pos] == '*')
+			++pos;
+		return pos;
+	}
+}
+
+GlobMatcher::GlobMatcher()
+	: match_all(false)
+{
+	compile(std::vector<std::string>());
+}
+
+GlobMatcher::GlobMatcher(const std::vector<std::string>& patterns)
+	: match_all(false)
+{
+	compile(patterns);
+}
+
+void GlobMatcher::compile(const std::vector<std::string>& p_patterns)
+{
+	patterns = p_patterns;
+	prefix_trie.assign(1, STrieNode());
+	suffix_trie.assign(1, STrieNode());
+	contains_trie.assign(1, STrieNode());
+	generic_patterns.clear();
+	match_all = false;
+
+	for (size_t i = 0; i < patterns.size(); ++i)
+	{
+		const std::string& p = patterns[i];
+		if (p.empty())
+			continue;
+
+		size_t pos = 0;
+		std::string lead = glob_literal(p, pos);
+
+		if (pos == p.size())
+		{
+			//Literal
+			prefix_trie[addToTrie(prefix_trie, lead)].terminal = true;
+			continue;
+		}
+
+		size_t stars_end = skip_stars(p, pos);
+		if (stars_end > pos)
+		{
+			if (!lead.empty()
+				&& stars_end == p.size())
+			{
+				//lit*
+				prefix_trie[addToTrie(prefix_trie, lead)].out = true;
+				continue;
+			}
+			else if (lead.empty())
+			{
+				if (stars_end == p.size())
+				{
+					match_all = true;
+					continue;
+				}
+
+				size_t lit_end = stars_end;
+				std::string lit = glob_literal(p, lit_end);
+				if (!lit.empty())
+				{
+					if (lit_end == p.size())
+					{
+						//*lit
+						suffix_trie[addToTrie(suffix_trie, std::string(lit.rbegin(), lit.rend()))].terminal = true;
+						continue;
+					}
+					else if (skip_stars(p, lit_end) == p.size())
+					{
+						//*lit*
+						contains_trie[addToTrie(contains_trie, lit)].terminal = true;
+						continue;
+					}
+				}
+			}
+		}
+
+		SGenericPattern generic;
+		generic.prefix = lead;
+		generic.pattern = p;
+		generic_patterns.push_back(generic);
+	}
+
+	buildContainsAutomaton();
+}
+
+bool GlobMatcher::match(const std::string& str) const
+{
+	if (match_all)
+		return true;
+
+	if (matchPrefix(str)
+		|| matchSuffix(str)
+		|| matchContains(str))
+	{
+		return true;
+	}
+
+	for (size_t i = 0; i < generic_patterns.size(); ++i)
+	{
+		const SGenericPattern& generic = generic_patterns[i];
+		if (str.compare(0, generic.prefix.size(), generic.prefix) == 0
+			&& amatch(str.c_str(), generic.pattern.c_str()))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool GlobMatcher::empty() const
+{
+	return !match_all
+		&& prefix_trie.size() == 1
+		&& suffix_trie.size() == 1
+		&& contains_trie.size() == 1
+		&& generic_patterns.empty();
+}
+
+const std::vector<std::string>& GlobMatcher::getPatterns() const
+{
+	return patterns;
+}
+
+size_t GlobMatcher::getChild(const std::vector<STrieNode>& trie, size_t node, unsigned char ch)
+{
+	const std::vector<std::pair<unsigned char, size_t> >& children = trie[node].children;
+	std::vector<std::pair<unsigned char, size_t> >::const_iterator it =
+		std::lower_bound(children.begin(), children.end(), std::make_pair(ch, static_cast<size_t>(0)));
+	if (it != children.end() && it->first == ch)
+	{
+		return it->second;
+	}
+	return 0;
+}
+
+size_t GlobMatcher::addToTrie(std::vector<STrieNode>& trie, const std::string& str)
+{
+	size_t node = 0;
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		unsigned char ch = static_cast<unsigned char>(str[i]);
+		size_t next = getChild(trie, node, ch);
+		if (next == 0)
+		{
+			next = trie.size();
+			trie.push_back(STrieNode());
+			std::vector<std::pair<unsigned char, size_t> >& children = trie[node].children;
+			children.insert(std::lower_bound(children.begin(), children.end(), std::make_pair(ch, static_cast<size_t>(0))),
+				std::make_pair(ch, next));
+		}
+		node = next;
+	}
+	return node;
+}
+
+void GlobMatcher::buildContainsAutomaton()
+{
+	std::vector<size_t> queue;
+	for (size_t i = 0; i < contains_trie[0].children.size(); ++i)
+	{
+		size_t child = contains_trie[0].children[i].second;
+		contains_trie[child].fail = 0;
+		contains_trie[child].out = contains_trie[child].terminal;
+		queue.push_back(child);
+	}
+
+	for (size_t q = 0; q < queue.size(); ++q)
+	{
+		size_t node = queue[q];
+		for (size_t i = 0; i < contains_trie[node].children.size(); ++i)
+		{
+			unsigned char ch = contains_trie[node].children[i].first;
+			size_t child = contains_trie[node].children[i].second;
+
+			size_t fail = contains_trie[node].fail;
+			while (fail != 0 && getChild(contains_trie, fail, ch) == 0)
+				fail = contains_trie[fail].fail;
+
+			fail = getChild(contains_trie, fail, ch);
+
+			contains_trie[child].fail = fail;
+			contains_trie[child].out = contains_trie[child].terminal || contains_trie[fail].out;
+			queue.push_back(child);
+		}
+	}
+}
+
+bool GlobMatcher::matchPrefix(const std::string& str) const
+{
+	size_t node = 0;
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		if (prefix_trie[node].out)
+			return true;
+
+		node = getChild(prefix_trie, node, static_cast<unsigned char>(str[i]));
+		if (node == 0)
+			return false;
+	}
+	return prefix_trie[node].out || prefix_trie[node].terminal;
+}
+
+bool GlobMatcher::matchSuffix(const std::string& str) const
+{
+	size_t node = 0;
+	for (size_t i = str.size(); i-- > 0;)
+	{
+		node = getChild(suffix_trie, node, static_cast<unsigned char>(str[i]));
+		if (node == 0)
+			return false;
+
+		if (suffix_trie[node].terminal)
+			return true;
+	}
+	return false;
+}
+
+bool GlobMatcher::matchContains(const std::string& str) const
+{
+	if (contains_trie.size() == 1)
+		return false;
+
+	size_t node = 0;
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		unsigned char ch = static_cast<unsigned char>(str[i]);
+		size_t next;
+		while ((next = getChild(contains_trie, node, ch)) == 0
+			&& node != 0)
+		{
+			node = contains_trie[node].fail;
+		}
+		node = next;
+
+		if (contains_trie[node].out)
+			return true;
+	}
+	return false;
+}
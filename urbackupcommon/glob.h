@@ -1,3 +1,68 @@
 #pragma once
 
-bool amatch(const char *str, const char *p);
\ No newline at end of file
+#include <string>
+#include <vector>
+
+bool amatch(const char *str, const char *p);
+
+/**
+* A set of amatch patterns compiled for matching many strings.
+* Literal patterns and patterns of the form "lit*", "*lit" and "*lit*"
+* are matched with tries in one pass over the string, independent of
+* the number of patterns. Other patterns fall back to amatch after
+* checking their literal prefix.
+*/
+class GlobMatcher
+{
+public:
+	GlobMatcher();
+	explicit GlobMatcher(const std::vector<std::string>& patterns);
+
+	void compile(const std::vector<std::string>& patterns);
+
+	//Returns true if any of the patterns matches str
+	bool match(const std::string& str) const;
+
+	bool empty() const;
+
+	const std::vector<std::string>& getPatterns() const;
+
+private:
+	struct STrieNode
+	{
+		STrieNode()
+			: fail(0), terminal(false), out(false)
+		{}
+
+		std::vector<std::pair<unsigned char, size_t> > children;
+		size_t fail;
+		bool terminal;
+		bool out;
+	};
+
+	static size_t getChild(const std::vector<STrieNode>& trie, size_t node, unsigned char ch);
+	static size_t addToTrie(std::vector<STrieNode>& trie, const std::string& str);
+	void buildContainsAutomaton();
+
+	bool matchPrefix(const std::string& str) const;
+	bool matchSuffix(const std::string& str) const;
+	bool matchContains(const std::string& str) const;
+
+	struct SGenericPattern
+	{
+		std::string prefix;
+		std::string pattern;
+	};
+
+	std::vector<std::string> patterns;
+
+	//Literal patterns are terminal nodes, "lit*" patterns are out nodes
+	std::vector<STrieNode> prefix_trie;
+	//Reversed "*lit" patterns
+	std::vector<STrieNode> suffix_trie;
+	//Aho-Corasick automaton of "*lit*" patterns
+	std::vector<STrieNode> contains_trie;
+
+	std::vector<SGenericPattern> generic_patterns;
+	bool match_all;
+};
\ No newline at end of file
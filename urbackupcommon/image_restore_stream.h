@@ -0,0 +1,143 @@
+#pragma once
+
+#include "../Interface/Types.h"
+#include "../stringtools.h"
+#include <vector>
+#include <string.h>
+#include <algorithm>
+
+/**
+* Image restore stream with extents (DOWNLOAD IMAGE with extents=1). Each
+* extent of used image data is sent as
+*   [int64 pos][_u32 len][_u32 comp_len][comp_len bytes]
+* with little endian integers. pos is relative to the start of the restored
+* volume and len is the size of the data at pos. If comp_len is smaller than
+* len the data is zstd compressed, otherwise it is sent as is. Extents with
+* len=0 are keep-alives. The stream ends with pos=stream_end.
+*/
+namespace image_restore
+{
+	const int64 stream_end = 0x7fffffffffffffffLL;
+
+	const _u32 max_extent_size = 1024 * 1024;
+
+	const size_t extent_header_size = sizeof(int64) + 2 * sizeof(_u32);
+
+	//Sent to the restore tool after the image size, if it asked for extents
+	const int64 stream_format_blocks = 0;
+	const int64 stream_format_extents = 1;
+
+	inline void writeExtentHeader(char* buf, int64 pos, _u32 len, _u32 comp_len)
+	{
+		pos = little_endian(pos);
+		len = little_endian(len);
+		comp_len = little_endian(comp_len);
+		memcpy(buf, &pos, sizeof(pos));
+		memcpy(buf + sizeof(pos), &len, sizeof(len));
+		memcpy(buf + sizeof(pos) + sizeof(len), &comp_len, sizeof(comp_len));
+	}
+
+	/**
+	* Collects the extents from the received data
+	*/
+	class ExtentStreamParser
+	{
+	public:
+		ExtentStreamParser()
+			: header_off(0), data_off(0), pos(0), len(0), comp_len(0),
+			has_extent(false), finished(false), has_error(false)
+		{}
+
+		//Returns the number of bytes used. Stops after a complete extent,
+		//which has to be taken with nextExtent() before adding more data
+		size_t add(const char* buf, size_t bsize)
+		{
+			size_t off = 0;
+			while (off < bsize
+				&& !has_extent
+				&& !finished
+				&& !has_error)
+			{
+				if (header_off < extent_header_size)
+				{
+					size_t tc = (std::min)(extent_header_size - header_off, bsize - off);
+					memcpy(header + header_off, buf + off, tc);
+					header_off += tc;
+					off += tc;
+
+					if (header_off == sizeof(int64))
+					{
+						memcpy(&pos, header, sizeof(pos));
+						pos = little_endian(pos);
+						if (pos == stream_end)
+						{
+							finished = true;
+						}
+					}
+					else if (header_off == extent_header_size)
+					{
+						memcpy(&len, header + sizeof(int64), sizeof(len));
+						memcpy(&comp_len, header + sizeof(int64) + sizeof(_u32), sizeof(comp_len));
+						len = little_endian(len);
+						comp_len = little_endian(comp_len);
+
+						if (len > max_extent_size
+							|| comp_len > len
+							|| pos < 0)
+						{
+							has_error = true;
+						}
+						else
+						{
+							data.resize(comp_len);
+							data_off = 0;
+							has_extent = comp_len == 0;
+						}
+					}
+				}
+				else
+				{
+					size_t tc = (std::min)(comp_len - data_off, bsize - off);
+					memcpy(data.data() + data_off, buf + off, tc);
+					data_off += tc;
+					off += tc;
+					has_extent = data_off == comp_len;
+				}
+			}
+			return off;
+		}
+
+		bool hasExtent() { return has_extent; }
+
+		bool isFinished() { return finished; }
+
+		bool hasError() { return has_error; }
+
+		int64 getPos() { return pos; }
+
+		_u32 getLen() { return len; }
+
+		_u32 getCompLen() { return comp_len; }
+
+		const char* getData() { return data.data(); }
+
+		void nextExtent()
+		{
+			has_extent = false;
+			header_off = 0;
+			data_off = 0;
+		}
+
+	private:
+		char header[extent_header_size];
+		size_t header_off;
+		std::vector<char> data;
+		size_t data_off;
+		int64 pos;
+		_u32 len;
+		_u32 comp_len;
+		bool has_extent;
+		bool finished;
+		bool has_error;
+	};
+}
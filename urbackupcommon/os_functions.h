@@ -15,7 +15,7 @@ struct SFile
 		usn(0), created(0), accessed(0),
 		isdir(false), issym(false),
 		isspecialf(false), isencrypted(false),
-		nlinks(0)
+		nlinks(0), inode(0)
 	{
 
 	}
@@ -31,6 +31,8 @@ struct SFile
 	bool isspecialf;
 	bool isencrypted;
 	size_t nlinks;
+	//Inode or (folded) file reference number. On Windows only set with with_usn
+	uint64 inode;
 
 	bool operator<(const SFile &other) const
 	{
@@ -125,6 +127,15 @@ bool copy_file(const std::string &src, const std::string &dst, bool flush = fals
 class IFile;
 bool copy_file(IFile *fsrc, IFile *fdst, std::string* error_str = NULL);
 
+//Shares the range [src_offset, src_offset+size) of fsrc with fdst at dst_offset
+//(FICLONERANGE). Offsets and size have to be file system block aligned, except
+//for a range that ends at the end of fsrc. size=0 clones until the end of fsrc
+bool os_clone_file_range(IFile* fsrc, int64 src_offset, IFile* fdst, int64 dst_offset, int64 size);
+
+//Clones the range if possible, otherwise copies it inside the kernel (copy_file_range).
+//Returns false if neither is supported for the two files
+bool os_copy_file_range(IFile* fsrc, int64 src_offset, IFile* fdst, int64 dst_offset, int64 size);
+
 bool os_path_absolute(const std::string& path);
 
 bool os_sync(const std::string& path);
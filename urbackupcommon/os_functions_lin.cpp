@@ -184,6 +184,7 @@ std::vector<SFile> getFiles(const std::string &path, bool *has_error, bool ignor
 			}
 			
 			f.usn = (uint64)f_info.st_mtime | ((uint64)f_info.st_ctime<<32);
+			f.inode = f_info.st_ino;
 			
 			if(!f.isdir)
 			{
@@ -353,9 +354,11 @@ bool os_create_reflink(const std::string &linkname, const std::string &fname)
 	}
 
 #define BTRFS_IOCTL_MAGIC 0x94
-#define BTRFS_IOC_CLONE _IOW (BTRFS_IOCTL_MAGIC, 9, int)
+#ifndef FICLONE
+#define FICLONE _IOW (BTRFS_IOCTL_MAGIC, 9, int)
+#endif
 	
-	int rc=ioctl(dst_desc, BTRFS_IOC_CLONE, src_desc);
+	int rc=ioctl(dst_desc, FICLONE, src_desc);
 	
 	if(rc)
 	{
@@ -940,7 +943,15 @@ bool copy_file(const std::string &src, const std::string &dst, bool flush, std::
 		return false;
 	}
 
-	bool copy_ok = copy_file(fsrc, fdst, error_str);
+	bool copy_ok;
+	if (os_copy_file_range(fsrc, 0, fdst, 0, 0))
+	{
+		copy_ok = true;
+	}
+	else
+	{
+		copy_ok = copy_file(fsrc, fdst, error_str);
+	}
 
 	if (copy_ok && flush)
 	{
@@ -1014,6 +1025,110 @@ bool copy_file(IFile *fsrc, IFile *fdst, std::string* error_str)
 		return true;
 	}
 }
+
+namespace
+{
+	int get_range_fd(IFile* f)
+	{
+		if (f == NULL
+			|| dynamic_cast<IMemFile*>(f) != NULL)
+		{
+			return -1;
+		}
+
+		IFsFile* fs_file = dynamic_cast<IFsFile*>(f);
+		if (fs_file == NULL)
+		{
+			return -1;
+		}
+
+		int fd = fs_file->getOsHandle();
+		struct stat64 f_info;
+		if (fd <= 0
+			|| fstat64(fd, &f_info) != 0
+			|| !S_ISREG(f_info.st_mode)
+			|| f_info.st_size != f->Size())
+		{
+			//Not a plain file (memory file, sparse file wrapper, ...)
+			return -1;
+		}
+
+		return fd;
+	}
+}
+
+bool os_clone_file_range(IFile* fsrc, int64 src_offset, IFile* fdst, int64 dst_offset, int64 size)
+{
+#if defined(__linux__) && defined(FICLONERANGE)
+	int src_fd = get_range_fd(fsrc);
+	int dst_fd = get_range_fd(fdst);
+	if (src_fd == -1 || dst_fd == -1)
+	{
+		return false;
+	}
+
+	file_clone_range clone_range = {};
+	clone_range.src_fd = src_fd;
+	clone_range.src_offset = src_offset;
+	clone_range.src_length = size;
+	clone_range.dest_offset = dst_offset;
+
+	return ioctl(dst_fd, FICLONERANGE, &clone_range) == 0;
+#else
+	return false;
+#endif
+}
+
+bool os_copy_file_range(IFile* fsrc, int64 src_offset, IFile* fdst, int64 dst_offset, int64 size)
+{
+	if (os_clone_file_range(fsrc, src_offset, fdst, dst_offset, size))
+	{
+		return true;
+	}
+
+#if defined(__linux__) && defined(__NR_copy_file_range)
+	int src_fd = get_range_fd(fsrc);
+	int dst_fd = get_range_fd(fdst);
+	if (src_fd == -1 || dst_fd == -1)
+	{
+		return false;
+	}
+
+	if (size == 0)
+	{
+		size = fsrc->Size() - src_offset;
+	}
+
+	loff_t off_in = src_offset;
+	loff_t off_out = dst_offset;
+	while (size > 0)
+	{
+		ssize_t rc = syscall(__NR_copy_file_range, src_fd, &off_in, dst_fd, &off_out,
+			static_cast<size_t>((std::min)(size, static_cast<int64>(1024 * 1024 * 1024))), 0);
+
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			//ENOSYS, EXDEV, EOPNOTSUPP, ... callers fall back to copying in user space
+			return false;
+		}
+		else if (rc == 0)
+		{
+			//Source is shorter than expected
+			return false;
+		}
+
+		size -= rc;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
 #endif //OS_FUNC_NO_SERVER
 
 SFile getFileMetadataWin( const std::string &path, bool with_usn)
@@ -296,11 +296,15 @@ std::vector<SFile> getFilesWin(const std::string &path, bool *has_error,
 							if(usnv2->MajorVersion==2)
 							{
 								f.usn = usnv2->Usn;
+								f.inode = usnv2->FileReferenceNumber;
 							}
 							else if(usnv2->MajorVersion==3)
 							{
 								usn::USN_RECORD_V3* usnv3=reinterpret_cast<usn::USN_RECORD_V3*>(usn_buffer.data());
 								f.usn = usnv3->Usn;
+								uint64 frn[2];
+								memcpy(frn, usnv3->FileReferenceNumber, sizeof(frn));
+								f.inode = frn[0] ^ frn[1];
 							}
 							else
 							{
@@ -1608,6 +1612,16 @@ bool copy_file(IFile *fsrc, IFile *fdst, std::string* error_str)
 	}
 }
 
+bool os_clone_file_range(IFile* fsrc, int64 src_offset, IFile* fdst, int64 dst_offset, int64 size)
+{
+	return false;
+}
+
+bool os_copy_file_range(IFile* fsrc, int64 src_offset, IFile* fdst, int64 dst_offset, int64 size)
+{
+	return false;
+}
+
 #endif
 
 bool os_path_absolute(const std::string& path)
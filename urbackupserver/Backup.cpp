@@ -28,6 +28,7 @@
 #include "server_status.h"
 #include "server_cleanup.h"
 #include "LogReport.h"
+#include "BackupScheduler.h"
 
 extern IUrlFactory *url_fak;
 
@@ -65,6 +66,11 @@ Backup::Backup(ClientMain* client_main, int clientid, std::string clientname, st
 	
 }
 
+Backup::~Backup()
+{
+	BackupScheduler::remove(this);
+}
+
 void Backup::operator()()
 {
 	logid = ServerLogger::getLogId(clientid);
@@ -123,7 +129,7 @@ void Backup::operator()()
 
 	if (stop_backup_running)
 	{
-		client_main->stopBackupRunning(is_file_backup);
+		client_main->stopBackupRunning(is_file_backup, this);
 	}
 
 	if(!has_early_error && log_action!=LogAction_NoLogging)
@@ -38,7 +38,7 @@ public:
 	Backup(ClientMain* client_main, int clientid, std::string clientname,
 		std::string clientsubname, LogAction log_action, bool is_file_backup, bool is_incremental,
 		std::string server_token, std::string details, bool scheduled);
-	virtual ~Backup() {}
+	virtual ~Backup();
 
 	virtual void operator()();
 
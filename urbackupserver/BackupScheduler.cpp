@@ -0,0 +1,317 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "BackupScheduler.h"
+#include "../Interface/Server.h"
+#include "../stringtools.h"
+#include <algorithm>
+
+IMutex* BackupScheduler::mutex = NULL;
+std::map<Backup*, SScheduledBackup> BackupScheduler::backups;
+int BackupScheduler::curr_max_sim_backups = 1;
+
+namespace
+{
+	//Every second spent waiting reduces the effective cost by this many seconds
+	const int64 aging_factor = 4;
+	//Woken up backups lose their place if they do not try to start within this time
+	const int64 claim_timeout_ms = 30 * 1000;
+	//Backups whose client did not ask for a slot within this time are dropped
+	const int64 stale_timeout_ms = 30 * 60 * 1000;
+
+	int64 effectiveCost(const SScheduledBackup& sbackup, int64 ctime)
+	{
+		int64 waited_s = (ctime - sbackup.queued_time) / 1000;
+		return sbackup.estimated_duration - waited_s * aging_factor;
+	}
+
+	size_t heavyLimit(int max_sim_backups)
+	{
+		return (std::max)(static_cast<size_t>(1), static_cast<size_t>(max_sim_backups) / 2);
+	}
+
+	struct SCostCmp
+	{
+		SCostCmp(std::map<Backup*, SScheduledBackup>& backups, int64 ctime)
+			: backups(backups), ctime(ctime) {}
+
+		bool operator()(Backup* a, Backup* b) const
+		{
+			const SScheduledBackup& sa = backups[a];
+			const SScheduledBackup& sb = backups[b];
+			int64 cost_a = effectiveCost(sa, ctime);
+			int64 cost_b = effectiveCost(sb, ctime);
+			if (cost_a != cost_b)
+				return cost_a < cost_b;
+			return sa.queued_time < sb.queued_time;
+		}
+
+		std::map<Backup*, SScheduledBackup>& backups;
+		int64 ctime;
+	};
+}
+
+void BackupScheduler::init_mutex()
+{
+	mutex = Server->createMutex();
+}
+
+void BackupScheduler::destroy_mutex()
+{
+	Server->destroy(mutex);
+}
+
+bool BackupScheduler::isQueued(Backup* backup)
+{
+	IScopedLock lock(mutex);
+	return backups.find(backup) != backups.end();
+}
+
+void BackupScheduler::enqueue(Backup* backup, const SScheduledBackup& sbackup)
+{
+	IScopedLock lock(mutex);
+	SScheduledBackup& nbackup = backups[backup];
+	nbackup = sbackup;
+	nbackup.queued_time = Server->getTimeMS();
+	nbackup.last_request = nbackup.queued_time;
+	nbackup.running = false;
+	nbackup.wakeup_time = 0;
+}
+
+bool BackupScheduler::canStart(Backup* backup, int running_backups, int max_sim_backups,
+	std::vector<std::string>& wakeup_clients)
+{
+	IScopedLock lock(mutex);
+
+	curr_max_sim_backups = max_sim_backups;
+
+	int64 ctime = Server->getTimeMS();
+	removeStale(ctime);
+
+	std::map<Backup*, SScheduledBackup>::iterator it = backups.find(backup);
+	if (it == backups.end())
+	{
+		return running_backups < max_sim_backups;
+	}
+
+	it->second.last_request = ctime;
+
+	if (running_backups >= max_sim_backups)
+	{
+		return false;
+	}
+
+	size_t free_slots = static_cast<size_t>(max_sim_backups - running_backups);
+	std::vector<Backup*> ranking = getRanking(ctime, max_sim_backups);
+
+	std::vector<Backup*>::iterator rank_it = std::find(ranking.begin(), ranking.end(), backup);
+	if (rank_it != ranking.end()
+		&& static_cast<size_t>(rank_it - ranking.begin()) < free_slots)
+	{
+		it->second.running = true;
+		it->second.start_time = ctime;
+		Server->Log("Scheduler: Starting backup of client \"" + it->second.clientname + "\" (estimated duration "
+			+ convert(it->second.estimated_duration) + "s, waited " + convert((ctime - it->second.queued_time) / 1000) + "s)", LL_DEBUG);
+		return true;
+	}
+
+	wakeupTop(ranking, free_slots, backup, ctime, wakeup_clients);
+	return false;
+}
+
+std::vector<std::string> BackupScheduler::release(Backup* backup, int running_backups)
+{
+	IScopedLock lock(mutex);
+
+	backups.erase(backup);
+
+	std::vector<std::string> wakeup_clients;
+	if (running_backups >= curr_max_sim_backups)
+	{
+		return wakeup_clients;
+	}
+
+	int64 ctime = Server->getTimeMS();
+	removeStale(ctime);
+
+	std::vector<Backup*> ranking = getRanking(ctime, curr_max_sim_backups);
+	wakeupTop(ranking, static_cast<size_t>(curr_max_sim_backups - running_backups), NULL, ctime, wakeup_clients);
+
+	return wakeup_clients;
+}
+
+void BackupScheduler::remove(Backup* backup)
+{
+	IScopedLock lock(mutex);
+	backups.erase(backup);
+}
+
+void BackupScheduler::removeClient(int clientid)
+{
+	IScopedLock lock(mutex);
+	for (std::map<Backup*, SScheduledBackup>::iterator it = backups.begin(); it != backups.end();)
+	{
+		if (it->second.clientid == clientid)
+		{
+			std::map<Backup*, SScheduledBackup>::iterator it_curr = it;
+			++it;
+			backups.erase(it_curr);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+std::vector<SScheduledBackup> BackupScheduler::getQueue()
+{
+	IScopedLock lock(mutex);
+
+	int64 ctime = Server->getTimeMS();
+	std::vector<Backup*> ranking = getRanking(ctime, curr_max_sim_backups);
+
+	std::vector<SScheduledBackup> ret;
+	for (std::map<Backup*, SScheduledBackup>::iterator it = backups.begin(); it != backups.end(); ++it)
+	{
+		ret.push_back(it->second);
+		std::vector<Backup*>::iterator rank_it = std::find(ranking.begin(), ranking.end(), it->first);
+		if (rank_it != ranking.end())
+		{
+			ret.back().rank = static_cast<int>(rank_it - ranking.begin());
+		}
+	}
+	return ret;
+}
+
+void BackupScheduler::removeStale(int64 ctime)
+{
+	for (std::map<Backup*, SScheduledBackup>::iterator it = backups.begin(); it != backups.end();)
+	{
+		if (!it->second.running
+			&& ctime - it->second.last_request > stale_timeout_ms)
+		{
+			std::map<Backup*, SScheduledBackup>::iterator it_curr = it;
+			++it;
+			backups.erase(it_curr);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+size_t BackupScheduler::numRunningHeavy()
+{
+	size_t ret = 0;
+	for (std::map<Backup*, SScheduledBackup>::iterator it = backups.begin(); it != backups.end(); ++it)
+	{
+		if (it->second.running && it->second.heavy)
+		{
+			++ret;
+		}
+	}
+	return ret;
+}
+
+bool BackupScheduler::isEligible(const SScheduledBackup& sbackup, int64 ctime)
+{
+	if (sbackup.running)
+	{
+		return false;
+	}
+
+	if (sbackup.wakeup_time > sbackup.last_request
+		&& ctime - sbackup.wakeup_time > claim_timeout_ms)
+	{
+		//Was woken up but did not try to start (e.g. client busy or outside of backup window)
+		return false;
+	}
+
+	return true;
+}
+
+std::vector<Backup*> BackupScheduler::getRanking(int64 ctime, int max_sim_backups)
+{
+	bool heavy_allowed = numRunningHeavy() < heavyLimit(max_sim_backups);
+
+	std::vector<Backup*> ret;
+	for (std::map<Backup*, SScheduledBackup>::iterator it = backups.begin(); it != backups.end(); ++it)
+	{
+		if (isEligible(it->second, ctime)
+			&& (heavy_allowed || !it->second.heavy))
+		{
+			ret.push_back(it->first);
+		}
+	}
+
+	std::sort(ret.begin(), ret.end(), SCostCmp(backups, ctime));
+
+	if (heavy_allowed)
+	{
+		//Only as many heavy backups as there are heavy slots left are ranked. The others
+		//would exceed the heavy limit if started and would block slots they cannot get
+		size_t heavy_left = heavyLimit(max_sim_backups) - numRunningHeavy();
+		std::vector<Backup*> filtered;
+		for (size_t i = 0; i < ret.size(); ++i)
+		{
+			if (backups[ret[i]].heavy)
+			{
+				if (heavy_left > 0)
+				{
+					--heavy_left;
+					filtered.push_back(ret[i]);
+				}
+			}
+			else
+			{
+				filtered.push_back(ret[i]);
+			}
+		}
+		ret.swap(filtered);
+	}
+
+	return ret;
+}
+
+void BackupScheduler::wakeupTop(const std::vector<Backup*>& ranking, size_t free_slots, Backup* self,
+	int64 ctime, std::vector<std::string>& wakeup_clients)
+{
+	for (size_t i = 0; i < ranking.size() && i < free_slots; ++i)
+	{
+		if (ranking[i] == self)
+		{
+			continue;
+		}
+
+		SScheduledBackup& sbackup = backups[ranking[i]];
+		if (sbackup.wakeup_time > sbackup.last_request)
+		{
+			//Already woken up and not yet processed
+			continue;
+		}
+
+		sbackup.wakeup_time = ctime;
+
+		if (std::find(wakeup_clients.begin(), wakeup_clients.end(), sbackup.clientname) == wakeup_clients.end())
+		{
+			wakeup_clients.push_back(sbackup.clientname);
+		}
+	}
+}
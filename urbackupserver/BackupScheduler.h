@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "../Interface/Mutex.h"
+#include "../Interface/Types.h"
+
+class Backup;
+
+struct SScheduledBackup
+{
+	SScheduledBackup()
+		: clientid(0), file(false), incremental(false), heavy(false),
+		estimated_duration(0), queued_time(0), last_request(0),
+		running(false), start_time(0), wakeup_time(0), rank(-1)
+	{
+	}
+
+	int clientid;
+	std::string clientname;
+	std::string details;
+	bool file;
+	bool incremental;
+	bool heavy;
+	int64 estimated_duration;
+	int64 queued_time;
+	int64 last_request;
+	bool running;
+	int64 start_time;
+	int64 wakeup_time;
+	//Position in the wait queue (filled by getQueue(), -1 if running or blocked)
+	int rank;
+};
+
+/**
+* Global admission control for backups. Instead of handing out the
+* max_sim_backups slots first-come first-served, waiting backups are ranked by
+* their estimated duration (from the backup history) minus an aging bonus for
+* the time they already waited, so short incrementals are not stuck behind
+* multi-hour full backups. Full file backups and image backups are additionally
+* limited to half of the slots, because they saturate disk and network
+* throughput.
+*/
+class BackupScheduler
+{
+public:
+	static void init_mutex();
+	static void destroy_mutex();
+
+	static bool isQueued(Backup* backup);
+
+	static void enqueue(Backup* backup, const SScheduledBackup& sbackup);
+
+	//Has to be called with the running backups counter locked. Returns true and marks
+	//the backup as running if it may start now. Clients that should claim free slots
+	//instead are returned in wakeup_clients
+	static bool canStart(Backup* backup, int running_backups, int max_sim_backups,
+		std::vector<std::string>& wakeup_clients);
+
+	//Returns the clients that should be woken up to claim the freed slot
+	static std::vector<std::string> release(Backup* backup, int running_backups);
+
+	//Has to be called before the backup object is freed
+	static void remove(Backup* backup);
+
+	static void removeClient(int clientid);
+
+	static std::vector<SScheduledBackup> getQueue();
+
+private:
+	static void removeStale(int64 ctime);
+	static size_t numRunningHeavy();
+	static bool isEligible(const SScheduledBackup& sbackup, int64 ctime);
+	static std::vector<Backup*> getRanking(int64 ctime, int max_sim_backups);
+	static void wakeupTop(const std::vector<Backup*>& ranking, size_t free_slots, Backup* self,
+		int64 ctime, std::vector<std::string>& wakeup_clients);
+
+	static IMutex* mutex;
+	static std::map<Backup*, SScheduledBackup> backups;
+	static int curr_max_sim_backups;
+};
@@ -259,7 +259,7 @@ void ClientMain::operator ()(void)
 
 		ServerChannelThread channel_thread(this, clientname, clientid, internet_connection, 
 			true, curr_server_token, clientsubname, NULL);
-		THREADPOOL_TICKET channel_thread_id=Server->getThreadPool()->execute(&channel_thread, "client channel");
+		channel_thread.start("client channel");
 
 		while(true)
 		{
@@ -270,7 +270,7 @@ void ClientMain::operator ()(void)
 		}
 
 		channel_thread.doExit();
-		Server->getThreadPool()->waitFor(channel_thread_id);
+		channel_thread.join();
 
 		cleanupShares();
 
@@ -417,7 +417,7 @@ void ClientMain::operator ()(void)
 
 	ServerChannelThread channel_thread(this, clientname, clientid, internet_connection, 
 		true, curr_server_token, clientsubname, NULL);
-	THREADPOOL_TICKET channel_thread_id=Server->getThreadPool()->execute(&channel_thread, "client channel");
+	channel_thread.start("client channel");
 
 	bool received_client_settings=true;
 	ServerLogger::Log(logid, "Getting client settings...", LL_DEBUG);
@@ -556,7 +556,7 @@ void ClientMain::operator ()(void)
 							 || dynamic_cast<ImageBackup*>(backup_queue[i].backup)->getDependencies(false).empty()) )
 					{
 						if (backup_queue[i].running)
-							stopBackupRunning(backup_queue[i].backup->isFileBackup());
+							stopBackupRunning(backup_queue[i].backup->isFileBackup(), backup_queue[i].backup);
 
 						ServerStatus::subRunningJob(clientmainname);
 
@@ -956,7 +956,7 @@ void ClientMain::operator ()(void)
 						{
 							ServerStatus::addRunningJob(clientmainname);
 							if(ServerStatus::numRunningJobs(clientmainname)<=server_settings->getSettings()->max_running_jobs_per_client
-								&& isBackupsRunningOkay(filebackup, true))
+								&& isBackupsRunningOkay(filebackup, true, backup_queue[i].backup))
 							{
 								std::string tname = "backup main";
 								if (filebackup)
@@ -1153,6 +1153,8 @@ void ClientMain::operator ()(void)
 		delete backup_queue[i].backup;
 	}
 
+	BackupScheduler::removeClient(clientid);
+
 	Server->wait(2000);
 
 
@@ -1162,7 +1164,7 @@ void ClientMain::operator ()(void)
 	{
 		Server->Log("Stopping channel...", LL_DEBUG);
 		channel_thread.doExit();
-		Server->getThreadPool()->waitFor(channel_thread_id);
+		channel_thread.join();
 	}
 
 	cleanupShares();
@@ -2461,13 +2463,40 @@ FileClient::SAddrHint ClientMain::getClientaddr(void)
 }
 
 
-bool ClientMain::isBackupsRunningOkay(bool file, bool incr)
+bool ClientMain::isBackupsRunningOkay(bool file, bool incr, Backup* backup)
 {
-	IScopedLock lock(running_backup_mutex);
-	if(running_backups<server_settings->getSettings()->max_sim_backups)
+	int max_sim_backups = server_settings->getSettings()->max_sim_backups;
+
+	if (incr && backup != NULL
+		&& !BackupScheduler::isQueued(backup))
+	{
+		BackupScheduler::enqueue(backup, getScheduledBackup(backup));
+	}
+
+	std::vector<std::string> wakeup_clients;
+	bool ret;
 	{
-		if (running_backups_allowed
-			&& incr)
+		IScopedLock lock(running_backup_mutex);
+		if (!running_backups_allowed)
+		{
+			ret = false;
+		}
+		else if (!incr)
+		{
+			//Backups are queued even if all slots are in use. The scheduler
+			//decides which of the queued backups gets the next free slot
+			ret = true;
+		}
+		else if (backup != NULL)
+		{
+			ret = BackupScheduler::canStart(backup, running_backups, max_sim_backups, wakeup_clients);
+		}
+		else
+		{
+			ret = running_backups < max_sim_backups;
+		}
+
+		if (ret && incr)
 		{
 			++running_backups;
 			if (file)
@@ -2475,35 +2504,101 @@ bool ClientMain::isBackupsRunningOkay(bool file, bool incr)
 				++running_file_backups;
 			}
 		}
+	}
 
-		return running_backups_allowed;
+	for (size_t i = 0; i < wakeup_clients.size(); ++i)
+	{
+		ServerStatus::sendToCommPipe(wakeup_clients[i], "WAKEUP");
 	}
-	else
+
+	return ret;
+}
+
+void ClientMain::stopBackupRunning(bool file, Backup* backup)
+{
+	std::vector<std::string> wakeup_clients;
 	{
-		return false;
+		IScopedLock lock(running_backup_mutex);
+		if (running_backups == 0)
+		{
+			Server->Log("running_backups is zero", LL_ERROR);
+			assert(false);
+			return;
+		}
+		--running_backups;
+		if (file)
+		{
+			if (running_file_backups == 0)
+			{
+				Server->Log("running_file_backups is zero", LL_ERROR);
+				assert(false);
+				return;
+			}
+			--running_file_backups;
+		}
+
+		wakeup_clients = BackupScheduler::release(backup, running_backups);
+	}
+
+	for (size_t i = 0; i < wakeup_clients.size(); ++i)
+	{
+		ServerStatus::sendToCommPipe(wakeup_clients[i], "WAKEUP");
 	}
 }
 
-void ClientMain::stopBackupRunning(bool file)
+SScheduledBackup ClientMain::getScheduledBackup(Backup* backup)
 {
-	IScopedLock lock(running_backup_mutex);
-	if (running_backups == 0)
+	SScheduledBackup ret;
+	ret.clientid = clientid;
+	ret.clientname = clientname;
+	ret.file = backup->isFileBackup();
+	ret.incremental = backup->isIncrementalBackup();
+	//Full file backups and image backups read or write everything and are limited
+	//separately so that they cannot saturate disk and network throughput
+	ret.heavy = !ret.file || !ret.incremental;
+
+	int64 duration_sum = 0;
+	size_t n_durations = 0;
+	if (ret.file)
 	{
-		Server->Log("running_backups is zero", LL_ERROR);
-		assert(false);
-		return;
+		std::vector<ServerBackupDao::SDuration> durations = ret.incremental ?
+			backup_dao->getLastIncrementalDurations(clientid) : backup_dao->getLastFullDurations(clientid);
+		for (size_t i = 0; i < durations.size(); ++i)
+		{
+			duration_sum += durations[i].duration;
+			++n_durations;
+		}
 	}
-	--running_backups;
-	if(file)
+	else
 	{
-		if (running_file_backups == 0)
+		ImageBackup* ibackup = dynamic_cast<ImageBackup*>(backup);
+		if (ibackup != NULL)
 		{
-			Server->Log("running_file_backups is zero", LL_ERROR);
-			assert(false);
-			return;
+			ret.details = ibackup->getLetter();
+			std::vector<int64> durations = ret.incremental ?
+				backup_dao->getLastIncrementalImageDurations(clientid, ret.details) : backup_dao->getLastFullImageDurations(clientid, ret.details);
+			for (size_t i = 0; i < durations.size(); ++i)
+			{
+				duration_sum += durations[i];
+				++n_durations;
+			}
 		}
-		--running_file_backups;
 	}
+
+	if (n_durations > 0)
+	{
+		ret.estimated_duration = (std::max)(duration_sum / static_cast<int64>(n_durations), static_cast<int64>(1));
+	}
+	else if (ret.file)
+	{
+		ret.estimated_duration = ret.incremental ? 10 * 60 : 2 * 60 * 60;
+	}
+	else
+	{
+		ret.estimated_duration = ret.incremental ? 30 * 60 : 4 * 60 * 60;
+	}
+
+	return ret;
 }
 
 int ClientMain::getNumberOfRunningBackups(void)
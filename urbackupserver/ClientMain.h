@@ -16,6 +16,7 @@
 #include "../urbackupcommon/sha2/sha2.h"
 #include "../urbackupcommon/fileclient/tcpstack.h"
 #include "server_settings.h"
+#include "BackupScheduler.h"
 
 #include <memory>
 #include <mutex>
@@ -242,7 +243,7 @@ public:
 
 	static bool run_script(std::string name, const std::string& params, logid_t logid);
 
-	void stopBackupRunning(bool file);
+	void stopBackupRunning(bool file, Backup* backup=NULL);
 
 	void updateClientAddress(const std::string& address_data);
 
@@ -317,7 +318,8 @@ private:
 	bool isRunningFileBackup(int group, bool queue_only=true);	
 	void checkClientVersion(void);
 	bool sendFile(IPipe *cc, IFile *f, int timeout);
-	bool isBackupsRunningOkay(bool file, bool incr=false);	
+	bool isBackupsRunningOkay(bool file, bool incr=false, Backup* backup=NULL);
+	SScheduledBackup getScheduledBackup(Backup* backup);	
 	bool updateCapabilities(bool* needs_restart);
 	IPipeThrottler *getThrottler(int speed_bps);
 	bool inBackupWindow(Backup* backup);
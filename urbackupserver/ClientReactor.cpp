@@ -0,0 +1,446 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "ClientReactor.h"
+#include "../Interface/Server.h"
+#include "../Interface/Pipe.h"
+#include "../stringtools.h"
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+std::vector<ClientReactorThread*> ClientReactor::threads;
+std::vector<THREADPOOL_TICKET> ClientReactor::tickets;
+
+namespace
+{
+	//Interval in which pipes that cannot be polled are checked for data
+	const int64 poll_fallback_interval = 100;
+	const int64 max_epoll_wait = 60000;
+
+	class ReactorBackgroundThread : public IThread
+	{
+	public:
+		ReactorBackgroundThread(ClientReactorThread* reactor, IReactorClient* client)
+			: reactor(reactor), client(client)
+		{}
+
+		void operator()()
+		{
+			client->reactorBackground();
+			reactor->backgroundDone(client);
+			delete this;
+		}
+
+	private:
+		ClientReactorThread* reactor;
+		IReactorClient* client;
+	};
+}
+
+ClientReactorThread::ClientReactorThread()
+	: mutex(Server->createMutex()), num_clients(0), do_stop(false),
+	epoll_fd(-1), wakeup_fd(-1)
+{
+}
+
+ClientReactorThread::~ClientReactorThread()
+{
+#ifndef _WIN32
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	if (wakeup_fd != -1)
+		close(wakeup_fd);
+#endif
+	Server->destroy(mutex);
+}
+
+bool ClientReactorThread::init()
+{
+#ifdef _WIN32
+	return false;
+#else
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1)
+	{
+		Server->Log("Error creating epoll instance. Errno " + convert(errno), LL_ERROR);
+		return false;
+	}
+
+	wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeup_fd == -1)
+	{
+		Server->Log("Error creating eventfd. Errno " + convert(errno), LL_ERROR);
+		return false;
+	}
+
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev) != 0)
+	{
+		Server->Log("Error adding eventfd to epoll. Errno " + convert(errno), LL_ERROR);
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+void ClientReactorThread::operator()()
+{
+#ifndef _WIN32
+	std::vector<epoll_event> events(64);
+
+	while (!do_stop)
+	{
+		addNewClients();
+
+		int rc = epoll_wait(epoll_fd, &events[0], static_cast<int>(events.size()), getTimeout());
+		if (rc < 0)
+		{
+			if (errno != EINTR)
+			{
+				Server->Log("Error waiting for epoll events. Errno " + convert(errno), LL_ERROR);
+				Server->wait(1000);
+			}
+			continue;
+		}
+
+		for (int i = 0; i < rc; ++i)
+		{
+			if (events[i].data.ptr == NULL)
+			{
+				eventfd_t val;
+				eventfd_read(wakeup_fd, &val);
+			}
+			else
+			{
+				std::map<IReactorClient*, SClient>::iterator it =
+					clients.find(reinterpret_cast<IReactorClient*>(events[i].data.ptr));
+				if (it != clients.end())
+				{
+					it->second.readable = true;
+				}
+			}
+		}
+
+		{
+			IScopedLock lock(mutex);
+			for (size_t i = 0; i < background_done.size(); ++i)
+			{
+				std::map<IReactorClient*, SClient>::iterator it = clients.find(background_done[i]);
+				if (it != clients.end())
+				{
+					it->second.background = false;
+					it->second.next_run = 0;
+				}
+			}
+			background_done.clear();
+		}
+
+		for (std::map<IReactorClient*, SClient>::iterator it = clients.begin(); it != clients.end();)
+		{
+			std::map<IReactorClient*, SClient>::iterator it_curr = it;
+			++it;
+			if (!processClient(it_curr->first, it_curr->second))
+			{
+				IReactorClient* client = it_curr->first;
+				clients.erase(it_curr);
+				{
+					IScopedLock lock(mutex);
+					--num_clients;
+				}
+				client->reactorFinish();
+			}
+		}
+	}
+#endif
+}
+
+void ClientReactorThread::add(IReactorClient* client)
+{
+	IScopedLock lock(mutex);
+	new_clients.push_back(client);
+	++num_clients;
+	wakeup();
+}
+
+void ClientReactorThread::wakeup()
+{
+#ifndef _WIN32
+	eventfd_write(wakeup_fd, 1);
+#endif
+}
+
+void ClientReactorThread::stop()
+{
+	do_stop = true;
+	wakeup();
+}
+
+size_t ClientReactorThread::getNumClients()
+{
+	IScopedLock lock(mutex);
+	return num_clients;
+}
+
+void ClientReactorThread::backgroundDone(IReactorClient* client)
+{
+	IScopedLock lock(mutex);
+	background_done.push_back(client);
+	wakeup();
+}
+
+void ClientReactorThread::addNewClients()
+{
+	std::vector<IReactorClient*> curr_new_clients;
+	{
+		IScopedLock lock(mutex);
+		curr_new_clients.swap(new_clients);
+	}
+
+	for (size_t i = 0; i < curr_new_clients.size(); ++i)
+	{
+		curr_new_clients[i]->reactorInit();
+		clients[curr_new_clients[i]] = SClient();
+	}
+}
+
+bool ClientReactorThread::processClient(IReactorClient* client, SClient& sclient)
+{
+	if (sclient.background)
+	{
+		return true;
+	}
+
+	if (client->reactorExit())
+	{
+		unregisterFd(sclient);
+		return false;
+	}
+
+	int64 ctime = Server->getTimeMS();
+
+	if (sclient.backoff)
+	{
+		if (ctime < sclient.next_run)
+		{
+			return true;
+		}
+		sclient.backoff = false;
+	}
+
+	if (client->reactorNeedsBackground())
+	{
+		unregisterFd(sclient);
+		sclient.background = true;
+		sclient.readable = false;
+		Server->getThreadPool()->execute(new ReactorBackgroundThread(this, client), "reactor background");
+		return true;
+	}
+
+	IPipe* pipe = client->reactorPipe();
+	if (pipe == NULL)
+	{
+		unregisterFd(sclient);
+	}
+	else if (sclient.registered_fd == -1
+		&& !sclient.poll_fallback)
+	{
+		registerFd(client, sclient, pipe->getPollFd());
+	}
+
+	if (sclient.poll_fallback
+		&& pipe != NULL
+		&& pipe->isReadable(0))
+	{
+		sclient.readable = true;
+	}
+
+	if (!sclient.readable
+		&& ctime < sclient.next_run)
+	{
+		return true;
+	}
+
+	bool readable = sclient.readable;
+	sclient.readable = false;
+
+	bool backoff = false;
+	int64 wait_ms = client->reactorRun(readable, backoff);
+
+	ctime = Server->getTimeMS();
+	sclient.next_run = ctime + wait_ms;
+
+	if (!backoff
+		&& client->reactorNeedsBackground())
+	{
+		sclient.next_run = ctime;
+	}
+
+	if (client->reactorExit())
+	{
+		unregisterFd(sclient);
+		return false;
+	}
+
+	pipe = client->reactorPipe();
+	if (pipe == NULL || backoff)
+	{
+		unregisterFd(sclient);
+		sclient.backoff = backoff;
+	}
+	else if (readable
+		&& pipe->isReadable(0))
+	{
+		//Data buffered in compression/encryption layers does not show up in epoll
+		sclient.readable = true;
+		sclient.next_run = ctime;
+	}
+
+	if (sclient.poll_fallback)
+	{
+		sclient.next_run = (std::min)(sclient.next_run, ctime + poll_fallback_interval);
+	}
+
+	return true;
+}
+
+void ClientReactorThread::registerFd(IReactorClient* client, SClient& sclient, int fd)
+{
+#ifndef _WIN32
+	if (fd == -1)
+	{
+		sclient.poll_fallback = true;
+		return;
+	}
+
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.ptr = client;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+	{
+		Server->Log("Error adding socket to epoll. Errno " + convert(errno), LL_WARNING);
+		sclient.poll_fallback = true;
+		return;
+	}
+
+	sclient.registered_fd = fd;
+#endif
+}
+
+void ClientReactorThread::unregisterFd(SClient& sclient)
+{
+#ifndef _WIN32
+	if (sclient.registered_fd != -1)
+	{
+		//Fails if the socket was closed already, which removed it from the epoll set
+		epoll_event ev = {};
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sclient.registered_fd, &ev);
+		sclient.registered_fd = -1;
+	}
+#endif
+	sclient.poll_fallback = false;
+	sclient.readable = false;
+}
+
+int ClientReactorThread::getTimeout()
+{
+	int64 ctime = Server->getTimeMS();
+	int64 timeout = max_epoll_wait;
+	for (std::map<IReactorClient*, SClient>::iterator it = clients.begin(); it != clients.end(); ++it)
+	{
+		if (it->second.background)
+			continue;
+
+		if (it->second.readable)
+			return 0;
+
+		timeout = (std::min)(timeout, it->second.next_run - ctime);
+	}
+	return static_cast<int>((std::max)(timeout, static_cast<int64>(0)));
+}
+
+void ClientReactor::init()
+{
+#ifndef _WIN32
+	int n_threads = watoi(Server->getServerParameter("channel_reactor_threads", "4"));
+
+	for (int i = 0; i < n_threads; ++i)
+	{
+		ClientReactorThread* thread = new ClientReactorThread;
+		if (!thread->init())
+		{
+			delete thread;
+			break;
+		}
+		threads.push_back(thread);
+		tickets.push_back(Server->getThreadPool()->execute(thread, "client reactor"));
+	}
+
+	if (!threads.empty())
+	{
+		Server->Log("Multiplexing idle client channels over " + convert(threads.size()) + " reactor threads", LL_DEBUG);
+	}
+#endif
+}
+
+void ClientReactor::destroy()
+{
+	for (size_t i = 0; i < threads.size(); ++i)
+	{
+		threads[i]->stop();
+	}
+
+	Server->getThreadPool()->waitFor(tickets);
+
+	for (size_t i = 0; i < threads.size(); ++i)
+	{
+		delete threads[i];
+	}
+
+	threads.clear();
+	tickets.clear();
+}
+
+ClientReactorThread* ClientReactor::getThread()
+{
+	if (threads.empty())
+	{
+		return NULL;
+	}
+
+	ClientReactorThread* min_thread = threads[0];
+	size_t min_clients = min_thread->getNumClients();
+	for (size_t i = 1; i < threads.size(); ++i)
+	{
+		size_t curr_clients = threads[i]->getNumClients();
+		if (curr_clients < min_clients)
+		{
+			min_thread = threads[i];
+			min_clients = curr_clients;
+		}
+	}
+
+	return min_thread;
+}
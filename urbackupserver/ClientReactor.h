@@ -0,0 +1,115 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include "../Interface/Thread.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/ThreadPool.h"
+#include "../Interface/Types.h"
+
+class IPipe;
+
+/**
+* Idle-time client work that can be multiplexed by the ClientReactor instead of
+* occupying a thread of its own. All methods except reactorBackground() are
+* called on the reactor thread the client was assigned to.
+*/
+class IReactorClient
+{
+public:
+	virtual ~IReactorClient() {}
+
+	virtual void reactorInit() = 0;
+
+	//Does the non-blocking part of the work. Returns the time in ms until it
+	//should be called again if the pipe does not become readable. If backoff
+	//is set the pipe is not polled until this time has passed
+	virtual int64 reactorRun(bool readable, bool& backoff) = 0;
+
+	//Pipe to poll for readability. May be NULL
+	virtual IPipe* reactorPipe() = 0;
+
+	//Returns true if the next step may block (connecting, long transfers)
+	virtual bool reactorNeedsBackground() = 0;
+
+	//Blocking step, runs on a thread pool thread
+	virtual void reactorBackground() = 0;
+
+	virtual bool reactorExit() = 0;
+
+	//Last call. The client is removed from the reactor before
+	virtual void reactorFinish() = 0;
+};
+
+class ClientReactorThread : public IThread
+{
+public:
+	ClientReactorThread();
+	~ClientReactorThread();
+
+	bool init();
+
+	void operator()();
+
+	void add(IReactorClient* client);
+
+	void wakeup();
+
+	void stop();
+
+	size_t getNumClients();
+
+	void backgroundDone(IReactorClient* client);
+
+private:
+	struct SClient
+	{
+		SClient()
+			: registered_fd(-1), next_run(0), readable(false),
+			backoff(false), background(false), poll_fallback(false)
+		{}
+
+		int registered_fd;
+		int64 next_run;
+		bool readable;
+		bool backoff;
+		bool background;
+		bool poll_fallback;
+	};
+
+	void addNewClients();
+	bool processClient(IReactorClient* client, SClient& sclient);
+	void registerFd(IReactorClient* client, SClient& sclient, int fd);
+	void unregisterFd(SClient& sclient);
+	int getTimeout();
+
+	IMutex* mutex;
+	std::map<IReactorClient*, SClient> clients;
+	std::vector<IReactorClient*> new_clients;
+	std::vector<IReactorClient*> background_done;
+	size_t num_clients;
+	volatile bool do_stop;
+
+	int epoll_fd;
+	int wakeup_fd;
+};
+
+/**
+* Multiplexes idle client connections over a small number of reactor threads
+* (epoll on Linux). Disabled on other platforms or with
+* channel_reactor_threads=0, callers then keep using a thread per client.
+*/
+class ClientReactor
+{
+public:
+	static void init();
+	static void destroy();
+
+	//Returns the least loaded reactor thread or NULL if clients
+	//have to run in a thread of their own
+	static ClientReactorThread* getThread();
+
+private:
+	static std::vector<ClientReactorThread*> threads;
+	static std::vector<THREADPOOL_TICKET> tickets;
+};
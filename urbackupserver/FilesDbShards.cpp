@@ -0,0 +1,289 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "FilesDbShards.h"
+#include "database.h"
+#include "dao/ServerFilesDao.h"
+#include "../Interface/Server.h"
+#include "../Interface/Query.h"
+#include "../stringtools.h"
+#include "../urbackupcommon/os_functions.h"
+#include "../urbackupcommon/WalCheckpointThread.h"
+#include <algorithm>
+
+IMutex* FilesDbShards::mutex = NULL;
+size_t FilesDbShards::num_shards = 1;
+size_t FilesDbShards::num_assign_shards = 1;
+std::map<int, size_t> FilesDbShards::client_shards;
+
+namespace
+{
+	const int shard_id_bits = 40;
+}
+
+bool FilesDbShards::openDatabases(const str_map& params, size_t allocation_chunk_size)
+{
+	if (mutex == NULL)
+	{
+		mutex = Server->createMutex();
+	}
+
+	num_assign_shards = (std::max)(1, watoi(Server->getServerParameter("files_db_shards", "1")));
+
+	//Shards with clients assigned to them stay open if the number of shards is lowered
+	num_shards = 1;
+	while (num_shards < num_assign_shards
+		|| FileExists("urbackup/backup_server_" + getShardName(num_shards) + ".db"))
+	{
+		++num_shards;
+	}
+
+	for (size_t shard = 1; shard < num_shards; ++shard)
+	{
+		std::string db_fn = "urbackup/backup_server_" + getShardName(shard) + ".db";
+		DATABASE_ID db_id = getShardDatabaseId(shard);
+
+		if (!Server->openDatabase(db_fn, db_id, params))
+		{
+			Server->Log("Couldn't open Database " + db_fn, LL_ERROR);
+			return false;
+		}
+
+		Server->setDatabaseAllocationChunkSize(db_id, allocation_chunk_size);
+
+		IDatabase* db = Server->getDatabase(Server->getThreadID(), db_id);
+		if (db == NULL)
+		{
+			Server->Log("Couldn't open file entry database shard. Expecting database at \"" +
+				Server->getServerWorkingDir() + os_file_sep() + "urbackup" + os_file_sep() + "backup_server_" + getShardName(shard) + ".db\"", LL_ERROR);
+			return false;
+		}
+
+		if (!setupShard(db, shard))
+		{
+			Server->Log("Error setting up file entry database shard " + convert(shard), LL_ERROR);
+			return false;
+		}
+	}
+
+	if (num_shards > 1)
+	{
+		Server->Log("File entries are split over " + convert(num_shards) + " databases", LL_DEBUG);
+	}
+
+	return true;
+}
+
+void FilesDbShards::startWalCheckpointThreads()
+{
+	for (size_t shard = 1; shard < num_shards; ++shard)
+	{
+		WalCheckpointThread* wal_checkpoint_thread = new WalCheckpointThread(100 * 1024 * 1024, 1000 * 1024 * 1024,
+			"urbackup" + os_file_sep() + "backup_server_" + getShardName(shard) + ".db", getShardDatabaseId(shard));
+		Server->createThread(wal_checkpoint_thread, "files checkpoint");
+	}
+}
+
+size_t FilesDbShards::getNumShards()
+{
+	return num_shards;
+}
+
+std::string FilesDbShards::getShardName(size_t shard)
+{
+	if (shard == 0)
+	{
+		return "files";
+	}
+
+	return "files_" + convert(shard);
+}
+
+DATABASE_ID FilesDbShards::getShardDatabaseId(size_t shard)
+{
+	if (shard == 0)
+	{
+		return URBACKUPDB_SERVER_FILES;
+	}
+
+	return URBACKUPDB_SERVER_FILES_SHARDS + static_cast<DATABASE_ID>(shard);
+}
+
+std::vector<DATABASE_ID> FilesDbShards::getDatabaseIds()
+{
+	std::vector<DATABASE_ID> ret;
+	for (size_t shard = 0; shard < num_shards; ++shard)
+	{
+		ret.push_back(getShardDatabaseId(shard));
+	}
+	return ret;
+}
+
+size_t FilesDbShards::getClientShard(int clientid)
+{
+	IScopedLock lock(mutex);
+
+	std::map<int, size_t>::iterator it = client_shards.find(clientid);
+	if (it != client_shards.end())
+	{
+		return it->second;
+	}
+
+	IDatabase* db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+
+	IQuery* q_get_shard = db->Prepare("SELECT shard FROM files_shards WHERE clientid=?", false);
+	q_get_shard->Bind(clientid);
+	db_results res = q_get_shard->Read();
+	db->destroyQuery(q_get_shard);
+
+	size_t shard;
+	if (!res.empty())
+	{
+		shard = static_cast<size_t>(watoi(res[0]["shard"]));
+	}
+	else
+	{
+		shard = assignShard(db, clientid);
+	}
+
+	if (shard >= num_shards)
+	{
+		Server->Log("File entry database shard " + convert(shard) + " of client with id " + convert(clientid) + " does not exist. Using shard 0.", LL_ERROR);
+		shard = 0;
+	}
+
+	client_shards[clientid] = shard;
+
+	return shard;
+}
+
+DATABASE_ID FilesDbShards::getClientDatabaseId(int clientid)
+{
+	return getShardDatabaseId(getClientShard(clientid));
+}
+
+size_t FilesDbShards::getEntryShard(int64 entryid)
+{
+	size_t shard = static_cast<size_t>(entryid >> shard_id_bits);
+	if (shard >= num_shards)
+	{
+		return 0;
+	}
+	return shard;
+}
+
+DATABASE_ID FilesDbShards::getEntryDatabaseId(int64 entryid)
+{
+	return getShardDatabaseId(getEntryShard(entryid));
+}
+
+bool FilesDbShards::setupShard(IDatabase* db, size_t shard)
+{
+	if (!db->Read("SELECT name FROM sqlite_master WHERE name='files' AND type='table'").empty())
+	{
+		return true;
+	}
+
+	Server->Log("Creating file entry database shard " + convert(shard) + "...", LL_INFO);
+
+	DBScopedWriteTransaction trans(db);
+
+	//AUTOINCREMENT keeps the ids in the range of the shard even if all entries get deleted
+	bool b = db->Write("CREATE TABLE files ("
+		"id INTEGER PRIMARY KEY AUTOINCREMENT,"
+		"backupid INTEGER,"
+		"fullpath TEXT,"
+		"shahash BLOB,"
+		"filesize INTEGER,"
+		"created INTEGER DEFAULT (CAST(strftime('%s','now') as INTEGER)),"
+		"rsize INTEGER, clientid INTEGER, incremental INTEGER, hashpath TEXT, next_entry INTEGER, prev_entry INTEGER, pointed_to INTEGER)");
+	b &= db->Write("INSERT INTO sqlite_sequence (name, seq) VALUES ('files', " + convert(static_cast<int64>(shard) << shard_id_bits) + ")");
+	b &= db->Write("CREATE INDEX files_backupid ON files (backupid)");
+	b &= db->Write("CREATE TABLE files_incoming_stat (id INTEGER PRIMARY KEY, filesize INTEGER, clientid INTEGER, backupid INTEGER, existing_clients TEXT, direction INTEGER, incremental INTEGER)");
+
+	if (!b)
+	{
+		trans.rollback();
+	}
+
+	return b;
+}
+
+size_t FilesDbShards::assignShard(IDatabase* db, int clientid)
+{
+	std::vector<int64> shard_clients(num_assign_shards);
+
+	db_results res = db->Read("SELECT shard, COUNT(*) AS c FROM files_shards GROUP BY shard");
+	for (size_t i = 0; i < res.size(); ++i)
+	{
+		size_t shard = static_cast<size_t>(watoi(res[i]["shard"]));
+		if (shard < shard_clients.size())
+		{
+			shard_clients[shard] = watoi64(res[i]["c"]);
+		}
+	}
+
+	size_t shard = std::min_element(shard_clients.begin(), shard_clients.end()) - shard_clients.begin();
+
+	IQuery* q_add_shard = db->Prepare("INSERT INTO files_shards (clientid, shard) VALUES (?, ?)", false);
+	q_add_shard->Bind(clientid);
+	q_add_shard->Bind(static_cast<int>(shard));
+	if (!q_add_shard->Write())
+	{
+		Server->Log("Error saving file entry database shard of client with id " + convert(clientid), LL_ERROR);
+	}
+	db->destroyQuery(q_add_shard);
+
+	Server->Log("Assigned client with id " + convert(clientid) + " to file entry database shard " + convert(shard), LL_DEBUG);
+
+	return shard;
+}
+
+ServerFilesDaoShards::ServerFilesDaoShards()
+	: daos(FilesDbShards::getNumShards())
+{
+}
+
+ServerFilesDaoShards::~ServerFilesDaoShards()
+{
+	for (size_t i = 0; i < daos.size(); ++i)
+	{
+		delete daos[i];
+	}
+}
+
+ServerFilesDao& ServerFilesDaoShards::getShard(size_t shard)
+{
+	if (daos[shard] == NULL)
+	{
+		daos[shard] = new ServerFilesDao(Server->getDatabase(Server->getThreadID(),
+			FilesDbShards::getShardDatabaseId(shard)));
+	}
+
+	return *daos[shard];
+}
+
+ServerFilesDao& ServerFilesDaoShards::getClient(int clientid)
+{
+	return getShard(FilesDbShards::getClientShard(clientid));
+}
+
+ServerFilesDao& ServerFilesDaoShards::getEntry(int64 entryid)
+{
+	return getShard(FilesDbShards::getEntryShard(entryid));
+}
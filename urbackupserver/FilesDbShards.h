@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "../Interface/Types.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Database.h"
+
+class ServerFilesDao;
+
+/**
+* The file entries (files and files_incoming_stat tables) can be split over
+* several databases (files_db_shards server parameter). Shard 0 is
+* backup_server_files.db, shard n is backup_server_files_n.db. Each client is
+* assigned to one shard (files_shards table). All entries of a client,
+* including the prev/next links between its copies of a file, are in this
+* shard. Backups, cleanups and statistics updates of clients in different
+* shards therefore do not contend on the same SQLite writer.
+*
+* Deduplication across clients goes through the file entry index
+* (LMDBFileIndex), whose keys contain the client id. Entry ids of shard n start
+* at n<<40, so the shard of an entry id from the index is known without a lookup.
+*/
+class FilesDbShards
+{
+public:
+	//Opens the shards in addition to the main files database (shard 0)
+	static bool openDatabases(const str_map& params, size_t allocation_chunk_size);
+
+	static void startWalCheckpointThreads();
+
+	static size_t getNumShards();
+
+	//"files" for shard 0, "files_<n>" otherwise (as in backup_server_files_<n>.db)
+	static std::string getShardName(size_t shard);
+
+	static DATABASE_ID getShardDatabaseId(size_t shard);
+
+	static std::vector<DATABASE_ID> getDatabaseIds();
+
+	static size_t getClientShard(int clientid);
+
+	static DATABASE_ID getClientDatabaseId(int clientid);
+
+	static size_t getEntryShard(int64 entryid);
+
+	static DATABASE_ID getEntryDatabaseId(int64 entryid);
+
+private:
+	static bool setupShard(IDatabase* db, size_t shard);
+	static size_t assignShard(IDatabase* db, int clientid);
+
+	static IMutex* mutex;
+	static size_t num_shards;
+	static size_t num_assign_shards;
+	static std::map<int, size_t> client_shards;
+};
+
+/**
+* Files DAOs of the shards used by one thread. Created on first use.
+*/
+class ServerFilesDaoShards
+{
+public:
+	ServerFilesDaoShards();
+	~ServerFilesDaoShards();
+
+	ServerFilesDao& getShard(size_t shard);
+
+	ServerFilesDao& getClient(int clientid);
+
+	ServerFilesDao& getEntry(int64 entryid);
+
+private:
+	ServerFilesDaoShards(const ServerFilesDaoShards& other);
+	ServerFilesDaoShards& operator=(const ServerFilesDaoShards& other);
+
+	std::vector<ServerFilesDao*> daos;
+};
@@ -37,6 +37,7 @@
 #include "database.h"
 #include <algorithm>
 #include "PhashLoad.h"
+#include "FilesDbShards.h"
 
 extern std::string server_identity;
 
@@ -50,17 +51,17 @@ namespace
 IncrFileBackup::IncrFileBackup( ClientMain* client_main, int clientid, std::string clientname, std::string clientsubname, LogAction log_action,
 	int group, bool use_tmpfiles, std::string tmpfile_path, bool use_reflink, bool use_snapshots, std::string server_token, std::string details, bool scheduled)
 	: FileBackup(client_main, clientid, clientname, clientsubname, log_action, true, group, use_tmpfiles, tmpfile_path, use_reflink, use_snapshots, server_token, details, scheduled), 
-	hash_existing_mutex(NULL), filesdao(NULL), link_dao(NULL), link_journal_dao(NULL)
+	hash_existing_mutex(NULL), filesdao_shards(NULL), filesdao(NULL), dir_link_batch(NULL)
 {
 
 }
 
 bool IncrFileBackup::doFileBackup()
 {
-	ScopedFreeObjRef<ServerFilesDao*> free_filesdao(filesdao);
-	filesdao = new ServerFilesDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES));
-	ScopedFreeObjRef<ServerLinkDao*> free_link_dao(link_dao);
-	ScopedFreeObjRef<ServerLinkJournalDao*> free_link_journal_dao(link_journal_dao);
+	ScopedFreeObjRef<ServerFilesDaoShards*> free_filesdao_shards(filesdao_shards);
+	filesdao_shards = new ServerFilesDaoShards;
+	filesdao = &filesdao_shards->getClient(clientid);
+	ScopedFreeObjRef<DirLinkBatch*> free_dir_link_batch(dir_link_batch);
 
 	ServerLogger::Log(logid, std::string("Starting ") + (scheduled ? "scheduled" : "unscheduled") + " incremental file backup...", LL_INFO);
 
@@ -781,11 +782,15 @@ bool IncrFileBackup::doFileBackup()
 						{
 							std::string srcpath=last_backuppath+local_curr_os_path;
 							std::string src_hashpath = last_backuppath_hashes+local_curr_os_path;
+							if(dir_link_batch==NULL)
+							{
+								dir_link_batch = new DirLinkBatch;
+							}
 							if(link_directory_pool(clientid, backuppath+local_curr_os_path, srcpath, dir_pool_path,
-								 BackupServer::isFilesystemTransactionEnabled(), link_dao, link_journal_dao, depth) )
+								 BackupServer::isFilesystemTransactionEnabled(), *dir_link_batch, depth) )
 							{
 								if(link_directory_pool(clientid, backuppath_hashes + local_curr_os_path, src_hashpath, dir_pool_path,
-									BackupServer::isFilesystemTransactionEnabled(), link_dao, link_journal_dao, depth) )
+									BackupServer::isFilesystemTransactionEnabled(), *dir_link_batch, depth) )
 								{
 									skip_dir_completely = 1;
 									dir_linked = true;
@@ -820,7 +825,7 @@ bool IncrFileBackup::doFileBackup()
 								else
 								{
 									std::unique_ptr<DBScopedSynchronous> link_dao_synchronous;
-									if (!remove_directory_link(backuppath + local_curr_os_path, *link_dao, clientid, link_dao_synchronous))
+									if (!remove_directory_link(backuppath + local_curr_os_path, dir_link_batch->getLinkDao(), clientid, link_dao_synchronous))
 									{
 										ServerLogger::Log(logid, "Could not remove symlinked directory \"" + backuppath + local_curr_os_path + "\" after symlinking metadata directory failed.", LL_ERROR);
 										c_has_error = true;
@@ -2084,7 +2089,8 @@ void IncrFileBackup::addFileEntrySQLWithExisting( const std::string &fp, const s
 
 		if (entryid != 0)
 		{
-			ServerFilesDao::SFindFileEntry fentry = filesdao->getFileEntry(entryid);
+			//Entry may be from another client in a different shard
+			ServerFilesDao::SFindFileEntry fentry = filesdao_shards->getEntry(entryid).getFileEntry(entryid);
 			if (!fentry.exists)
 			{
 				Server->Log("File entry in database with id=" + convert(entryid) 
@@ -5,6 +5,9 @@
 #include "dao/ServerLinkDao.h"
 #include "dao/ServerLinkJournalDao.h"
 
+class ServerFilesDaoShards;
+class DirLinkBatch;
+
 struct SFile;
 class FileMetadata;
 
@@ -30,7 +33,7 @@ protected:
 
 	IMutex* hash_existing_mutex;
 
+	ServerFilesDaoShards* filesdao_shards;
 	ServerFilesDao* filesdao;
-	ServerLinkDao* link_dao;
-	ServerLinkJournalDao* link_journal_dao;
+	DirLinkBatch* dir_link_batch;
 };
\ No newline at end of file
@@ -103,10 +103,15 @@ void LMDBFileIndex::begin_txn(unsigned int flags)
 }
 
 void LMDBFileIndex::create(get_data_callback_t get_data_callback, void *userdata)
+{
+	create(get_data_callback, userdata, URBACKUPDB_SERVER_FILES_NEW, true);
+}
+
+void LMDBFileIndex::create(get_data_callback_t get_data_callback, void *userdata, DATABASE_ID pointer_db, bool append)
 {
 	begin_txn(0);
 
-	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES_NEW);
+	IDatabase *db=Server->getDatabase(Server->getThreadID(), pointer_db);
 
 	ServerFilesDao filesdao(db);
 
@@ -167,7 +172,7 @@ void LMDBFileIndex::create(get_data_callback_t get_data_callback, void *userdata
 				}
 			}
 			
-			put(key, id, MDB_APPEND);
+			put(key, id, append ? MDB_APPEND : 0);
 
 			if(_has_error)
 			{
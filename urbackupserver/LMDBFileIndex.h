@@ -27,6 +27,10 @@ public:
 
 	virtual void create(get_data_callback_t get_data_callback, void *userdata);
 
+	//Updates the entry pointers in pointer_db. Entries have to be appended
+	//in key order if append is set
+	void create(get_data_callback_t get_data_callback, void *userdata, DATABASE_ID pointer_db, bool append);
+
 	virtual int64 get(const SIndexKey& key);
 
 	virtual int64 get_any_client(const SIndexKey& key);
@@ -0,0 +1,253 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "RemoveUnknownScanner.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../stringtools.h"
+#include "database.h"
+#include "ClientMain.h"
+#include <algorithm>
+
+namespace
+{
+	class RemoveUnknownScannerThread : public IThread
+	{
+	public:
+		RemoveUnknownScannerThread(RemoveUnknownScanner* scanner, size_t thread_idx)
+			: scanner(scanner), thread_idx(thread_idx)
+		{}
+
+		void operator()()
+		{
+			scanner->scannerThread(thread_idx);
+			Server->destroyDatabases(Server->getThreadID());
+			delete this;
+		}
+
+	private:
+		RemoveUnknownScanner* scanner;
+		size_t thread_idx;
+	};
+
+	bool isImageFolder(const SFile& cf)
+	{
+		return (cf.isdir || cf.name.find(".") == std::string::npos)
+			&& cf.name.find("Image") != std::string::npos;
+	}
+}
+
+bool SRemoveUnknownScan::hasFileBackup(const std::string& path) const
+{
+	return std::binary_search(file_backup_paths.begin(), file_backup_paths.end(), path);
+}
+
+bool SRemoveUnknownScan::hasImage(const std::string& name) const
+{
+	return std::binary_search(image_names.begin(), image_names.end(), name);
+}
+
+RemoveUnknownScanner::RemoveUnknownScanner(const std::vector<ServerCleanupDao::SClientInfo>& clients, const std::string& backupfolder)
+	: clients(clients), backupfolder(backupfolder), mutex(Server->createMutex()), cond(Server->createCondition()),
+	next_scan(0), next_result(0), do_stop(false)
+{
+	max_queued = (std::max)(1, watoi(Server->getServerParameter("remove_unknown_max_queued", "16")));
+}
+
+RemoveUnknownScanner::~RemoveUnknownScanner()
+{
+	{
+		IScopedLock lock(mutex);
+		do_stop = true;
+		cond->notify_all();
+	}
+
+	Server->getThreadPool()->waitFor(tickets);
+
+	for (std::map<size_t, SRemoveUnknownScan*>::iterator it = results.begin(); it != results.end(); ++it)
+	{
+		delete it->second;
+	}
+
+	Server->destroy(cond);
+	Server->destroy(mutex);
+}
+
+void RemoveUnknownScanner::start()
+{
+	size_t n_threads = (std::max)(1, watoi(Server->getServerParameter("remove_unknown_threads", "4")));
+	n_threads = (std::min)(n_threads, clients.size());
+
+	for (size_t i = 0; i < n_threads; ++i)
+	{
+		tickets.push_back(Server->getThreadPool()->execute(new RemoveUnknownScannerThread(this, i), "remove unknown scan"));
+	}
+}
+
+SRemoveUnknownScan* RemoveUnknownScanner::next()
+{
+	IScopedLock lock(mutex);
+
+	if (next_result >= clients.size())
+	{
+		return NULL;
+	}
+
+	std::map<size_t, SRemoveUnknownScan*>::iterator it;
+	while ((it = results.find(next_result)) == results.end())
+	{
+		cond->wait(&lock);
+	}
+
+	SRemoveUnknownScan* ret = it->second;
+	results.erase(it);
+	++next_result;
+	cond->notify_all();
+
+	return ret;
+}
+
+void RemoveUnknownScanner::scannerThread(size_t thread_idx)
+{
+	IDatabase* db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+	ServerCleanupDao cleanupdao(db);
+
+	while (true)
+	{
+		throttle(thread_idx);
+
+		size_t idx;
+		{
+			IScopedLock lock(mutex);
+			while (!do_stop
+				&& next_scan < clients.size()
+				&& next_scan >= next_result + max_queued)
+			{
+				cond->wait(&lock);
+			}
+
+			if (do_stop
+				|| next_scan >= clients.size())
+			{
+				return;
+			}
+
+			idx = next_scan++;
+		}
+
+		SRemoveUnknownScan* scan = scanClient(cleanupdao, clients[idx]);
+
+		IScopedLock lock(mutex);
+		results[idx] = scan;
+		cond->notify_all();
+	}
+}
+
+SRemoveUnknownScan* RemoveUnknownScanner::scanClient(ServerCleanupDao& cleanupdao, const ServerCleanupDao::SClientInfo& client_info)
+{
+	SRemoveUnknownScan* scan = new SRemoveUnknownScan;
+	scan->client_info = client_info;
+
+	std::string client_folder = backupfolder + os_file_sep() + client_info.name;
+
+	scan->files = getFiles(client_folder, NULL);
+
+	for (size_t i = 0; i < scan->files.size(); ++i)
+	{
+		const SFile& cf = scan->files[i];
+		if (cf.name == "current"
+			|| cf.name == ".directory_pool")
+		{
+			continue;
+		}
+
+		if (isImageFolder(cf))
+		{
+			scan->image_folder_files[cf.name] = getFiles(client_folder + os_file_sep() + cf.name);
+		}
+	}
+
+	//Read from the database after listing the folder, so that backups
+	//which were started in between are known
+	std::vector<ServerCleanupDao::SFileBackupInfo> file_backups = cleanupdao.getFileBackupsOfClient(client_info.id);
+	scan->file_backup_paths.reserve(file_backups.size());
+	for (size_t i = 0; i < file_backups.size(); ++i)
+	{
+		if (!os_directory_exists(client_folder + os_file_sep() + file_backups[i].path))
+		{
+			scan->missing_file_backups.push_back(file_backups[i]);
+		}
+		scan->file_backup_paths.push_back(file_backups[i].path);
+	}
+	std::sort(scan->file_backup_paths.begin(), scan->file_backup_paths.end());
+
+	std::vector<ServerCleanupDao::SImageBackupInfo> image_backups = cleanupdao.getImageBackupsOfClient(client_info.id);
+	for (size_t i = 0; i < image_backups.size(); ++i)
+	{
+		IFile* tf = Server->openFile(os_file_prefix(image_backups[i].path), MODE_READ);
+		if (tf == NULL)
+		{
+			scan->missing_image_backups.push_back(image_backups[i]);
+		}
+		else
+		{
+			Server->destroy(tf);
+			scan->image_names.push_back(ExtractFileName(image_backups[i].path));
+		}
+	}
+	std::sort(scan->image_names.begin(), scan->image_names.end());
+
+	listDirectoryPool(client_folder + os_file_sep() + ".directory_pool", scan->pool_dirs, scan->pool_dir_files);
+
+	return scan;
+}
+
+void RemoveUnknownScanner::listDirectoryPool(const std::string& pool_root, std::vector<SFile>& pool_dirs, std::vector<std::vector<SFile> >& pool_dir_files)
+{
+	if (!os_directory_exists(pool_root))
+	{
+		return;
+	}
+
+	std::vector<SFile> first_files = getFiles(pool_root, NULL);
+	for (size_t i = 0; i < first_files.size(); ++i)
+	{
+		if (!first_files[i].isdir)
+			continue;
+		if (first_files[i].issym)
+			continue;
+
+		pool_dirs.push_back(first_files[i]);
+		pool_dir_files.push_back(getFiles(pool_root + os_file_sep() + first_files[i].name, NULL));
+	}
+}
+
+void RemoveUnknownScanner::throttle(size_t thread_idx)
+{
+	if (thread_idx == 0)
+	{
+		return;
+	}
+
+	IScopedLock lock(mutex);
+	while (!do_stop
+		&& ClientMain::getNumberOfRunningBackups() > 0)
+	{
+		cond->wait(&lock, 10000);
+	}
+}
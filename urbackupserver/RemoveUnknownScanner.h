@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "../Interface/Thread.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include "../Interface/ThreadPool.h"
+#include "../urbackupcommon/os_functions.h"
+#include "dao/ServerCleanupDao.h"
+
+/**
+* Result of listing the backup folder of one client and checking the entries
+* against the database. Only reads, the removal is done by the cleanup thread.
+*/
+struct SRemoveUnknownScan
+{
+	ServerCleanupDao::SClientInfo client_info;
+
+	//Entries of the client folder
+	std::vector<SFile> files;
+	//Contents of the image backup folders in files
+	std::map<std::string, std::vector<SFile> > image_folder_files;
+
+	//Sorted backup folder names and image file names of the client in the database
+	std::vector<std::string> file_backup_paths;
+	std::vector<std::string> image_names;
+
+	std::vector<ServerCleanupDao::SFileBackupInfo> missing_file_backups;
+	std::vector<ServerCleanupDao::SImageBackupInfo> missing_image_backups;
+
+	//First level of the directory pool and its contents
+	std::vector<SFile> pool_dirs;
+	std::vector<std::vector<SFile> > pool_dir_files;
+
+	bool hasFileBackup(const std::string& path) const;
+	bool hasImage(const std::string& name) const;
+};
+
+/**
+* Scans the client backup folders for remove_unknown with several threads.
+* The scans are returned in client order and the threads stay at most
+* max_queued clients ahead of the consumer. While backups are running only
+* one thread keeps scanning.
+*/
+class RemoveUnknownScanner
+{
+public:
+	RemoveUnknownScanner(const std::vector<ServerCleanupDao::SClientInfo>& clients, const std::string& backupfolder);
+	~RemoveUnknownScanner();
+
+	void start();
+
+	//Returns the scan of the next client or NULL if all clients were returned.
+	//The caller takes ownership
+	SRemoveUnknownScan* next();
+
+	void scannerThread(size_t thread_idx);
+
+	//Lists the first two levels of a directory pool (non-symlink directories only)
+	static void listDirectoryPool(const std::string& pool_root, std::vector<SFile>& pool_dirs,
+		std::vector<std::vector<SFile> >& pool_dir_files);
+
+private:
+	RemoveUnknownScanner(const RemoveUnknownScanner& other);
+	RemoveUnknownScanner& operator=(const RemoveUnknownScanner& other);
+
+	SRemoveUnknownScan* scanClient(ServerCleanupDao& cleanupdao, const ServerCleanupDao::SClientInfo& client_info);
+	void throttle(size_t thread_idx);
+
+	std::vector<ServerCleanupDao::SClientInfo> clients;
+	std::string backupfolder;
+
+	IMutex* mutex;
+	ICondition* cond;
+
+	size_t next_scan;
+	size_t next_result;
+	size_t max_queued;
+	bool do_stop;
+	std::map<size_t, SRemoveUnknownScan*> results;
+	std::vector<THREADPOOL_TICKET> tickets;
+};
@@ -0,0 +1,289 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "StatusWebSocket.h"
+#include "WebSocketConnector.h"
+#include "server_status.h"
+#include "server_log.h"
+#include "serverinterface/helper.h"
+#include "../urbackupcommon/json.h"
+#include "../urbackupcommon/WebSocketPipe.h"
+#include "../stringtools.h"
+#include <algorithm>
+#include <set>
+
+JSON::Object getProgressJson(const SStatus& client, SProcess proc, int64 ctime);
+
+namespace
+{
+	const int push_interval_ms = 1000;
+	const int64 session_check_interval_ms = 60 * 1000;
+	const int write_timeout_ms = 60 * 1000;
+
+	struct SStatusRights
+	{
+		SStatusRights()
+			: all_progress_rights(false), all_stop_rights(false), all_log_rights(false) {}
+
+		bool all_progress_rights;
+		std::vector<int> progress_clientids;
+		bool all_stop_rights;
+		std::vector<int> stop_clientids;
+		bool all_log_rights;
+		std::vector<int> log_clientids;
+
+		bool hasRight(bool all_rights, const std::vector<int>& clientids, int clientid) const
+		{
+			return all_rights
+				|| std::find(clientids.begin(), clientids.end(), clientid) != clientids.end();
+		}
+	};
+
+	bool getRights(THREAD_ID tid, str_map& GET, str_map& PARAMS, SStatusRights& rights)
+	{
+		Helper helper(tid, &GET, &PARAMS);
+
+		SUser *session = helper.getSession();
+		if (session == NULL || session->id == SESSION_ID_INVALID)
+		{
+			return false;
+		}
+
+		rights.progress_clientids = helper.clientRights("progress", rights.all_progress_rights);
+		rights.stop_clientids = helper.clientRights("stop_backup", rights.all_stop_rights);
+		rights.log_clientids = helper.clientRights("logs", rights.all_log_rights);
+
+		return true;
+	}
+
+	bool pushProgress(IPipe* pipe, const SStatusRights& rights, size_t& version, std::set<std::string>& sent_clients)
+	{
+		std::vector<SStatus> changed;
+		std::vector<std::string> removed;
+		bool full;
+		size_t new_version = ServerStatus::getStatusChanges(version, changed, removed, full);
+
+		if (!full && new_version == version)
+		{
+			return true;
+		}
+
+		version = new_version;
+
+		JSON::Array j_removed;
+		if (full)
+		{
+			sent_clients.clear();
+		}
+		else
+		{
+			for (size_t i = 0; i < removed.size(); ++i)
+			{
+				if (sent_clients.erase(removed[i]) > 0)
+				{
+					j_removed.add(removed[i]);
+				}
+			}
+		}
+
+		JSON::Array j_clients;
+		int64 ctime = Server->getTimeMS();
+		for (size_t i = 0; i < changed.size(); ++i)
+		{
+			const SStatus& client = changed[i];
+
+			if (!rights.hasRight(rights.all_progress_rights, rights.progress_clientids, client.clientid))
+			{
+				continue;
+			}
+
+			JSON::Array pg;
+			for (size_t j = 0; j < client.processes.size(); ++j)
+			{
+				const SProcess& proc = client.processes[j];
+				JSON::Object obj = getProgressJson(client, proc, ctime);
+
+				if (proc.can_stop
+					&& rights.hasRight(rights.all_stop_rights, rights.stop_clientids, client.clientid))
+				{
+					obj.set("can_stop_backup", true);
+				}
+
+				if (proc.logid != logid_t()
+					&& rights.hasRight(rights.all_log_rights, rights.log_clientids, client.clientid))
+				{
+					obj.set("can_show_backup_log", true);
+				}
+
+				pg.add(obj);
+			}
+
+			JSON::Object j_client;
+			j_client.set("name", client.client);
+			j_client.set("clientid", client.clientid);
+			j_client.set("online", client.online);
+			j_client.set("progress", pg);
+			j_clients.add(j_client);
+
+			sent_clients.insert(client.client);
+		}
+
+		if (!full
+			&& j_clients.size() == 0
+			&& j_removed.size() == 0)
+		{
+			return true;
+		}
+
+		JSON::Object msg;
+		msg.set("type", "progress");
+		msg.set("full", full);
+		msg.set("version", version);
+		msg.set("removed", j_removed);
+		msg.set("clients", j_clients);
+
+		return pipe->Write(msg.stringify(false), write_timeout_ms);
+	}
+
+	bool pushLog(IPipe* pipe, int clientid, logid_t logid, size_t& lastid)
+	{
+		std::vector<SCircularLogEntry> entries;
+		if (clientid == 0)
+		{
+			entries = Server->getCicularLogBuffer(lastid);
+		}
+		else
+		{
+			entries = ServerLogger::getCircularLogdata(clientid, lastid, logid);
+		}
+
+		JSON::Array j_log;
+		size_t new_lastid = lastid;
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			const SCircularLogEntry& entry = entries[i];
+			if (entry.id != std::string::npos
+				&& (lastid == std::string::npos || entry.id > lastid))
+			{
+				JSON::Object obj;
+				obj.set("msg", entry.utf8_msg);
+				obj.set("id", entry.id);
+				obj.set("loglevel", entry.loglevel);
+				obj.set("time", entry.time);
+				j_log.add(obj);
+
+				if (new_lastid == std::string::npos
+					|| entry.id > new_lastid)
+				{
+					new_lastid = entry.id;
+				}
+			}
+		}
+
+		lastid = new_lastid;
+
+		if (j_log.size() == 0)
+		{
+			return true;
+		}
+
+		JSON::Object msg;
+		msg.set("type", "log");
+		msg.set("log", j_log);
+
+		return pipe->Write(msg.stringify(false), write_timeout_ms);
+	}
+}
+
+void StatusWebSocket::Execute(str_map& GET, THREAD_ID tid, str_map& PARAMS, IPipe* pipe, const std::string& endpoint_name)
+{
+	SStatusRights rights;
+	if (!getRights(tid, GET, PARAMS, rights))
+	{
+		pipe->Write("HTTP/1.1 403 Forbidden\r\nConnection: Close\r\n\r\n");
+		delete pipe;
+		return;
+	}
+
+	if (!websocketHandshake(PARAMS, pipe))
+	{
+		return;
+	}
+
+	WebSocketPipe* ws_pipe = new WebSocketPipe(pipe, false, true, std::string(), true);
+
+	bool with_log = GET["log"] == "1";
+	int log_clientid = watoi(GET["clientid"]);
+	logid_t logid = logid_t();
+	str_map::iterator logid_it = GET.find("logid");
+	if (logid_it != GET.end())
+	{
+		logid.first = watoi64(logid_it->second);
+	}
+
+	if (with_log
+		&& ( (log_clientid == 0 && !rights.all_log_rights)
+			|| (log_clientid != 0 && !rights.hasRight(rights.all_log_rights, rights.log_clientids, log_clientid)) ) )
+	{
+		with_log = false;
+	}
+
+	size_t version = 0;
+	size_t log_lastid = std::string::npos;
+	std::set<std::string> sent_clients;
+	int64 last_session_check = Server->getTimeMS();
+
+	while (!ws_pipe->hasError())
+	{
+		if (!pushProgress(ws_pipe, rights, version, sent_clients))
+		{
+			break;
+		}
+
+		if (with_log
+			&& !pushLog(ws_pipe, log_clientid, logid, log_lastid))
+		{
+			break;
+		}
+
+		if (ws_pipe->isReadable(push_interval_ms))
+		{
+			//Only close and ping frames are expected
+			std::string msg;
+			ws_pipe->Read(&msg, 0);
+		}
+
+		if (Server->getTimeMS() - last_session_check > session_check_interval_ms)
+		{
+			SStatusRights new_rights;
+			if (!getRights(tid, GET, PARAMS, new_rights))
+			{
+				break;
+			}
+			rights = new_rights;
+			last_session_check = Server->getTimeMS();
+		}
+	}
+
+	delete ws_pipe;
+}
+
+std::string StatusWebSocket::getName()
+{
+	return name;
+}
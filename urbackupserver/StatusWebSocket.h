@@ -0,0 +1,26 @@
+#pragma once
+
+#include "../Interface/WebSocket.h"
+
+/**
+* Pushes progress changes and live log entries to the web interface.
+* Instead of polling the progress and livelog actions the web interface
+* connects to the "status" websocket with its session and gets
+* - {"type": "progress", "full": true/false, "version": ..., "removed": [names], "clients": [...]}
+*   with only the clients changed since the last message (all clients if full is set).
+*   Removed clients should be removed before the changed clients are applied.
+* - {"type": "log", "log": [...]} with the new log entries (if log=1 is given,
+*   optionally with clientid and logid)
+*/
+class StatusWebSocket : public IWebSocket
+{
+public:
+	StatusWebSocket(const std::string& name)
+		: name(name) {}
+
+	virtual void Execute(str_map& GET, THREAD_ID tid, str_map& PARAMS, IPipe* pipe, const std::string& endpoint_name);
+	virtual std::string getName();
+
+private:
+	std::string name;
+};
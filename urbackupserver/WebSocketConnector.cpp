@@ -7,13 +7,13 @@
 
 extern ICryptoFactory* crypto_fak;
 
-void WebSocketConnector::Execute(str_map& GET, THREAD_ID tid, str_map& PARAMS, IPipe* pipe, const std::string& endpoint_name)
+bool websocketHandshake(str_map& PARAMS, IPipe* pipe)
 {
 	if (PARAMS["CONNECTION"] != "Upgrade")
 	{
 		pipe->Write("HTTP/1.1 500 Expecting Connection: Upgrade\r\nConnection: Close\r\n\r\n");
 		delete pipe;
-		return;
+		return false;
 	}
 
 	std::string protocol_list = PARAMS["SEC-WEBSOCKET-PROTOCOL"];
@@ -27,14 +27,14 @@ void WebSocketConnector::Execute(str_map& GET, THREAD_ID tid, str_map& PARAMS, I
 	{
 		pipe->Write("HTTP/1.1 500 urbackup protocol not supported\r\nConnection: Close\r\n\r\n");
 		delete pipe;
-		return;
+		return false;
 	}
 
 	if (PARAMS["SEC-WEBSOCKET-VERSION"] != "13")
 	{
 		pipe->Write("HTTP/1.1 500 websocket protocol version not supported\r\nConnection: Close\r\n\r\n");
 		delete pipe;
-		return;
+		return false;
 	}
 
 	std::string websocket_key = trim(PARAMS["SEC-WEBSOCKET-KEY"]);
@@ -48,6 +48,16 @@ void WebSocketConnector::Execute(str_map& GET, THREAD_ID tid, str_map& PARAMS, I
 			static_cast<unsigned int>(key_response.size())) + "\r\n"
 		"Sec-WebSocket-Protocol: urbackup\r\n\r\n");
 
+	return true;
+}
+
+void WebSocketConnector::Execute(str_map& GET, THREAD_ID tid, str_map& PARAMS, IPipe* pipe, const std::string& endpoint_name)
+{
+	if (!websocketHandshake(PARAMS, pipe))
+	{
+		return;
+	}
+
 	ICustomClient* client = wrapped_service->createClient();
 
 	str_map::iterator it_forwarded_for = PARAMS.find("X-FORWARDED-FOR");
@@ -3,6 +3,9 @@
 #include "../Interface/WebSocket.h"
 #include "../Interface/Service.h"
 
+//Answers the websocket upgrade request. Deletes the pipe and returns false on error
+bool websocketHandshake(str_map& PARAMS, IPipe* pipe);
+
 class WebSocketConnector : public IWebSocket
 {
 public:
@@ -24,6 +24,7 @@
 #include "../server.h"
 #include "../serverinterface/helper.h"
 #include "../create_files_index.h"
+#include "../FilesDbShards.h"
 
 extern SStartupStatus startup_status;
 
@@ -161,6 +162,10 @@ int vacuum_databases()
 	dbs.push_back(URBACKUPDB_SERVER_FILES);
 	dbs.push_back(URBACKUPDB_SERVER_LINKS);
 	dbs.push_back(URBACKUPDB_SERVER_LINK_JOURNAL);
+	for (size_t shard = 1; shard < FilesDbShards::getNumShards(); ++shard)
+	{
+		dbs.push_back(FilesDbShards::getShardDatabaseId(shard));
+	}
 
 	for (size_t i = 0; i < dbs.size(); ++i)
 	{
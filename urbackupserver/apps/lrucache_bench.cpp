@@ -0,0 +1,134 @@
+#include "../../Interface/Server.h"
+#include "../../stringtools.h"
+#include "../../common/lrucache.h"
+#include "../../common/hash_lrucache.h"
+#include "../../mt19937ar.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+namespace
+{
+	struct SBenchVal
+	{
+		SBenchVal()
+			: size(0), dirty(false) {}
+
+		SBenchVal(int64 size, bool dirty)
+			: size(size), dirty(dirty) {}
+
+		int64 size;
+		bool dirty;
+	};
+
+	template<typename T>
+	int64 run_bench(T& cache, const std::vector<std::string>& keys, const std::vector<size_t>& access_seq,
+		size_t max_items, int64& chksum)
+	{
+		int64 starttime = Server->getTimeMS();
+
+		for (size_t i = 0; i < access_seq.size(); ++i)
+		{
+			const std::string& key = keys[access_seq[i]];
+			SBenchVal* val = cache.get(key);
+			if (val != NULL)
+			{
+				chksum += val->size;
+				if (i % 7 == 0)
+				{
+					val->dirty = !val->dirty;
+				}
+			}
+			else
+			{
+				if (cache.size() >= max_items)
+				{
+					typename T::list_t::iterator it = cache.eviction_iterator_start();
+					--it;
+					if (it->second.dirty)
+					{
+						cache.bring_to_front(it);
+					}
+					std::pair<std::string, SBenchVal> evicted = cache.evict_one();
+					chksum += evicted.second.size;
+				}
+				cache.put(key, SBenchVal(static_cast<int64>(access_seq[i]), false));
+			}
+		}
+
+		for (size_t i = 0; i < keys.size(); i+=3)
+		{
+			cache.del(keys[i]);
+		}
+
+		return Server->getTimeMS() - starttime;
+	}
+}
+
+int lrucache_bench()
+{
+	size_t n_keys = static_cast<size_t>(watoi64(Server->getServerParameter("n_keys", "2000000")));
+	size_t n_ops = static_cast<size_t>(watoi64(Server->getServerParameter("n_ops", "20000000")));
+	size_t max_items = static_cast<size_t>(watoi64(Server->getServerParameter("max_items", "1000000")));
+
+	if (n_keys == 0 || max_items == 0)
+	{
+		Server->Log("n_keys and max_items have to be larger than zero", LL_ERROR);
+		return 1;
+	}
+
+	Server->Log("Generating " + convert(n_keys) + " keys and " + convert(n_ops) + " accesses...", LL_INFO);
+
+	init_genrand(123);
+
+	std::vector<std::string> keys;
+	keys.reserve(n_keys);
+	for (size_t i = 0; i < n_keys; ++i)
+	{
+		//Same shape as the hex block keys used by the cloud drive
+		std::string key = bytesToHex(reinterpret_cast<const unsigned char*>(&i), sizeof(i));
+		keys.push_back(key + convert(genrand_int32()));
+	}
+
+	std::vector<size_t> access_seq;
+	access_seq.reserve(n_ops);
+	size_t hot_keys = (std::max)(n_keys / 10, static_cast<size_t>(1));
+	for (size_t i = 0; i < n_ops; ++i)
+	{
+		//80% of accesses go to 10% of the keys
+		if (genrand_int32() % 10 < 8)
+		{
+			access_seq.push_back(genrand_int32() % hot_keys);
+		}
+		else
+		{
+			access_seq.push_back(genrand_int32() % n_keys);
+		}
+	}
+
+	int64 chksum_map = 0;
+	int64 time_map;
+	{
+		common::lrucache<std::string, SBenchVal> cache;
+		time_map = run_bench(cache, keys, access_seq, max_items, chksum_map);
+	}
+
+	Server->Log("common::lrucache: " + convert(time_map) + " ms", LL_INFO);
+
+	int64 chksum_hash = 0;
+	int64 time_hash;
+	{
+		common::hash_lrucache<std::string, SBenchVal> cache;
+		time_hash = run_bench(cache, keys, access_seq, max_items, chksum_hash);
+	}
+
+	Server->Log("common::hash_lrucache: " + convert(time_hash) + " ms", LL_INFO);
+
+	if (chksum_map != chksum_hash)
+	{
+		Server->Log("Checksum mismatch between cache implementations (" + convert(chksum_map) + " vs. " + convert(chksum_hash) + ")", LL_ERROR);
+		return 2;
+	}
+
+	return 0;
+}
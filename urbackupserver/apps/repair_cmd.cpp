@@ -18,6 +18,7 @@
 
 #include "app.h"
 #include "../../stringtools.h"
+#include "../FilesDbShards.h"
 
 int repair_cmd(void)
 {
@@ -29,6 +30,10 @@ int repair_cmd(void)
 	dbs.push_back(URBACKUPDB_SERVER_FILES);
 	dbs.push_back(URBACKUPDB_SERVER_LINKS);
 	dbs.push_back(URBACKUPDB_SERVER_LINK_JOURNAL);
+	for (size_t shard = 1; shard < FilesDbShards::getNumShards(); ++shard)
+	{
+		dbs.push_back(FilesDbShards::getShardDatabaseId(shard));
+	}
 
 	for (size_t i = 0; i < dbs.size(); ++i)
 	{
@@ -56,6 +61,10 @@ int repair_cmd(void)
 	db_names.push_back("_files");
 	db_names.push_back("_links");
 	db_names.push_back("_link_journal");
+	for (size_t shard = 1; shard < FilesDbShards::getNumShards(); ++shard)
+	{
+		db_names.push_back("_" + FilesDbShards::getShardName(shard));
+	}
 
 	for (size_t i = 0; i < db_names.size(); ++i)
 	{
@@ -80,7 +89,7 @@ int repair_cmd(void)
 			return 1;
 		}
 
-		if (db_names[i] == "_files")
+		if (next(db_names[i], 0, "_files"))
 		{
 			Server->Log("Moving rows from lost+found...", LL_INFO);
 			db->Write("INSERT OR IGNORE INTO files SELECT id, c1 AS backupid, c2 AS fullpath, c3 AS shahash, c4 AS filesize, c5 AS created, c6 AS rsize, "
@@ -28,14 +28,426 @@
 #include "serverinterface/helper.h"
 #include "dao/ServerBackupDao.h"
 #include "server_hash.h"
+#include "FilesDbShards.h"
+#include "../Interface/ThreadPool.h"
+#include "../Interface/Mutex.h"
+#include <algorithm>
+#include <queue>
 
 namespace
 {
 const size_t sqlite_data_allocation_chunk_size = 50 * 1024 * 1024; //50MB
+const int64 sort_min_range_ids = 1000000;
+const int64 sort_max_ranges = 512;
+const size_t sort_io_entries = 4096;
+
+#pragma pack(1)
+struct SSortEntry
+{
+	FileIndex::SIndexKey key;
+	int64 created;
+	int64 id;
+	int64 next_entry;
+	int64 prev_entry;
+	char pointed_to;
+
+	//Same order as ORDER BY shahash ASC, filesize ASC, clientid ASC, created DESC
+	bool operator<(const SSortEntry& other) const
+	{
+		if (key != other.key)
+			return key < other.key;
+		if (created != other.created)
+			return created > other.created;
+		return id > other.id;
+	}
+};
+#pragma pack()
+
+/**
+* Sorts the file entries of one files database in index key order. Ranges of
+* entry ids are read and sorted in memory by several threads and written as
+* sorted runs, which are then merged. Finished runs are kept until the index
+* is created, so an interrupted rebuild only has to sort the remaining ranges.
+*/
+class FileEntrySorter
+{
+public:
+	FileEntrySorter(DATABASE_ID db_id, const std::string& name, SStartupStatus& status)
+		: db_id(db_id), dir("urbackup/fileindex_sort_" + name), status(status),
+		mutex(Server->createMutex()), n_files(0), min_id(0), range_size(sort_min_range_ids),
+		n_ranges(0), next_range(0), done_ranges(0), sorted_entries(0), error(false)
+	{
+	}
+
+	~FileEntrySorter()
+	{
+		closeRuns();
+		Server->destroy(mutex);
+	}
+
+	bool sort();
+
+	bool startMerge();
+
+	bool next(SSortEntry& entry);
+
+	void removeRuns();
+
+	int64 getNumEntries()
+	{
+		return n_files;
+	}
+
+	bool has_error()
+	{
+		return error;
+	}
+
+	void sortRanges();
+
+private:
+	struct SRunReader
+	{
+		IFile* file;
+		std::vector<SSortEntry> buf;
+		size_t pos;
+	};
+
+	struct SMergeItem
+	{
+		SMergeItem(const SSortEntry& entry, size_t run)
+			: entry(entry), run(run) {}
+
+		//std::priority_queue returns the largest item first
+		bool operator<(const SMergeItem& other) const
+		{
+			return other.entry < entry;
+		}
+
+		SSortEntry entry;
+		size_t run;
+	};
+
+	std::string getRunFn(int64 range)
+	{
+		return dir + "/" + convert(range) + ".run";
+	}
+
+	bool sortRange(IDatabase* db, int64 range, size_t& n_entries);
+	bool refill(SRunReader& reader);
+	void closeRuns();
+
+	DATABASE_ID db_id;
+	std::string dir;
+	SStartupStatus& status;
+
+	IMutex* mutex;
+	int64 n_files;
+	int64 min_id;
+	int64 range_size;
+	int64 n_ranges;
+	int64 next_range;
+	int64 done_ranges;
+	size_t sorted_entries;
+	bool error;
+
+	std::vector<SRunReader> readers;
+	std::priority_queue<SMergeItem> merge_queue;
+};
+
+class FileEntrySortThread : public IThread
+{
+public:
+	FileEntrySortThread(FileEntrySorter* sorter)
+		: sorter(sorter) {}
+
+	void operator()()
+	{
+		sorter->sortRanges();
+		Server->destroyDatabases(Server->getThreadID());
+		delete this;
+	}
+
+private:
+	FileEntrySorter* sorter;
+};
+
+bool FileEntrySorter::sort()
+{
+	IDatabase* db = Server->getDatabase(Server->getThreadID(), db_id);
+	if (db == NULL)
+	{
+		return false;
+	}
+
+	db_results res = db->Read("SELECT COUNT(*) AS c, MIN(id) AS min_id, MAX(id) AS max_id FROM files");
+	if (res.empty())
+	{
+		Server->Log("Error getting number of file entries", LL_ERROR);
+		return false;
+	}
+
+	n_files = watoi64(res[0]["c"]);
+	min_id = watoi64(res[0]["min_id"]);
+	int64 max_id = watoi64(res[0]["max_id"]);
+
+	range_size = (std::max)(sort_min_range_ids, (max_id - min_id) / sort_max_ranges + 1);
+	n_ranges = n_files > 0 ? ((max_id - min_id) / range_size + 1) : 0;
+
+	//Runs of a previous attempt are only valid for the same entries
+	std::string state = "n_files=" + convert(n_files) + "\nmin_id=" + convert(min_id)
+		+ "\nmax_id=" + convert(max_id) + "\nrange_size=" + convert(range_size) + "\n";
+
+	if (getFile(dir + "/state") != state)
+	{
+		os_remove_nonempty_dir(dir);
+		if (!os_create_dir(dir))
+		{
+			Server->Log("Error creating directory \"" + dir + "\". " + os_last_error_str(), LL_ERROR);
+			return false;
+		}
+		writestring(state, dir + "/state");
+	}
+	else
+	{
+		Server->Log("Resuming sorting of file entries...", LL_INFO);
+	}
+
+	size_t n_threads = watoi(Server->getServerParameter("files_index_sort_threads", "0"));
+	if (n_threads == 0)
+	{
+		n_threads = (std::min)((std::max)(os_get_num_cpus(), static_cast<size_t>(1)), static_cast<size_t>(8));
+	}
+
+	Server->Log("Sorting " + convert(n_files) + " file entries in " + convert(n_ranges) + " ranges with " + convert(n_threads) + " threads...", LL_INFO);
+
+	std::vector<THREADPOOL_TICKET> tickets;
+	for (size_t i = 0; i < n_threads; ++i)
+	{
+		tickets.push_back(Server->getThreadPool()->execute(new FileEntrySortThread(this), "sort file entries"));
+	}
+
+	Server->getThreadPool()->waitFor(tickets);
+
+	return !error;
+}
+
+void FileEntrySorter::sortRanges()
+{
+	IDatabase* db = Server->getDatabase(Server->getThreadID(), db_id);
+
+	while (true)
+	{
+		int64 range;
+		{
+			IScopedLock lock(mutex);
+			if (error || next_range >= n_ranges)
+			{
+				break;
+			}
+			range = next_range++;
+		}
+
+		size_t n_entries = 0;
+		bool b = db != NULL && sortRange(db, range, n_entries);
+
+		IScopedLock lock(mutex);
+		if (!b)
+		{
+			error = true;
+			break;
+		}
+
+		++done_ranges;
+		sorted_entries += n_entries;
+
+		int last_pc = static_cast<int>(status.pc_done * 100 + 0.5);
+
+		{
+			IScopedLock status_lock(status.mutex);
+			status.processed_file_entries = sorted_entries;
+			status.pc_done = static_cast<double>(done_ranges) / n_ranges;
+		}
+
+		int curr_pc = static_cast<int>(status.pc_done * 100 + 0.5);
+		if (curr_pc != last_pc)
+		{
+			Server->Log("Sorting file entries: " + convert(curr_pc) + "% finished", LL_INFO);
+		}
+	}
+}
+
+bool FileEntrySorter::sortRange(IDatabase* db, int64 range, size_t& n_entries)
+{
+	std::string run_fn = getRunFn(range);
+
+	if (FileExists(run_fn))
+	{
+		//Sorted by a previous attempt
+		std::unique_ptr<IFile> run_file(Server->openFile(run_fn, MODE_READ));
+		if (run_file.get() != NULL)
+		{
+			n_entries = static_cast<size_t>(run_file->Size() / sizeof(SSortEntry));
+			return true;
+		}
+	}
+
+	IQuery* q_read = db->Prepare("SELECT id, shahash, filesize, clientid, created, next_entry, prev_entry, pointed_to "
+		"FROM files "
+		"WHERE id>=? AND id<? AND length(shahash)>=16 AND filesize>" + std::to_string(link_file_min_size), false);
+	q_read->Bind(min_id + range * range_size);
+	q_read->Bind(min_id + (range + 1) * range_size);
+
+	std::vector<SSortEntry> entries;
+
+	IDatabaseCursor* cur = q_read->Cursor();
+	db_single_result res;
+	while (cur->next(res))
+	{
+		SSortEntry entry;
+		entry.key = FileIndex::SIndexKey(res["shahash"].c_str(), watoi64(res["filesize"]), watoi(res["clientid"]));
+		entry.created = watoi64(res["created"]);
+		entry.id = watoi64(res["id"]);
+		entry.next_entry = watoi64(res["next_entry"]);
+		entry.prev_entry = watoi64(res["prev_entry"]);
+		entry.pointed_to = watoi(res["pointed_to"]) != 0 ? 1 : 0;
+		entries.push_back(entry);
+	}
+
+	bool read_error = cur->has_error();
+	db->destroyQuery(q_read);
+
+	if (read_error)
+	{
+		Server->Log("Error reading file entries of range " + convert(range), LL_ERROR);
+		return false;
+	}
+
+	std::sort(entries.begin(), entries.end());
+
+	std::unique_ptr<IFile> run_file(Server->openFile(run_fn + ".new", MODE_WRITE));
+	if (run_file.get() == NULL)
+	{
+		Server->Log("Error creating sorted run \"" + run_fn + ".new\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	for (size_t i = 0; i < entries.size(); i += sort_io_entries)
+	{
+		_u32 towrite = static_cast<_u32>((std::min)(sort_io_entries, entries.size() - i) * sizeof(SSortEntry));
+		if (run_file->Write(reinterpret_cast<const char*>(&entries[i]), towrite) != towrite)
+		{
+			Server->Log("Error writing sorted run \"" + run_fn + ".new\". " + os_last_error_str(), LL_ERROR);
+			return false;
+		}
+	}
+
+	if (!run_file->Sync())
+	{
+		Server->Log("Error syncing sorted run \"" + run_fn + ".new\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	run_file.reset();
+
+	if (!os_rename_file(run_fn + ".new", run_fn))
+	{
+		Server->Log("Error renaming sorted run to \"" + run_fn + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	n_entries = entries.size();
+	return true;
+}
+
+bool FileEntrySorter::startMerge()
+{
+	for (int64 range = 0; range < n_ranges; ++range)
+	{
+		SRunReader reader;
+		reader.file = Server->openFile(getRunFn(range), MODE_READ);
+		reader.pos = 0;
+
+		if (reader.file == NULL)
+		{
+			Server->Log("Error opening sorted run \"" + getRunFn(range) + "\". " + os_last_error_str(), LL_ERROR);
+			error = true;
+			return false;
+		}
+
+		readers.push_back(reader);
+
+		if (refill(readers.back()))
+		{
+			merge_queue.push(SMergeItem(readers.back().buf[0], readers.size() - 1));
+		}
+	}
+
+	return !error;
+}
+
+bool FileEntrySorter::refill(SRunReader& reader)
+{
+	reader.buf.resize(sort_io_entries);
+	reader.pos = 0;
+
+	bool read_error = false;
+	_u32 read = reader.file->Read(reinterpret_cast<char*>(&reader.buf[0]),
+		static_cast<_u32>(reader.buf.size() * sizeof(SSortEntry)), &read_error);
+
+	if (read_error)
+	{
+		Server->Log("Error reading sorted run \"" + reader.file->getFilename() + "\"", LL_ERROR);
+		error = true;
+	}
+
+	reader.buf.resize(read / sizeof(SSortEntry));
+
+	return !reader.buf.empty();
+}
+
+bool FileEntrySorter::next(SSortEntry& entry)
+{
+	if (merge_queue.empty())
+	{
+		return false;
+	}
+
+	SMergeItem item = merge_queue.top();
+	merge_queue.pop();
+
+	entry = item.entry;
+
+	SRunReader& reader = readers[item.run];
+	++reader.pos;
+	if (reader.pos < reader.buf.size()
+		|| refill(reader))
+	{
+		merge_queue.push(SMergeItem(reader.buf[reader.pos], item.run));
+	}
+
+	return true;
+}
+
+void FileEntrySorter::closeRuns()
+{
+	for (size_t i = 0; i < readers.size(); ++i)
+	{
+		Server->destroy(readers[i].file);
+	}
+	readers.clear();
+	merge_queue = std::priority_queue<SMergeItem>();
+}
+
+void FileEntrySorter::removeRuns()
+{
+	closeRuns();
+	os_remove_nonempty_dir(dir);
+}
 
 struct SCallbackData
 {
-	IDatabaseCursor* cur;
+	FileEntrySorter* sorter;
 	int64 pos;
 	int64 max_pos;
 	SStartupStatus* status;
@@ -62,17 +474,75 @@ db_results create_callback(size_t n_done, size_t n_rows, void *userdata)
 	}
 	
 	db_results ret;
-	db_single_result res;
+	SSortEntry entry;
 	
-	if(data->cur->next(res))
+	if(data->sorter->next(entry))
 	{
+		db_single_result res;
+		res["id"] = convert(entry.id);
+		res["shahash"] = std::string(entry.key.getHash(), bytes_in_index);
+		res["filesize"] = convert(entry.key.getFilesize());
+		res["clientid"] = convert(entry.key.getClientid());
+		res["next_entry"] = convert(entry.next_entry);
+		res["prev_entry"] = convert(entry.prev_entry);
+		res["pointed_to"] = convert(static_cast<int>(entry.pointed_to));
 		ret.push_back(res);
 	}
 	
 	return ret;
 }
 
-bool create_files_index_common(FileIndex& fileindex, SStartupStatus& status)
+bool create_files_index_shard(LMDBFileIndex& fileindex, size_t shard, SStartupStatus& status)
+{
+	IDatabase* db = Server->getDatabase(Server->getThreadID(), FilesDbShards::getShardDatabaseId(shard));
+
+	if (db == NULL)
+	{
+		Server->Log("Error opening file entry database shard " + convert(shard), LL_ERROR);
+		return false;
+	}
+
+	Server->Log("Adding file entries of database shard " + convert(shard) + " to file entry index...", LL_INFO);
+
+	db->Write("UPDATE files SET next_entry=0, prev_entry=0, pointed_to=0 "
+		"WHERE length(shahash)<16 OR filesize<" + std::to_string(link_file_min_size));
+
+	status.pc_done = 0;
+
+	FileEntrySorter sorter(FilesDbShards::getShardDatabaseId(shard), FilesDbShards::getShardName(shard), status);
+	if (!sorter.sort()
+		|| !sorter.startMerge())
+	{
+		return false;
+	}
+
+	SCallbackData data;
+	data.sorter = &sorter;
+	data.pos = 0;
+	data.max_pos = sorter.getNumEntries();
+	data.status = &status;
+
+	status.pc_done = 0;
+
+	{
+		//Pointers are updated in place. The keys of the shard are
+		//interleaved with the ones already in the index, so no appending
+		DBScopedWriteTransaction write_transaction(db);
+		fileindex.create(create_callback, &data, FilesDbShards::getShardDatabaseId(shard), false);
+	}
+
+	if (fileindex.has_error()
+		|| sorter.has_error())
+	{
+		return false;
+	}
+
+	sorter.removeRuns();
+
+	return true;
+}
+
+bool create_files_index_common(LMDBFileIndex& fileindex, SStartupStatus& status)
 {
 	Server->destroyAllDatabases();
 
@@ -142,16 +612,6 @@ bool create_files_index_common(FileIndex& fileindex, SStartupStatus& status)
 	status.creating_filesindex=true;
 	Server->Log("Creating file entry index. This might take a while...", LL_WARNING);
 	
-	Server->Log("Getting number of files...", LL_INFO);
-	
-	db_results res = db->Read("SELECT COUNT(*) AS c FROM files");
-	
-	int64 n_files = 0;
-	if(!res.empty())
-	{
-		n_files=watoi64(res[0]["c"]);
-	}
-
 	Server->Log("Dropping index...", LL_INFO);
 
 	db_files_new->Write("DROP INDEX IF EXISTS files_backupid");
@@ -161,17 +621,23 @@ bool create_files_index_common(FileIndex& fileindex, SStartupStatus& status)
 	db->Write("UPDATE files SET next_entry=0, prev_entry=0, pointed_to=0 "
 		"WHERE length(shahash)<16 OR filesize<" + std::to_string(link_file_min_size));
 
+	Server->Log("Sorting file entries...", LL_INFO);
+
+	FileEntrySorter sorter(URBACKUPDB_SERVER_FILES, FilesDbShards::getShardName(0), status);
+	if (!sorter.sort()
+		|| !sorter.startMerge())
+	{
+		return false;
+	}
+
 	Server->Log("Starting creating files index...", LL_INFO);
 
-	IQuery *q_read=db->Prepare("SELECT id, shahash, filesize, clientid, next_entry, prev_entry, pointed_to "
-		"FROM files "
-		"WHERE length(shahash)>=16 AND filesize>"+std::to_string(link_file_min_size)+" "
-		"ORDER BY shahash ASC, filesize ASC, clientid ASC, created DESC");
+	status.pc_done = 0;
 
 	SCallbackData data;
-	data.cur=q_read->Cursor();
+	data.sorter=&sorter;
 	data.pos=0;
-	data.max_pos=n_files;
+	data.max_pos=sorter.getNumEntries();
 	data.status=&status;
 
 	{
@@ -185,11 +651,13 @@ bool create_files_index_common(FileIndex& fileindex, SStartupStatus& status)
 	}
 	else
 	{
-		if (data.cur->has_error())
+		if (sorter.has_error())
 		{
 			return false;
 		}
 
+		sorter.removeRuns();
+
 		Server->Log("Creating backupid index...", LL_INFO);
 
 		db_files_new->Write("CREATE INDEX files_backupid ON files (backupid)");
@@ -227,6 +695,14 @@ bool create_files_index_common(FileIndex& fileindex, SStartupStatus& status)
 		}
 
 		db->Write("PRAGMA journal_mode = WAL");
+
+		for (size_t shard = 1; shard < FilesDbShards::getNumShards(); ++shard)
+		{
+			if (!create_files_index_shard(fileindex, shard, status))
+			{
+				return false;
+			}
+		}
 	}
 
 	status.creating_filesindex=false;
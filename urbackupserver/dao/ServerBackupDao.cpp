@@ -271,6 +271,66 @@ std::vector<ServerBackupDao::SDuration> ServerBackupDao::getLastFullDurations(in
 }
 
 
+/**
+* @-SQLGenAccess
+* @func vector<int64> ServerBackupDao::getLastIncrementalImageDurations
+* @return int64 duration
+* @sql
+*      SELECT (strftime('%s',running)-strftime('%s',backuptime)) AS duration
+*		FROM backup_images
+*		WHERE clientid=:clientid(int) AND letter=:letter(string) AND complete=1 AND incremental<>0
+*		ORDER BY backuptime DESC LIMIT 10
+*/
+std::vector<int64> ServerBackupDao::getLastIncrementalImageDurations(int clientid, const std::string& letter)
+{
+	if(q_getLastIncrementalImageDurations==NULL)
+	{
+		q_getLastIncrementalImageDurations=db->Prepare("SELECT (strftime('%s',running)-strftime('%s',backuptime)) AS duration FROM backup_images WHERE clientid=? AND letter=? AND complete=1 AND incremental<>0 ORDER BY backuptime DESC LIMIT 10", false);
+	}
+	q_getLastIncrementalImageDurations->Bind(clientid);
+	q_getLastIncrementalImageDurations->Bind(letter);
+	db_results res=q_getLastIncrementalImageDurations->Read();
+	q_getLastIncrementalImageDurations->Reset();
+	std::vector<int64> ret;
+	ret.resize(res.size());
+	for(size_t i=0;i<res.size();++i)
+	{
+		ret[i]=watoi64(res[i]["duration"]);
+	}
+	return ret;
+}
+
+
+/**
+* @-SQLGenAccess
+* @func vector<int64> ServerBackupDao::getLastFullImageDurations
+* @return int64 duration
+* @sql
+*      SELECT (strftime('%s',running)-strftime('%s',backuptime)) AS duration
+*		FROM backup_images
+*		WHERE clientid=:clientid(int) AND letter=:letter(string) AND complete=1 AND incremental=0
+*		ORDER BY backuptime DESC LIMIT 1
+*/
+std::vector<int64> ServerBackupDao::getLastFullImageDurations(int clientid, const std::string& letter)
+{
+	if(q_getLastFullImageDurations==NULL)
+	{
+		q_getLastFullImageDurations=db->Prepare("SELECT (strftime('%s',running)-strftime('%s',backuptime)) AS duration FROM backup_images WHERE clientid=? AND letter=? AND complete=1 AND incremental=0 ORDER BY backuptime DESC LIMIT 1", false);
+	}
+	q_getLastFullImageDurations->Bind(clientid);
+	q_getLastFullImageDurations->Bind(letter);
+	db_results res=q_getLastFullImageDurations->Read();
+	q_getLastFullImageDurations->Reset();
+	std::vector<int64> ret;
+	ret.resize(res.size());
+	for(size_t i=0;i<res.size();++i)
+	{
+		ret[i]=watoi64(res[i]["duration"]);
+	}
+	return ret;
+}
+
+
 /**
 * @-SQLGenAccess
 * @func string ServerBackupDao::getClientSetting
@@ -2041,6 +2101,8 @@ void ServerBackupDao::prepareQueries( void )
 	q_getVirtualMainClientname=NULL;
 	q_getLastIncrementalDurations=NULL;
 	q_getLastFullDurations=NULL;
+	q_getLastIncrementalImageDurations=NULL;
+	q_getLastFullImageDurations=NULL;
 	q_getClientSetting=NULL;
 	q_getClientIds=NULL;
 	q_getClientsByUid=NULL;
@@ -2133,6 +2195,8 @@ void ServerBackupDao::destroyQueries( void )
 	db->destroyQuery(q_getVirtualMainClientname);
 	db->destroyQuery(q_getLastIncrementalDurations);
 	db->destroyQuery(q_getLastFullDurations);
+	db->destroyQuery(q_getLastIncrementalImageDurations);
+	db->destroyQuery(q_getLastFullImageDurations);
 	db->destroyQuery(q_getClientSetting);
 	db->destroyQuery(q_getClientIds);
 	db->destroyQuery(q_getClientsByUid);
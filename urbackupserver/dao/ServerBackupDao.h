@@ -110,6 +110,8 @@ public:
 	SClientName getVirtualMainClientname(int clientid);
 	std::vector<SDuration> getLastIncrementalDurations(int clientid);
 	std::vector<SDuration> getLastFullDurations(int clientid);
+	std::vector<int64> getLastIncrementalImageDurations(int clientid, const std::string& letter);
+	std::vector<int64> getLastFullImageDurations(int clientid, const std::string& letter);
 	CondString getClientSetting(const std::string& key, int clientid);
 	std::vector<int> getClientIds(void);
 	std::vector<int> getClientsByUid(const std::string& uid);
@@ -209,6 +211,8 @@ private:
 	IQuery* q_getVirtualMainClientname;
 	IQuery* q_getLastIncrementalDurations;
 	IQuery* q_getLastFullDurations;
+	IQuery* q_getLastIncrementalImageDurations;
+	IQuery* q_getLastFullImageDurations;
 	IQuery* q_getClientSetting;
 	IQuery* q_getClientIds;
 	IQuery* q_getClientsByUid;
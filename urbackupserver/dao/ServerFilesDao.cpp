@@ -492,6 +492,24 @@ void ServerFilesDao::deleteFiles(int backupid)
 	q_deleteFiles->Reset();
 }
 
+/**
+* @-SQLGenAccess
+* @func void ServerFilesDao::deleteFilesUpTo
+* @sql
+*	DELETE FROM files WHERE backupid=:backupid(int) AND id<=:max_id(int64)
+*/
+void ServerFilesDao::deleteFilesUpTo(int backupid, int64 max_id)
+{
+	if(q_deleteFilesUpTo==NULL)
+	{
+		q_deleteFilesUpTo=db->Prepare("DELETE FROM files WHERE backupid=? AND id<=?", false);
+	}
+	q_deleteFilesUpTo->Bind(backupid);
+	q_deleteFilesUpTo->Bind(max_id);
+	q_deleteFilesUpTo->Write();
+	q_deleteFilesUpTo->Reset();
+}
+
 /**
 * @-SQLGenAccess
 * @func void ServerFilesDao::removeDanglingFiles
@@ -698,6 +716,7 @@ void ServerFilesDao::prepareQueries()
 	q_delIncomingStatEntry=NULL;
 	q_getIncomingStats=NULL;
 	q_deleteFiles=NULL;
+	q_deleteFilesUpTo=NULL;
 	q_removeDanglingFiles=NULL;
 	q_createTemporaryLastFilesTable=NULL;
 	q_dropTemporaryLastFilesTable=NULL;
@@ -731,6 +750,7 @@ void ServerFilesDao::destroyQueries()
 	db->destroyQuery(q_delIncomingStatEntry);
 	db->destroyQuery(q_getIncomingStats);
 	db->destroyQuery(q_deleteFiles);
+	db->destroyQuery(q_deleteFilesUpTo);
 	db->destroyQuery(q_removeDanglingFiles);
 	db->destroyQuery(q_createTemporaryLastFilesTable);
 	db->destroyQuery(q_dropTemporaryLastFilesTable);
@@ -97,6 +97,7 @@ public:
 	void delIncomingStatEntry(int64 id);
 	std::vector<SIncomingStat> getIncomingStats(void);
 	void deleteFiles(int backupid);
+	void deleteFilesUpTo(int backupid, int64 max_id);
 	void removeDanglingFiles(void);
 	bool createTemporaryLastFilesTable(void);
 	void dropTemporaryLastFilesTable(void);
@@ -137,6 +138,7 @@ private:
 	IQuery* q_delIncomingStatEntry;
 	IQuery* q_getIncomingStats;
 	IQuery* q_deleteFiles;
+	IQuery* q_deleteFilesUpTo;
 	IQuery* q_removeDanglingFiles;
 	IQuery* q_createTemporaryLastFilesTable;
 	IQuery* q_dropTemporaryLastFilesTable;
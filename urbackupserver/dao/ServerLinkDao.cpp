@@ -242,6 +242,33 @@ std::vector<ServerLinkDao::DirectoryLinkEntry> ServerLinkDao::getLinksByPoolName
 	return ret;
 }
 
+/**
+* @-SQLGenAccess
+* @func vector<string> ServerLinkDao::getReferencedPoolNames
+* @return string name
+* @sql
+*     SELECT DISTINCT name FROM directory_links
+*            WHERE clientid=:clientid(int)
+*            ORDER BY name
+*/
+std::vector<std::string> ServerLinkDao::getReferencedPoolNames(int clientid)
+{
+	if(q_getReferencedPoolNames==NULL)
+	{
+		q_getReferencedPoolNames=db->Prepare("SELECT DISTINCT name FROM directory_links WHERE clientid=? ORDER BY name", false);
+	}
+	q_getReferencedPoolNames->Bind(clientid);
+	db_results res=q_getReferencedPoolNames->Read();
+	q_getReferencedPoolNames->Reset();
+	std::vector<std::string> ret;
+	ret.resize(res.size());
+	for(size_t i=0;i<res.size();++i)
+	{
+		ret[i]=res[i]["name"];
+	}
+	return ret;
+}
+
 /**
 * @-SQLGenAccess
 * @func void ServerLinkDao::deleteLinkReferenceEntry
@@ -290,6 +317,7 @@ void ServerLinkDao::prepareQueries()
 	q_getDirectoryRefcountWithTarget=NULL;
 	q_getLinksInDirectory=NULL;
 	q_getLinksByPoolName=NULL;
+	q_getReferencedPoolNames=NULL;
 	q_deleteLinkReferenceEntry=NULL;
 	q_updateLinkReferenceTarget=NULL;
 }
@@ -305,6 +333,7 @@ void ServerLinkDao::destroyQueries()
 	db->destroyQuery(q_getDirectoryRefcountWithTarget);
 	db->destroyQuery(q_getLinksInDirectory);
 	db->destroyQuery(q_getLinksByPoolName);
+	db->destroyQuery(q_getReferencedPoolNames);
 	db->destroyQuery(q_deleteLinkReferenceEntry);
 	db->destroyQuery(q_updateLinkReferenceTarget);
 }
\ No newline at end of file
@@ -29,6 +29,7 @@ public:
 	int getDirectoryRefcountWithTarget(int clientid, const std::string& name, const std::string& target);
 	std::vector<DirectoryLinkEntry> getLinksInDirectory(int clientid, const std::string& dir);
 	std::vector<DirectoryLinkEntry> getLinksByPoolName(int clientid, const std::string& name);
+	std::vector<std::string> getReferencedPoolNames(int clientid);
 	void deleteLinkReferenceEntry(int64 id);
 	void updateLinkReferenceTarget(const std::string& new_target, int64 id);
 	//@-SQLGenFunctionsEnd
@@ -49,6 +50,7 @@ private:
 	IQuery* q_getDirectoryRefcountWithTarget;
 	IQuery* q_getLinksInDirectory;
 	IQuery* q_getLinksByPoolName;
+	IQuery* q_getReferencedPoolNames;
 	IQuery* q_deleteLinkReferenceEntry;
 	IQuery* q_updateLinkReferenceTarget;
 	//@-SQLGenVariablesEnd
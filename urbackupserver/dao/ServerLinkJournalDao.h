@@ -12,6 +12,11 @@ public:
 		return db->getLastInsertID();
 	}
 
+	IDatabase* getDatabase()
+	{
+		return db;
+	}
+
 	//@-SQLGenFunctionsBegin
 	struct JournalEntry
 	{
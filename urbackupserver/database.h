@@ -8,5 +8,7 @@ const DATABASE_ID URBACKUPDB_SERVER_LINKS = 24;
 const DATABASE_ID URBACKUPDB_SERVER_LINK_JOURNAL = 25;
 const DATABASE_ID URBACKUPDB_SERVER_SETTINGS=30;
 const DATABASE_ID URBACKUPDB_SERVER_FILES_NEW = 26;
+//Plus shard number (see FilesDbShards)
+const DATABASE_ID URBACKUPDB_SERVER_FILES_SHARDS = 100;
 
 #endif //DATABASE_H
\ No newline at end of file
@@ -60,6 +60,7 @@ extern IServer* Server;
 #include "actions.h"
 #include "serverinterface/actions.h"
 #include "serverinterface/helper.h"
+#include "serverinterface/backups.h"
 SStartupStatus startup_status;
 #include "server.h"
 #include "ImageMount.h"
@@ -70,6 +71,9 @@ SStartupStatus startup_status;
 #include "server_log.h"
 #include "server_cleanup.h"
 #include "ClientMain.h"
+#include "BackupScheduler.h"
+#include "FilesDbShards.h"
+#include "ClientReactor.h"
 #include "server_archive.h"
 #include "server_settings.h"
 #include "server_update_stats.h"
@@ -101,6 +105,7 @@ SStartupStatus startup_status;
 #include "../urbackupcommon/chunk_hasher.h"
 #include "LogReport.h"
 #include "WebSocketConnector.h"
+#include "StatusWebSocket.h"
 
 #define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
 #include "../common/miniz.h"
@@ -155,6 +160,7 @@ bool verify_hashes(std::string arg);
 void updateRights(int t_userid, std::string s_rights, IDatabase *db);
 int md5sum_check();
 int blockalign();
+int lrucache_bench();
 void init_server_pubkey();
 
 std::string lang="en";
@@ -248,6 +254,22 @@ void open_server_database(bool init_db)
 		exit(1);
 	}
 
+	if (!sqlite_mmap_huge.empty())
+	{
+		params["mmap_size"] = sqlite_mmap_huge;
+	}
+
+	if (!FilesDbShards::openDatabases(params, sqlite_data_allocation_chunk_size))
+	{
+		Server->Log("Couldn't open file entry database shards. Exiting.", LL_ERROR);
+		exit(1);
+	}
+
+	if (!sqlite_mmap_huge.empty())
+	{
+		params.erase(params.find("mmap_size"));
+	}
+
 	if (!sqlite_mmap_small.empty())
 	{
 		params["mmap_size"] = sqlite_mmap_small;
@@ -342,6 +364,8 @@ void start_wal_checkpoint_threads()
 		"urbackup" + os_file_sep() + "backup_server_files.db", URBACKUPDB_SERVER_FILES);
 	Server->createThread(wal_checkpoint_thread, "files checkpoint");
 
+	FilesDbShards::startWalCheckpointThreads();
+
 	wal_checkpoint_thread = new WalCheckpointThread(10 * 1024 * 1024, 100 * 1024 * 1024,
 		"urbackup" + os_file_sep() + "backup_server.db", URBACKUPDB_SERVER, "main");
 	Server->createThread(wal_checkpoint_thread, "main checkpoint");
@@ -529,10 +553,14 @@ DLLEXPORT void LoadActions(IServer* pServer)
 		{
 			rc = blockalign();
 		}
+		else if (app == "lrucache_bench")
+		{
+			rc = lrucache_bench();
+		}
 		else
 		{
 			rc=100;
-			Server->Log("App not found. Available apps: cleanup, remove_unknown, cleanup_database, repair_database, defrag_database, export_auth_log, check_fileindex, skiphash_copy, md5sum_check, hash, blockalign");
+			Server->Log("App not found. Available apps: cleanup, remove_unknown, cleanup_database, repair_database, defrag_database, export_auth_log, check_fileindex, skiphash_copy, md5sum_check, hash, blockalign, lrucache_bench");
 		}
 		exit(rc);
 	}
@@ -665,9 +693,11 @@ DLLEXPORT void LoadActions(IServer* pServer)
 	ServerStatus::init_mutex();
 	ServerSettings::init_mutex();
 	ClientMain::init_mutex();
+	BackupScheduler::init_mutex();
 	DataplanDb::init();
 	init_log_report();
 	ServerChannelThread::init_mutex();
+	backupaccess::init_mutex();
 
 	open_settings_database();
 	
@@ -700,9 +730,8 @@ DLLEXPORT void LoadActions(IServer* pServer)
 	upgrade();
 
 
-	std::vector<DATABASE_ID> dbs;
+	std::vector<DATABASE_ID> dbs = FilesDbShards::getDatabaseIds();
 	dbs.push_back(URBACKUPDB_SERVER);
-	dbs.push_back(URBACKUPDB_SERVER_FILES);
 	dbs.push_back(URBACKUPDB_SERVER_LINKS);
 	dbs.push_back(URBACKUPDB_SERVER_LINK_JOURNAL);
 
@@ -840,6 +869,8 @@ DLLEXPORT void LoadActions(IServer* pServer)
 	ADD_ACTION(status_check);
 	ADD_ACTION(restore_image);
 
+	Server->addWebSocket(new StatusWebSocket("status"));
+
 	if(Server->getServerParameter("allow_shutdown")=="true")
 	{
 		ADD_ACTION(shutdown);
@@ -859,6 +890,8 @@ DLLEXPORT void LoadActions(IServer* pServer)
 
     ServerChannelThread::initOffset();
 
+	ClientReactor::init();
+
 	IDatabase* db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
 	if(crypto_fak==NULL 
 		&& db->Read("SELECT * FROM settings_db.si_users WHERE pbkdf2_rounds>0").size()>0)
@@ -969,6 +1002,7 @@ DLLEXPORT void UnloadActions(void)
 		{
 			Server->destroy(server_exit_pipe);
 			BackupServer::cleanupThrottlers();
+			ClientReactor::destroy();
 			shutdown_ok=true;
 		}
 	}
@@ -1001,6 +1035,7 @@ DLLEXPORT void UnloadActions(void)
 		ServerSettings::clear_cache();
 		ServerSettings::destroy_mutex();
 		ServerStatus::destroy_mutex();
+		backupaccess::destroy_mutex();
 		WalCheckpointThread::destroy_mutex();
 		destroy_dir_link_mutex();
 		Server->wait(1000);
@@ -1009,11 +1044,11 @@ DLLEXPORT void UnloadActions(void)
 	if(shutdown_ok)
 	{
 		ClientMain::destroy_mutex();
+		BackupScheduler::destroy_mutex();
 	}
 
-	std::vector<DATABASE_ID> db_ids;
+	std::vector<DATABASE_ID> db_ids = FilesDbShards::getDatabaseIds();
 	db_ids.push_back(URBACKUPDB_SERVER);
-	db_ids.push_back(URBACKUPDB_SERVER_FILES);
 	db_ids.push_back(URBACKUPDB_SERVER_LINKS);
 	db_ids.push_back(URBACKUPDB_SERVER_LINK_JOURNAL);
 
@@ -2379,6 +2414,18 @@ bool upgrade65_66()
 	return b;	
 }
 
+bool upgrade66_67()
+{
+	IDatabase* db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+
+	bool b = true;
+	b &= db->Write("CREATE TABLE files_shards (clientid INTEGER PRIMARY KEY, shard INTEGER)");
+	//Existing clients have their file entries in backup_server_files.db
+	b &= db->Write("INSERT INTO files_shards (clientid, shard) SELECT id, 0 FROM clients");
+
+	return b;
+}
+
 void upgrade(void)
 {
 	Server->destroyAllDatabases();
@@ -2400,7 +2447,7 @@ void upgrade(void)
 	
 	int ver=watoi(res_v[0]["tvalue"]);
 	int old_v;
-	int max_v=66;
+	int max_v=67;
 	{
 		IScopedLock lock(startup_status.mutex);
 		startup_status.target_db_version=max_v;
@@ -2806,6 +2853,13 @@ void upgrade(void)
 				}
 				++ver;
 				break;
+			case 66:
+				if (!upgrade66_67())
+				{
+					has_error = true;
+				}
+				++ver;
+				break;
 			default:
 				break;
 		}
@@ -29,6 +29,7 @@
 #include "../fsimageplugin/IVHDFile.h"
 #include "server_status.h"
 #include "server_settings.h"
+#include "ClientReactor.h"
 #include "../urbackupcommon/capa_bits.h"
 #include "serverinterface/helper.h"
 #include "serverinterface/login.h"
@@ -42,6 +43,10 @@
 #include "serverinterface/backups.h"
 #include "dao/ServerBackupDao.h"
 #include "../urbackupcommon/mbrdata.h"
+#include "../urbackupcommon/image_restore_stream.h"
+#ifndef NO_ZSTD_COMPRESSION
+#include <zstd.h>
+#endif
 
 const unsigned short serviceport=35623;
 extern IFSImageFactory *image_fak;
@@ -68,6 +73,18 @@ namespace
 		}
 	}
 
+	//Messages whose handlers hash passwords, query the database, walk backup
+	//directories or stream restores. They are handled off the reactor thread
+	bool isBlockingMsg(const std::string& msg)
+	{
+		return next(msg, 0, "DOWNLOAD IMAGE ")
+			|| next(msg, 0, "DOWNLOAD FILES ")
+			|| next(msg, 0, "LOGIN ")
+			|| next(msg, 0, "GET BACKUPIMAGES ")
+			|| next(msg, 0, "GET FILE BACKUPS")
+			|| next(msg, 0, "GET FILE LIST TOKENS ");
+	}
+
 
 	class SessionKeepaliveThread : public IThread
 	{
@@ -156,6 +173,23 @@ namespace
 		IPipe* pipe;
 		std::vector<char> extra_buffer;
 	};
+
+	class ReactorFinishThread : public IThread
+	{
+	public:
+		ReactorFinishThread(ServerChannelThread* channel)
+			: channel(channel)
+		{}
+
+		void operator()()
+		{
+			channel->reactorFinishBackground();
+			delete this;
+		}
+
+	private:
+		ServerChannelThread* channel;
+	};
 }
 
 int ServerChannelThread::img_id_offset=0;
@@ -224,10 +258,12 @@ ServerChannelThread::ServerChannelThread(ClientMain *client_main, const std::str
 		internet_mode(internet_mode), allow_restore(allow_restore), keepalive_thread(NULL), server_token(server_token),
 	virtual_client(virtual_client), allow_shutdown(true),
 	parent(parent), next_reauth_time(0), reauth_tries(0), restore_token_keepalive_thread(NULL),
-	startup_timestamp(0)
+	startup_timestamp(0), reactor(NULL), thread_ticket(ILLEGAL_THREADPOOL_TICKET),
+	reactor_finished(false), next_connect_time(0)
 {
 	do_exit=false;
 	mutex=Server->createMutex();
+	finish_cond=Server->createCondition();
 	input=NULL;
 	tcpstack.setAddChecksum(internet_mode);
 }
@@ -235,6 +271,7 @@ ServerChannelThread::ServerChannelThread(ClientMain *client_main, const std::str
 ServerChannelThread::~ServerChannelThread(void)
 {
 	Server->destroy(mutex);
+	Server->destroy(finish_cond);
 }
 
 void ServerChannelThread::operator()()
@@ -249,104 +286,296 @@ void ServerChannelThread::operator()()
 
 void ServerChannelThread::run()
 {
-	int64 lastpingtime=0;
-	lasttime=0;
-
-	settings=new ServerSettings(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER), clientid);
-	ScopedFreeObjRef<ServerSettings*> settings_free(settings);
-
-	std::string curr_ident;
+	initRun();
 
 	while(!do_exit)
 	{
 		if(input==NULL)
 		{
-			IPipe *np=client_main->getClientCommandConnection(settings, 10000, &client_addr);
+			IPipe *np=connectChannel();
 			if(np==NULL)
 			{
-				Server->Log("Connecting Channel to "+clientname+" failed - CONNECT error -55", LL_DEBUG);
 				Server->wait(10000);
 			}
 			else
 			{
-				{
-					IScopedLock lock(mutex);
-					input=np;
-				}
-				curr_ident = client_main->getIdentity();
-				tcpstack.reset();
-				tcpstack.setAddChecksum(client_main->isOnInternetConnection());
-				tcpstack.Send(input, curr_ident +"1CHANNEL capa="+convert(constructCapabilities())+"&token="+server_token+"&restore_version=1&startup=1&virtual_client="+EscapeParamString(virtual_client));
-
-				lasttime=Server->getTimeMS();
-				lastpingtime=lasttime;
+				channelConnected(np);
 			}
 		}
 		else
 		{
-			if(Server->getTimeMS()-lasttime>180000)
-			{
-				Server->Log("Resetting channel to "+clientname+" because of timeout.", LL_DEBUG);
-				reset();
-			}
-
-			if (curr_ident != client_main->getIdentity())
-			{
-				Server->Log("Resetting channel to " + clientname + " because session identity changed.", LL_DEBUG);
-				reset();
-			}
+			checkInput();
 
 			if(input!=NULL)
 			{
-				std::string ret;
-				size_t rc=input->Read(&ret, 80000);
-				if(rc>0)
+				int64 wait_ms = readInput(80000);
+				if (wait_ms > 0)
 				{
-					tcpstack.AddData((char*)ret.c_str(), ret.size());
+					Server->wait(static_cast<unsigned int>(wait_ms));
+				}
+			}
+		}
+	}
 
-					while(tcpstack.getPacket(ret) && !ret.empty())
-					{
-						if(ret!="PING")
-						{
-							Server->Log("Channel message: "+ret, LL_DEBUG);
-						}
-						lasttime=Server->getTimeMS();
-						std::string r=processMsg(ret);
-						if(!r.empty())
-							tcpstack.Send(input, r);
-					}
+	finishRun();
+}
 
-					bool was_updated;
-					settings->getSettings(&was_updated);
-					if(input!=NULL && was_updated)
-					{
-						Server->Log("Settings changed. Capabilities may have changed. Reconnecting channel...", LL_DEBUG);
-						reset();
-					}
-				}
-				else if(rc==0)
-				{
-					if(input->hasError())
-					{
-						Server->Log("Lost channel connection to "+clientname+". has_error=true", LL_DEBUG);
-						reset();
-						Server->wait(1000);
-					}
-					else
-					{
-						Server->Log("Lost channel connection to "+clientname+". has_error=false", LL_DEBUG);
-						Server->wait(1000);
-					}
-				}
+void ServerChannelThread::start(const std::string& name)
+{
+	reactor = ClientReactor::getThread();
+	if (reactor != NULL)
+	{
+		reactor->add(this);
+	}
+	else
+	{
+		thread_ticket = Server->getThreadPool()->execute(this, name);
+	}
+}
+
+void ServerChannelThread::join()
+{
+	if (reactor == NULL)
+	{
+		Server->getThreadPool()->waitFor(thread_ticket);
+	}
+	else
+	{
+		IScopedLock lock(mutex);
+		while (!reactor_finished)
+		{
+			finish_cond->wait(&lock);
+		}
+	}
+}
+
+void ServerChannelThread::reactorInit()
+{
+	initRun();
+}
+
+int64 ServerChannelThread::reactorRun(bool readable, bool& backoff)
+{
+	if (input == NULL)
+	{
+		return (std::max)(next_connect_time - Server->getTimeMS(), static_cast<int64>(0));
+	}
+
+	checkInput();
+
+	int64 wait_ms = 0;
+	if (input != NULL
+		&& readable)
+	{
+		wait_ms = readInput(0);
+	}
+
+	if (wait_ms > 0)
+	{
+		backoff = true;
+		return wait_ms;
+	}
+
+	if (input == NULL)
+	{
+		return 0;
+	}
+
+	return 80000;
+}
+
+IPipe* ServerChannelThread::reactorPipe()
+{
+	IScopedLock lock(mutex);
+	return input;
+}
+
+bool ServerChannelThread::reactorNeedsBackground()
+{
+	return (input == NULL && Server->getTimeMS() >= next_connect_time)
+		|| !background_msg.empty();
+}
+
+void ServerChannelThread::reactorBackground()
+{
+	//The reactor thread's settings object must not be used from another thread
+	ServerSettings* reactor_settings = settings;
+	settings = new ServerSettings(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER), clientid);
+
+	if (input == NULL)
+	{
+		IPipe *np = connectChannel();
+		if (np == NULL)
+		{
+			next_connect_time = Server->getTimeMS() + 10000;
+		}
+		else
+		{
+			channelConnected(np);
+		}
+	}
+	else
+	{
+		std::string msg;
+		msg.swap(background_msg);
+		processPacket(msg);
+
+		std::string ret;
+		while (input!=NULL
+			&& !do_exit
+			&& tcpstack.getPacket(ret) && !ret.empty())
+		{
+			processPacket(ret);
+		}
+	}
+
+	delete settings;
+	settings = reactor_settings;
+}
+
+bool ServerChannelThread::reactorExit()
+{
+	return do_exit;
+}
+
+void ServerChannelThread::reactorFinish()
+{
+	//Waiting for the fileclient threads would stall the other channels of the reactor
+	Server->getThreadPool()->execute(new ReactorFinishThread(this), "channel finish");
+}
+
+void ServerChannelThread::reactorFinishBackground()
+{
+	finishRun();
+
+	if (parent != NULL)
+	{
+		delete this;
+		return;
+	}
+
+	IScopedLock lock(mutex);
+	reactor_finished = true;
+	finish_cond->notify_all();
+}
+
+void ServerChannelThread::initRun()
+{
+	lasttime=0;
+
+	settings=new ServerSettings(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER), clientid);
+}
+
+IPipe* ServerChannelThread::connectChannel()
+{
+	IPipe *np=client_main->getClientCommandConnection(settings, 10000, &client_addr);
+	if(np==NULL)
+	{
+		Server->Log("Connecting Channel to "+clientname+" failed - CONNECT error -55", LL_DEBUG);
+	}
+	return np;
+}
+
+void ServerChannelThread::channelConnected(IPipe* np)
+{
+	{
+		IScopedLock lock(mutex);
+		input=np;
+	}
+	curr_ident = client_main->getIdentity();
+	tcpstack.reset();
+	tcpstack.setAddChecksum(client_main->isOnInternetConnection());
+	tcpstack.Send(input, curr_ident +"1CHANNEL capa="+convert(constructCapabilities())+"&token="+server_token+"&restore_version=2&startup=1&virtual_client="+EscapeParamString(virtual_client));
+
+	lasttime=Server->getTimeMS();
+}
+
+void ServerChannelThread::checkInput()
+{
+	if(Server->getTimeMS()-lasttime>180000)
+	{
+		Server->Log("Resetting channel to "+clientname+" because of timeout.", LL_DEBUG);
+		reset();
+	}
+
+	if (input!=NULL
+		&& curr_ident != client_main->getIdentity())
+	{
+		Server->Log("Resetting channel to " + clientname + " because session identity changed.", LL_DEBUG);
+		reset();
+	}
+}
+
+int64 ServerChannelThread::readInput(int timeoutms)
+{
+	std::string ret;
+	size_t rc=input->Read(&ret, timeoutms);
+	if(rc>0)
+	{
+		tcpstack.AddData((char*)ret.c_str(), ret.size());
+
+		while(input!=NULL
+			&& tcpstack.getPacket(ret) && !ret.empty())
+		{
+			if (reactor != NULL
+				&& isBlockingMsg(ret))
+			{
+				//Would stall the other channels of the reactor. Continue on a thread of its own
+				background_msg = ret;
+				return 0;
 			}
+
+			processPacket(ret);
+		}
+
+		bool was_updated;
+		settings->getSettings(&was_updated);
+		if(input!=NULL && was_updated)
+		{
+			Server->Log("Settings changed. Capabilities may have changed. Reconnecting channel...", LL_DEBUG);
+			reset();
+		}
+	}
+	else if(rc==0)
+	{
+		if(input->hasError())
+		{
+			Server->Log("Lost channel connection to "+clientname+". has_error=true", LL_DEBUG);
+			reset();
+			return 1000;
+		}
+		else if(timeoutms>0)
+		{
+			Server->Log("Lost channel connection to "+clientname+". has_error=false", LL_DEBUG);
+			return 1000;
 		}
 	}
 
+	return 0;
+}
+
+void ServerChannelThread::processPacket(const std::string& msg)
+{
+	if(msg!="PING")
+	{
+		Server->Log("Channel message: "+msg, LL_DEBUG);
+	}
+	lasttime=Server->getTimeMS();
+	std::string r=processMsg(msg);
+	if(!r.empty() && input!=NULL)
+		tcpstack.Send(input, r);
+}
+
+void ServerChannelThread::finishRun()
+{
 	if(input!=NULL)
 	{
 		Server->destroy(input);
 	}
 
+	delete settings;
+	settings = NULL;
+
 	if(keepalive_thread!=NULL)
 	{
 		keepalive_thread->doQuit();
@@ -373,6 +602,11 @@ void ServerChannelThread::doExit(void)
 	{
 		input->shutdown();
 	}
+
+	if (reactor != NULL)
+	{
+		reactor->wakeup();
+	}
 }
 
 std::string ServerChannelThread::processMsg(const std::string &msg)
@@ -626,7 +860,14 @@ std::string ServerChannelThread::processMsg(const std::string &msg)
 			input = NULL;
 			tcpstack.reset();
 		}
-		Server->wait(60000);
+		if (reactor == NULL)
+		{
+			Server->wait(60000);
+		}
+		else
+		{
+			next_connect_time = Server->getTimeMS() + 60000;
+		}
 	}
 	return "";
 }
@@ -1285,6 +1526,22 @@ void ServerChannelThread::DOWNLOAD_IMAGE(str_map& params)
 
 			vhdfile->Seek(skip + currpos);
 
+			if (params["extents"] == "1")
+			{
+				bool is_ok;
+				if (!sendImageExtents(vhdfile, skip, currpos, imgsize, params["compress"] == "zstd",
+					clientname, restore_process.getStatusId(), used_bytes, used_transferred_bytes, is_ok))
+				{
+					return;
+				}
+
+				if (is_ok)
+				{
+					restore_done.set_ok();
+				}
+				return;
+			}
+
 			bool is_ok=true;
 			do
 			{
@@ -1385,6 +1642,144 @@ void ServerChannelThread::DOWNLOAD_IMAGE(str_map& params)
 	}
 }
 
+bool ServerChannelThread::sendImageExtents(IVHDFile* vhdfile, int skip, uint64 currpos, _i64 imgsize, bool compress,
+	const std::string& clientname, size_t status_id, int64 used_bytes, int64 used_transferred_bytes, bool& is_ok)
+{
+	const _u32 img_send_timeout = 30000;
+	const _i64 c_block_size = 4096;
+
+	//Used data is only tracked per image block, so there is no need to check smaller parts
+	_i64 check_size = vhdfile->getBlocksize();
+	if (check_size <= 0
+		|| check_size%c_block_size != 0)
+	{
+		check_size = c_block_size;
+	}
+
+	std::vector<char> buffer(image_restore::extent_header_size + image_restore::max_extent_size);
+
+#ifndef NO_ZSTD_COMPRESSION
+	std::unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> cctx(nullptr, ZSTD_freeCCtx);
+	std::vector<char> comp_buffer;
+	int compression_level = watoi(Server->getServerParameter("image_restore_compression_level", "3"));
+	if (compress)
+	{
+		cctx.reset(ZSTD_createCCtx());
+		comp_buffer.resize(image_restore::extent_header_size + ZSTD_compressBound(image_restore::max_extent_size));
+	}
+#endif
+
+	int64 last_update_time = Server->getTimeMS();
+	int pcdone = 0;
+
+	is_ok = true;
+	while (is_ok && (_i64)currpos < imgsize)
+	{
+		_i64 chunk_end = ((skip + currpos) / check_size + 1)*check_size - skip;
+		chunk_end = (std::min)(chunk_end, imgsize);
+
+		vhdfile->Seek(skip + currpos);
+		if (!vhdfile->has_sector())
+		{
+			currpos = chunk_end;
+
+			if (Server->getTimeMS() - lasttime > 30000)
+			{
+				image_restore::writeExtentHeader(buffer.data(), currpos, 0, 0);
+				if (!input->Write(buffer.data(), image_restore::extent_header_size, img_send_timeout, true))
+				{
+					Server->Log("Sending keep-alive extent failed", LL_DEBUG);
+					reset();
+					return false;
+				}
+				lasttime = Server->getTimeMS();
+			}
+		}
+
+		while (is_ok && (_i64)currpos < chunk_end)
+		{
+			_u32 len = static_cast<_u32>((std::min)(static_cast<_i64>(image_restore::max_extent_size), chunk_end - (_i64)currpos));
+			char* data = buffer.data() + image_restore::extent_header_size;
+
+			size_t read;
+			vhdfile->Seek(skip + currpos);
+			is_ok = vhdfile->Read(data, len, read);
+			if (!is_ok)
+			{
+				Server->Log("Error reading from VHD file during restore. " + os_last_error_str(), LL_ERROR);
+			}
+			if (read < len)
+			{
+				Server->Log("Padding " + convert(len - read) + " zero bytes during restore...", LL_WARNING);
+				memset(&data[read], 0, len - read);
+			}
+
+			char* send_buf = buffer.data();
+			_u32 comp_len = len;
+
+#ifndef NO_ZSTD_COMPRESSION
+			if (cctx.get() != nullptr)
+			{
+				size_t rc = ZSTD_compressCCtx(cctx.get(), comp_buffer.data() + image_restore::extent_header_size,
+					comp_buffer.size() - image_restore::extent_header_size, data, len, compression_level);
+				if (!ZSTD_isError(rc)
+					&& rc < len)
+				{
+					send_buf = comp_buffer.data();
+					comp_len = static_cast<_u32>(rc);
+				}
+			}
+#endif
+
+			image_restore::writeExtentHeader(send_buf, currpos, len, comp_len);
+			if (!input->Write(send_buf, image_restore::extent_header_size + comp_len, img_send_timeout, false))
+			{
+				Server->Log("Writing to output pipe failed processMsg-3", LL_ERROR);
+				reset();
+				return false;
+			}
+
+			used_transferred_bytes += len;
+			lasttime = Server->getTimeMS();
+			currpos += len;
+		}
+
+		if (Server->getTimeMS() - last_update_time > 60000)
+		{
+			last_update_time = Server->getTimeMS();
+			ServerStatus::updateActive();
+
+			if (used_bytes > 0)
+			{
+				int pcdone_new = static_cast<int>((used_transferred_bytes * 100) / used_bytes);
+				if (pcdone_new != pcdone)
+				{
+					pcdone = pcdone_new;
+					ServerStatus::setProcessPcDone(clientname, status_id, pcdone);
+				}
+			}
+		}
+	}
+
+	if ((_i64)currpos >= imgsize)
+	{
+		int64 r = little_endian(image_restore::stream_end);
+		if (!input->Write((char*)&r, sizeof(int64), img_send_timeout))
+		{
+			Server->Log("Sending image end failed", LL_WARNING);
+			reset();
+			return false;
+		}
+	}
+	else if (!input->Flush())
+	{
+		reset();
+		return false;
+	}
+
+	return true;
+}
+
 void ServerChannelThread::DOWNLOAD_FILES( str_map& params )
 {
 	int backupid=watoi(params["backupid"])-img_id_offset;
@@ -1827,7 +2222,7 @@ void ServerChannelThread::add_extra_channel()
 
 	extra_channel_threads.push_back(extra);
 
-	Server->getThreadPool()->execute(extra, "channel extra");
+	extra->start("channel extra");
 }
 
 void ServerChannelThread::remove_extra_channel()
@@ -3,17 +3,21 @@
 #include "../Interface/Mutex.h"
 #include "../urbackupcommon/fileclient/socket_header.h"
 #include "../urbackupcommon/fileclient/tcpstack.h"
+#include "../Interface/Condition.h"
+#include "../Interface/ThreadPool.h"
+#include "ClientReactor.h"
 
 class ClientMain;
 class IDatabase;
 
 class ServerSettings;
+class IVHDFile;
 namespace {
 class SessionKeepaliveThread;
 class RestoreTokenKeepaliveThread;
 }
 
-class ServerChannelThread : public IThread
+class ServerChannelThread : public IThread, public IReactorClient
 {
 public:
 	ServerChannelThread(ClientMain *client_main, const std::string& clientname, int clientid, bool internet_mode, 
@@ -24,6 +28,21 @@ public:
 	void run();
 	void operator()(void);
 
+	//Runs the channel on a reactor thread if available, otherwise on a thread of its own
+	void start(const std::string& name);
+	//Waits for the channel to finish after doExit()
+	void join();
+
+	virtual void reactorInit();
+	virtual int64 reactorRun(bool readable, bool& backoff);
+	virtual IPipe* reactorPipe();
+	virtual bool reactorNeedsBackground();
+	virtual void reactorBackground();
+	virtual bool reactorExit();
+	virtual void reactorFinish();
+	//Rest of reactorFinish(), runs on a thread pool thread
+	void reactorFinishBackground();
+
 	std::string processMsg(const std::string &msg);
 
 	void doExit(void);
@@ -53,6 +72,14 @@ private:
 
 	int constructCapabilities(void);
 
+	void initRun();
+	IPipe* connectChannel();
+	void channelConnected(IPipe* np);
+	void checkInput();
+	int64 readInput(int timeoutms);
+	void processPacket(const std::string& msg);
+	void finishRun();
+
 	bool hasDownloadImageRights(const str_map& params=str_map());
 
 	int getLastBackupid(IDatabase* db);
@@ -66,6 +93,8 @@ private:
 	void GET_FILE_BACKUPS_TOKENS(str_map& params);
 	void GET_FILE_LIST_TOKENS(str_map& params);
 	void DOWNLOAD_IMAGE(str_map& params);
+	bool sendImageExtents(IVHDFile* vhdfile, int skip, uint64 currpos, _i64 imgsize, bool compress,
+		const std::string& clientname, size_t status_id, int64 used_bytes, int64 used_transferred_bytes, bool& is_ok);
 	void DOWNLOAD_FILES(str_map& params);
 	void DOWNLOAD_FILES_TOKENS(str_map& params);
 	void RESTORE_PERCENT( str_map params );
@@ -130,4 +159,13 @@ private:
 	static std::map<std::string, SRestoreToken> restore_tokens_used;
 
 	int64 startup_timestamp;
+
+	std::string curr_ident;
+
+	ClientReactorThread* reactor;
+	THREADPOOL_TICKET thread_ticket;
+	ICondition* finish_cond;
+	bool reactor_finished;
+	int64 next_connect_time;
+	std::string background_msg;
 };
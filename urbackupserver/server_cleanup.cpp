@@ -38,6 +38,7 @@
 #include "dao/ServerLinkDao.h"
 #include "dao/ServerFilesDao.h"
 #include "server_dir_links.h"
+#include "RemoveUnknownScanner.h"
 #include <stdio.h>
 #include <algorithm>
 #include "create_files_index.h"
@@ -64,6 +65,7 @@ bool ServerCleanupThread::allow_clientlist_deletion = true;
 void cleanupLastActs();
 
 const unsigned int min_cleanup_interval=12*60*60;
+const size_t remove_file_entries_segment_size=10000;
 
 extern IClouddriveFactory* clouddrive_fak;
 
@@ -101,7 +103,7 @@ void ServerCleanupThread::operator()(void)
 	{
 		cleanupdao.reset(new ServerCleanupDao(db));
 		backupdao.reset(new ServerBackupDao(db));
-		filesdao.reset(new ServerFilesDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES)));
+		filesdao_shards.reset(new ServerFilesDaoShards);
 		fileindex.reset(create_lmdb_files_index());
 
 		switch(cleanup_action.action)
@@ -142,7 +144,7 @@ void ServerCleanupThread::operator()(void)
 		
 		cleanupdao.reset();
 		backupdao.reset();
-		filesdao.reset();
+		filesdao_shards.reset();
 		fileindex.reset();
 
 		Server->destroyDatabases(Server->getThreadID());
@@ -209,7 +211,7 @@ void ServerCleanupThread::operator()(void)
 
 			cleanupdao.reset(new ServerCleanupDao(db));
 			backupdao.reset(new ServerBackupDao(db));
-			filesdao.reset(new ServerFilesDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES)));
+			filesdao_shards.reset(new ServerFilesDaoShards);
 			fileindex.reset(create_lmdb_files_index());
 
 			{
@@ -222,7 +224,7 @@ void ServerCleanupThread::operator()(void)
 			
 			cleanupdao.reset();
 			backupdao.reset();
-			filesdao.reset();
+			filesdao_shards.reset();
 			fileindex.reset();
 
 
@@ -348,7 +350,7 @@ void ServerCleanupThread::operator()(void)
 
 				cleanupdao.reset(new ServerCleanupDao(db));
 				backupdao.reset(new ServerBackupDao(db));
-				filesdao.reset(new ServerFilesDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES)));
+				filesdao_shards.reset(new ServerFilesDaoShards);
 				fileindex.reset(create_lmdb_files_index());
 
 				{
@@ -363,7 +365,7 @@ void ServerCleanupThread::operator()(void)
 
 				cleanupdao.reset();
 				backupdao.reset();
-				filesdao.reset();
+				filesdao_shards.reset();
 				fileindex.reset();
 
 				{
@@ -541,55 +543,46 @@ void ServerCleanupThread::do_remove_unknown(void)
 
 	std::vector<ServerCleanupDao::SClientInfo> res_clients=cleanupdao->getClients();
 
-	for(size_t i=0;i<res_clients.size();++i)
+	//Listing the folders and checking them against the database is done by several
+	//threads ahead of the removal of the unknown entries here
+	RemoveUnknownScanner scanner(res_clients, backupfolder);
+	scanner.start();
+
+	while(true)
 	{
-		int clientid=res_clients[i].id;
-		const std::string& clientname=res_clients[i].name;
+		std::unique_ptr<SRemoveUnknownScan> scan(scanner.next());
+		if(scan.get()==NULL)
+		{
+			break;
+		}
 
-		Server->Log("Removing unknown for client \""+clientname+"\"");
+		int clientid=scan->client_info.id;
+		const std::string& clientname=scan->client_info.name;
 
-		std::vector<ServerCleanupDao::SFileBackupInfo> res_file_backups=cleanupdao->getFileBackupsOfClient(clientid);
+		Server->Log("Removing unknown for client \""+clientname+"\"");
 
-		for(size_t j=0;j<res_file_backups.size();++j)
+		for(size_t j=0;j<scan->missing_file_backups.size();++j)
 		{
-			std::string backup_path=backupfolder+os_file_sep()+clientname+os_file_sep()+res_file_backups[j].path;
-			int backupid=res_file_backups[j].id;
-			if(!os_directory_exists(backup_path))
-			{
-				Server->Log("Path for file backup [id="+convert(res_file_backups[j].id)+" path="+res_file_backups[j].path+" clientname="+clientname+"] does not exist. Deleting it from the database.", LL_WARNING);
-
-				removeFileBackupSql(backupid);
+			const ServerCleanupDao::SFileBackupInfo& file_backup=scan->missing_file_backups[j];
+			Server->Log("Path for file backup [id="+convert(file_backup.id)+" path="+file_backup.path+" clientname="+clientname+"] does not exist. Deleting it from the database.", LL_WARNING);
 
-			}
+			removeFileBackupSql(clientid, file_backup.id);
 		}
 
-		std::vector<ServerCleanupDao::SImageBackupInfo> res_image_backups=cleanupdao->getImageBackupsOfClient(clientid);
-
-		for(size_t j=0;j<res_image_backups.size();++j)
+		for(size_t j=0;j<scan->missing_image_backups.size();++j)
 		{
-			std::string backup_path=res_image_backups[j].path;
-
-			IFile *tf=Server->openFile(os_file_prefix(backup_path), MODE_READ);
-			if(tf==NULL)
-			{
-				Server->Log("Image backup [id="+convert(res_image_backups[j].id)+" path="+res_image_backups[j].path+" clientname="+clientname+"] does not exist. Deleting it from the database.", LL_WARNING);
-				cleanupdao->removeImage(res_image_backups[j].id);
-			}
-			else
-			{
-				Server->destroy(tf);
-			}
+			const ServerCleanupDao::SImageBackupInfo& image_backup=scan->missing_image_backups[j];
+			Server->Log("Image backup [id="+convert(image_backup.id)+" path="+image_backup.path+" clientname="+clientname+"] does not exist. Deleting it from the database.", LL_WARNING);
+			cleanupdao->removeImage(image_backup.id);
 		}
 
 		cleanup_system_images(clientid, clientname, settings);
 
-
-		std::vector<SFile> files=getFiles(backupfolder+os_file_sep()+clientname, NULL);
-		std::vector<ServerCleanupDao::SImageBackupInfo> res_images=cleanupdao->getClientImages(clientid);
+		const std::vector<SFile>& files=scan->files;
 
 		for(size_t j=0;j<files.size();++j)
 		{
-			SFile cf=files[j];
+			const SFile& cf=files[j];
 
 			if(cf.name=="current")
 				continue;
@@ -603,9 +596,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 			{
 				if (cf.name.find("Image") == std::string::npos)
 				{
-					ServerCleanupDao::CondInt res_id = cleanupdao->findFileBackup(clientid, cf.name);
-
-					if (!res_id.exists)
+					if (!scan->hasFileBackup(cf.name))
 					{
 						Server->Log("File backup \"" + cf.name + "\" of client \"" + clientname + "\" not found in database. Deleting it.", LL_WARNING);
 						bool remove_folder = false;
@@ -639,7 +630,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 				}
 				else
 				{
-					std::vector<SFile> image_files = getFiles(backupfolder + os_file_sep() + clientname + os_file_sep() + cf.name);
+					const std::vector<SFile>& image_files = scan->image_folder_files[cf.name];
 
 					bool found_image = false;
 					for (size_t l = 0; l < image_files.size(); ++l)
@@ -651,18 +642,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 
 						found_image = true;
 
-						bool found = false;
-
-						for (size_t k = 0; k<res_images.size(); ++k)
-						{
-							if (ExtractFileName(res_images[k].path) == image_files[l].name)
-							{
-								found = true;
-								break;
-							}
-						}
-
-						if (!found)
+						if (!scan->hasImage(image_files[l].name))
 						{
 							Server->Log("Image backup \"" + cf.name + "\" of client \"" + clientname + "\" not found in database. Deleting it.", LL_WARNING);
 							
@@ -704,18 +684,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 				if(extension!="vhd" && extension!="vhdz" && extension!="raw")
 					continue;
 
-				bool found=false;
-
-				for(size_t k=0;k<res_images.size();++k)
-				{
-					if(ExtractFileName(res_images[k].path)==cf.name)
-					{
-						found=true;
-						break;
-					}
-				}
-
-				if(!found)
+				if(!scan->hasImage(cf.name))
 				{
 					Server->Log("Image backup \""+cf.name+"\" of client \""+clientname+"\" not found in database. Deleting it.", LL_WARNING);
 					std::string rm_file=backupfolder+os_file_sep()+clientname+os_file_sep()+cf.name;
@@ -737,7 +706,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 				}
 			}
 		}
-		check_symlinks(res_clients[i], backupfolder, false);
+		check_symlinks(scan->client_info, backupfolder, false, scan.get());
 	}
 
 	Server->Log("Removing dangling file entries...", LL_INFO);
@@ -746,30 +715,41 @@ void ServerCleanupThread::do_remove_unknown(void)
 	IDatabaseCursor* cur = q_backup_ids->Cursor();
 	db_single_result res;
 
-	IDatabase* files_db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES);
-
-	files_db->Write("CREATE TEMPORARY TABLE backups (id INTEGER PRIMARY KEY)");
-
-	IQuery* q_insert = files_db->Prepare("INSERT INTO backups (id) VALUES (?)", false);
-
-	bool ok = true;
+	std::vector<std::string> backup_ids;
 	while (cur->next(res))
 	{
-		q_insert->Bind(res["id"]);
-		ok &= q_insert->Write();
-		q_insert->Reset();
+		backup_ids.push_back(res["id"]);
 	}
 
 	db->destroyQuery(q_backup_ids);
-	files_db->destroyQuery(q_insert);
 
-	if (ok)
+	for (size_t shard = 0; shard < FilesDbShards::getNumShards(); ++shard)
 	{
-		filesdao->removeDanglingFiles();
-		Server->Log("Deleted " + convert(files_db->getLastChanges()) + " file entries", LL_INFO);
-	}
+		ServerFilesDao& filesdao = filesdao_shards->getShard(shard);
+		IDatabase* files_db = filesdao.getDatabase();
+
+		files_db->Write("CREATE TEMPORARY TABLE backups (id INTEGER PRIMARY KEY)");
 
-	files_db->Write("DROP TABLE backups");
+		IQuery* q_insert = files_db->Prepare("INSERT INTO backups (id) VALUES (?)", false);
+
+		bool ok = true;
+		for (size_t i = 0; i < backup_ids.size(); ++i)
+		{
+			q_insert->Bind(backup_ids[i]);
+			ok &= q_insert->Write();
+			q_insert->Reset();
+		}
+
+		files_db->destroyQuery(q_insert);
+
+		if (ok)
+		{
+			filesdao.removeDanglingFiles();
+			Server->Log("Deleted " + convert(files_db->getLastChanges()) + " file entries", LL_INFO);
+		}
+
+		files_db->Write("DROP TABLE backups");
+	}
 
 	FileIndex::flush();
 }
@@ -1605,7 +1585,7 @@ bool ServerCleanupThread::deleteFileBackup(const std::string &backupfolder, int
 		{
 			ServerLinkDao link_dao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_LINKS));
 
-			b=remove_directory_link_dir(path, link_dao, clientid);
+			b=remove_directory_link_dir_parallel(path, link_dao, clientid);
 
 			if(!b && SnapshotHelper::isSubvolume(false, clientname, backuppath) )
 			{
@@ -1627,7 +1607,7 @@ bool ServerCleanupThread::deleteFileBackup(const std::string &backupfolder, int
 	{
 		ServerLinkDao link_dao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_LINKS));
 
-		b=remove_directory_link_dir(path, link_dao, clientid);
+		b=remove_directory_link_dir_parallel(path, link_dao, clientid);
 	}
 
 	bool del=true;
@@ -1659,7 +1639,7 @@ bool ServerCleanupThread::deleteFileBackup(const std::string &backupfolder, int
 	}
 	if(del || force_remove)
 	{
-		removeFileBackupSql(backupid);
+		removeFileBackupSql(clientid, backupid);
 	}
 
 	ServerStatus::updateActive();
@@ -1892,6 +1872,10 @@ bool ServerCleanupThread::backup_database(void)
 		copy_backup_ids.push_back(URBACKUPDB_SERVER_FILES);
 		copy_backup_ids.push_back(URBACKUPDB_SERVER_LINKS);
 		copy_backup_ids.push_back(URBACKUPDB_SERVER_LINK_JOURNAL);
+		for (size_t shard = 1; shard < FilesDbShards::getNumShards(); ++shard)
+		{
+			copy_backup_ids.push_back(FilesDbShards::getShardDatabaseId(shard));
+		}
 
 		std::vector<std::string> copy_backup;
 		copy_backup.push_back("backup_server.db");
@@ -1899,6 +1883,10 @@ bool ServerCleanupThread::backup_database(void)
 		copy_backup.push_back("backup_server_files.db");
 		copy_backup.push_back("backup_server_links.db");
 		copy_backup.push_back("backup_server_link_journal.db");
+		for (size_t shard = 1; shard < FilesDbShards::getNumShards(); ++shard)
+		{
+			copy_backup.push_back("backup_server_" + FilesDbShards::getShardName(shard) + ".db");
+		}
 
 		copy_backup.push_back("backup_server.db-wal");
 		copy_backup.push_back("backup_server_settings.db-wal");
@@ -2294,7 +2282,7 @@ bool ServerCleanupThread::correct_poolname( const std::string& backupfolder, con
 }
 
 void ServerCleanupThread::check_symlinks( const ServerCleanupDao::SClientInfo& client_info, const std::string& backupfolder,
-	bool deep_check)
+	bool deep_check, const SRemoveUnknownScan* scan)
 {
 	const int clientid=client_info.id;
 	const std::string& clientname=client_info.name;
@@ -2389,18 +2377,29 @@ void ServerCleanupThread::check_symlinks( const ServerCleanupDao::SClientInfo& c
 			std::string(), deep_check_links[i].target);
 	}
 
-	if(os_directory_exists(pool_root))
+	std::vector<SFile> listed_pool_dirs;
+	std::vector<std::vector<SFile> > listed_pool_dir_files;
+	const std::vector<SFile>* pool_dirs = &listed_pool_dirs;
+	const std::vector<std::vector<SFile> >* pool_dir_files = &listed_pool_dir_files;
+	if(scan!=NULL)
 	{
-		std::vector<SFile> first_files = getFiles(pool_root, NULL);
-		for(size_t i=0;i<first_files.size();++i)
-		{
-			if(!first_files[i].isdir)
-				continue;
-			if(first_files[i].issym)
-				continue;
+		pool_dirs = &scan->pool_dirs;
+		pool_dir_files = &scan->pool_dir_files;
+	}
+	else
+	{
+		RemoveUnknownScanner::listDirectoryPool(pool_root, listed_pool_dirs, listed_pool_dir_files);
+	}
 
-			std::string curr_path = pool_root + os_file_sep() + first_files[i].name;
-			std::vector<SFile> pool_files = getFiles(curr_path, NULL);
+	if(!pool_dirs->empty())
+	{
+		std::vector<std::string> referenced_pool_names = link_dao.getReferencedPoolNames(clientid);
+		std::sort(referenced_pool_names.begin(), referenced_pool_names.end());
+
+		for(size_t i=0;i<pool_dirs->size();++i)
+		{
+			std::string curr_path = pool_root + os_file_sep() + (*pool_dirs)[i].name;
+			const std::vector<SFile>& pool_files = (*pool_dir_files)[i];
 
 			if (pool_files.empty())
 			{
@@ -2418,7 +2417,7 @@ void ServerCleanupThread::check_symlinks( const ServerCleanupDao::SClientInfo& c
 
 				std::string pool_path = curr_path + os_file_sep() + pool_files[j].name;
 
-				if(link_dao.getDirectoryRefcount(clientid, pool_files[j].name)==0)
+				if(!std::binary_search(referenced_pool_names.begin(), referenced_pool_names.end(), pool_files[j].name))
 				{
 					Server->Log("Refcount of \""+pool_path+"\" is zero. Deleting pool folder.", LL_WARNING);
 
@@ -2639,10 +2638,11 @@ void ServerCleanupThread::cleanup_other()
 
 }
 
-void ServerCleanupThread::removeFileBackupSql( int backupid )
+void ServerCleanupThread::removeFileBackupSql( int clientid, int backupid )
 {
+	ServerFilesDao* filesdao = &filesdao_shards->getClient(clientid);
+
 	DBScopedSynchronous synchronous_files(filesdao->getDatabase());
-	filesdao->BeginWriteTransaction();
 
 	BackupServerHash::SInMemCorrection correction;
 
@@ -2651,101 +2651,130 @@ void ServerCleanupThread::removeFileBackupSql( int backupid )
 	correction.max_correct = minmax.tmax;
 	correction.min_correct = minmax.tmin;
 
-	IQuery* q_iterate = filesdao->getDatabase()->Prepare("SELECT id, shahash, filesize, rsize, clientid, backupid, incremental, next_entry, prev_entry, pointed_to FROM files WHERE backupid=?", false);
-	q_iterate->Bind(backupid);
-	IDatabaseCursor* cursor = q_iterate->Cursor();
+	//The entries of a backup are appended in id order. They are removed in segments of ascending
+	//ids with one transaction per segment, so the files database is not locked for the whole deletion.
+	//Pointer changes to entries in the not yet removed part of the backup are kept in memory
+	//and written sorted by id at the end of each segment
+	IQuery* q_iterate = filesdao->getDatabase()->Prepare("SELECT id, shahash, filesize, rsize, clientid, backupid, incremental, next_entry, prev_entry, pointed_to FROM files WHERE backupid=? AND id>? ORDER BY id ASC LIMIT "
+		+ convert(remove_file_entries_segment_size), false);
 
-	bool modified_file_entry_index = false;
+	int64 total_entries = (std::max)(static_cast<int64>(1), minmax.tmax - minmax.tmin + 1);
+	int last_pc = 0;
+	int64 segment_start = minmax.tmin - 1;
 
-	db_single_result res;
-	while(cursor->next(res))
+	db_results res_segment;
+	do
 	{
-		int64 id = watoi64(res["id"]);
+		filesdao->BeginWriteTransaction();
 
-		int64 filesize = watoi64(res["filesize"]);
-		int64 rsize = watoi64(res["rsize"]);
-		int clientid = watoi(res["clientid"]);
-		int backupid = watoi(res["backupid"]);
-		int incremental = watoi(res["incremental"]);
-		int64 next_entry = watoi64(res["next_entry"]);
-		int64 prev_entry = watoi64(res["prev_entry"]);
-		int pointed_to = watoi(res["pointed_to"]);
+		q_iterate->Bind(backupid);
+		q_iterate->Bind(segment_start);
+		res_segment = q_iterate->Read();
+		q_iterate->Reset();
 
-		std::map<int64, int64>::iterator it_next = correction.next_entries.find(id);
-		if (it_next != correction.next_entries.end())
+		if (res_segment.empty())
 		{
-			if (it_next->second != next_entry)
-			{
-				int abc = 5;
-			}
+			filesdao->endTransaction();
+			break;
+		}
 
-			next_entry = it_next->second;
+		int64 segment_end = watoi64(res_segment[res_segment.size() - 1]["id"]);
 
-			correction.next_entries.erase(it_next);
-		}
+		bool modified_file_entry_index = false;
 
-		std::map<int64, int64>::iterator it_prev= correction.prev_entries.find(id);
-		if (it_prev != correction.prev_entries.end())
+		for (size_t i = 0; i < res_segment.size(); ++i)
 		{
-			if (it_prev->second != prev_entry)
+			db_single_result& res = res_segment[i];
+
+			int64 id = watoi64(res["id"]);
+
+			int64 filesize = watoi64(res["filesize"]);
+			int64 rsize = watoi64(res["rsize"]);
+			int clientid = watoi(res["clientid"]);
+			int backupid = watoi(res["backupid"]);
+			int incremental = watoi(res["incremental"]);
+			int64 next_entry = watoi64(res["next_entry"]);
+			int64 prev_entry = watoi64(res["prev_entry"]);
+			int pointed_to = watoi(res["pointed_to"]);
+
+			std::map<int64, int64>::iterator it_next = correction.next_entries.find(id);
+			if (it_next != correction.next_entries.end())
 			{
-				int abc = 5;
+				next_entry = it_next->second;
+				correction.next_entries.erase(it_next);
 			}
 
-			prev_entry = it_prev->second;
+			std::map<int64, int64>::iterator it_prev = correction.prev_entries.find(id);
+			if (it_prev != correction.prev_entries.end())
+			{
+				prev_entry = it_prev->second;
+				correction.prev_entries.erase(it_prev);
+			}
 
-			correction.prev_entries.erase(it_prev);
-		}
+			std::map<int64, int>::iterator it_pointed_to = correction.pointed_to.find(id);
+			if (it_pointed_to != correction.pointed_to.end())
+			{
+				pointed_to = it_pointed_to->second;
+				correction.pointed_to.erase(it_pointed_to);
+			}
 
-		std::map<int64, int>::iterator it_pointed_to = correction.pointed_to.find(id);
-		if (it_pointed_to != correction.pointed_to.end())
-		{
-			if (it_pointed_to->second != pointed_to)
+			if (pointed_to)
 			{
-				int abc = 5;
+				modified_file_entry_index = true;
 			}
 
-			pointed_to = it_pointed_to->second;
+			BackupServerHash::deleteFileSQL(*filesdao, *fileindex.get(), res["shahash"].c_str(),
+				filesize, rsize, clientid, backupid, incremental, id, prev_entry, next_entry, pointed_to, false, false, false, true, &correction);
+		}
 
-			correction.pointed_to.erase(it_pointed_to);
+		//Remaining corrections are to entries of other backups or to entries after this
+		//segment. Write them now, so the next segment reads them from the database
+		for (std::map<int64, int64>::iterator it_next = correction.next_entries.begin();
+			it_next != correction.next_entries.end(); ++it_next)
+		{
+			filesdao->setNextEntry(it_next->second, it_next->first);
 		}
 
-		if (pointed_to)
+		for (std::map<int64, int64>::iterator it_prev = correction.prev_entries.begin();
+			it_prev != correction.prev_entries.end(); ++it_prev)
 		{
-			modified_file_entry_index = true;
+			filesdao->setPrevEntry(it_prev->second, it_prev->first);
 		}
 
-		BackupServerHash::deleteFileSQL(*filesdao, *fileindex.get(), res["shahash"].c_str(),
-			filesize, rsize, clientid, backupid, incremental, id, prev_entry, next_entry, pointed_to, false, false, false, true, &correction);
-	}
-	filesdao->getDatabase()->destroyQuery(q_iterate);
+		for (std::map<int64, int>::iterator it_pointed_to = correction.pointed_to.begin();
+			it_pointed_to != correction.pointed_to.end(); ++it_pointed_to)
+		{
+			filesdao->setPointedTo(it_pointed_to->second, it_pointed_to->first);
+		}
 
-	for (std::map<int64, int64>::iterator it_next = correction.next_entries.begin();
-		 it_next != correction.next_entries.end(); ++it_next)
-	{
-		filesdao->setNextEntry(it_next->second, it_next->first);
-	}
+		correction.next_entries.clear();
+		correction.prev_entries.clear();
+		correction.pointed_to.clear();
 
-	for (std::map<int64, int64>::iterator it_prev = correction.prev_entries.begin();
-		 it_prev != correction.prev_entries.end(); ++it_prev)
-	{
-		filesdao->setPrevEntry(it_prev->second, it_prev->first);
-	}
+		filesdao->deleteFilesUpTo(backupid, segment_end);
 
-	for (std::map<int64, int>::iterator it_pointed_to = correction.pointed_to.begin();
-		 it_pointed_to != correction.pointed_to.end(); ++it_pointed_to)
-	{
-		filesdao->setPointedTo(it_pointed_to->second, it_pointed_to->first);
-	}
+		if (modified_file_entry_index)
+		{
+			FileIndex::flush();
+		}
 
-	filesdao->deleteFiles(backupid);
+		filesdao->endTransaction();
 
-	if (modified_file_entry_index)
-	{
-		FileIndex::flush();
-	}
+		segment_start = segment_end;
+		correction.min_correct = segment_end + 1;
+
+		ServerStatus::updateActive();
+
+		int pc = static_cast<int>((segment_end - minmax.tmin + 1) * 100 / total_entries);
+		if (res_segment.size() == remove_file_entries_segment_size
+			&& pc / 10 != last_pc / 10)
+		{
+			ServerLogger::Log(logid, "Removing file entries of backup with id " + convert(backupid) + ": " + convert(pc) + "%", LL_INFO);
+			last_pc = pc;
+		}
+	} while (res_segment.size() == remove_file_entries_segment_size);
 
-	filesdao->endTransaction();
+	filesdao->getDatabase()->destroyQuery(q_iterate);
 
 	cleanupdao->removeFileBackup(backupid);
 }
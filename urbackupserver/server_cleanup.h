@@ -7,6 +7,7 @@
 #include "dao/ServerCleanupDao.h"
 #include "dao/ServerBackupDao.h"
 #include "dao/ServerFilesDao.h"
+#include "FilesDbShards.h"
 #include <sstream>
 #include <memory>
 #include <set>
@@ -14,6 +15,7 @@
 #include "server_log.h"
 
 class ServerSettings;
+struct SRemoveUnknownScan;
 
 enum ECleanupAction
 {
@@ -130,7 +132,8 @@ private:
 
 	bool correct_poolname(const std::string& backupfolder, const std::string& clientname, const std::string& pool_name, std::string& pool_path);
 
-	void check_symlinks(const ServerCleanupDao::SClientInfo& client_info, const std::string& backupfolder, bool deep_check);
+	void check_symlinks(const ServerCleanupDao::SClientInfo& client_info, const std::string& backupfolder, bool deep_check,
+		const SRemoveUnknownScan* scan=NULL);
 
 	int max_removable_incr_images(ServerSettings& settings, int backupid, int del_in_stack);
 
@@ -171,7 +174,7 @@ private:
 	bool deleteFileBackup(const std::string &backupfolder, int clientid, int backupid, bool force_remove, bool remove_references,
 		int del_incr_in_stack = 0);
 
-	void removeFileBackupSql( int backupid );
+	void removeFileBackupSql( int clientid, int backupid );
 
 	void deletePendingClients(void);
 
@@ -218,7 +221,7 @@ private:
 
 	std::unique_ptr<ServerCleanupDao> cleanupdao;
 	std::unique_ptr<ServerBackupDao> backupdao;
-	std::unique_ptr<ServerFilesDao> filesdao;
+	std::unique_ptr<ServerFilesDaoShards> filesdao_shards;
 	std::unique_ptr<FileIndex> fileindex;
 
 	logid_t logid;
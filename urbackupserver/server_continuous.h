@@ -18,6 +18,7 @@
 #include "server_log.h"
 #include "dao/ServerBackupDao.h"
 #include "dao/ServerFilesDao.h"
+#include "FilesDbShards.h"
 #include "FileIndex.h"
 #include "create_files_index.h"
 #include "FileBackup.h"
@@ -90,7 +91,7 @@ public:
 	{
 		server_settings.reset(new ServerSettings(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER)));
 		backupdao.reset(new ServerBackupDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER)));
-		filesdao.reset(new ServerFilesDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES)));
+		filesdao.reset(new ServerFilesDao(Server->getDatabase(Server->getThreadID(), FilesDbShards::getClientDatabaseId(clientid))));
 		fileindex.reset(create_lmdb_files_index());
 
 		hashed_transfer_full = true;
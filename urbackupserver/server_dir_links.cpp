@@ -24,8 +24,11 @@
 #include "../Interface/Mutex.h"
 #include "../Interface/Database.h"
 #include "../Interface/File.h"
+#include "../Interface/Thread.h"
+#include "../Interface/ThreadPool.h"
 #include "database.h"
 #include <assert.h>
+#include <algorithm>
 
 namespace
 {
@@ -43,9 +46,11 @@ namespace
 		}
 	}
 
-	bool reference_parents(ServerLinkDao& link_dao, int clientid, const std::string& target,
+	bool reference_parents(DirLinkBatch& dir_link_batch, int clientid, const std::string& target,
 		const std::string& new_pool_name, int depth, bool remove)
 	{
+		ServerLinkDao& link_dao = dir_link_batch.getLinkDao();
+
 		bool ret = true;
 		std::string path = target;
 		std::string sub_path;
@@ -54,25 +59,11 @@ namespace
 			sub_path = os_file_sep() + ExtractFileName(path, os_file_sep()) + sub_path;
 			path = ExtractFilePath(path, os_file_sep());
 
-			if (os_is_symlink(os_file_prefix(path)))
+			std::string pool_name;
+			std::string link_src_dir;
+			bool has_error = false;
+			if (dir_link_batch.getPoolLink(path, pool_name, link_src_dir, has_error))
 			{
-				std::string link_src_dir;
-				if (!os_get_symlink_target(os_file_prefix(path), link_src_dir))
-				{
-					Server->Log("Could not get symlink target of source directory \"" + path + "\". (1)", LL_ERROR);
-					ret = false;
-					continue;
-				}
-
-				std::string pool_name = ExtractFileName(link_src_dir);
-
-				if (pool_name.empty())
-				{
-					Server->Log("Error extracting pool name from link source \"" + link_src_dir + "\" (1)", LL_ERROR);
-					ret = false;
-					continue;
-				}
-
 				std::vector<ServerLinkDao::DirectoryLinkEntry> entries = link_dao.getLinksByPoolName(clientid, pool_name);
 
 				for (size_t j = 0; j < entries.size(); ++j)
@@ -93,6 +84,10 @@ namespace
 					}
 				}
 			}
+			else if (has_error)
+			{
+				ret = false;
+			}
 		}
 
 		return ret;
@@ -148,53 +143,136 @@ std::string escape_glob_sql(const std::string& glob)
 }
 
 
-bool link_directory_pool( int clientid, const std::string& target_dir, const std::string& src_dir, const std::string& pooldir, bool with_transaction,
-	ServerLinkDao*& link_dao, ServerLinkJournalDao*& link_journal_dao, int depth)
+DirLinkBatch::DirLinkBatch()
+{
+}
+
+DirLinkBatch::~DirLinkBatch()
+{
+	flush();
+}
+
+ServerLinkDao& DirLinkBatch::getLinkDao()
+{
+	if (link_dao.get() == NULL)
+	{
+		link_dao.reset(new ServerLinkDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_LINKS)));
+		synchronous_link.reset(new DBScopedSynchronous(link_dao->getDatabase()));
+	}
+	return *link_dao;
+}
+
+ServerLinkJournalDao& DirLinkBatch::getLinkJournalDao()
+{
+	if (link_journal_dao.get() == NULL)
+	{
+		link_journal_dao.reset(new ServerLinkJournalDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_LINK_JOURNAL)));
+		synchronous_link_journal.reset(new DBScopedSynchronous(link_journal_dao->getDatabase()));
+	}
+	return *link_journal_dao;
+}
+
+bool DirLinkBatch::getPoolLink(const std::string& path, std::string& pool_name, std::string& link_target, bool& has_error)
+{
+	std::map<std::string, std::pair<std::string, std::string> >::iterator it = pool_links.find(path);
+	if (it != pool_links.end())
+	{
+		pool_name = it->second.first;
+		link_target = it->second.second;
+		return !pool_name.empty();
+	}
+
+	//Only the directories of one client are cached
+	if (pool_links.size() > 100000)
+	{
+		pool_links.clear();
+	}
+
+	if (!os_is_symlink(os_file_prefix(path)))
+	{
+		pool_links[path] = std::make_pair(std::string(), std::string());
+		return false;
+	}
+
+	if (!os_get_symlink_target(os_file_prefix(path), link_target))
+	{
+		Server->Log("Could not get symlink target of source directory \"" + path + "\".", LL_ERROR);
+		has_error = true;
+		return false;
+	}
+
+	pool_name = ExtractFileName(link_target);
+
+	if (pool_name.empty())
+	{
+		Server->Log("Error extracting pool name from link source \"" + link_target + "\"", LL_ERROR);
+		has_error = true;
+		return false;
+	}
+
+	pool_links[path] = std::make_pair(pool_name, link_target);
+
+	return true;
+}
+
+void DirLinkBatch::setPoolLink(const std::string& path, const std::string& pool_name, const std::string& link_target)
+{
+	pool_links[path] = std::make_pair(pool_name, link_target);
+}
+
+void DirLinkBatch::addCompletedJournalEntry(int64 entry_id)
 {
-	if (link_dao == NULL)
+	completed_journal_entries.push_back(entry_id);
+
+	if (completed_journal_entries.size() >= 1000)
 	{
-		link_dao=new ServerLinkDao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_LINKS));
+		flush();
 	}
+}
+
+void DirLinkBatch::flush()
+{
+	if (completed_journal_entries.empty())
+	{
+		return;
+	}
+
+	ServerLinkJournalDao& journal_dao = getLinkJournalDao();
 
-	DBScopedSynchronous synchonous_link_journal(NULL);
+	DBScopedWriteTransaction journal_transaction(journal_dao.getDatabase());
 
-	if (!with_transaction && link_journal_dao == NULL)
+	for (size_t i = 0; i < completed_journal_entries.size(); ++i)
 	{
-		IDatabase* link_journal_db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_LINK_JOURNAL);
-		link_journal_dao = new ServerLinkJournalDao(link_journal_db);
-		synchonous_link_journal.reset(link_journal_db);
+		journal_dao.removeDirectoryLinkJournalEntry(completed_journal_entries[i]);
 	}
 
-	DBScopedSynchronous synchonous_link(link_dao->getDatabase());
+	completed_journal_entries.clear();
+}
+
+bool link_directory_pool( int clientid, const std::string& target_dir, const std::string& src_dir, const std::string& pooldir, bool with_transaction,
+	DirLinkBatch& dir_link_batch, int depth)
+{
+	ServerLinkDao& link_dao = dir_link_batch.getLinkDao();
 
 	IScopedLock lock(NULL);
 	dir_link_lock_client_mutex(clientid, lock);
 
-	DBScopedWriteTransaction link_transaction(link_dao->getDatabase());
+	DBScopedWriteTransaction link_transaction(link_dao.getDatabase());
 
 	std::string link_src_dir;
 	std::string pool_name;
 	bool remove_glob=false;
-	if(os_is_symlink(os_file_prefix(src_dir)))
+	bool has_error=false;
+	if(dir_link_batch.getPoolLink(src_dir, pool_name, link_src_dir, has_error))
 	{
-		if(!os_get_symlink_target(os_file_prefix(src_dir), link_src_dir))
-		{
-			Server->Log("Could not get symlink target of source directory \""+src_dir+"\".", LL_ERROR);
-			return false;
-		}
-
-		pool_name = ExtractFileName(link_src_dir);
-
-		if(pool_name.empty())
-		{
-			Server->Log("Error extracting pool name from link source \""+link_src_dir+"\"", LL_ERROR);
-			return false;
-		}
-
-		link_dao->addDirectoryLink(clientid, pool_name, target_dir);
-		reference_all_sublinks(*link_dao, clientid, src_dir, target_dir);
+		link_dao.addDirectoryLink(clientid, pool_name, target_dir);
+		reference_all_sublinks(link_dao, clientid, src_dir, target_dir);
 		remove_glob=true;
 	}
+	else if(has_error)
+	{
+		return false;
+	}
 	else if(os_directory_exists(os_file_prefix(src_dir)))
 	{
 		std::string parent_src_dir;
@@ -212,18 +290,18 @@ bool link_directory_pool( int clientid, const std::string& target_dir, const std
 		}
 
 		std::vector<int64> parent_ids;
-		reference_parents(*link_dao, clientid, src_dir, pool_name, depth, false);
-		link_dao->addDirectoryLink(clientid, pool_name, src_dir);
-		reference_all_sublinks(*link_dao, clientid, src_dir, target_dir);
+		reference_parents(dir_link_batch, clientid, src_dir, pool_name, depth, false);
+		link_dao.addDirectoryLink(clientid, pool_name, src_dir);
+		reference_all_sublinks(link_dao, clientid, src_dir, target_dir);
 		remove_glob = true;
-		link_dao->addDirectoryLink(clientid, pool_name, target_dir);
+		link_dao.addDirectoryLink(clientid, pool_name, target_dir);
 				
 
 		int64 replay_entry_id;
 		if(!with_transaction)
 		{
-			link_journal_dao->addDirectoryLinkJournalEntry(src_dir, link_src_dir);
-			replay_entry_id = link_journal_dao->getLastId();
+			dir_link_batch.getLinkJournalDao().addDirectoryLinkJournalEntry(src_dir, link_src_dir);
+			replay_entry_id = dir_link_batch.getLinkJournalDao().getLastId();
 		}
 
 		link_transaction.end();
@@ -236,10 +314,10 @@ bool link_directory_pool( int clientid, const std::string& target_dir, const std
 			if(!transaction)
 			{
 				Server->Log("Error starting filesystem transaction", LL_ERROR);
-				reference_parents(*link_dao, clientid, src_dir, pool_name, depth, true);
-				link_dao->removeDirectoryLink(clientid, src_dir);
-				link_dao->removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir) + os_file_sep() + "*");
-				link_dao->removeDirectoryLink(clientid, target_dir);
+				reference_parents(dir_link_batch, clientid, src_dir, pool_name, depth, true);
+				link_dao.removeDirectoryLink(clientid, src_dir);
+				link_dao.removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir) + os_file_sep() + "*");
+				link_dao.removeDirectoryLink(clientid, target_dir);
 				return false;
 			}
 		}
@@ -248,14 +326,14 @@ bool link_directory_pool( int clientid, const std::string& target_dir, const std
 		{
 			Server->Log("Could not rename folder \""+src_dir+"\" to \""+link_src_dir+"\"", LL_ERROR);
 			os_finish_transaction(transaction);
-			reference_parents(*link_dao, clientid, src_dir, pool_name, depth, true);
-			link_dao->removeDirectoryLink(clientid, src_dir);
-			link_dao->removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir) + os_file_sep() + "*");
-			link_dao->removeDirectoryLink(clientid, target_dir);
+			reference_parents(dir_link_batch, clientid, src_dir, pool_name, depth, true);
+			link_dao.removeDirectoryLink(clientid, src_dir);
+			link_dao.removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir) + os_file_sep() + "*");
+			link_dao.removeDirectoryLink(clientid, target_dir);
 			
 			if (!with_transaction)
 			{
-				link_journal_dao->removeDirectoryLinkJournalEntry(replay_entry_id);
+				dir_link_batch.getLinkJournalDao().removeDirectoryLinkJournalEntry(replay_entry_id);
 			}
 
 			return false;
@@ -267,14 +345,14 @@ bool link_directory_pool( int clientid, const std::string& target_dir, const std
 			Server->Log("Could not create a symbolic link at \""+src_dir+"\" to \""+link_src_dir+"\"", LL_ERROR);
 			os_rename_file(link_src_dir, src_dir, transaction);
 			os_finish_transaction(transaction);
-			reference_parents(*link_dao, clientid, src_dir, pool_name, depth, true);
-			link_dao->removeDirectoryLink(clientid, src_dir);
-			link_dao->removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir) + os_file_sep() + "*");
-			link_dao->removeDirectoryLink(clientid, target_dir);
+			reference_parents(dir_link_batch, clientid, src_dir, pool_name, depth, true);
+			link_dao.removeDirectoryLink(clientid, src_dir);
+			link_dao.removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir) + os_file_sep() + "*");
+			link_dao.removeDirectoryLink(clientid, target_dir);
 
 			if (!with_transaction)
 			{
-				link_journal_dao->removeDirectoryLinkJournalEntry(replay_entry_id);
+				dir_link_batch.getLinkJournalDao().removeDirectoryLinkJournalEntry(replay_entry_id);
 			}
 
 			return false;
@@ -285,17 +363,19 @@ bool link_directory_pool( int clientid, const std::string& target_dir, const std
 			if(!os_finish_transaction(transaction))
 			{
 				Server->Log("Error finishing filesystem transaction", LL_ERROR);
-				reference_parents(*link_dao, clientid, src_dir, pool_name, depth, true);
-				link_dao->removeDirectoryLink(clientid, src_dir);
-				link_dao->removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir) + os_file_sep() + "*");
-				link_dao->removeDirectoryLink(clientid, target_dir);
+				reference_parents(dir_link_batch, clientid, src_dir, pool_name, depth, true);
+				link_dao.removeDirectoryLink(clientid, src_dir);
+				link_dao.removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir) + os_file_sep() + "*");
+				link_dao.removeDirectoryLink(clientid, target_dir);
 				return false;
 			}
 		}
 		else
 		{
-			link_journal_dao->removeDirectoryLinkJournalEntry(replay_entry_id);
+			dir_link_batch.addCompletedJournalEntry(replay_entry_id);
 		}
+
+		dir_link_batch.setPoolLink(src_dir, pool_name, link_src_dir);
 	}
 	else
 	{
@@ -308,16 +388,18 @@ bool link_directory_pool( int clientid, const std::string& target_dir, const std
 		Server->Log("Error creating symbolic link from \"" + link_src_dir +"\" to \"" +
 			target_dir+"\" -2", LL_ERROR);
 
-		link_dao->removeDirectoryLink(clientid, target_dir);
+		link_dao.removeDirectoryLink(clientid, target_dir);
 
 		if(remove_glob)
 		{
-			link_dao->removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir)+os_file_sep()+"*");
+			link_dao.removeDirectoryLinkGlob(clientid, escape_glob_sql(target_dir)+os_file_sep()+"*");
 		}
 
 		return false;
 	}
 
+	dir_link_batch.setPoolLink(target_dir, pool_name, link_src_dir);
+
 	return true;
 }
 
@@ -502,6 +584,134 @@ bool remove_directory_link_dir(const std::string &path, ServerLinkDao& link_dao,
 	return os_remove_nonempty_dir(os_file_prefix(path), symlink_callback, &userdata, delete_root);
 }
 
+namespace
+{
+	struct SParallelRemove
+	{
+		IMutex* mutex;
+		std::vector<std::string> subtrees;
+		size_t next_subtree;
+		bool has_error;
+		int clientid;
+	};
+
+	bool locked_symlink_callback(const std::string &path, bool* isdir, void* userdata)
+	{
+		SSymlinkCallbackData* data = reinterpret_cast<SSymlinkCallbackData*>(userdata);
+
+		IScopedLock lock(NULL);
+		dir_link_lock_client_mutex(data->clientid, lock);
+
+		return symlink_callback(path, isdir, userdata);
+	}
+
+	class ParallelRemoveThread : public IThread
+	{
+	public:
+		ParallelRemoveThread(SParallelRemove* parallel_remove)
+			: parallel_remove(parallel_remove)
+		{}
+
+		void operator()()
+		{
+			{
+				ServerLinkDao link_dao(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_LINKS));
+				SSymlinkCallbackData userdata(&link_dao, parallel_remove->clientid, true);
+
+				while (true)
+				{
+					std::string subtree;
+					{
+						IScopedLock lock(parallel_remove->mutex);
+						if (parallel_remove->next_subtree >= parallel_remove->subtrees.size())
+						{
+							break;
+						}
+						subtree = parallel_remove->subtrees[parallel_remove->next_subtree++];
+					}
+
+					if (!os_remove_nonempty_dir(os_file_prefix(subtree), locked_symlink_callback, &userdata, true))
+					{
+						IScopedLock lock(parallel_remove->mutex);
+						parallel_remove->has_error = true;
+					}
+				}
+			}
+
+			Server->destroyDatabases(Server->getThreadID());
+			delete this;
+		}
+
+	private:
+		SParallelRemove* parallel_remove;
+	};
+}
+
+bool remove_directory_link_dir_parallel(const std::string &path, ServerLinkDao& link_dao, int clientid)
+{
+	size_t n_threads = (std::max)(1, watoi(Server->getServerParameter("file_backup_delete_threads", "4")));
+
+	if (n_threads <= 1
+		|| (os_get_file_type(os_file_prefix(path)) & EFileType_Symlink) )
+	{
+		return remove_directory_link_dir(path, link_dao, clientid);
+	}
+
+	//Split the tree into subtrees (directories, not directory links) until there are
+	//enough of them for the threads. Files and links above the subtrees are removed afterwards.
+	//The threads lock the directory links of the client per link instead of for the whole removal
+	std::vector<std::string> subtrees(1, path);
+	for (int depth = 0; depth < 3 && subtrees.size() < n_threads * 8; ++depth)
+	{
+		std::vector<std::string> next_subtrees;
+		for (size_t i = 0; i < subtrees.size(); ++i)
+		{
+			std::vector<SFile> files = getFiles(os_file_prefix(subtrees[i]));
+			for (size_t j = 0; j < files.size(); ++j)
+			{
+				if (files[j].isdir && !files[j].issym)
+				{
+					next_subtrees.push_back(subtrees[i] + os_file_sep() + files[j].name);
+				}
+			}
+		}
+
+		if (next_subtrees.empty())
+		{
+			break;
+		}
+
+		subtrees.swap(next_subtrees);
+	}
+
+	bool ret = true;
+
+	if (subtrees.size() > 1)
+	{
+		SParallelRemove parallel_remove;
+		parallel_remove.mutex = Server->createMutex();
+		parallel_remove.subtrees.swap(subtrees);
+		parallel_remove.next_subtree = 0;
+		parallel_remove.has_error = false;
+		parallel_remove.clientid = clientid;
+
+		std::vector<THREADPOOL_TICKET> tickets;
+		n_threads = (std::min)(n_threads, parallel_remove.subtrees.size());
+		for (size_t i = 0; i < n_threads; ++i)
+		{
+			tickets.push_back(Server->getThreadPool()->execute(new ParallelRemoveThread(&parallel_remove), "backup delete"));
+		}
+
+		Server->getThreadPool()->waitFor(tickets);
+
+		Server->destroy(parallel_remove.mutex);
+
+		ret = !parallel_remove.has_error;
+	}
+
+	return remove_directory_link_dir(path, link_dao, clientid) && ret;
+}
+
 bool reference_contained_directory_links(ServerLinkDao& link_dao, int clientid, 
 	const std::string& pool_name, const std::string &path, const std::string& link_path)
 {
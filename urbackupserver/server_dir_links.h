@@ -4,6 +4,8 @@
 #include "dao/ServerLinkJournalDao.h"
 #include <string>
 #include <memory>
+#include <map>
+#include <vector>
 
 void init_dir_link_mutex();
 
@@ -14,8 +16,45 @@ std::string escape_glob_sql(const std::string& glob);
 class IScopedLock;
 void dir_link_lock_client_mutex(int clientid, IScopedLock& lock);
 
+/**
+* State kept between the link_directory_pool calls of one backup. Keeps the
+* link databases of the thread in synchronous mode for the whole backup, caches
+* which directories are links into the directory pool (and their pool names)
+* and removes the journal entries of completed links in batches.
+*/
+class DirLinkBatch
+{
+public:
+	DirLinkBatch();
+	~DirLinkBatch();
+
+	ServerLinkDao& getLinkDao();
+	ServerLinkJournalDao& getLinkJournalDao();
+
+	//Returns true if path is a directory pool link. Sets pool_name and link_target in this case
+	bool getPoolLink(const std::string& path, std::string& pool_name, std::string& link_target, bool& has_error);
+	void setPoolLink(const std::string& path, const std::string& pool_name, const std::string& link_target);
+
+	//Journal entry of a link that was completed. Replaying it is a no-op
+	void addCompletedJournalEntry(int64 entry_id);
+
+	void flush();
+
+private:
+	DirLinkBatch(const DirLinkBatch& other);
+	DirLinkBatch& operator=(const DirLinkBatch& other);
+
+	std::unique_ptr<ServerLinkDao> link_dao;
+	std::unique_ptr<ServerLinkJournalDao> link_journal_dao;
+	std::unique_ptr<DBScopedSynchronous> synchronous_link;
+	std::unique_ptr<DBScopedSynchronous> synchronous_link_journal;
+
+	std::map<std::string, std::pair<std::string, std::string> > pool_links;
+	std::vector<int64> completed_journal_entries;
+};
+
 bool link_directory_pool(int clientid, const std::string& target_dir, const std::string& src_dir, const std::string& pooldir, bool with_transaction,
-	ServerLinkDao*& link_dao, ServerLinkJournalDao*& link_journal_dao, int depth);
+	DirLinkBatch& dir_link_batch, int depth);
 
 bool replay_directory_link_journal();
 
@@ -24,6 +63,10 @@ bool remove_directory_link(const std::string &path, ServerLinkDao& link_dao, int
 
 bool remove_directory_link_dir(const std::string &path, ServerLinkDao& link_dao, int clientid, bool delete_root=true, bool with_transaction=true);
 
+//Same as remove_directory_link_dir, but the subtrees are removed with
+//file_backup_delete_threads threads
+bool remove_directory_link_dir_parallel(const std::string &path, ServerLinkDao& link_dao, int clientid);
+
 bool reference_contained_directory_links(ServerLinkDao& link_dao, int clientid,
 	const std::string& pool_name, const std::string &path, const std::string& link_path);
 
@@ -23,8 +23,10 @@
 #include "../Interface/Server.h"
 #include "../Interface/File.h"
 #include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
 #include "../common/data.h"
 #include "database.h"
+#include "FilesDbShards.h"
 #include "../urbackupcommon/sha2/sha2.h"
 #include "../stringtools.h"
 #include "server_log.h"
@@ -41,23 +43,36 @@
 
 const size_t freespace_mod=50*1024*1024; //50 MB
 const size_t BUFFER_SIZE=64*1024; //64KB
+const int64 clone_range_align=512*1024; //Same as the chunk patcher sparse block size
+const int64 commit_group_max_copy_size=1024*1024; //1MB
 
 IMutex * delete_mutex=NULL;
 
+//File index entries of all running commit groups and the hash thread they belong to
+IMutex * commit_group_mutex=NULL;
+ICondition * commit_group_cond=NULL;
+std::map<FileIndex::SIndexKey, BackupServerHash*> commit_group_pending;
+
 void init_mutex1(void)
 {
 	delete_mutex=Server->createMutex();
+	commit_group_mutex=Server->createMutex();
+	commit_group_cond=Server->createCondition();
 }
 
 void destroy_mutex1(void)
 {
 	Server->destroy(delete_mutex);
+	Server->destroy(commit_group_mutex);
+	Server->destroy(commit_group_cond);
 }
 
 BackupServerHash::BackupServerHash(IPipe *pPipe, int pClientid, bool use_snapshots, bool use_reflink, bool use_tmpfiles, logid_t logid,
 	bool snapshot_file_inplace, MaxFileId& max_file_id)
-	: use_snapshots(use_snapshots), use_reflink(use_reflink), use_tmpfiles(use_tmpfiles), filesdao(NULL), old_backupfolders_loaded(false),
-	  logid(logid), snapshot_file_inplace(snapshot_file_inplace), max_file_id(max_file_id)
+	: use_snapshots(use_snapshots), use_reflink(use_reflink), use_tmpfiles(use_tmpfiles), filesdao(NULL), filesdao_shards(NULL), old_backupfolders_loaded(false),
+	  logid(logid), snapshot_file_inplace(snapshot_file_inplace), max_file_id(max_file_id),
+	  commit_group_active(false), commit_group_files(0), commit_group_starttime(0),
+	  commit_group_requested(false)
 {
 	pipe=pPipe;
 	clientid=pClientid;
@@ -66,8 +81,12 @@ BackupServerHash::BackupServerHash(IPipe *pPipe, int pClientid, bool use_snapsho
 	working=false;
 	has_error=false;
 	chunk_patcher.setCallback(this);
+	chunk_clone_source=NULL;
 	fileindex=NULL;
 
+	commit_group_max_files = (std::max)(1, watoi(Server->getServerParameter("hash_commit_group_files", "128")));
+	commit_group_max_ms = watoi64(Server->getServerParameter("hash_commit_group_ms", "500"));
+
 	if(use_reflink)
 		ServerLogger::Log(logid, "Reflink copying is enabled", LL_DEBUG);
 }
@@ -79,9 +98,10 @@ BackupServerHash::~BackupServerHash(void)
 
 void BackupServerHash::setupDatabase(void)
 {
-	db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES);
+	filesdao_shards = new ServerFilesDaoShards;
 
-	filesdao = new ServerFilesDao(db);
+	filesdao = &filesdao_shards->getClient(clientid);
+	db = filesdao->getDatabase();
 
 	fileindex=create_lmdb_files_index(); 
 }
@@ -93,7 +113,8 @@ void BackupServerHash::deinitDatabase(void)
 	delete fileindex;
 	fileindex=NULL;
 
-	delete filesdao;
+	delete filesdao_shards;
+	filesdao_shards = NULL;
 	filesdao =NULL;
 }
 
@@ -105,7 +126,20 @@ void BackupServerHash::operator()(void)
 	{
 		working=false;
 		std::string data;
-		size_t rc=pipe->Read(&data, static_cast<int>(60000) );
+		size_t rc=0;
+		if(commit_group_active)
+		{
+			rc=pipe->Read(&data, 0);
+			if(rc==0)
+			{
+				//Queue is empty. Commit before waiting
+				endCommitGroup();
+			}
+		}
+		if(rc==0)
+		{
+			rc=pipe->Read(&data, static_cast<int>(60000) );
+		}
 		if(rc==0)
 		{
 			link_logcnt=0;
@@ -116,6 +150,7 @@ void BackupServerHash::operator()(void)
 		working=true;
 		if(data=="exit")
 		{
+			endCommitGroup();
 			pipe->Write("exit");
 			deinitDatabase();
 			Server->Log("server_hash Thread finished - normal");
@@ -125,6 +160,7 @@ void BackupServerHash::operator()(void)
 		}
 		else if(data=="flush")
 		{
+			endCommitGroup();
 			continue;
 		}
 
@@ -211,7 +247,23 @@ void BackupServerHash::operator()(void)
 					Server->deleteFile(hashoutput_fn);
 				}
 
-				max_file_id.setMaxDownloaded(fileid);
+				if(commit_group_active)
+				{
+					//The file entry is only visible to the metadata thread once the group is committed
+					commit_group_fileids.push_back(fileid);
+
+					++commit_group_files;
+					if(commit_group_files>=commit_group_max_files
+						|| Server->getTimeMS()-commit_group_starttime>=commit_group_max_ms
+						|| commit_group_requested)
+					{
+						endCommitGroup();
+					}
+				}
+				else
+				{
+					max_file_id.setMaxDownloaded(fileid);
+				}
 			}
 			else if(action==EAction_Copy)
 			{
@@ -276,11 +328,30 @@ void BackupServerHash::operator()(void)
 
 void BackupServerHash::addFileSQL(int backupid, int clientid, int incremental, const std::string &fp, const std::string &hash_path, const std::string &shahash, _i64 filesize, _i64 rsize, int64 prev_entry, int64 prev_entry_clientid, int64 next_entry, bool update_fileindex)
 {
-	addFileSQL(*filesdao, *fileindex, backupid, clientid, incremental, fp, hash_path, shahash, filesize, rsize, prev_entry, prev_entry_clientid, next_entry, update_fileindex);
+	if(pipe!=NULL)
+	{
+		beginCommitGroup();
+		addFileSQL(*filesdao, *fileindex, backupid, clientid, incremental, fp, hash_path, shahash, filesize, rsize, prev_entry, prev_entry_clientid, next_entry, update_fileindex, &commit_group_index);
+
+		FileIndex::SIndexKey key(shahash.c_str(), filesize, clientid);
+		if(commit_group_index.find(key)!=commit_group_index.end())
+		{
+			IScopedLock lock(commit_group_mutex);
+			commit_group_pending[key]=this;
+		}
+	}
+	else
+	{
+		//Reads and updates the previous entry in the same transaction,
+		//so it cannot interleave with a commit group of a hash thread
+		DBScopedWriteTransaction trans(db);
+		addFileSQL(*filesdao, *fileindex, backupid, clientid, incremental, fp, hash_path, shahash, filesize, rsize, prev_entry, prev_entry_clientid, next_entry, update_fileindex);
+	}
 }
 
 void BackupServerHash::addFileSQL(ServerFilesDao& filesdao, FileIndex& fileindex, int backupid, const int clientid, int incremental, const std::string &fp,
-	const std::string &hash_path, const std::string &shahash, _i64 filesize, _i64 rsize, int64 prev_entry, int64 prev_entry_clientid, int64 next_entry, bool update_fileindex)
+	const std::string &hash_path, const std::string &shahash, _i64 filesize, _i64 rsize, int64 prev_entry, int64 prev_entry_clientid, int64 next_entry, bool update_fileindex,
+	std::map<FileIndex::SIndexKey, int64>* index_updates)
 {
 	if (filesize < link_file_min_size)
 	{
@@ -383,7 +454,14 @@ void BackupServerHash::addFileSQL(ServerFilesDao& filesdao, FileIndex& fileindex
 		FILEENTRY_DEBUG(Server->Log("New fileindex entry for \"" + fp + "\""
 			" id=" + convert(entryid)
 			+" hash="+base64_encode(reinterpret_cast<const unsigned char*>(shahash.c_str()), bytes_in_index), LL_DEBUG));
-		fileindex.put_delayed(FileIndex::SIndexKey(shahash.c_str(), filesize, clientid), entryid);
+		if(index_updates!=NULL)
+		{
+			(*index_updates)[FileIndex::SIndexKey(shahash.c_str(), filesize, clientid)]=entryid;
+		}
+		else
+		{
+			fileindex.put_delayed(FileIndex::SIndexKey(shahash.c_str(), filesize, clientid), entryid);
+		}
 	}
 }
 
@@ -670,7 +748,9 @@ bool BackupServerHash::findFileAndLink(const std::string &tfn, IFile *tf, std::s
 					}
 					first_logmsg=false;
 
-					deleteFileSQL(*filesdao, *fileindex, sha2.c_str(), t_filesize, existing_file.rsize, existing_file.clientid, existing_file.backupid, existing_file.incremental,
+					endCommitGroup();
+
+					deleteFileSQL(filesdao_shards->getEntry(existing_file.id), *fileindex, sha2.c_str(), t_filesize, existing_file.rsize, existing_file.clientid, existing_file.backupid, existing_file.incremental,
 						existing_file.id, existing_file.prev_entry, existing_file.next_entry, existing_file.pointed_to, true, true, detach_dbs, false, NULL);
 
 					existing_file = findFileHash(sha2, t_filesize, clientid, find_state);
@@ -891,6 +971,13 @@ void BackupServerHash::addFile(int backupid, int incremental, IFile *tf, const s
 	if(copy)
 	{
 		ServerLogger::Log(logid, "HT: Copying file: \""+tfn+"\" (id=" + convert(fileid) + ")", LL_DEBUG);
+
+		if(t_filesize>=commit_group_max_copy_size)
+		{
+			//Do not block other writers while copying
+			endCommitGroup();
+		}
+
 		int64 fs=tf->Size();
 		if(!use_reflink)
 		{
@@ -1058,6 +1145,9 @@ void BackupServerHash::addFile(int backupid, int incremental, IFile *tf, const s
 
 bool BackupServerHash::freeSpace(int64 fs, const std::string &fp)
 {
+	//Cleanup uses the database connections of this thread
+	endCommitGroup();
+
 	IScopedLock lock(delete_mutex);
 
 	int64 available_space=os_free_space(ExtractFilePath(fp, os_file_sep()));
@@ -1087,6 +1177,101 @@ bool BackupServerHash::freeSpace(int64 fs, const std::string &fp)
 	return b;
 }
 
+/**
+* Starts a write transaction on the files database of the client (if not
+* already started). The file entries of the following files are added in this
+* transaction until endCommitGroup() is called, i.e. when the queue is empty,
+* after hash_commit_group_files files or hash_commit_group_ms milliseconds, before
+* large copies and before anything that needs a transaction of its own.
+* The file index entries of the group are published after it is committed.
+*/
+void BackupServerHash::beginCommitGroup()
+{
+	if(commit_group_active)
+	{
+		return;
+	}
+
+	db->BeginWriteTransaction();
+	commit_group_active=true;
+	commit_group_files=0;
+	commit_group_starttime=Server->getTimeMS();
+}
+
+void BackupServerHash::endCommitGroup()
+{
+	if(!commit_group_active)
+	{
+		return;
+	}
+
+	db->EndTransaction();
+	commit_group_active=false;
+
+	for(std::map<FileIndex::SIndexKey, int64>::iterator it=commit_group_index.begin();
+		it!=commit_group_index.end();++it)
+	{
+		fileindex->put_delayed(it->first, it->second);
+	}
+
+	{
+		IScopedLock lock(commit_group_mutex);
+		for(std::map<FileIndex::SIndexKey, int64>::iterator it=commit_group_index.begin();
+			it!=commit_group_index.end();++it)
+		{
+			std::map<FileIndex::SIndexKey, BackupServerHash*>::iterator it_pending = commit_group_pending.find(it->first);
+			if(it_pending!=commit_group_pending.end()
+				&& it_pending->second==this)
+			{
+				commit_group_pending.erase(it_pending);
+			}
+		}
+		commit_group_requested=false;
+		commit_group_cond->notify_all();
+	}
+	commit_group_index.clear();
+
+	for(size_t i=0;i<commit_group_fileids.size();++i)
+	{
+		max_file_id.setMaxDownloaded(commit_group_fileids[i]);
+	}
+	commit_group_fileids.clear();
+}
+
+/**
+* Waits until the file index entry with this key is published if it belongs to a
+* running commit group. Otherwise a file with the same content hashed by another
+* hash thread would not be linked. The own commit group is committed before
+* waiting, so two hash threads cannot wait for each other.
+*/
+void BackupServerHash::waitForCommitGroupIndex(const FileIndex::SIndexKey& key)
+{
+	IScopedLock lock(commit_group_mutex);
+
+	std::map<FileIndex::SIndexKey, BackupServerHash*>::iterator it = commit_group_pending.find(key);
+	if(it==commit_group_pending.end())
+	{
+		return;
+	}
+
+	if(it->second==this)
+	{
+		lock.relock(NULL);
+		endCommitGroup();
+		return;
+	}
+
+	lock.relock(NULL);
+	endCommitGroup();
+	lock.relock(commit_group_mutex);
+
+	while((it=commit_group_pending.find(key))!=commit_group_pending.end())
+	{
+		it->second->commit_group_requested=true;
+		commit_group_cond->wait(&lock);
+	}
+}
+
 ServerFilesDao::SFindFileEntry BackupServerHash::findFileHash(const std::string &pHash, _i64 filesize, int clientid, SFindState& state)
 {
 	int64 entryid;
@@ -1096,6 +1281,8 @@ ServerFilesDao::SFindFileEntry BackupServerHash::findFileHash(const std::string
 	bool switch_to_next_client=false;
 	if(state.state==0)
 	{
+		waitForCommitGroupIndex(FileIndex::SIndexKey(pHash.c_str(), filesize, clientid));
+
 		entryid = fileindex->get_with_cache_prefer_client(FileIndex::SIndexKey(pHash.c_str(), filesize, clientid));
 		state.state=1;
 		save_orig=true;
@@ -1198,7 +1385,8 @@ ServerFilesDao::SFindFileEntry BackupServerHash::findFileHash(const std::string
 		return ret;
 	}
 
-	state.prev = filesdao->getFileEntry(entryid);
+	//May be an entry of another client in a different files database shard
+	state.prev = filesdao_shards->getEntry(entryid).getFileEntry(entryid);
 
 	if(!state.prev.exists)
 	{
@@ -1263,6 +1451,12 @@ bool BackupServerHash::copyFile(IFile *tf, const std::string &dest, ExtentIterat
 		return false;
 	}
 
+	if (extent_iterator == NULL
+		&& os_copy_file_range(tf, 0, dst.get(), 0, 0))
+	{
+		return true;
+	}
+
 	tf->Seek(0);
 	_u32 read;
 	char buf[BUFFER_SIZE];
@@ -1425,7 +1619,14 @@ bool BackupServerHash::handle_not_enough_space(const std::string &path)
 
 void BackupServerHash::next_chunk_patcher_bytes(const char *buf, size_t bsize, bool changed, bool* is_sparse)
 {
-	if(!has_reflink || changed )
+	if (chunk_clone_source != NULL
+		&& buf == NULL
+		&& !changed
+		&& (is_sparse == NULL || !*is_sparse))
+	{
+		cloneChunkPatcherBytes(bsize);
+	}
+	else if(!has_reflink || changed )
 	{
 		if (buf != NULL) //buf is NULL for sparse extents
 		{
@@ -1461,6 +1662,48 @@ void BackupServerHash::next_chunk_patcher_bytes(const char *buf, size_t bsize, b
 	}
 }
 
+void BackupServerHash::cloneChunkPatcherBytes(size_t bsize)
+{
+	if (os_copy_file_range(chunk_clone_source, chunk_patch_pos, chunk_output_fn, chunk_patch_pos, bsize))
+	{
+		return;
+	}
+
+	char buf[BUFFER_SIZE];
+	int64 pos = chunk_patch_pos;
+	int64 end = chunk_patch_pos + bsize;
+
+	if (!chunk_output_fn->Seek(pos))
+	{
+		ServerLogger::Log(logid, "Error seeking to offset " + convert(pos) + " in \"" + chunk_output_fn->getFilename() + "\" -4", LL_ERROR);
+		chunk_patcher_has_error = true;
+		return;
+	}
+
+	while (pos < end)
+	{
+		_u32 toread = static_cast<_u32>((std::min)(end - pos, static_cast<int64>(BUFFER_SIZE)));
+		bool has_read_error = false;
+		_u32 read = chunk_clone_source->Read(pos, buf, toread, &has_read_error);
+		if (has_read_error
+			|| read != toread)
+		{
+			ServerLogger::Log(logid, "Error reading unchanged data from \"" + chunk_clone_source->getFilename() + "\" at offset " + convert(pos) + ". " + os_last_error_str(), LL_ERROR);
+			chunk_patcher_has_error = true;
+			return;
+		}
+
+		if (!writeRepeatFreeSpace(chunk_output_fn, buf, read, this))
+		{
+			ServerLogger::Log(logid, "Error writing to file \"" + chunk_output_fn->getFilename() + "\" -4. " + os_last_error_str(), LL_ERROR);
+			chunk_patcher_has_error = true;
+			return;
+		}
+
+		pos += read;
+	}
+}
+
 void BackupServerHash::next_sparse_extent_bytes(const char * buf, size_t bsize)
 {
 }
@@ -1514,8 +1757,26 @@ bool BackupServerHash::patchFile(IFile *patch, const std::string &source, const
 		chunk_patch_pos=0;
 		enabled_sparse = false;
 		chunk_patcher_has_error = false;
-		chunk_patcher.setRequireUnchanged(!has_reflink);
+		chunk_clone_source = NULL;
+
+		if (!has_reflink
+			&& f_source->Size() >= clone_range_align
+			&& os_copy_file_range(f_source, 0, chunk_output_fn, 0, clone_range_align))
+		{
+			//Unchanged ranges are cloned (FICLONERANGE) or copied by the kernel (copy_file_range)
+			//instead of being read and written back through user space
+			chunk_clone_source = f_source;
+			chunk_patcher.setRequireUnchanged(false);
+			chunk_patcher.setUnchangedAlign(clone_range_align);
+		}
+		else
+		{
+			chunk_patcher.setRequireUnchanged(!has_reflink);
+			chunk_patcher.setUnchangedAlign(0);
+		}
+
 		bool b=chunk_patcher.ApplyPatch(f_source, patch, extent_iterator);
+		chunk_clone_source = NULL;
 
 		if (!b)
 		{
@@ -17,6 +17,7 @@
 #include "../urbackupcommon/ExtentIterator.h"
 
 class FileMetadata;
+class ServerFilesDaoShards;
 class MaxFileId;
 
 const int64 link_file_min_size = 2048;
@@ -74,7 +75,7 @@ public:
 
 	static void addFileSQL(ServerFilesDao& filesdao, FileIndex& fileindex, int backupid, int clientid, int incremental, const std::string &fp,
 		const std::string &hash_path, const std::string &shahash, _i64 filesize, _i64 rsize, int64 prev_entry, int64 prev_entry_clientid,
-		int64 next_entry, bool update_fileindex);
+		int64 next_entry, bool update_fileindex, std::map<FileIndex::SIndexKey, int64>* index_updates=NULL);
 		
 		
 	static void deleteFileSQL(ServerFilesDao& filesdao, FileIndex& fileindex, int64 id);
@@ -135,9 +136,16 @@ private:
 
 	bool punchHoleOrZero(IFile *tf, int64 offset, int64 size);
 
+	void cloneChunkPatcherBytes(size_t bsize);
+
+	void beginCommitGroup();
+	void endCommitGroup();
+	void waitForCommitGroupIndex(const FileIndex::SIndexKey& key);
+
 	std::map<std::pair<std::string, _i64>, std::vector<STmpFile> > files_tmp;
 
 	ServerFilesDao* filesdao;
+	ServerFilesDaoShards* filesdao_shards;
 
 	IPipe *pipe;
 
@@ -153,6 +161,7 @@ private:
 	volatile bool has_error;
 
 	IFsFile *chunk_output_fn;
+	IFile *chunk_clone_source;
 	ChunkPatcher chunk_patcher;
 	bool chunk_patcher_has_error;
 
@@ -178,4 +187,19 @@ private:
 	bool snapshot_file_inplace;
 
 	MaxFileId& max_file_id;
+
+	//The file entries of consecutive files are written in one
+	//transaction (hash thread only)
+	bool commit_group_active;
+	size_t commit_group_files;
+	int64 commit_group_starttime;
+	size_t commit_group_max_files;
+	int64 commit_group_max_ms;
+	//File index updates of the commit group. Only published once the
+	//transaction with the file entries they point to is committed
+	std::map<FileIndex::SIndexKey, int64> commit_group_index;
+	//Files of the commit group, only reported as downloaded once it is committed
+	std::vector<int64> commit_group_fileids;
+	//Another hash thread waits for an index entry of this commit group
+	volatile bool commit_group_requested;
 };
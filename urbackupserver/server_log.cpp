@@ -24,9 +24,9 @@
 #include "../stringtools.h"
 #include <limits.h>
 
-std::map<logid_t, SLogData> ServerLogger::logdata;
-IMutex *ServerLogger::mutex=NULL;
-std::map<int, SCircularData> ServerLogger::circular_logdata;
+SLogDataShard ServerLogger::logdata_shards[LOG_NUM_SHARDS];
+ISharedMutex *ServerLogger::mutex=NULL;
+SCircularDataShard ServerLogger::circular_logdata_shards[LOG_NUM_SHARDS];
 logid_t ServerLogger::logid_gen;
 std::map<logid_t, int> ServerLogger::logid_client;
 
@@ -35,40 +35,50 @@ const size_t max_memory_logdata_size = 2 * 1024 * 1024;
 
 void ServerLogger::Log(logid_t logid, const std::string &pStr, int LogLevel)
 {
-	Server->Log(pStr, LogLevel);
-
-	IScopedLock lock(mutex);
-
-	logCircular(logid_client[logid], logid, pStr, LogLevel);
-
-	if(LogLevel<0)
-		return;
-
-	logMemory(Server->getTimeSeconds(), logid, pStr, LogLevel);
+	Log(Server->getTimeSeconds(), logid, pStr, LogLevel);
 }
 
 void ServerLogger::Log(int64 times, logid_t logid, const std::string &pStr, int LogLevel)
 {
 	Server->Log(pStr, LogLevel);
 
-	IScopedLock lock(mutex);
+	int clientid = getClientId(logid);
 
-	logCircular(logid_client[logid], logid, pStr, LogLevel);
+	logCircular(clientid, logid, pStr, LogLevel);
 
-	if(LogLevel<0)
+	if(LogLevel<0 || clientid<=0)
 		return;
 
 	logMemory(times, logid, pStr, LogLevel);
 }
 
-void ServerLogger::logMemory(int64 times, logid_t logid, const std::string &pStr, int LogLevel)
+int ServerLogger::getClientId(logid_t logid)
 {
-	std::map<logid_t, int>::iterator it = logid_client.find(logid);
+	IScopedReadLock lock(mutex);
 
-	if (it != logid_client.end() && it->second <= 0)
+	std::map<logid_t, int>::iterator it = logid_client.find(logid);
+	if (it != logid_client.end())
 	{
-		return;
+		return it->second;
 	}
+	return 0;
+}
+
+SLogDataShard& ServerLogger::getLogDataShard(logid_t logid)
+{
+	return logdata_shards[static_cast<uint64>(logid.first) % LOG_NUM_SHARDS];
+}
+
+SCircularDataShard& ServerLogger::getCircularDataShard(int clientid)
+{
+	return circular_logdata_shards[static_cast<unsigned int>(clientid) % LOG_NUM_SHARDS];
+}
+
+void ServerLogger::logMemory(int64 times, logid_t logid, const std::string &pStr, int LogLevel)
+{
+	SLogDataShard& shard = getLogDataShard(logid);
+	IScopedLock lock(shard.mutex);
+	std::map<logid_t, SLogData>& logdata = shard.logdata;
 
 	SLogEntry le;
 	le.data=pStr;
@@ -145,6 +155,10 @@ std::vector<SCircularLogEntry> ServerLogger::stripLogIdFilter(const std::vector<
 
 void ServerLogger::logCircular(int clientid, logid_t logid, const std::string &pStr, int LogLevel)
 {
+	SCircularDataShard& shard = getCircularDataShard(clientid);
+	IScopedLock lock(shard.mutex);
+	std::map<int, SCircularData>& circular_logdata = shard.circular_logdata;
+
 	std::map<int, SCircularData>::iterator iter=circular_logdata.find(clientid);
 	SCircularData *data;
 	if(iter==circular_logdata.end())
@@ -171,17 +185,31 @@ void ServerLogger::logCircular(int clientid, logid_t logid, const std::string &p
 
 void ServerLogger::init_mutex(void)
 {
-	mutex=Server->createMutex();
+	mutex=Server->createSharedMutex();
+
+	for(size_t i=0;i<LOG_NUM_SHARDS;++i)
+	{
+		logdata_shards[i].mutex=Server->createMutex();
+		circular_logdata_shards[i].mutex=Server->createMutex();
+	}
 }
 
 void ServerLogger::destroy_mutex(void)
 {
 	Server->destroy(mutex);
+
+	for(size_t i=0;i<LOG_NUM_SHARDS;++i)
+	{
+		Server->destroy(logdata_shards[i].mutex);
+		Server->destroy(circular_logdata_shards[i].mutex);
+	}
 }
 
 std::string ServerLogger::getLogdata(logid_t logid, int &errors, int &warnings, int &infos)
 {
-	IScopedLock lock(mutex);
+	SLogDataShard& shard = getLogDataShard(logid);
+	IScopedLock lock(shard.mutex);
+	std::map<logid_t, SLogData>& logdata = shard.logdata;
 
 	std::string ret;
 
@@ -217,7 +245,9 @@ std::string ServerLogger::getLogdata(logid_t logid, int &errors, int &warnings,
 
 std::string ServerLogger::getWarningLevelTextLogdata(logid_t logid)
 {
-	IScopedLock lock(mutex);
+	SLogDataShard& shard = getLogDataShard(logid);
+	IScopedLock lock(shard.mutex);
+	std::map<logid_t, SLogData>& logdata = shard.logdata;
 
 	std::string ret;
 	std::map<logid_t, SLogData >::iterator iter=logdata.find(logid);
@@ -249,7 +279,9 @@ std::string ServerLogger::getWarningLevelTextLogdata(logid_t logid)
 
 void ServerLogger::reset(logid_t id)
 {
-	IScopedLock lock(mutex);
+	SLogDataShard& shard = getLogDataShard(id);
+	IScopedLock lock(shard.mutex);
+	std::map<logid_t, SLogData>& logdata = shard.logdata;
 
 	std::map<logid_t, SLogData >::iterator iter=logdata.find(id);
 	if( iter!=logdata.end() )
@@ -261,21 +293,31 @@ void ServerLogger::reset(logid_t id)
 
 void ServerLogger::reset( int clientid )
 {
-	IScopedLock lock(mutex);
-
-	for(std::map<logid_t, int>::iterator it=logid_client.begin();
-		it!=logid_client.end();++it)
+	std::vector<logid_t> logids;
 	{
-		if(it->second==clientid)
+		IScopedReadLock lock(mutex);
+
+		for(std::map<logid_t, int>::iterator it=logid_client.begin();
+			it!=logid_client.end();++it)
 		{
-			reset(it->first);
+			if(it->second==clientid)
+			{
+				logids.push_back(it->first);
+			}
 		}
 	}
+
+	for(size_t i=0;i<logids.size();++i)
+	{
+		reset(logids[i]);
+	}
 }
 
 std::vector<SCircularLogEntry> ServerLogger::getCircularLogdata( int clientid, size_t minid, logid_t logid)
 {
-	IScopedLock lock(mutex);
+	SCircularDataShard& shard = getCircularDataShard(clientid);
+	IScopedLock lock(shard.mutex);
+	std::map<int, SCircularData>& circular_logdata = shard.circular_logdata;
 
 	std::map<int, SCircularData>::const_iterator iter=circular_logdata.find(clientid);
 	if(iter!=circular_logdata.end())
@@ -313,7 +355,7 @@ std::vector<SCircularLogEntry> ServerLogger::getCircularLogdata( int clientid, s
 
 logid_t ServerLogger::getLogId( int clientid )
 {
-	IScopedLock lock(mutex);
+	IScopedWriteLock lock(mutex);
 
 	logid_t ret= std::make_pair(++logid_gen.first, 0);
 
@@ -324,8 +366,6 @@ logid_t ServerLogger::getLogId( int clientid )
 
 bool ServerLogger::hasClient( logid_t id, int clientid )
 {
-	IScopedLock lock(mutex);
-
-	return logid_client[id] == clientid;
+	return getClientId(id) == clientid;
 }
 
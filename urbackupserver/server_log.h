@@ -2,6 +2,7 @@
 
 #include "../Interface/Server.h"
 #include "../Interface/Mutex.h"
+#include "../Interface/SharedMutex.h"
 
 struct SLogEntry
 {
@@ -43,6 +44,20 @@ struct SCircularData
 	size_t id;
 };
 
+struct SLogDataShard
+{
+	IMutex* mutex;
+	std::map<logid_t, SLogData> logdata;
+};
+
+struct SCircularDataShard
+{
+	IMutex* mutex;
+	std::map<int, SCircularData> circular_logdata;
+};
+
+const size_t LOG_NUM_SHARDS = 16;
+
 const int LOG_CATEGORY_CLEANUP = -4;
 
 class ServerLogger
@@ -75,9 +90,15 @@ private:
 
 	static std::vector<SCircularLogEntry> stripLogIdFilter(const std::vector<SCircularLogEntryWithId>& data, logid_t logid);
 
-	static std::map<logid_t, SLogData> logdata;
-	static std::map<int, SCircularData> circular_logdata;
+	static int getClientId(logid_t logid);
+	static SLogDataShard& getLogDataShard(logid_t logid);
+	static SCircularDataShard& getCircularDataShard(int clientid);
+
+	//Log data is sharded by log id/client id so that
+	//log readers and writers of different backups do not block each other
+	static SLogDataShard logdata_shards[LOG_NUM_SHARDS];
+	static SCircularDataShard circular_logdata_shards[LOG_NUM_SHARDS];
 	static std::map<logid_t, int> logid_client;
-	static IMutex *mutex;
+	static ISharedMutex *mutex;
 	static logid_t logid_gen;
 };
\ No newline at end of file
@@ -30,6 +30,7 @@
 
 IMutex *ServerSettings::g_mutex=NULL;
 std::map<int, SSettings*> ServerSettings::g_settings_cache;
+int64 ServerSettings::g_settings_version = 0;
 
 #ifndef DEFAULT_BACKUP_FOLDER
 #ifdef _WIN32
@@ -106,6 +107,10 @@ ServerSettings::ServerSettings(IDatabase *db, int pClientid)
 		}
 		else
 		{
+			if (local_settings->version != g_settings_version)
+			{
+				local_settings->needs_update = true;
+			}
 			g_settings_cache.insert(std::make_pair(clientid, local_settings));
 		}
 	}	
@@ -172,6 +177,8 @@ void ServerSettings::updateAll(void)
 {
 	IScopedLock lock(g_mutex);
 
+	++g_settings_version;
+
 	for(std::map<int, SSettings*>::iterator it=g_settings_cache.begin();
 		it!=g_settings_cache.end();)
 	{
@@ -194,6 +201,8 @@ void ServerSettings::updateClient(int clientid)
 {
 	IScopedLock lock(g_mutex);
 
+	++g_settings_version;
+
 	std::map<int, SSettings*>::iterator it = g_settings_cache.find(clientid);
 	if(it!=g_settings_cache.end())
 	{
@@ -270,6 +279,10 @@ void ServerSettings::update(bool force_update)
 		if (iter==g_settings_cache.end()
 			|| iter->second == old_local_settings)
 		{
+			if (local_settings->version != g_settings_version)
+			{
+				local_settings->needs_update = true;
+			}
 			g_settings_cache[clientid] = local_settings;
 		}
 		else
@@ -868,34 +881,29 @@ void ServerSettings::readSizeClientSetting(IQuery * q_get_client_setting, const
 	}
 }
 
-std::vector<STimeSpan> ServerSettings::getCleanupWindow(void)
+const std::vector<STimeSpan>& ServerSettings::getCleanupWindow(void)
 {
-	std::string window=getSettings()->cleanup_window;
-	return getWindow(window);
+	return getSettings()->cleanup_window_spans;
 }
 
-std::vector<STimeSpan> ServerSettings::getBackupWindowIncrFile(void)
+const std::vector<STimeSpan>& ServerSettings::getBackupWindowIncrFile(void)
 {
-	std::string window=getSettings()->backup_window_incr_file;
-	return getWindow(window);
+	return getSettings()->backup_window_incr_file_spans;
 }
 
-std::vector<STimeSpan> ServerSettings::getBackupWindowFullFile(void)
+const std::vector<STimeSpan>& ServerSettings::getBackupWindowFullFile(void)
 {
-	std::string window=getSettings()->backup_window_full_file;
-	return getWindow(window);
+	return getSettings()->backup_window_full_file_spans;
 }
 
-std::vector<STimeSpan> ServerSettings::getBackupWindowIncrImage(void)
+const std::vector<STimeSpan>& ServerSettings::getBackupWindowIncrImage(void)
 {
-	std::string window=getSettings()->backup_window_incr_image;
-	return getWindow(window);
+	return getSettings()->backup_window_incr_image_spans;
 }
 
-std::vector<STimeSpan> ServerSettings::getBackupWindowFullImage(void)
+const std::vector<STimeSpan>& ServerSettings::getBackupWindowFullImage(void)
 {
-	std::string window=getSettings()->backup_window_full_image;
-	return getWindow(window);
+	return getSettings()->backup_window_full_image_spans;
 }
 
 std::vector<std::string> ServerSettings::getBackupVolumes(const std::string& all_volumes, const std::string& all_nonusb_volumes)
@@ -1007,25 +1015,25 @@ std::string ServerSettings::generateRandomBinaryKey(void)
 int ServerSettings::getUpdateFreqImageIncr()
 {
 	updateInternal(NULL);
-	return static_cast<int>(currentTimeSpanValue(local_settings->update_freq_image_incr)+1);
+	return static_cast<int>(currentTimeSpanValue(local_settings->update_freq_image_incr_spans)+1);
 }
 
 int ServerSettings::getUpdateFreqFileIncr()
 {
 	updateInternal(NULL);
-	return static_cast<int>(currentTimeSpanValue(local_settings->update_freq_incr)+1);
+	return static_cast<int>(currentTimeSpanValue(local_settings->update_freq_incr_spans)+1);
 }
 
 int ServerSettings::getUpdateFreqImageFull()
 {
 	updateInternal(NULL);
-	return static_cast<int>(currentTimeSpanValue(local_settings->update_freq_image_full)+1);
+	return static_cast<int>(currentTimeSpanValue(local_settings->update_freq_image_full_spans)+1);
 }
 
 int ServerSettings::getUpdateFreqFileFull()
 {
 	updateInternal(NULL);
-	return static_cast<int>(currentTimeSpanValue(local_settings->update_freq_full)+1);
+	return static_cast<int>(currentTimeSpanValue(local_settings->update_freq_full_spans)+1);
 }
 
 std::string ServerSettings::getImageFileFormat()
@@ -1192,22 +1200,22 @@ std::vector<std::pair<double, STimeSpan > > ServerSettings::parseTimeSpanValue(s
 
 int ServerSettings::getLocalSpeed()
 {
-	return static_cast<int>(round(currentTimeSpanValue(getSettings()->local_speed)));
+	return static_cast<int>(round(currentTimeSpanValue(getSettings()->local_speed_spans)));
 }
 
 int ServerSettings::getGlobalLocalSpeed()
 {
-	return static_cast<int>(round(currentTimeSpanValue(getSettings()->global_local_speed)));
+	return static_cast<int>(round(currentTimeSpanValue(getSettings()->global_local_speed_spans)));
 }
 
 int ServerSettings::getInternetSpeed()
 {
-	return static_cast<int>(round(currentTimeSpanValue(getSettings()->internet_speed)));
+	return static_cast<int>(round(currentTimeSpanValue(getSettings()->internet_speed_spans)));
 }
 
 int ServerSettings::getGlobalInternetSpeed()
 {
-	return static_cast<int>(round(currentTimeSpanValue(getSettings()->global_internet_speed)));
+	return static_cast<int>(round(currentTimeSpanValue(getSettings()->global_internet_speed_spans)));
 }
 
 std::string ServerSettings::getVirtualClients()
@@ -1222,10 +1230,8 @@ std::string ServerSettings::getVirtualClients()
 	return ret;
 }
 
-double ServerSettings::currentTimeSpanValue(std::string time_span_value)
+double ServerSettings::currentTimeSpanValue(const std::vector<std::pair<double, STimeSpan > >& time_span_values)
 {
-	std::vector<std::pair<double, STimeSpan > > time_span_values = parseTimeSpanValue(time_span_value);
-
 	double val = 0;
 	double selected_time_span_duration=25.f*7;
 
@@ -1250,6 +1256,12 @@ void ServerSettings::readSettings()
 	local_settings = new SSettings();
 	local_settings->refcount = 1;
 	local_settings->clientid = clientid;
+
+	{
+		IScopedLock lock(g_mutex);
+		local_settings->version = g_settings_version;
+	}
+
 	std::unique_ptr<ISettingsReader> settings_client, settings_default, settings_global;
 	int settings_default_id;
 
@@ -1278,6 +1290,29 @@ void ServerSettings::readSettings()
 	}
 
 	db->destroyQuery(q_get_client_setting);
+
+	parseSettings();
+}
+
+void ServerSettings::parseSettings()
+{
+	SSettings* settings = local_settings;
+
+	settings->backup_window_incr_file_spans = getWindow(settings->backup_window_incr_file);
+	settings->backup_window_full_file_spans = getWindow(settings->backup_window_full_file);
+	settings->backup_window_incr_image_spans = getWindow(settings->backup_window_incr_image);
+	settings->backup_window_full_image_spans = getWindow(settings->backup_window_full_image);
+	settings->cleanup_window_spans = getWindow(settings->cleanup_window);
+
+	settings->update_freq_incr_spans = parseTimeSpanValue(settings->update_freq_incr);
+	settings->update_freq_full_spans = parseTimeSpanValue(settings->update_freq_full);
+	settings->update_freq_image_incr_spans = parseTimeSpanValue(settings->update_freq_image_incr);
+	settings->update_freq_image_full_spans = parseTimeSpanValue(settings->update_freq_image_full);
+
+	settings->local_speed_spans = parseTimeSpanValue(settings->local_speed);
+	settings->internet_speed_spans = parseTimeSpanValue(settings->internet_speed);
+	settings->global_internet_speed_spans = parseTimeSpanValue(settings->global_internet_speed);
+	settings->global_local_speed_spans = parseTimeSpanValue(settings->global_local_speed);
 }
 
 namespace
@@ -1300,7 +1335,7 @@ namespace
 	}
 }
 
-bool ServerSettings::isInTimeSpan(std::vector<STimeSpan> bw)
+bool ServerSettings::isInTimeSpan(const std::vector<STimeSpan>& bw)
 {
 	if(bw.empty()) return true;
 	int dow=atoi(os_strftime("%w").c_str());
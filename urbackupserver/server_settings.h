@@ -28,10 +28,41 @@ namespace
 	const int c_use_value_client = 4;
 }
 
+struct STimeSpan
+{
+	STimeSpan(void): dayofweek(-1), numdays(7) {}
+	STimeSpan(int dayofweek, float start_hour, float stop_hour):dayofweek(dayofweek), start_hour(start_hour), stop_hour(stop_hour), numdays(1) {}
+	STimeSpan(float start_hour, float stop_hour):dayofweek(0), start_hour(start_hour), stop_hour(stop_hour), numdays(1) {}
+
+	int dayofweek;
+	int numdays;
+	float start_hour;
+	float stop_hour;
+
+	float duration() const
+	{
+		if(dayofweek==-1)
+		{
+			return 24.f*numdays;
+		}
+		else
+		{
+			if (stop_hour < start_hour)
+			{
+				return (stop_hour + 24 - start_hour)*numdays;
+			}
+			else
+			{
+				return (stop_hour - start_hour)*numdays;
+			}
+		}
+	}
+};
+
 struct SSettings
 {
 	SSettings()
-		: needs_update(false), refcount(0)
+		: needs_update(false), refcount(0), version(0)
 	{}
 
 	volatile bool needs_update;
@@ -158,6 +189,24 @@ struct SSettings
 	std::string backup_dest_secret_params;
 	bool pause_if_windows_unlocked;
 	std::string backup_unlocked_window;
+
+	//Settings version at the time the settings were read
+	int64 version;
+
+	//Parsed once when the settings are read
+	std::vector<STimeSpan> backup_window_incr_file_spans;
+	std::vector<STimeSpan> backup_window_full_file_spans;
+	std::vector<STimeSpan> backup_window_incr_image_spans;
+	std::vector<STimeSpan> backup_window_full_image_spans;
+	std::vector<STimeSpan> cleanup_window_spans;
+	std::vector<std::pair<double, STimeSpan > > update_freq_incr_spans;
+	std::vector<std::pair<double, STimeSpan > > update_freq_full_spans;
+	std::vector<std::pair<double, STimeSpan > > update_freq_image_incr_spans;
+	std::vector<std::pair<double, STimeSpan > > update_freq_image_full_spans;
+	std::vector<std::pair<double, STimeSpan > > local_speed_spans;
+	std::vector<std::pair<double, STimeSpan > > internet_speed_spans;
+	std::vector<std::pair<double, STimeSpan > > global_internet_speed_spans;
+	std::vector<std::pair<double, STimeSpan > > global_local_speed_spans;
 };
 
 struct SLDAPSettings
@@ -180,37 +229,6 @@ struct SLDAPSettings
 	std::map<std::string, std::string> class_rights_map;
 };
 
-struct STimeSpan
-{
-	STimeSpan(void): dayofweek(-1), numdays(7) {}
-	STimeSpan(int dayofweek, float start_hour, float stop_hour):dayofweek(dayofweek), start_hour(start_hour), stop_hour(stop_hour), numdays(1) {}
-	STimeSpan(float start_hour, float stop_hour):dayofweek(0), start_hour(start_hour), stop_hour(stop_hour), numdays(1) {}
-
-	int dayofweek;
-	int numdays;
-	float start_hour;
-	float stop_hour;
-
-	float duration()
-	{
-		if(dayofweek==-1)
-		{
-			return 24.f*numdays;
-		}
-		else
-		{
-			if (stop_hour < start_hour)
-			{
-				return (stop_hour + 24 - start_hour)*numdays;
-			}
-			else
-			{
-				return (stop_hour - start_hour)*numdays;
-			}
-		}
-	}
-};
-
 class ServerSettings
 {
 public:
@@ -229,12 +247,12 @@ public:
 	static std::string generateRandomAuthKey(size_t len=10);
 	static std::string generateRandomBinaryKey(void);
 
-	std::vector<STimeSpan> getBackupWindowIncrFile(void);
-	std::vector<STimeSpan> getBackupWindowFullFile(void);
-	std::vector<STimeSpan> getBackupWindowIncrImage(void);
-	std::vector<STimeSpan> getBackupWindowFullImage(void);
+	const std::vector<STimeSpan>& getBackupWindowIncrFile(void);
+	const std::vector<STimeSpan>& getBackupWindowFullFile(void);
+	const std::vector<STimeSpan>& getBackupWindowIncrImage(void);
+	const std::vector<STimeSpan>& getBackupWindowFullImage(void);
 
-	std::vector<STimeSpan> getCleanupWindow(void);
+	const std::vector<STimeSpan>& getCleanupWindow(void);
 	std::vector<std::string> getBackupVolumes(const std::string& all_volumes, const std::string& all_nonusb_volumes);
 
 	std::string getImageFileFormat();
@@ -251,7 +269,7 @@ public:
 
 	std::string getVirtualClients();
 
-	static bool isInTimeSpan(std::vector<STimeSpan> bw);
+	static bool isInTimeSpan(const std::vector<STimeSpan>& bw);
 
 	SLDAPSettings getLDAPSettings();
 
@@ -274,7 +292,9 @@ private:
 
 	std::vector<std::pair<double, STimeSpan > > parseTimeSpanValue(std::string time_span_value);
 
-	double currentTimeSpanValue(std::string time_span_value);
+	double currentTimeSpanValue(const std::vector<std::pair<double, STimeSpan > >& time_span_values);
+
+	void parseSettings();
 
 	void readSettings();
 
@@ -304,6 +324,7 @@ private:
 
 	static std::map<int, SSettings*> g_settings_cache;
 	static IMutex *g_mutex;
+	static int64 g_settings_version;
 };
 
 
@@ -30,12 +30,16 @@ IMutex *ServerStatus::mutex=NULL;
 std::map<std::string, SStatus> ServerStatus::status;
 int64 ServerStatus::last_status_update;
 size_t ServerStatus::curr_process_id = 0;
+size_t ServerStatus::status_version = 0;
+std::deque<std::pair<size_t, std::string> > ServerStatus::removed_status;
+size_t ServerStatus::removed_status_min_version = 0;
 
 
 int ServerStatus::server_nospc_stalled=0;
 bool ServerStatus::server_nospc_fatal=false;
 
 const unsigned int inactive_time_const=30*60*1000;
+const size_t max_removed_status=1000;
 
 void ServerStatus::init_mutex(void)
 {
@@ -59,10 +63,11 @@ void ServerStatus::setOnline(const std::string &clientname, bool bonline)
 	assert(!clientname.empty());
 
 	IScopedLock lock(mutex);
-	SStatus *s=&status[clientname];
+	SStatus *s=getStatusMod(clientname);
 	if(bonline)
 	{
 		*s=SStatus();
+		s->version=status_version;
 	}
 	s->online=bonline;
 	s->client=clientname;
@@ -126,7 +131,7 @@ void ServerStatus::setCommPipe(const std::string &clientname, IPipe *p)
 void ServerStatus::stopProcess(const std::string &clientname, size_t id, bool b)
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 	if(proc!=NULL)
 	{
 		proc->stop=true;
@@ -155,6 +160,33 @@ std::vector<SStatus> ServerStatus::getStatus(void)
 	return ret;
 }
 
+size_t ServerStatus::getStatusChanges(size_t since_version, std::vector<SStatus>& changed,
+	std::vector<std::string>& removed, bool& full)
+{
+	IScopedLock lock(mutex);
+
+	full = since_version==0 || since_version<removed_status_min_version;
+
+	for(std::map<std::string, SStatus>::iterator it=status.begin();it!=status.end();++it)
+	{
+		if(full || it->second.version>since_version)
+		{
+			changed.push_back(it->second);
+		}
+	}
+
+	if(!full)
+	{
+		for(std::deque<std::pair<size_t, std::string> >::reverse_iterator it=removed_status.rbegin();
+			it!=removed_status.rend() && it->first>since_version;++it)
+		{
+			removed.push_back(it->second);
+		}
+	}
+
+	return status_version;
+}
+
 SStatus ServerStatus::getStatus(const std::string &clientname)
 {
 	IScopedLock lock(mutex);
@@ -244,7 +276,7 @@ size_t ServerStatus::startProcess( const std::string &clientname, SStatusAction
 	const std::string& details, logid_t logid, bool can_stop, int clientid)
 {
 	IScopedLock lock(mutex);
-	SStatus *s=&status[clientname];
+	SStatus *s=getStatusMod(clientname);
 
 	if (s->client.empty())
 	{
@@ -267,7 +299,7 @@ size_t ServerStatus::startProcess( const std::string &clientname, SStatusAction
 bool ServerStatus::stopProcess( const std::string &clientname, size_t id )
 {
 	IScopedLock lock(mutex);
-	SStatus *s=&status[clientname];
+	SStatus *s=getStatusMod(clientname);
 
 	std::vector<SProcess>::iterator it = std::find(s->processes.begin(), s->processes.end(), SProcess(id, sa_none, std::string()));
 
@@ -285,7 +317,7 @@ bool ServerStatus::stopProcess( const std::string &clientname, size_t id )
 bool ServerStatus::changeProcess(const std::string & clientname, size_t id, SStatusAction action)
 {
 	IScopedLock lock(mutex);
-	SStatus *s = &status[clientname];
+	SStatus *s = getStatusMod(clientname);
 
 	std::vector<SProcess>::iterator it = std::find(s->processes.begin(), s->processes.end(), SProcess(id, sa_none, std::string()));
 
@@ -300,6 +332,24 @@ bool ServerStatus::changeProcess(const std::string & clientname, size_t id, SSta
 	}
 }
 
+//Only for fields sent to status websockets (online, clientid, processes)
+SStatus* ServerStatus::getStatusMod(const std::string & clientname)
+{
+	SStatus *s=&status[clientname];
+	s->version=++status_version;
+	return s;
+}
+
+SProcess* ServerStatus::getProcessMod(const std::string & clientname, size_t id)
+{
+	SProcess* proc = getProcessInt(clientname, id);
+	if(proc!=NULL)
+	{
+		status[clientname].version=++status_version;
+	}
+	return proc;
+}
+
 SProcess* ServerStatus::getProcessInt( const std::string &clientname, size_t id )
 {
 	SStatus *s=&status[clientname];
@@ -319,7 +369,7 @@ SProcess* ServerStatus::getProcessInt( const std::string &clientname, size_t id
 void ServerStatus::setProcessQueuesize( const std::string &clientname, size_t id, unsigned int prepare_hashqueuesize, unsigned int hashqueuesize )
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if(proc!=NULL)
 	{
@@ -331,7 +381,7 @@ void ServerStatus::setProcessQueuesize( const std::string &clientname, size_t id
 void ServerStatus::setProcessStarttime( const std::string &clientname, size_t id, int64 starttime )
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if(proc!=NULL)
 	{
@@ -342,7 +392,7 @@ void ServerStatus::setProcessStarttime( const std::string &clientname, size_t id
 void ServerStatus::setProcessEta( const std::string &clientname, size_t id, int64 eta_ms, int64 eta_set_time )
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if(proc!=NULL)
 	{
@@ -354,7 +404,7 @@ void ServerStatus::setProcessEta( const std::string &clientname, size_t id, int6
 void ServerStatus::setProcessEta( const std::string &clientname, size_t id, int64 eta_ms )
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if(proc!=NULL)
 	{
@@ -365,7 +415,7 @@ void ServerStatus::setProcessEta( const std::string &clientname, size_t id, int6
 void ServerStatus::setProcessSpeed(const std::string &clientname, size_t id, double speed_bpms)
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if (proc != NULL)
 	{
@@ -388,6 +438,13 @@ bool ServerStatus::removeStatus( const std::string &clientname )
 	if(it!=status.end())
 	{
 		status.erase(it);
+
+		removed_status.push_back(std::make_pair(++status_version, clientname));
+		if(removed_status.size()>max_removed_status)
+		{
+			removed_status_min_version=removed_status.front().first;
+			removed_status.pop_front();
+		}
 		return true;
 	}
 	else
@@ -399,7 +456,7 @@ bool ServerStatus::removeStatus( const std::string &clientname )
 void ServerStatus::setProcessPcDone( const std::string &clientname, size_t id, int pcdone )
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if(proc!=NULL)
 	{
@@ -410,7 +467,7 @@ void ServerStatus::setProcessPcDone( const std::string &clientname, size_t id, i
 void ServerStatus::setProcessTotalBytes(const std::string & clientname, size_t id, int64 total_bytes)
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if (proc != NULL)
 	{
@@ -421,7 +478,7 @@ void ServerStatus::setProcessTotalBytes(const std::string & clientname, size_t i
 void ServerStatus::setProcessDoneBytes(const std::string & clientname, size_t id, int64 done_bytes)
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if (proc != NULL)
 	{
@@ -432,7 +489,7 @@ void ServerStatus::setProcessDoneBytes(const std::string & clientname, size_t id
 void ServerStatus::setProcessDoneBytes(const std::string & clientname, size_t id, int64 done_bytes, int64 total_bytes)
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if (proc != NULL)
 	{
@@ -445,7 +502,7 @@ void ServerStatus::setProcessDetails(const std::string & clientname, size_t id,
 	std::string details, int detail_pc)
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if (proc != NULL)
 	{
@@ -457,7 +514,7 @@ void ServerStatus::setProcessDetails(const std::string & clientname, size_t id,
 void ServerStatus::setProcessPaused(const std::string & clientname, size_t id, bool b)
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if (proc != NULL)
 	{
@@ -482,7 +539,7 @@ SProcess ServerStatus::getProcess( const std::string &clientname, size_t id )
 void ServerStatus::setProcessEtaSetTime( const std::string &clientname, size_t id, int64 eta_set_time )
 {
 	IScopedLock lock(mutex);
-	SProcess* proc = getProcessInt(clientname, id);
+	SProcess* proc = getProcessMod(clientname, id);
 
 	if(proc!=NULL)
 	{
@@ -495,7 +552,7 @@ void ServerStatus::setClientId( const std::string &clientname, int clientid)
 	assert(!clientname.empty());
 
 	IScopedLock lock(mutex);
-	SStatus *s=&status[clientname];
+	SStatus *s=getStatusMod(clientname);
 	s->clientid = clientid;
 }
 
@@ -100,7 +100,7 @@ struct SStatus
 {
 	SStatus(void){ online=false; has_status=false;r_online=false; clientid=0; 
 		comm_pipe=NULL; status_error=se_none; running_jobs=0; restore=ERestore_disabled;
-		lastseen = 0;
+		lastseen = 0; version = 0;
 	}
 
 	std::string client;
@@ -117,6 +117,8 @@ struct SStatus
 	int running_jobs;
 	ERestore restore;
 	int64 lastseen;
+	//Status version of the last change
+	size_t version;
 };
 
 class ServerStatus
@@ -147,6 +149,12 @@ public:
 	static std::vector<SStatus> getStatus(void);
 	static SStatus getStatus(const std::string &clientname);
 
+	//Returns the statuses changed and the client names removed since version since_version
+	//and the current version. Sets full if all statuses are returned, because
+	//since_version was zero or is too old
+	static size_t getStatusChanges(size_t since_version, std::vector<SStatus>& changed,
+		std::vector<std::string>& removed, bool& full);
+
 	static bool isActive(void);
 	static void updateActive(void);
 
@@ -211,8 +219,13 @@ public:
 
 private:
 	static SProcess* getProcessInt(const std::string &clientname, size_t id);
+	static SProcess* getProcessMod(const std::string &clientname, size_t id);
+	static SStatus* getStatusMod(const std::string &clientname);
 
 	static std::map<std::string, SStatus> status;
+	static size_t status_version;
+	static std::deque<std::pair<size_t, std::string> > removed_status;
+	static size_t removed_status_min_version;
 	static IMutex *mutex;
 	static int64 last_status_update;
 	static size_t curr_process_id;
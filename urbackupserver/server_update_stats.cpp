@@ -30,8 +30,11 @@
 #include "../Interface/DatabaseCursor.h"
 #include "create_files_index.h"
 #include "dao/ServerFilesDao.h"
+#include "FilesDbShards.h"
 #include <algorithm>
 
+int64 ServerUpdateStats::last_image_reconcile = 0;
+
 ServerUpdateStats::ServerUpdateStats(bool image_repair_mode, bool interruptible)
 	: image_repair_mode(image_repair_mode), interruptible(interruptible)
 {
@@ -41,13 +44,11 @@ void ServerUpdateStats::createQueries(void)
 {
 	q_get_images=db->Prepare("SELECT id,clientid,path FROM backup_images WHERE complete=1 AND running<datetime('now','-300 seconds')", false);
 	q_update_images_size=db->Prepare("UPDATE clients SET bytes_used_images=? WHERE id=?", false);
-	q_get_sizes=db->Prepare("SELECT id, bytes_used_files FROM clients", false);
-	q_size_update=db->Prepare("UPDATE clients SET bytes_used_files=? WHERE id=?", false);
-	q_update_backups=db->Prepare("UPDATE backups SET size_bytes=? WHERE id=?", false);
-	q_get_backup_size=db->Prepare("SELECT size_bytes FROM backups WHERE id=?", false);
+	q_size_update=db->Prepare("UPDATE clients SET bytes_used_files=bytes_used_files+? WHERE id=?", false);
+	q_update_backups=db->Prepare("UPDATE backups SET size_bytes=(CASE WHEN size_bytes=-1 THEN 0 ELSE size_bytes END)+? WHERE id=?", false);
 	q_get_del_size=db->Prepare("SELECT delsize FROM del_stats WHERE backupid=? AND image=0 AND created>datetime('now','-4 days')", false);
 	q_add_del_size=db->Prepare("INSERT INTO del_stats (backupid, image, delsize, clientid, incremental, stoptime) VALUES (?, 0, ?, ?, ?, CURRENT_TIMESTAMP)", false);
-	q_update_del_size=db->Prepare("UPDATE del_stats SET delsize=?,stoptime=CURRENT_TIMESTAMP WHERE backupid=? AND image=0 AND created>datetime('now','-4 days')", false);
+	q_update_del_size=db->Prepare("UPDATE del_stats SET delsize=delsize+?,stoptime=CURRENT_TIMESTAMP WHERE backupid=? AND image=0 AND created>datetime('now','-4 days')", false);
 	q_save_client_hist=db->Prepare("INSERT INTO clients_hist (id, name, lastbackup, lastseen, lastbackup_image, bytes_used_files, bytes_used_images, hist_id) SELECT id, name, lastbackup, lastseen, lastbackup_image, bytes_used_files, bytes_used_images, ? AS hist_id FROM clients", false);
 	q_set_file_backup_null=db->Prepare("UPDATE backups SET size_bytes=0 WHERE size_bytes=-1 AND complete=1", false);
 	q_create_hist=db->Prepare("INSERT INTO clients_hist_id (created) VALUES (CURRENT_TIMESTAMP)", false);
@@ -58,10 +59,8 @@ void ServerUpdateStats::destroyQueries(void)
 {
 	db->destroyQuery(q_get_images);
 	db->destroyQuery(q_update_images_size);
-	db->destroyQuery(q_get_sizes);
 	db->destroyQuery(q_size_update);
 	db->destroyQuery(q_update_backups);
-	db->destroyQuery(q_get_backup_size);
 	db->destroyQuery(q_get_del_size);
 	db->destroyQuery(q_add_del_size);
 	db->destroyQuery(q_update_del_size);
@@ -106,7 +105,16 @@ void ServerUpdateStats::operator()(void)
 		q_save_client_hist->Reset();
 	}
 
-	update_images();
+	//The image sizes of the clients are maintained when image backups are added or removed.
+	//Opening every image file to correct them is only done once in a while
+	int64 image_reconcile_interval = watoi64(Server->getServerParameter("image_stats_reconcile_interval", "86400"))*1000;
+	if(image_repair_mode
+		|| last_image_reconcile==0
+		|| Server->getTimeMS()-last_image_reconcile>image_reconcile_interval)
+	{
+		update_images();
+		last_image_reconcile = Server->getTimeMS();
+	}
 
 	if(!image_repair_mode)
 	{
@@ -213,151 +221,147 @@ void ServerUpdateStats::update_files(void)
 	
 	Server->Log("Updating file statistics...");
 
-	IDatabase* files_db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES);
-	ServerFilesDao filesdao(files_db);
-	
-	size_t total_num = static_cast<size_t>(filesdao.getIncomingStatsCount().value);
-	size_t total_i=0;
+	ServerFilesDaoShards filesdao_shards;
 
-	std::map<int, _i64> size_data_clients=getFilebackupSizesClients();
-	std::map<int, _i64> size_data_backups;
-	std::map<int, SDelInfo> del_sizes;
+	size_t total_num = 0;
+	for (size_t shard = 0; shard < FilesDbShards::getNumShards(); ++shard)
+	{
+		total_num += static_cast<size_t>(filesdao_shards.getShard(shard).getIncomingStatsCount().value);
+	}
+	size_t total_i=0;
 
 	DBScopedSynchronous synchonous_db(db);
-	DBScopedSynchronous synchonous_files_db(files_db);
-
-	DBScopedWriteTransaction files_db_transaction(NULL);
-	bool started_transaction = false;
 	
 	std::vector<ServerFilesDao::SIncomingStat> stat_entries;
 
 	int last_pc=0;
-	do
+	for (size_t shard = 0; shard < FilesDbShards::getNumShards(); ++shard)
 	{
-		if(interruptible)
-		{
-			if( ClientMain::getNumberOfRunningFileBackups()>0 )
-			{
-				files_db_transaction.rollback();
-				return;
-			}
-		}
+		ServerFilesDao& filesdao = filesdao_shards.getShard(shard);
+		IDatabase* files_db = filesdao.getDatabase();
 
-		ServerStatus::updateActive();
-
-		stat_entries = filesdao.getIncomingStats();
-
-		if(!started_transaction && !stat_entries.empty())
-		{
-			files_db_transaction.reset(files_db);
-			started_transaction = true;
-		}
+		DBScopedSynchronous synchonous_files_db(files_db);
 
-		for(size_t i=0;i<stat_entries.size();++i,++total_i)
+		while(true)
 		{
-			++num_updated_files;
-
-			if(total_i%1000==0 && total_i>0)
+			if(interruptible)
 			{
-				int pc=(std::min)(100, (int)((float)total_i/(float)total_num*100.f+0.5f));
-				if(pc!=last_pc)
+				if( ClientMain::getNumberOfRunningFileBackups()>0 )
 				{
-					measureSpeed();
-					Server->Log( "Updating file statistics: "+convert(pc)+"%", LL_INFO);
-					last_pc=pc;
+					return;
 				}
 			}
 
-			ServerFilesDao::SIncomingStat& entry = stat_entries[i];
+			ServerStatus::updateActive();
 
-			std::vector<int> clients;
-			std::vector<std::string> s_clients;
-			Tokenize(entry.existing_clients, s_clients, ",");
-			clients.resize(s_clients.size());
-			for(size_t j=0;j<s_clients.size();++j)
-			{
-				clients[j]=watoi(s_clients[j]);
-			}
+			stat_entries = filesdao.getIncomingStats();
 
-			
-			if(entry.direction== ServerFilesDao::c_direction_incoming)
+			if(stat_entries.empty())
 			{
-				int64 current_size_per_client = 0; 
-				if(!clients.empty())
-				{
-					current_size_per_client=entry.filesize/clients.size();
+				break;
+			}
 
-					add(clients, -current_size_per_client, size_data_clients);
-				}			
+			//Each batch of statistic entries is applied as a change of the current sizes
+			//in its own transaction, so the work done so far is kept if it gets interrupted
+			std::map<int, _i64> size_data_clients;
+			std::map<int, _i64> size_data_backups;
+			std::map<int, SDelInfo> del_sizes;
 
-				clients.push_back(entry.clientid);
-				current_size_per_client = entry.filesize/clients.size();
-				
-				add(clients, current_size_per_client, size_data_clients);
+			DBScopedWriteTransaction files_db_transaction(files_db);
 
-				add(size_data_backups, entry.backupid, entry.filesize);
-			}
-			else if(entry.direction== ServerFilesDao::c_direction_outgoing ||
-				entry.direction== ServerFilesDao::c_direction_outgoing_nobackupstat)
+			for(size_t i=0;i<stat_entries.size();++i,++total_i)
 			{
-				int64 current_size_per_client = entry.filesize;
-				
-				if(!clients.empty())
+				++num_updated_files;
+
+				if(total_i%1000==0 && total_i>0)
 				{
-					current_size_per_client/=clients.size();
+					int pc=(std::min)(100, (int)((float)total_i/(float)total_num*100.f+0.5f));
+					if(pc!=last_pc)
+					{
+						measureSpeed();
+						Server->Log( "Updating file statistics: "+convert(pc)+"%", LL_INFO);
+						last_pc=pc;
+					}
 				}
 
-				add(clients, -current_size_per_client, size_data_clients);
+				ServerFilesDao::SIncomingStat& entry = stat_entries[i];
 
-				std::vector<int>::iterator it_client = std::find(clients.begin(), clients.end(), entry.clientid);
-				if(it_client!=clients.end())
+				std::vector<int> clients;
+				std::vector<std::string> s_clients;
+				Tokenize(entry.existing_clients, s_clients, ",");
+				clients.resize(s_clients.size());
+				for(size_t j=0;j<s_clients.size();++j)
 				{
-					clients.erase(it_client);
+					clients[j]=watoi(s_clients[j]);
 				}
 
-				if(!clients.empty())
+			
+				if(entry.direction== ServerFilesDao::c_direction_incoming)
 				{
-					current_size_per_client = entry.filesize/clients.size();
+					int64 current_size_per_client = 0; 
+					if(!clients.empty())
+					{
+						current_size_per_client=entry.filesize/clients.size();
+
+						add(clients, -current_size_per_client, size_data_clients);
+					}			
 
+					clients.push_back(entry.clientid);
+					current_size_per_client = entry.filesize/clients.size();
+				
 					add(clients, current_size_per_client, size_data_clients);
-				}				
 
-				if(entry.direction!= ServerFilesDao::c_direction_outgoing_nobackupstat)
-				{
-					add_del(del_sizes, entry.backupid, entry.filesize, entry.clientid, entry.incremental);
+					add(size_data_backups, entry.backupid, entry.filesize);
 				}
-			}
-			else
-			{
-				Server->Log("Unknown direction in ServerUpdateStats::update_files " + convert((int)entry.direction), LL_ERROR);
-				assert(false);
-			}
+				else if(entry.direction== ServerFilesDao::c_direction_outgoing ||
+					entry.direction== ServerFilesDao::c_direction_outgoing_nobackupstat)
+				{
+					int64 current_size_per_client = entry.filesize;
+				
+					if(!clients.empty())
+					{
+						current_size_per_client/=clients.size();
+					}
 
-			filesdao.delIncomingStatEntry(entry.id);
-		}
-	}
-	while(!stat_entries.empty());
+					add(clients, -current_size_per_client, size_data_clients);
 
+					std::vector<int>::iterator it_client = std::find(clients.begin(), clients.end(), entry.clientid);
+					if(it_client!=clients.end())
+					{
+						clients.erase(it_client);
+					}
 
-	DBScopedWriteTransaction db_transaction(db);
+					if(!clients.empty())
+					{
+						current_size_per_client = entry.filesize/clients.size();
 
-	updateSizes(size_data_clients);
-	updateDels(del_sizes);
-	updateBackups(size_data_backups);
+						add(clients, current_size_per_client, size_data_clients);
+					}				
 
-	db->Write("UPDATE backups SET size_calculated=1 WHERE size_calculated=0 AND done=1");
-}
+					if(entry.direction!= ServerFilesDao::c_direction_outgoing_nobackupstat)
+					{
+						add_del(del_sizes, entry.backupid, entry.filesize, entry.clientid, entry.incremental);
+					}
+				}
+				else
+				{
+					Server->Log("Unknown direction in ServerUpdateStats::update_files " + convert((int)entry.direction), LL_ERROR);
+					assert(false);
+				}
 
-std::map<int, _i64> ServerUpdateStats::getFilebackupSizesClients(void)
-{
-	std::map<int, _i64> ret;
-	db_results res=q_get_sizes->Read();
-	q_get_sizes->Reset();
-	for(size_t i=0;i<res.size();++i)
-	{
-		ret.insert(std::pair<int, _i64>(watoi(res[i]["id"]), os_atoi64(res[i]["bytes_used_files"])));
+				filesdao.delIncomingStatEntry(entry.id);
+			}
+
+			//The file entry shard transaction is committed after the statistics in the main database
+			DBScopedWriteTransaction db_transaction(db);
+
+			updateSizes(size_data_clients);
+			updateDels(del_sizes);
+			updateBackups(size_data_backups);
+		}
 	}
-	return ret;
+
+	db->Write("UPDATE backups SET size_calculated=1 WHERE size_calculated=0 AND done=1");
 }
 
 void ServerUpdateStats::updateSizes(std::map<int, _i64> & size_data)
@@ -381,26 +385,7 @@ void ServerUpdateStats::add(const std::vector<int>& subset, int64 num, std::map<
 
 void ServerUpdateStats::add(std::map<int, _i64> &data, int backupid, _i64 filesize)
 {
-	std::map<int, _i64>::iterator it=data.find(backupid);
-	if(it==data.end())
-	{
-		q_get_backup_size->Bind(backupid);
-		db_results res=q_get_backup_size->Read();
-		q_get_backup_size->Reset();
-		if(!res.empty())
-		{
-			_i64 b_fs=os_atoi64(res[0]["size_bytes"]);
-			if(b_fs!=-1)
-			{
-				filesize+=b_fs;
-			}
-		}
-		data.insert(std::pair<int, _i64>(backupid, filesize));
-	}
-	else
-	{
-		it->second+=filesize;
-	}
+	data[backupid]+=filesize;
 }
 
 void ServerUpdateStats::updateBackups(std::map<int, _i64> &data)
@@ -419,13 +404,6 @@ void ServerUpdateStats::add_del(std::map<int, SDelInfo> &data, int backupid, _i6
 	std::map<int, SDelInfo>::iterator it=data.find(backupid);
 	if(it==data.end())
 	{
-		q_get_del_size->Bind(backupid);
-		db_results res=q_get_del_size->Read();
-		q_get_del_size->Reset();
-		if(!res.empty())
-		{
-			filesize+=os_atoi64(res[0]["delsize"]);
-		}
 		SDelInfo di;
 		di.delsize=filesize;
 		di.clientid=clientid;
@@ -32,7 +32,6 @@ private:
 	void createQueries(void);
 	void destroyQueries(void);
 
-	std::map<int, _i64> getFilebackupSizesClients(void);
 	void add(const std::vector<int>& subset, int64 num, std::map<int, _i64> &data);
 	void updateSizes(std::map<int, _i64> & size_data);
 	void add(std::map<int, _i64> &data, int backupid, _i64 filesize);
@@ -49,10 +48,8 @@ private:
 
 	IQuery *q_get_images;
 	IQuery *q_update_images_size;
-    IQuery *q_get_sizes;
 	IQuery *q_size_update;
 	IQuery *q_update_backups;
-	IQuery *q_get_backup_size;
 	IQuery *q_get_del_size;
 	IQuery *q_add_del_size;
 	IQuery *q_update_del_size;
@@ -67,4 +64,6 @@ private:
 
 	std::unique_ptr<ServerBackupDao> backupdao;
 	std::unique_ptr<FileIndex> fileindex;
+
+	static int64 last_image_reconcile;
 };
\ No newline at end of file
@@ -28,6 +28,7 @@
 #include "../server_settings.h"
 #include "backups.h"
 #include <memory>
+#include <map>
 #include <algorithm>
 #include <assert.h>
 #include "../../fileservplugin/IFileServ.h"
@@ -63,7 +64,8 @@ namespace backupaccess
 
 bool create_zip_to_output(const std::string& folderbase, const std::string& foldername, const std::string& hashfolderbase, 
 	const std::string& hashfoldername, const std::string& filter, bool token_authentication,
-	const std::vector<backupaccess::SToken> &backup_tokens, const std::vector<std::string> &tokens, bool skip_hashes);
+	const std::vector<backupaccess::SToken> &backup_tokens, const std::vector<std::string> &tokens, bool skip_hashes,
+	backupaccess::EArchiveFormat format);
 
 namespace
 {
@@ -98,9 +100,20 @@ namespace
 	}
 
 	bool sendZip(Helper& helper, std::string folderbase, std::string foldername, std::string hashfolderbase, std::string hashfoldername, const std::string& filter, bool token_authentication,
-		const std::vector<backupaccess::SToken>& backup_tokens, const std::vector<std::string>& tokens, bool skip_hashes)
+		const std::vector<backupaccess::SToken>& backup_tokens, const std::vector<std::string>& tokens, bool skip_hashes,
+		const std::string& format)
 	{
-		std::string zipname=ExtractFileName(foldername)+".zip";
+		backupaccess::EArchiveFormat archive_format = backupaccess::EArchiveFormat_Zip;
+		if(format=="tar")
+		{
+			archive_format = backupaccess::EArchiveFormat_Tar;
+		}
+		else if(format=="zip_store")
+		{
+			archive_format = backupaccess::EArchiveFormat_ZipStore;
+		}
+
+		std::string zipname=ExtractFileName(foldername)+(archive_format==backupaccess::EArchiveFormat_Tar ? ".tar" : ".zip");
 
 		THREAD_ID tid = Server->getThreadID();
 		Server->setContentType(tid, "application/octet-stream");
@@ -125,55 +138,170 @@ namespace
 		}
 
 		return create_zip_to_output(folderbase, foldername, hashfolderbase, hashfoldername, filter, token_authentication,
-			backup_tokens, tokens, skip_hashes);
+			backup_tokens, tokens, skip_hashes, archive_format);
 	}
 
-	std::vector<FileMetadata> getMetadata(std::string dir, const std::vector<SFile>& files, bool skip_special)
+	FileMetadata getEntryMetadata(std::string dir, SFile file)
 	{
-		std::vector<FileMetadata> ret;
-		ret.resize(files.size());
-
 		if(dir.empty() || dir[dir.size()-1]!=os_file_sep()[0])
 		{
 			dir+=os_file_sep();
 		}
 
-		for(size_t i=0;i<files.size();++i)
+		if (file.isdir
+			&& file.issym
+			&& is_directory_link(dir + file.name) )
 		{
-			if(skip_special && (files[i].name==".hashes" || files[i].name=="user_views" || next(files[i].name, 0, ".symlink_") ) )
-				continue;
+			file.issym = false;
+			file.isspecialf = false;
+		}
 
-			SFile file = files[i];
+		std::string metadata_fn;
+		if (file.isdir
+			&& !file.issym
+			&& !file.isspecialf)
+		{
+			metadata_fn = dir + escape_metadata_fn(file.name) + os_file_sep() + metadata_dir_fn;
+		}
+		else
+		{
+			metadata_fn = dir + escape_metadata_fn(file.name);
+		}
 
-			if (file.isdir
-				&& file.issym
-				&& is_directory_link(dir + file.name) )
-			{
-				file.issym = false;
-				file.isspecialf = false;
-			}
+		FileMetadata ret;
+		if(!read_metadata(metadata_fn, ret) )
+		{
+			Server->Log("Error reading metadata of file "+dir+os_file_sep()+ file.name, LL_ERROR);
+		}
 
-			std::string metadata_fn;
-			if (file.isdir
-				&& !file.issym
-				&& !file.isspecialf)
-			{
-				metadata_fn = dir + escape_metadata_fn(file.name) + os_file_sep() + metadata_dir_fn;
-			}
-			else
+		return ret;
+	}
+
+	struct SDirIndex
+	{
+		int64 dir_mtime;
+		int64 last_used;
+		std::shared_ptr<std::vector<SFile> > files;
+	};
+
+	IMutex* dir_index_mutex = NULL;
+	std::map<std::string, SDirIndex> dir_indices;
+	size_t dir_indices_entries = 0;
+
+	const size_t max_dir_indices_entries = 1000000;
+
+	/**
+	* Listing of a backup directory with the directories first. Backups do
+	* not change after they are complete, so listings are kept in memory
+	* and revalidated with the modification time of the directory.
+	*/
+	std::shared_ptr<std::vector<SFile> > getDirIndex(const std::string& path)
+	{
+		int64 dir_mtime = getFileMetadata(os_file_prefix(path)).last_modified;
+
+		{
+			IScopedLock lock(dir_index_mutex);
+			std::map<std::string, SDirIndex>::iterator it = dir_indices.find(path);
+			if (it != dir_indices.end())
 			{
-				metadata_fn = dir + escape_metadata_fn(file.name);
+				if (it->second.dir_mtime == dir_mtime)
+				{
+					it->second.last_used = Server->getTimeMS();
+					return it->second.files;
+				}
+
+				dir_indices_entries -= it->second.files->size();
+				dir_indices.erase(it);
 			}
+		}
+
+		bool has_error = false;
+		std::shared_ptr<std::vector<SFile> > files(new std::vector<SFile>(getFiles(os_file_prefix(path), &has_error)));
+		std::stable_partition(files->begin(), files->end(), [](const SFile& f) { return f.isdir; });
 
-			if(!read_metadata(metadata_fn, ret[i]) )
+		if (has_error
+			|| files->size() > max_dir_indices_entries)
+		{
+			return files;
+		}
+
+		IScopedLock lock(dir_index_mutex);
+
+		while (!dir_indices.empty()
+			&& dir_indices_entries + files->size() > max_dir_indices_entries)
+		{
+			std::map<std::string, SDirIndex>::iterator oldest = dir_indices.begin();
+			for (std::map<std::string, SDirIndex>::iterator it = dir_indices.begin(); it != dir_indices.end(); ++it)
 			{
-				Server->Log("Error reading metadata of file "+dir+os_file_sep()+ file.name, LL_ERROR);
+				if (it->second.last_used < oldest->second.last_used)
+				{
+					oldest = it;
+				}
 			}
+			dir_indices_entries -= oldest->second.files->size();
+			dir_indices.erase(oldest);
 		}
 
-		return ret;
+		SDirIndex& idx = dir_indices[path];
+		if (idx.files.get() != NULL)
+		{
+			dir_indices_entries -= idx.files->size();
+		}
+		idx.dir_mtime = dir_mtime;
+		idx.last_used = Server->getTimeMS();
+		idx.files = files;
+		dir_indices_entries += files->size();
+
+		return files;
+	}
+
+	bool isSpecialBackupEntry(const SFile& file)
+	{
+		if (file.isdir)
+		{
+			return file.name == ".hashes" || file.name == "user_views" || next(file.name, 0, ".symlink_");
+		}
+		else
+		{
+			return file.name == ".urbackup_tokens.properties" || next(file.name, 0, ".symlink_");
+		}
 	}
 
+	struct SFileNameSort
+	{
+		SFileNameSort(bool desc)
+			: desc(desc) {}
+
+		bool operator()(const SFile* a, const SFile* b) const
+		{
+			if (a->isdir != b->isdir)
+				return a->isdir;
+
+			return desc ? b->name < a->name : a->name < b->name;
+		}
+
+		bool desc;
+	};
+
+	struct SFileSizeSort
+	{
+		SFileSizeSort(bool desc)
+			: desc(desc) {}
+
+		bool operator()(const SFile* a, const SFile* b) const
+		{
+			if (a->isdir != b->isdir)
+				return a->isdir;
+
+			if (a->isdir || a->size == b->size)
+				return a->name < b->name;
+
+			return desc ? b->size < a->size : a->size < b->size;
+		}
+
+		bool desc;
+	};
+
 	FileMetadata getMetaData(std::string path, bool is_file)
 	{
 		if(path.empty() || (!is_file && path[path.size()-1]!=os_file_sep()[0]) )
@@ -436,7 +564,47 @@ namespace backupaccess
 		return has_permission;
 	}
 
-	JSON::Array get_backups_with_tokens(IDatabase * db, int t_clientid, std::string clientname, std::string* fileaccesstokens, int backupid_offset, bool& has_access)
+	void init_mutex()
+	{
+		dir_index_mutex = Server->createMutex();
+	}
+
+	void destroy_mutex()
+	{
+		Server->destroy(dir_index_mutex);
+	}
+
+	bool getListParams(str_map& params, SListParams& list_params)
+	{
+		str_map::iterator it_limit = params.find("limit");
+		if (it_limit == params.end())
+		{
+			return false;
+		}
+
+		list_params.limit = static_cast<size_t>((std::max)(0LL, watoi64(it_limit->second)));
+		list_params.offset = static_cast<size_t>((std::max)(0LL, watoi64(params["cursor"])));
+		list_params.sort = params["sort"];
+		list_params.sort_desc = params["sort_order"] == "desc";
+		list_params.filter = params["filter"];
+
+		return list_params.limit > 0;
+	}
+
+	void setListResult(const SListResult& list_result, JSON::Object& ret)
+	{
+		if (list_result.total >= 0)
+		{
+			ret.set("total", list_result.total);
+		}
+		if (!list_result.next_cursor.empty())
+		{
+			ret.set("next_cursor", list_result.next_cursor);
+		}
+	}
+
+	JSON::Array get_backups_with_tokens(IDatabase * db, int t_clientid, std::string clientname, std::string* fileaccesstokens, int backupid_offset, bool& has_access,
+		const SListParams* list_params, SListResult* list_result)
 	{
 		std::string backupfolder = getBackupFolder(db);
 
@@ -452,12 +620,54 @@ namespace backupaccess
 			last_filebackup = watoi(res_last[0]["id"]);
 		}
 
+		std::string filter;
+		std::string order = "backuptime DESC";
+		if (list_params != NULL)
+		{
+			if (list_params->filter == "full")
+				filter = " AND incremental=0";
+			else if (list_params->filter == "incremental")
+				filter = " AND incremental<>0";
+			else if (list_params->filter == "archived")
+				filter = " AND archived=1";
+
+			std::string dir = list_params->sort_desc ? " DESC" : " ASC";
+			if (list_params->sort == "size")
+				order = "size_bytes" + dir + ", backuptime DESC";
+			else if (list_params->sort == "backuptime")
+				order = "backuptime" + dir;
+		}
+
+		//Without tokens the page can be selected by the database
+		bool db_paging = list_params != NULL && fileaccesstokens == NULL;
+
 		IQuery *q=db->Prepare("SELECT id, strftime('"+helper.getTimeFormatString()+"', backuptime) AS t_backuptime, incremental, size_bytes, "
-			"archived, archive_timeout, path, delete_pending, deletion_protected, delete_client_pending FROM backups WHERE complete=1 AND done=1 AND clientid=? ORDER BY backuptime DESC");
+			"archived, archive_timeout, path, delete_pending, deletion_protected, delete_client_pending FROM backups WHERE complete=1 AND done=1 AND clientid=?"+filter+" ORDER BY "+order
+			+ (db_paging ? " LIMIT ? OFFSET ?" : ""), false);
 		q->Bind(t_clientid);
+		if (db_paging)
+		{
+			q->Bind(static_cast<int64>(list_params->limit));
+			q->Bind(static_cast<int64>(list_params->offset));
+		}
 		db_results res=q->Read();
+		q->Reset();
+		db->destroyQuery(q);
 		JSON::Array backups;
 
+		int64 total = 0;
+		if (db_paging)
+		{
+			IQuery* q_count = db->Prepare("SELECT COUNT(*) AS c FROM backups WHERE complete=1 AND done=1 AND clientid=?" + filter, false);
+			q_count->Bind(t_clientid);
+			db_results res_count = q_count->Read();
+			db->destroyQuery(q_count);
+			if (!res_count.empty())
+			{
+				total = watoi64(res_count[0]["c"]);
+			}
+		}
+
 		has_access = false;
 		
 		if (res.empty())
@@ -474,6 +684,16 @@ namespace backupaccess
 
 			has_access = true;
 
+			if (list_params != NULL && !db_paging)
+			{
+				++total;
+				if (static_cast<size_t>(total) <= list_params->offset
+					|| static_cast<size_t>(total) > list_params->offset + list_params->limit)
+				{
+					continue;
+				}
+			}
+
 			JSON::Object obj;
 			int backupid = watoi(res[i]["id"]);
 			obj.set("id", backupid+backupid_offset);
@@ -508,6 +728,16 @@ namespace backupaccess
 			backups.add(obj);
 		}
 
+		if (list_result != NULL
+			&& list_params != NULL)
+		{
+			list_result->total = total;
+			if (list_params->offset + list_params->limit < static_cast<size_t>(total))
+			{
+				list_result->next_cursor = convert(static_cast<int64>(list_params->offset + list_params->limit));
+			}
+		}
+
 		return backups;
 	}
 
@@ -649,7 +879,7 @@ namespace backupaccess
 	}
 
     bool get_files_with_tokens(IDatabase* db, int* backupid, int t_clientid, std::string clientname, std::string* fileaccesstokens,
-                               const std::string& u_path, int backupid_offset, JSON::Object& ret)
+                               const std::string& u_path, int backupid_offset, JSON::Object& ret, const SListParams* list_params)
 	{
 		Helper helper(Server->getThreadID(), NULL, NULL);
 
@@ -764,68 +994,100 @@ namespace backupaccess
 						}
 					}
 
-					std::vector<SFile> tfiles=getFiles(os_file_prefix(full_path), NULL);
-					std::vector<FileMetadata> tmetadata=getMetadata(full_metadata_path, tfiles, path.empty());
+					std::shared_ptr<std::vector<SFile> > tfiles = getDirIndex(full_path);
 
-					JSON::Array files;
-					for(size_t i=0;i<tfiles.size();++i)
+					std::string name_filter;
+					if (list_params != NULL)
 					{
-						if(!fn_filter.empty() && tfiles[i].name!=fn_filter)
+						name_filter = strlower(list_params->filter);
+					}
+
+					std::vector<const SFile*> entries;
+					entries.reserve(tfiles->size());
+					for(size_t i=0;i<tfiles->size();++i)
+					{
+						const SFile& file = (*tfiles)[i];
+
+						if(!fn_filter.empty() && file.name!=fn_filter)
 						{
 							continue;
 						}
 
-						if(tfiles[i].isdir)
+						if(path.empty() && isSpecialBackupEntry(file))
 						{
-							if(path.empty() && (tfiles[i].name==".hashes" || tfiles[i].name=="user_views" || next(tfiles[i].name, 0, ".symlink_") ) )
-								continue;
+							continue;
+						}
 
-							if(fileaccesstokens && 
-								!checkFileToken(path_info.backup_tokens.tokens, tokens, tmetadata[i]))
-							{
-								continue;
-							}
+						if (!name_filter.empty()
+							&& strlower(file.name).find(name_filter) == std::string::npos)
+						{
+							continue;
+						}
 
-							JSON::Object obj;
-							obj.set("name", tfiles[i].name);
-							obj.set("dir", tfiles[i].isdir);
-							obj.set("mod", tmetadata[i].last_modified);
-							obj.set("creat", tmetadata[i].created);
-							obj.set("access", tmetadata[i].accessed);
-							files.add(obj);
+						entries.push_back(&file);
+					}
+
+					size_t start = 0;
+					size_t limit = entries.size();
+					if (list_params != NULL)
+					{
+						if (list_params->sort == "name")
+						{
+							std::stable_sort(entries.begin(), entries.end(), SFileNameSort(list_params->sort_desc));
+						}
+						else if (list_params->sort == "size")
+						{
+							std::stable_sort(entries.begin(), entries.end(), SFileSizeSort(list_params->sort_desc));
 						}
+
+						start = (std::min)(list_params->offset, entries.size());
+						limit = list_params->limit;
 					}
-					for(size_t i=0;i<tfiles.size();++i)
+
+					//Metadata is only read for the returned entries
+					JSON::Array files;
+					size_t added = 0;
+					size_t i;
+					for(i=start;i<entries.size() && added<limit;++i)
 					{
-						if(!fn_filter.empty() && tfiles[i].name!=fn_filter)
+						const SFile& file = *entries[i];
+						FileMetadata metadata = getEntryMetadata(full_metadata_path, file);
+
+						if(fileaccesstokens && 
+							!checkFileToken(path_info.backup_tokens.tokens, tokens, metadata))
 						{
 							continue;
 						}
 
-						if(!tfiles[i].isdir)
+						JSON::Object obj;
+						obj.set("name", file.name);
+						obj.set("dir", file.isdir);
+						if(!file.isdir)
 						{
-							if(path.empty() && (tfiles[i].name==".urbackup_tokens.properties" || next(tfiles[i].name, 0, ".symlink_")) )
-								continue;
-
-							if(fileaccesstokens && 
-								!checkFileToken(path_info.backup_tokens.tokens, tokens, tmetadata[i]))
-							{
-								continue;
-							}
+							obj.set("size", file.size);
+						}
+						obj.set("mod", metadata.last_modified);
+						obj.set("creat", metadata.created);
+						obj.set("access", metadata.accessed);
+						if(!file.isdir && !metadata.shahash.empty())
+						{
+							obj.set("shahash", base64_encode(reinterpret_cast<const unsigned char*>(metadata.shahash.c_str()), static_cast<unsigned int>(metadata.shahash.size())));
+						}
+						files.add(obj);
+						++added;
+					}
 
-							JSON::Object obj;
-							obj.set("name", tfiles[i].name);
-							obj.set("dir", tfiles[i].isdir);
-							obj.set("size", tfiles[i].size);
-							obj.set("mod", tmetadata[i].last_modified);
-							obj.set("creat", tmetadata[i].created);
-							obj.set("access", tmetadata[i].accessed);
-							if(!tmetadata[i].shahash.empty())
-							{
-								obj.set("shahash", base64_encode(reinterpret_cast<const unsigned char*>(tmetadata[i].shahash.c_str()), static_cast<unsigned int>(tmetadata[i].shahash.size())));
-							}
-							files.add(obj);
+					if (list_params != NULL)
+					{
+						SListResult list_result;
+						//Entries are only checked against the tokens while paging, so the number of
+						//entries the tokens give access to is not known
+						list_result.total = fileaccesstokens ? -1 : static_cast<int64>(entries.size());
+						if (i < entries.size())
+						{
+							list_result.next_cursor = convert(static_cast<int64>(i));
 						}
+						setListResult(list_result, ret);
 					}
 
 					ret.set("files", files);
@@ -1727,9 +1989,14 @@ ACTION_IMPL(backups)
 					}
 				}
 
+				backupaccess::SListParams list_params;
+				bool has_list_params = backupaccess::getListParams(CURRP, list_params);
+				backupaccess::SListResult list_result;
+
 				bool has_access;
 				JSON::Array backups = backupaccess::get_backups_with_tokens(db, t_clientid, clientname,
-					token_authentication ? &fileaccesstokens : NULL, 0, has_access);
+					token_authentication ? &fileaccesstokens : NULL, 0, has_access,
+					has_list_params ? &list_params : NULL, &list_result);
 
 				if (!has_access)
 				{
@@ -1742,6 +2009,11 @@ ACTION_IMPL(backups)
 
 				ret.set("backups", backups);
 
+				if (has_list_params)
+				{
+					backupaccess::setListResult(list_result, ret);
+				}
+
 				if (r_ok)
 				{
 					ret.set("backup_images", backupaccess::get_backup_images(db, t_clientid, clientname, 0));
@@ -1892,7 +2164,7 @@ ACTION_IMPL(backups)
 							std::string bpath = backupfolder + os_file_sep() + clientname + os_file_sep() + backuppath;
 							sendZip(helper, bpath, path_info.full_path, backupid<0 ? "" : bpath + os_file_sep()+".hashes",
 								path_info.full_metadata_path, CURRP["filter"], token_authentication,
-								path_info.backup_tokens.tokens, tokens, backupid<0 ? false : path_info.rel_path.empty());
+								path_info.backup_tokens.tokens, tokens, backupid<0 ? false : path_info.rel_path.empty(), CURRP["format"]);
 							return;
 						}
 						else if(sa=="clientdl" && fileserv!=NULL)
@@ -1950,8 +2222,11 @@ ACTION_IMPL(backups)
 						}
 						else
 						{
+							backupaccess::SListParams list_params;
+							bool has_list_params = backupaccess::getListParams(CURRP, list_params);
+
 							if (!backupaccess::get_files_with_tokens(db, has_backupid ? &backupid : NULL, t_clientid, clientname, token_authentication ? &fileaccesstokens : NULL,
-								u_path, 0, ret))
+								u_path, 0, ret, has_list_params ? &list_params : NULL))
 							{
 								JSON::Object err_ret;
 								err_ret.set("err", "access_denied");
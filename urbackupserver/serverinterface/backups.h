@@ -33,7 +33,51 @@ namespace backupaccess
 
 	std::string get_backup_path(IDatabase* db, int backupid, int t_clientid);
 
-	JSON::Array get_backups_with_tokens(IDatabase * db, int t_clientid, std::string clientname, std::string* fileaccesstokens, int backupid_offset, bool& has_access);
+	void init_mutex();
+
+	void destroy_mutex();
+
+	/**
+	* Paging of backup and file lists. limit=0 returns the whole list.
+	* The cursor is the opaque next_cursor value of the previous page.
+	* sort is "backuptime"/"size" for backups and "name"/"size" for files.
+	* filter is "full", "incremental" or "archived" for backups and a case
+	* insensitive name substring for files.
+	*/
+	struct SListParams
+	{
+		SListParams()
+			: limit(0), offset(0), sort_desc(false)
+		{
+
+		}
+
+		size_t limit;
+		size_t offset;
+		std::string sort;
+		bool sort_desc;
+		std::string filter;
+	};
+
+	struct SListResult
+	{
+		SListResult()
+			: total(0)
+		{
+
+		}
+
+		//Negative if the total is not reported
+		int64 total;
+		std::string next_cursor;
+	};
+
+	bool getListParams(str_map& params, SListParams& list_params);
+
+	void setListResult(const SListResult& list_result, JSON::Object& ret);
+
+	JSON::Array get_backups_with_tokens(IDatabase * db, int t_clientid, std::string clientname, std::string* fileaccesstokens, int backupid_offset, bool& has_access,
+		const SListParams* list_params=NULL, SListResult* list_result=NULL);
 
 	struct SPathInfo
 	{
@@ -59,7 +103,15 @@ namespace backupaccess
 	SPathInfo get_metadata_path_with_tokens(const std::string& u_path, std::string* fileaccesstokens,
 		std::string clientname, std::string backupfolder, int* backupid, std::string backuppath);
 
+	enum EArchiveFormat
+	{
+		EArchiveFormat_Zip,
+		EArchiveFormat_ZipStore,
+		EArchiveFormat_Tar
+	};
+
 	bool get_files_with_tokens(IDatabase* db, int* backupid, int t_clientid, std::string clientname,
-        std::string* fileaccesstokens, const std::string& u_path, int backupid_offset, JSON::Object& ret);
+        std::string* fileaccesstokens, const std::string& u_path, int backupid_offset, JSON::Object& ret,
+		const SListParams* list_params=NULL);
 }
 
@@ -21,8 +21,15 @@
 #include "action_header.h"
 #include "../../urbackupcommon/os_functions.h"
 #include "../../Interface/File.h"
+#include "../../Interface/Mutex.h"
+#include "../../Interface/Thread.h"
+#include "../../Interface/Condition.h"
+#include "../../Interface/ThreadPool.h"
 #include "backups.h"
 #include <memory>
+#include <deque>
+#include <algorithm>
+#include <string.h>
 #include "../../common/data.h"
 
 #define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
@@ -84,7 +91,713 @@ bool my_miniz_init(mz_zip_archive *pZip, MiniZFileInfo* fileInfo)
 	return true;
 }
 
-bool add_dir(mz_zip_archive& zip_archive, const std::string& archivefoldername, const std::string& folderbase, const std::string& foldername, const std::string& start_foldername,
+struct SArchiveEntry
+{
+	SArchiveEntry()
+		: isdir(false), has_metadata(false),
+		last_modified(0), accessed(0), created(0)
+	{}
+
+	std::string archivename;
+	std::string filename;
+	bool isdir;
+	bool has_metadata;
+	int64 last_modified;
+	int64 accessed;
+	int64 created;
+};
+
+class IArchiveStreamWriter
+{
+public:
+	virtual ~IArchiveStreamWriter() {}
+
+	virtual bool init() = 0;
+	virtual bool add(const SArchiveEntry& entry) = 0;
+	virtual bool finish() = 0;
+};
+
+/**
+* Writes a ZIP file (ZIP64 if needed) to the output. Files up to
+* zip_parallel_max_file_size bytes are read and deflated by
+* zip_compress_threads worker threads, the entries are still written in the
+* order they were added. At most zip_max_buffered bytes of file data are held
+* in memory. Other entries (directories, larger files and all files in
+* store-only mode) are written directly once the entries in flight before
+* them are written. Files are only opened while they are read.
+*/
+class ZipStreamWriter : public IArchiveStreamWriter
+{
+public:
+	ZipStreamWriter(bool store_only)
+		: store_only(store_only), zip_initialized(false), mutex(Server->createMutex()), cond(Server->createCondition()),
+		buffered_bytes(0), do_stop(false)
+	{
+		memset(&zip_archive, 0, sizeof(zip_archive));
+		memset(&file_info, 0, sizeof(file_info));
+
+		max_buffered = static_cast<size_t>(watoi64(Server->getServerParameter("zip_max_buffered", "268435456")));
+		max_parallel_size = watoi64(Server->getServerParameter("zip_parallel_max_file_size", "8388608"));
+	}
+
+	~ZipStreamWriter()
+	{
+		{
+			IScopedLock lock(mutex);
+			do_stop = true;
+			cond->notify_all();
+		}
+
+		Server->getThreadPool()->waitFor(tickets);
+
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			delete entries[i];
+		}
+
+		if (zip_initialized)
+		{
+			mz_zip_writer_end(&zip_archive);
+		}
+
+		Server->destroy(cond);
+		Server->destroy(mutex);
+	}
+
+	bool init()
+	{
+		file_info.tid = Server->getThreadID();
+		file_info.last_writetime = Server->getTimeMS();
+
+		if (!my_miniz_init(&zip_archive, &file_info))
+		{
+			Server->Log("Error while initializing ZIP archive", LL_ERROR);
+			return false;
+		}
+
+		zip_initialized = true;
+
+		if (!store_only)
+		{
+			size_t n_threads = (std::min)(os_get_num_cpus(), static_cast<size_t>(4));
+			n_threads = static_cast<size_t>(watoi(Server->getServerParameter("zip_compress_threads", convert(n_threads))));
+
+			for (size_t i = 0; i < n_threads; ++i)
+			{
+				tickets.push_back(Server->getThreadPool()->execute(new CompressThread(this), "zip compress"));
+			}
+		}
+
+		return true;
+	}
+
+	bool add(const SArchiveEntry& entry)
+	{
+		std::unique_ptr<SZipEntry> zip_entry(new SZipEntry);
+		zip_entry->entry = entry;
+
+		if (!entry.isdir
+			&& !tickets.empty())
+		{
+			SFile file_metadata = getFileMetadata(os_file_prefix(entry.filename));
+			if (file_metadata.name.empty())
+			{
+				Server->Log("Error getting size of file \"" + entry.filename + "\" for ZIP file download. " + os_last_error_str(), LL_ERROR);
+				return false;
+			}
+
+			zip_entry->uncomp_size = file_metadata.size;
+			zip_entry->compress = zip_entry->uncomp_size <= max_parallel_size;
+		}
+
+		IScopedLock lock(mutex);
+
+		if (!zip_entry->compress)
+		{
+			while (!entries.empty())
+			{
+				if (!writeHead(lock))
+				{
+					return false;
+				}
+			}
+
+			lock.relock(NULL);
+
+			return writeEntry(*zip_entry);
+		}
+
+		buffered_bytes += static_cast<size_t>(zip_entry->uncomp_size);
+		compress_queue.push_back(zip_entry.get());
+		cond->notify_all();
+
+		entries.push_back(zip_entry.release());
+
+		while (buffered_bytes > max_buffered
+			|| entries.size() > 1000)
+		{
+			if (!writeHead(lock))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool finish()
+	{
+		{
+			IScopedLock lock(mutex);
+			while (!entries.empty())
+			{
+				if (!writeHead(lock))
+				{
+					return false;
+				}
+			}
+		}
+
+		if (!mz_zip_writer_finalize_archive(&zip_archive))
+		{
+			Server->Log("Error while finalizing ZIP archive", LL_ERROR);
+			return false;
+		}
+
+		zip_initialized = false;
+
+		if (!mz_zip_writer_end(&zip_archive))
+		{
+			Server->Log("Error while ending ZIP archive writer", LL_ERROR);
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	struct SZipEntry
+	{
+		SZipEntry()
+			: uncomp_size(0), compress(false), done(false), ok(false),
+			data_compressed(false), crc(0)
+		{}
+
+		SArchiveEntry entry;
+		int64 uncomp_size;
+		bool compress;
+		bool done;
+		bool ok;
+		std::string data;
+		bool data_compressed;
+		mz_uint32 crc;
+	};
+
+	class CompressThread : public IThread
+	{
+	public:
+		CompressThread(ZipStreamWriter* writer)
+			: writer(writer)
+		{}
+
+		void operator()()
+		{
+			writer->compressThread();
+			delete this;
+		}
+
+	private:
+		ZipStreamWriter* writer;
+	};
+
+	void compressThread()
+	{
+		while (true)
+		{
+			SZipEntry* zip_entry;
+			{
+				IScopedLock lock(mutex);
+				while (!do_stop
+					&& compress_queue.empty())
+				{
+					cond->wait(&lock);
+				}
+
+				if (do_stop)
+				{
+					return;
+				}
+
+				zip_entry = compress_queue.front();
+				compress_queue.pop_front();
+			}
+
+			bool ok = compressEntry(*zip_entry);
+
+			IScopedLock lock(mutex);
+			zip_entry->ok = ok;
+			zip_entry->done = true;
+			cond->notify_all();
+		}
+	}
+
+	static bool compressEntry(SZipEntry& zip_entry)
+	{
+		std::unique_ptr<IFsFile> file(Server->openFile(os_file_prefix(zip_entry.entry.filename), MODE_READ_SEQUENTIAL));
+		if (file.get() == NULL)
+		{
+			Server->Log("Error opening file \"" + zip_entry.entry.filename + "\" for ZIP file download. " + os_last_error_str(), LL_ERROR);
+			return false;
+		}
+
+		if (file->Size() != zip_entry.uncomp_size)
+		{
+			Server->Log("File \"" + zip_entry.entry.filename + "\" changed size while creating ZIP file download", LL_ERROR);
+			return false;
+		}
+
+		zip_entry.data.resize(static_cast<size_t>(zip_entry.uncomp_size));
+
+		size_t pos = 0;
+		while (pos < zip_entry.data.size())
+		{
+			bool has_error = false;
+			_u32 r = file->Read(&zip_entry.data[pos], static_cast<_u32>(zip_entry.data.size() - pos), &has_error);
+			if (has_error || r == 0)
+			{
+				Server->Log("Error reading from file \"" + zip_entry.entry.filename + "\" for ZIP file download. " + os_last_error_str(), LL_ERROR);
+				return false;
+			}
+			pos += r;
+		}
+
+		file.reset();
+
+		zip_entry.crc = static_cast<mz_uint32>(mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const unsigned char*>(zip_entry.data.data()), zip_entry.data.size()));
+
+		if (zip_entry.data.empty())
+		{
+			return true;
+		}
+
+		size_t comp_size = 0;
+		void* comp_data = tdefl_compress_mem_to_heap(zip_entry.data.data(), zip_entry.data.size(), &comp_size,
+			tdefl_create_comp_flags_from_zip_params(MZ_DEFAULT_LEVEL, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY));
+
+		if (comp_data == NULL)
+		{
+			Server->Log("Error compressing file \"" + zip_entry.entry.filename + "\" for ZIP file download", LL_ERROR);
+			return false;
+		}
+
+		//Incompressible data is stored
+		if (comp_size < zip_entry.data.size())
+		{
+			zip_entry.data.assign(reinterpret_cast<char*>(comp_data), comp_size);
+			zip_entry.data_compressed = true;
+		}
+
+		mz_free(comp_data);
+
+		return true;
+	}
+
+	bool writeHead(IScopedLock& lock)
+	{
+		SZipEntry* zip_entry = entries.front();
+
+		while (zip_entry->compress
+			&& !zip_entry->done)
+		{
+			cond->wait(&lock);
+		}
+
+		lock.relock(NULL);
+
+		bool ret = writeEntry(*zip_entry);
+
+		lock.relock(mutex);
+
+		if (zip_entry->compress)
+		{
+			buffered_bytes -= static_cast<size_t>(zip_entry->uncomp_size);
+		}
+
+		entries.pop_front();
+		delete zip_entry;
+
+		return ret;
+	}
+
+	void getExtraData(const SArchiveEntry& entry, CWData& extra_data_local, CWData& extra_data_central)
+	{
+		if (entry.created > 0)
+		{
+			//NTFS extra field
+			CWData ntfs_extra;
+			ntfs_extra.addUShort(0x000a);
+			ntfs_extra.addUShort(4 + 2 + 2 + 8 + 8 + 8);
+			ntfs_extra.addUInt(0);
+			ntfs_extra.addUShort(0x0001);
+			ntfs_extra.addUShort(3 * 8);
+			//TODO: Get higher resolution NTFS timestamps from metadata and use it here
+			ntfs_extra.addInt64(os_to_windows_filetime(entry.last_modified));
+			ntfs_extra.addInt64(os_to_windows_filetime(entry.accessed));
+			ntfs_extra.addInt64(os_to_windows_filetime(entry.created));
+
+			extra_data_local.addBuffer(ntfs_extra.getDataPtr(), ntfs_extra.getDataSize());
+			extra_data_central.addBuffer(ntfs_extra.getDataPtr(), ntfs_extra.getDataSize());
+		}
+
+		unsigned char flags = 0 << 1 | 1 << 1;
+		unsigned short local_size = 1 + sizeof(_u32) * 2;
+
+		if (entry.created > 0)
+		{
+			flags |= 1 << 2;
+			local_size += sizeof(_u32);
+		}
+
+		//Extended Timestamp Extra Field
+		extra_data_local.addUShort(0x5455);
+		extra_data_local.addUShort(local_size);
+		extra_data_local.addUChar(flags);
+		extra_data_local.addUInt(static_cast<_u32>(entry.last_modified));
+		extra_data_local.addUInt(static_cast<_u32>(entry.accessed));
+		if (entry.created>0)
+		{
+			extra_data_local.addUInt(static_cast<_u32>(entry.created));
+		}
+		
+		extra_data_central.addUShort(0x5455);
+		extra_data_central.addUShort(1 + sizeof(_u32));
+		extra_data_central.addUChar(flags);
+		extra_data_central.addUInt(static_cast<_u32>(entry.last_modified));
+	}
+
+	bool writeEntry(SZipEntry& zip_entry)
+	{
+		const SArchiveEntry& entry = zip_entry.entry;
+
+		if (zip_entry.compress
+			&& !zip_entry.ok)
+		{
+			return false;
+		}
+
+		time_t* last_modified=NULL;
+		time_t last_modified_wt;
+		CWData extra_data_local;
+		CWData extra_data_central;
+		if(entry.has_metadata)
+		{
+			last_modified_wt=static_cast<time_t>(entry.last_modified);
+			last_modified=&last_modified_wt;
+
+			getExtraData(entry, extra_data_local, extra_data_central);
+		}
+
+		mz_uint level = store_only ? MZ_NO_COMPRESSION : MZ_DEFAULT_LEVEL;
+
+		//TODO: ZIP has extensions for NTFS/Unix/MacOS attributes, symbolic links, NTFS ACL, ... use them
+
+		std::string os_err;
+
+		mz_bool rc;
+		if(entry.isdir)
+		{
+			rc = mz_zip_writer_add_mem_ex_v2(&zip_archive, (entry.archivename + "/").c_str(), NULL, 0, NULL, 0,
+											level,
+											0, 0, last_modified, extra_data_local.getDataPtr(), extra_data_local.getDataSize(),
+											extra_data_central.getDataPtr(), extra_data_central.getDataSize());
+
+			if (rc == MZ_FALSE)
+			{
+				os_err = os_last_error_str();
+			}
+		}
+		else if(zip_entry.compress)
+		{
+			if (zip_entry.data_compressed)
+			{
+				rc = mz_zip_writer_add_mem_ex_v2(&zip_archive, entry.archivename.c_str(), zip_entry.data.data(), zip_entry.data.size(), NULL, 0,
+					level | MZ_ZIP_FLAG_COMPRESSED_DATA, static_cast<mz_uint64>(zip_entry.uncomp_size), zip_entry.crc,
+					last_modified, extra_data_local.getDataPtr(), extra_data_local.getDataSize(),
+					extra_data_central.getDataPtr(), extra_data_central.getDataSize());
+			}
+			else
+			{
+				rc = mz_zip_writer_add_mem_ex_v2(&zip_archive, entry.archivename.c_str(), zip_entry.data.data(), zip_entry.data.size(), NULL, 0,
+					MZ_NO_COMPRESSION, 0, 0,
+					last_modified, extra_data_local.getDataPtr(), extra_data_local.getDataSize(),
+					extra_data_central.getDataPtr(), extra_data_central.getDataSize());
+			}
+		}
+		else
+		{	
+			std::unique_ptr<IFsFile> fsfile(Server->openFile(os_file_prefix(entry.filename), MODE_READ_SEQUENTIAL));
+			if (fsfile.get() == NULL)
+			{
+				Server->Log("Error opening file \"" + entry.filename + "\" for ZIP file download. " + os_last_error_str(), LL_ERROR);
+				return false;
+			}
+
+			int64 fsize = fsfile->Size();
+#ifndef _WIN32
+			int fd = fsfile->getOsHandle(true);
+#else
+			int fd =_open_osfhandle(reinterpret_cast<intptr_t>(fsfile->getOsHandle(true)), _O_RDONLY);
+			if (fd == -1)
+			{
+				Server->Log("Error opening file fd for \"" + entry.filename + "\" for ZIP file download." + os_last_error_str(), LL_ERROR);
+				return false;
+			}
+#endif
+			fsfile.reset();
+
+			FILE* file = _fdopen(fd, "r");
+			if (file != NULL)
+			{
+				rc = mz_zip_writer_add_cfile(&zip_archive, entry.archivename.c_str(), file, fsize, last_modified, NULL, 0,
+					level,
+					extra_data_local.getDataPtr(), extra_data_local.getDataSize(),
+					extra_data_central.getDataPtr(), extra_data_central.getDataSize());
+
+				if (rc == MZ_FALSE)
+				{
+					os_err = os_last_error_str();
+				}
+
+				fclose(file);
+			}
+			else
+			{
+				Server->Log("Error opening FILE handle for \"" + entry.filename + "\" for ZIP file download." + os_last_error_str(), LL_ERROR);
+				_close(fd);
+				return false;
+			}
+		}
+
+		if(rc==MZ_FALSE)
+		{
+			mz_zip_error err = mz_zip_get_last_error(&zip_archive);
+			Server->Log("Error while adding file \""+entry.filename+"\" to ZIP file. Error: "+mz_zip_get_error_string(err)+ (os_err.empty() ? "" : (". OS error: "+os_err)), LL_ERROR);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool store_only;
+	mz_zip_archive zip_archive;
+	MiniZFileInfo file_info;
+	bool zip_initialized;
+
+	IMutex* mutex;
+	ICondition* cond;
+	std::deque<SZipEntry*> entries;
+	std::deque<SZipEntry*> compress_queue;
+	size_t buffered_bytes;
+	size_t max_buffered;
+	int64 max_parallel_size;
+	bool do_stop;
+	std::vector<THREADPOOL_TICKET> tickets;
+};
+
+/**
+* Writes an uncompressed POSIX (pax) tar file to the output. Names longer
+* than the ustar fields and sizes of 8GiB and more are stored in pax extended
+* headers.
+*/
+class TarStreamWriter : public IArchiveStreamWriter
+{
+public:
+	TarStreamWriter()
+		: tid(Server->getThreadID())
+	{
+	}
+
+	bool init()
+	{
+		return true;
+	}
+
+	bool add(const SArchiveEntry& entry)
+	{
+		std::string name = entry.archivename + (entry.isdir ? "/" : "");
+
+		std::unique_ptr<IFsFile> file;
+		int64 fsize = 0;
+		if (!entry.isdir)
+		{
+			file.reset(Server->openFile(os_file_prefix(entry.filename), MODE_READ_SEQUENTIAL));
+			if (file.get() == NULL)
+			{
+				Server->Log("Error opening file \"" + entry.filename + "\" for TAR file download. " + os_last_error_str(), LL_ERROR);
+				return false;
+			}
+			fsize = file->Size();
+		}
+
+		int64 mtime = entry.has_metadata ? (std::max)(entry.last_modified, static_cast<int64>(0)) : 0;
+
+		std::string pax_records;
+		if (name.size() > 100)
+		{
+			pax_records += paxRecord("path", name);
+		}
+		if (fsize > max_octal_size)
+		{
+			pax_records += paxRecord("size", convert(fsize));
+		}
+
+		if (!pax_records.empty())
+		{
+			std::string pax_name = "PaxHeaders/" + ExtractFileName(entry.archivename, "/");
+			if (!writeHeader(pax_name, 'x', static_cast<int64>(pax_records.size()), mtime, 0644)
+				|| !write(pax_records.data(), pax_records.size())
+				|| !writePadding(static_cast<int64>(pax_records.size())))
+			{
+				return false;
+			}
+		}
+
+		if (!writeHeader(name, entry.isdir ? '5' : '0', fsize, mtime, entry.isdir ? 0755 : 0644))
+		{
+			return false;
+		}
+
+		if (file.get() == NULL)
+		{
+			return true;
+		}
+
+		std::vector<char> buf(512 * 1024);
+		int64 written = 0;
+		bool read_error = false;
+		while (written < fsize)
+		{
+			_u32 toread = static_cast<_u32>((std::min)(static_cast<int64>(buf.size()), fsize - written));
+			_u32 r = 0;
+			if (!read_error)
+			{
+				bool has_error = false;
+				r = file->Read(buf.data(), toread, &has_error);
+				if (has_error || r == 0)
+				{
+					Server->Log("Error reading from file \"" + entry.filename + "\" for TAR file download. Filling it with zeros. " + os_last_error_str(), LL_ERROR);
+					read_error = true;
+				}
+			}
+
+			//The size is already in the header
+			if (read_error)
+			{
+				memset(buf.data(), 0, toread);
+				r = toread;
+			}
+
+			if (!write(buf.data(), r))
+			{
+				return false;
+			}
+
+			written += r;
+		}
+
+		return writePadding(fsize);
+	}
+
+	bool finish()
+	{
+		char end_blocks[1024] = {};
+		return write(end_blocks, sizeof(end_blocks));
+	}
+
+private:
+	static const int64 max_octal_size = 077777777777LL;
+
+	static std::string paxRecord(const std::string& key, const std::string& value)
+	{
+		//Length includes the length field itself
+		size_t len = key.size() + value.size() + 3;
+		size_t total = len + convert(len).size();
+		if (convert(total).size() != convert(len).size())
+		{
+			total = len + convert(total).size();
+		}
+		return convert(total) + " " + key + "=" + value + "\n";
+	}
+
+	static void setOctal(char* field, size_t field_size, int64 val)
+	{
+		std::string oct;
+		do
+		{
+			oct.insert(oct.begin(), static_cast<char>('0' + (val & 7)));
+			val >>= 3;
+		} while (val > 0);
+
+		if (oct.size() < field_size - 1)
+		{
+			oct.insert(oct.begin(), field_size - 1 - oct.size(), '0');
+		}
+
+		memcpy(field, oct.data(), (std::min)(oct.size(), field_size - 1));
+	}
+
+	bool writeHeader(const std::string& name, char typeflag, int64 size, int64 mtime, int mode)
+	{
+		char header[512] = {};
+
+		memcpy(header, name.data(), (std::min)(name.size(), static_cast<size_t>(100)));
+		setOctal(header + 100, 8, mode);
+		setOctal(header + 108, 8, 0);
+		setOctal(header + 116, 8, 0);
+		setOctal(header + 124, 12, size > max_octal_size ? 0 : size);
+		setOctal(header + 136, 12, mtime);
+		header[156] = typeflag;
+		memcpy(header + 257, "ustar", 6);
+		memcpy(header + 263, "00", 2);
+
+		memset(header + 148, ' ', 8);
+		unsigned int checksum = 0;
+		for (size_t i = 0; i < sizeof(header); ++i)
+		{
+			checksum += static_cast<unsigned char>(header[i]);
+		}
+		setOctal(header + 148, 7, checksum);
+		header[154] = 0;
+
+		return write(header, sizeof(header));
+	}
+
+	bool writePadding(int64 size)
+	{
+		size_t padding = static_cast<size_t>((512 - size % 512) % 512);
+		if (padding == 0)
+		{
+			return true;
+		}
+
+		char zeros[512] = {};
+		return write(zeros, padding);
+	}
+
+	bool write(const char* buf, size_t bsize)
+	{
+		if (!Server->WriteRaw(tid, buf, bsize, false))
+		{
+			Server->Log("Error writing TAR file to output", LL_INFO);
+			return false;
+		}
+		return true;
+	}
+
+	THREAD_ID tid;
+};
+
+bool add_dir(IArchiveStreamWriter& writer, const std::string& archivefoldername, const std::string& folderbase, const std::string& foldername, const std::string& start_foldername,
 	    const std::string& hashfolderbase, const std::string& hashfoldername, const std::string& filter,
 		bool token_authentication, const std::vector<backupaccess::SToken> &backup_tokens, const std::vector<std::string> &tokens, bool skip_special, bool orig_skip_special)
 {
@@ -93,7 +806,7 @@ bool add_dir(mz_zip_archive& zip_archive, const std::string& archivefoldername,
 
 	if (has_error)
 	{
-		Server->Log("Error while adding files to ZIP file. Error listing files in folder \""
+		Server->Log("Error while adding files to archive. Error listing files in folder \""
 			+ foldername+"\". " + os_last_error_str(), LL_ERROR);
 		return false;
 	}
@@ -203,128 +916,20 @@ bool add_dir(mz_zip_archive& zip_archive, const std::string& archivefoldername,
 			}
 		}
 
-		time_t* last_modified=NULL;
-		time_t last_modified_wt;
-		CWData extra_data_local;
-		CWData extra_data_central;
+		SArchiveEntry entry;
+		entry.archivename = archivename;
+		entry.filename = filename;
+		entry.isdir = file.isdir;
+		entry.has_metadata = has_metadata;
 		if(has_metadata)
 		{
-#ifdef _WIN32
-			last_modified_wt=static_cast<time_t>(metadata.last_modified);
-#else
-			last_modified_wt=static_cast<time_t>(metadata.last_modified);
-#endif
-			last_modified=&last_modified_wt;
-
-			if (metadata.created > 0)
-			{
-				//NTFS extra field
-				CWData ntfs_extra;
-				ntfs_extra.addUShort(0x000a);
-				ntfs_extra.addUShort(4 + 2 + 2 + 8 + 8 + 8);
-				ntfs_extra.addUInt(0);
-				ntfs_extra.addUShort(0x0001);
-				ntfs_extra.addUShort(3 * 8);
-				//TODO: Get higher resolution NTFS timestamps from metadata and use it here
-				ntfs_extra.addInt64(os_to_windows_filetime(metadata.last_modified));
-				ntfs_extra.addInt64(os_to_windows_filetime(metadata.accessed));
-				ntfs_extra.addInt64(os_to_windows_filetime(metadata.created));
-
-				extra_data_local.addBuffer(ntfs_extra.getDataPtr(), ntfs_extra.getDataSize());
-				extra_data_central.addBuffer(ntfs_extra.getDataPtr(), ntfs_extra.getDataSize());
-			}
-
-			unsigned char flags = 0 << 1 | 1 << 1;
-			unsigned short local_size = 1 + sizeof(_u32) * 2;
-
-			if (metadata.created > 0)
-			{
-				flags |= 1 << 2;
-				local_size += sizeof(_u32);
-			}
-
-			//Extended Timestamp Extra Field
-			extra_data_local.addUShort(0x5455);
-			extra_data_local.addUShort(local_size);
-			extra_data_local.addUChar(flags);
-			extra_data_local.addUInt(static_cast<_u32>(metadata.last_modified));
-			extra_data_local.addUInt(static_cast<_u32>(metadata.accessed));
-			if (metadata.created>0)
-			{
-				extra_data_local.addUInt(static_cast<_u32>(metadata.created));
-			}
-			
-			extra_data_central.addUShort(0x5455);
-			extra_data_central.addUShort(1 + sizeof(_u32));
-			extra_data_central.addUChar(flags);
-			extra_data_central.addUInt(static_cast<_u32>(metadata.last_modified));
-		}
-
-		//TODO: ZIP has extensions for NTFS/Unix/MacOS attributes, symbolic links, NTFS ACL, ... use them
-
-		std::string os_err;
-
-		mz_bool rc;
-		if(file.isdir)
-		{
-			rc = mz_zip_writer_add_mem_ex_v2(&zip_archive, (archivename + "/").c_str(), NULL, 0, NULL, 0,
-											MZ_DEFAULT_LEVEL,
-											0, 0, last_modified, extra_data_local.getDataPtr(), extra_data_local.getDataSize(),
-											extra_data_central.getDataPtr(), extra_data_central.getDataSize());
-
-			if (rc == MZ_FALSE)
-			{
-				os_err = os_last_error_str();
-			}
+			entry.last_modified = metadata.last_modified;
+			entry.accessed = metadata.accessed;
+			entry.created = metadata.created;
 		}
-		else
-		{	
-			std::unique_ptr<IFsFile> add_file(Server->openFile(os_file_prefix(filename), MODE_READ_SEQUENTIAL));
-			if (add_file.get() == NULL)
-			{
-				Server->Log("Error opening file \"" + filename + "\" for ZIP file download. " + os_last_error_str(), LL_ERROR);
-				return false;
-			}
-			int64 fsize = add_file->Size();
-#ifndef _WIN32
-			int fd = add_file->getOsHandle(true);
-#else
-			int fd =_open_osfhandle(reinterpret_cast<intptr_t>(add_file->getOsHandle(true)), _O_RDONLY);
-			if (fd == -1)
-			{
-				Server->Log("Error opening file fd for \"" + filename + "\" for ZIP file download." + os_last_error_str(), LL_ERROR);
-				return false;
-			}
-#endif
-			add_file.reset();
 
-			FILE* file = _fdopen(fd, "r");
-			if (file != NULL)
-			{
-				rc = mz_zip_writer_add_cfile(&zip_archive, archivename.c_str(), file, fsize, last_modified, NULL, 0,
-					MZ_DEFAULT_LEVEL,
-					extra_data_local.getDataPtr(), extra_data_local.getDataSize(),
-					extra_data_central.getDataPtr(), extra_data_central.getDataSize());
-
-				if (rc == MZ_FALSE)
-				{
-					os_err = os_last_error_str();
-				}
-
-				fclose(file);
-			}
-			else
-			{
-				Server->Log("Error opening FILE handle for \"" + filename + "\" for ZIP file download." + os_last_error_str(), LL_ERROR);
-				_close(fd);
-				return false;
-			}
-		}
-
-		if(rc==MZ_FALSE)
+		if(!writer.add(entry))
 		{
-			mz_zip_error err = mz_zip_get_last_error(&zip_archive);
-			Server->Log("Error while adding file \""+filename+"\" to ZIP file. Error: "+mz_zip_get_error_string(err)+ (os_err.empty() ? "" : (". OS error: "+os_err)), LL_ERROR);
 			return false;
 		}
 
@@ -353,7 +958,7 @@ bool add_dir(mz_zip_archive& zip_archive, const std::string& archivefoldername,
 
 			if (!symlink_loop && symlink_outside)
 			{
-				if (!add_dir(zip_archive, archivename, folderbase, filename, start_foldername, hashfolderbase, next_hashfoldername, filter,
+				if (!add_dir(writer, archivename, folderbase, filename, start_foldername, hashfolderbase, next_hashfoldername, filter,
 								token_authentication, backup_tokens, tokens, false, orig_skip_special))
 				{
 					return false;
@@ -364,7 +969,7 @@ bool add_dir(mz_zip_archive& zip_archive, const std::string& archivefoldername,
 				if(symlink_loop)
 					Server->Log("Not following looping symbolic link at \"" + orig_filename + "\" to \""+filename+"\"", LL_INFO);
 				else if(!symlink_outside)
-					Server->Log("Not following symbolic link at \"" + orig_filename + "\" to \""+filename+"\" because its contents are already in the ZIP file", LL_INFO);
+					Server->Log("Not following symbolic link at \"" + orig_filename + "\" to \""+filename+"\" because its contents are already in the archive", LL_INFO);
 			}
 		}
 	}
@@ -376,41 +981,31 @@ bool add_dir(mz_zip_archive& zip_archive, const std::string& archivefoldername,
 
 bool create_zip_to_output(const std::string& folderbase, const std::string& foldername, const std::string& hashfolderbase,
 	const std::string& hashfoldername, const std::string& filter, bool token_authentication,
-	const std::vector<backupaccess::SToken> &backup_tokens, const std::vector<std::string> &tokens, bool skip_hashes)
+	const std::vector<backupaccess::SToken> &backup_tokens, const std::vector<std::string> &tokens, bool skip_hashes,
+	backupaccess::EArchiveFormat format)
 {
-	mz_zip_archive zip_archive;
-	memset(&zip_archive, 0, sizeof(zip_archive));
-
-	MiniZFileInfo file_info = {};
-
-	file_info.tid=Server->getThreadID();
-	file_info.last_writetime = Server->getTimeMS();
-
-	if(!my_miniz_init(&zip_archive, &file_info))
+	std::unique_ptr<IArchiveStreamWriter> writer;
+	if (format == backupaccess::EArchiveFormat_Tar)
 	{
-		Server->Log("Error while initializing ZIP archive", LL_ERROR);
-		return false;
+		writer.reset(new TarStreamWriter);
 	}
-
-	if(!add_dir(zip_archive, "", folderbase, foldername, foldername, hashfolderbase,
-		hashfoldername, filter, token_authentication, backup_tokens, tokens, skip_hashes,
-		skip_hashes))
+	else
 	{
-		Server->Log("Error while adding files and folders to ZIP archive", LL_ERROR);
-		return false;
+		writer.reset(new ZipStreamWriter(format == backupaccess::EArchiveFormat_ZipStore));
 	}
 
-	if(!mz_zip_writer_finalize_archive(&zip_archive))
+	if(!writer->init())
 	{
-		Server->Log("Error while finalizing ZIP archive", LL_ERROR);
 		return false;
 	}
 
-	if(!mz_zip_writer_end(&zip_archive))
+	if(!add_dir(*writer, "", folderbase, foldername, foldername, hashfolderbase,
+		hashfoldername, filter, token_authentication, backup_tokens, tokens, skip_hashes,
+		skip_hashes))
 	{
-		Server->Log("Error while ending ZIP archive writer", LL_ERROR);
+		Server->Log("Error while adding files and folders to archive", LL_ERROR);
 		return false;
 	}
 
-	return true;
-}
\ No newline at end of file
+	return writer->finish();
+}
@@ -20,9 +20,57 @@
 
 #include "action_header.h"
 #include "../server_status.h"
+#include "../BackupScheduler.h"
 
 void getLastActs(Helper &helper, JSON::Object &ret, std::vector<int> clientids);
 
+JSON::Object getProgressJson(const SStatus& client, SProcess proc, int64 ctime)
+{
+	JSON::Object obj;
+	obj.set("name", JSON::Value(client.client));
+	obj.set("clientid", JSON::Value(client.clientid));
+	obj.set("action", JSON::Value(static_cast<int>(proc.action)));
+	obj.set("pcdone", JSON::Value(proc.pcdone));
+	obj.set("queue", JSON::Value(proc.prepare_hashqueuesize+
+		proc.hashqueuesize));
+	obj.set("id", JSON::Value(proc.id));
+	obj.set("logid", JSON::Value(proc.logid.first));
+	obj.set("details", proc.details);
+	obj.set("total_bytes", proc.total_bytes);
+	obj.set("done_bytes", proc.done_bytes);
+	obj.set("detail_pc", proc.detail_pc);
+	obj.set("paused", proc.paused);
+
+	if (ctime - proc.speed_set_time >= 2000)
+		proc.speed_bpms = 0;
+
+	obj.set("speed_bpms", proc.speed_bpms);
+
+	JSON::Array past_speed_bpms;
+	for (std::deque<double>::iterator it = proc.past_speed_bpms.begin();
+		it != proc.past_speed_bpms.end(); ++it)
+	{
+		past_speed_bpms.add(*it);
+	}
+
+	obj.set("past_speed_bpms", past_speed_bpms);
+
+	int64 add_time = ctime - proc.eta_set_time;
+	int64 etams = proc.eta_ms - add_time;
+	if (etams > 0 && etams < 60 * 1000)
+	{
+		etams = 61 * 1000;
+	}
+
+	if(proc.speed_bpms>0 ||
+		proc.pcdone<0)
+		obj.set("eta_ms", etams);
+	else
+		obj.set("eta_ms", -1);
+
+	return obj;
+}
+
 ACTION_IMPL(progress)
 {
 	Helper helper(tid, &POST, &PARAMS);
@@ -72,49 +120,7 @@ ACTION_IMPL(progress)
 			{
 				for(size_t j=0;j<clients[i].processes.size();++j)
 				{
-					JSON::Object obj;
-					obj.set("name", JSON::Value(clients[i].client));
-					obj.set("clientid", JSON::Value(clients[i].clientid));
-					obj.set("action", JSON::Value(static_cast<int>(clients[i].processes[j].action)));
-					obj.set("pcdone", JSON::Value(clients[i].processes[j].pcdone));
-					obj.set("queue", JSON::Value(clients[i].processes[j].prepare_hashqueuesize+
-						clients[i].processes[j].hashqueuesize));
-					obj.set("id", JSON::Value(clients[i].processes[j].id));
-					obj.set("logid", JSON::Value(clients[i].processes[j].logid.first));
-					obj.set("details", clients[i].processes[j].details);
-					obj.set("total_bytes", clients[i].processes[j].total_bytes);
-					obj.set("done_bytes", clients[i].processes[j].done_bytes);
-					obj.set("detail_pc", clients[i].processes[j].detail_pc);
-					obj.set("paused", clients[i].processes[j].paused);
-
-					int64 ctime = Server->getTimeMS();
-					
-					if (ctime - clients[i].processes[j].speed_set_time >= 2000)
-						clients[i].processes[j].speed_bpms = 0;
-					
-					obj.set("speed_bpms", clients[i].processes[j].speed_bpms);
-
-					JSON::Array past_speed_bpms;
-					for (std::deque<double>::iterator it = clients[i].processes[j].past_speed_bpms.begin();
-						it != clients[i].processes[j].past_speed_bpms.end(); ++it)
-					{
-						past_speed_bpms.add(*it);
-					}
-
-					obj.set("past_speed_bpms", past_speed_bpms);
-
-					int64 add_time = ctime - clients[i].processes[j].eta_set_time;
-					int64 etams = clients[i].processes[j].eta_ms - add_time;
-					if (etams > 0 && etams < 60 * 1000)
-					{
-						etams = 61 * 1000;
-					}
-
-					if(clients[i].processes[j].speed_bpms>0 ||
-						clients[i].processes[j].pcdone<0)
-						obj.set("eta_ms", etams);
-					else
-						obj.set("eta_ms", -1);
+					JSON::Object obj = getProgressJson(clients[i], clients[i].processes[j], Server->getTimeMS());
 
 					if (clients[i].processes[j].can_stop 
 						&& (all_stop_rights
@@ -135,6 +141,36 @@ ACTION_IMPL(progress)
 			}
 		}
 		ret.set("progress", pg);
+
+		JSON::Array sched;
+		std::vector<SScheduledBackup> scheduled = BackupScheduler::getQueue();
+		int64 ctime = Server->getTimeMS();
+		for (size_t i = 0; i < scheduled.size(); ++i)
+		{
+			if (all_progress_rights
+				|| std::find(progress_clientids.begin(), progress_clientids.end(), scheduled[i].clientid) != progress_clientids.end())
+			{
+				JSON::Object obj;
+				obj.set("name", scheduled[i].clientname);
+				obj.set("clientid", scheduled[i].clientid);
+				obj.set("details", scheduled[i].details);
+				obj.set("file", scheduled[i].file);
+				obj.set("incremental", scheduled[i].incremental);
+				obj.set("running", scheduled[i].running);
+				obj.set("rank", scheduled[i].rank);
+				obj.set("estimated_duration", scheduled[i].estimated_duration);
+				if (scheduled[i].running)
+				{
+					obj.set("waited", (scheduled[i].start_time - scheduled[i].queued_time) / 1000);
+				}
+				else
+				{
+					obj.set("waited", (ctime - scheduled[i].queued_time) / 1000);
+				}
+				sched.add(obj);
+			}
+		}
+		ret.set("scheduler_queue", sched);
 	}
 	else if (session != NULL)
 	{
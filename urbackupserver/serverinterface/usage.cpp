@@ -23,6 +23,7 @@
 #include "../../Interface/ThreadPool.h"
 #include "../create_files_index.h"
 #include "../dao/ServerFilesDao.h"
+#include "../FilesDbShards.h"
 #include "../database.h"
 #include "../server_status.h"
 
@@ -58,8 +59,7 @@ namespace
 				Server->wait(10000);
 			}
 
-			IDatabase* files_db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES);
-			ServerFilesDao filesdao(files_db);
+			ServerFilesDaoShards filesdao_shards;
 			
 			std::unique_ptr<FileIndex> fileindex(create_lmdb_files_index());
 
@@ -77,7 +77,8 @@ namespace
 
 				if(!entries.empty())
 				{
-					ServerFilesDao::SStatFileEntry fentry = filesdao.getStatFileEntry(entries.begin()->second);
+					int64 entryid = entries.begin()->second;
+					ServerFilesDao::SStatFileEntry fentry = filesdao_shards.getEntry(entryid).getStatFileEntry(entryid);
 
 					if(fentry.exists)
 					{
@@ -29,6 +29,7 @@
 #include <memory.h>
 #include <memory>
 #include "dao/ServerFilesDao.h"
+#include "FilesDbShards.h"
 #include "FileIndex.h"
 #include "create_files_index.h"
 #include "server_hash.h"
@@ -243,8 +244,6 @@ bool verify_hashes(std::string arg)
 	int backupid=0;
 	std::string filter;
 
-	IDatabase *files_db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES);
-
 	if(!clientname.empty())
 	{
 		if(clientname!="*")
@@ -329,22 +328,33 @@ bool verify_hashes(std::string arg)
 
 			if (!temp_create_query.empty())
 			{
-				files_db->Write("CREATE TEMPORARY TABLE backups (id INTEGER PRIMARY KEY)");
-
-				IQuery* q_insert = files_db->Prepare("INSERT INTO backups (id) VALUES (?)", false);
+				std::vector<std::string> temp_backup_ids;
 				IQuery* q_backup_ids = db->Prepare(temp_create_query, false);
 				IDatabaseCursor* cur = q_backup_ids->Cursor();
 
 				db_single_result res;
 				while (cur->next(res))
 				{
-					q_insert->Bind(res["id"]);
-					q_insert->Write();
-					q_insert->Reset();
+					temp_backup_ids.push_back(res["id"]);
 				}
 
 				db->destroyQuery(q_backup_ids);
-				files_db->destroyQuery(q_insert);
+
+				for (size_t shard = 0; shard < FilesDbShards::getNumShards(); ++shard)
+				{
+					IDatabase* files_db = Server->getDatabase(Server->getThreadID(), FilesDbShards::getShardDatabaseId(shard));
+
+					files_db->Write("CREATE TEMPORARY TABLE backups (id INTEGER PRIMARY KEY)");
+
+					IQuery* q_insert = files_db->Prepare("INSERT INTO backups (id) VALUES (?)", false);
+					for (size_t i = 0; i < temp_backup_ids.size(); ++i)
+					{
+						q_insert->Bind(temp_backup_ids[i]);
+						q_insert->Write();
+						q_insert->Reset();
+					}
+					files_db->destroyQuery(q_insert);
+				}
 			}
 		}
 	}
@@ -353,74 +363,96 @@ bool verify_hashes(std::string arg)
 		filter = "1=1";
 	}
 
+	std::vector<DATABASE_ID> files_db_ids;
+	if (cid != 0)
+	{
+		files_db_ids.push_back(FilesDbShards::getClientDatabaseId(cid));
+	}
+	else
+	{
+		files_db_ids = FilesDbShards::getDatabaseIds();
+	}
+
 	
 	std::cout << "Calculating filesize..." << std::endl;
-	IQuery *q_num_files = files_db->Prepare("SELECT SUM(filesize) AS c FROM files WHERE filesize>0 AND "+filter);
-	db_results res=q_num_files->Read();
-	if(res.empty())
+	_i64 verify_size=0;
+	for (size_t i = 0; i < files_db_ids.size(); ++i)
 	{
-		Server->Log("Error during filesize calculation.", LL_ERROR);
-		return false;
-	}
+		IDatabase* files_db = Server->getDatabase(Server->getThreadID(), files_db_ids[i]);
+		IQuery *q_num_files = files_db->Prepare("SELECT SUM(filesize) AS c FROM files WHERE filesize>0 AND "+filter);
+		db_results res=q_num_files->Read();
+		if(res.empty())
+		{
+			Server->Log("Error during filesize calculation.", LL_ERROR);
+			return false;
+		}
 
-	_i64 verify_size=watoi64(res[0]["c"]);
+		verify_size+=watoi64(res[0]["c"]);
+	}
 	_i64 curr_verified=0;
 
 	std::cout << "To be verified: " << PrettyPrintBytes(verify_size) << " of files" << std::endl;
 
 	_i64 crowid=0;
 
-	IQuery *q_get_files = files_db->Prepare("SELECT id, fullpath, shahash, filesize, backupid FROM files WHERE "+filter, false);
 	IQuery* q_get_backuppath = db->Prepare("SELECT path FROM backups WHERE id=?", false);
 
 	bool is_okay=true;
 
-	IDatabaseCursor* cursor = q_get_files->Cursor();
-
 	std::vector<int64> todelete;
 	std::vector<int64> missing_files;
 	std::map<int, std::string> backuppaths;
 
-	db_single_result res_single;
-	while(cursor->next(res_single))
+	for (size_t i = 0; i < files_db_ids.size(); ++i)
 	{
-		int backupid = watoi(res_single["backupid"]);
-		std::string backuppath;
-		std::map<int, std::string>::iterator it_backuppath = backuppaths.find(backupid);
-		if (it_backuppath == backuppaths.end())
-		{
-			q_get_backuppath->Bind(backupid);
-			db_results res_backuppath = q_get_backuppath->Read();
-			q_get_backuppath->Reset();
-			if (!res_backuppath.empty())
-			{
-				backuppath = res_backuppath[0]["path"];
-				backuppaths.insert(std::make_pair(backupid, backuppath));
-			}
-		}
-		else
-		{
-			backuppath = it_backuppath->second;
-		}
+		IDatabase* files_db = Server->getDatabase(Server->getThreadID(), files_db_ids[i]);
+		IQuery *q_get_files = files_db->Prepare("SELECT id, fullpath, shahash, filesize, backupid FROM files WHERE "+filter, false);
 
-		bool is_missing=false;
-		if(! verify_file( res_single, curr_verified, verify_size, is_missing, backuppath) )
+		IDatabaseCursor* cursor = q_get_files->Cursor();
+
+		db_single_result res_single;
+		while(cursor->next(res_single))
 		{
-			if(!is_missing)
+			int backupid = watoi(res_single["backupid"]);
+			std::string backuppath;
+			std::map<int, std::string>::iterator it_backuppath = backuppaths.find(backupid);
+			if (it_backuppath == backuppaths.end())
 			{
-				v_failure << "Verification of \"" << (res_single["fullpath"]) << "\" failed\r\n";
-				is_okay=false;
-
-				if(delete_failed)
+				q_get_backuppath->Bind(backupid);
+				db_results res_backuppath = q_get_backuppath->Read();
+				q_get_backuppath->Reset();
+				if (!res_backuppath.empty())
 				{
-					todelete.push_back(watoi64(res_single["id"]));
+					backuppath = res_backuppath[0]["path"];
+					backuppaths.insert(std::make_pair(backupid, backuppath));
 				}
 			}
 			else
 			{
-				missing_files.push_back(watoi64(res_single["id"]));
-			}			
+				backuppath = it_backuppath->second;
+			}
+
+			bool is_missing=false;
+			if(! verify_file( res_single, curr_verified, verify_size, is_missing, backuppath) )
+			{
+				if(!is_missing)
+				{
+					v_failure << "Verification of \"" << (res_single["fullpath"]) << "\" failed\r\n";
+					is_okay=false;
+
+					if(delete_failed)
+					{
+						todelete.push_back(watoi64(res_single["id"]));
+					}
+				}
+				else
+				{
+					missing_files.push_back(watoi64(res_single["id"]));
+				}			
+			}
 		}
+
+		files_db->destroyQuery(q_get_files);
 	}
 
 	std::cout << std::endl;
@@ -431,17 +463,16 @@ bool verify_hashes(std::string arg)
 		Server->deleteFile(v_output_fn);
 	}
 
-	files_db->destroyQuery(q_get_files);
 	db->destroyQuery(q_get_backuppath);
 
-	IQuery* q_get_file = files_db->Prepare("SELECT id, fullpath, shahash, filesize, backupid FROM files WHERE id=?");
-
 	if (missing_files.size() > 0)
 	{
 		std::cout << missing_files.size() << " could not be opened during verification. Checking now if they have been deleted from the database..." << std::endl;
 
 		for (size_t i = 0; i < missing_files.size(); ++i)
 		{
+			IDatabase* files_db = Server->getDatabase(Server->getThreadID(), FilesDbShards::getEntryDatabaseId(missing_files[i]));
+			IQuery* q_get_file = files_db->Prepare("SELECT id, fullpath, shahash, filesize, backupid FROM files WHERE id=?");
 			q_get_file->Bind(missing_files[i]);
 			db_results res = q_get_file->Read();
 			q_get_file->Reset();
@@ -475,8 +506,7 @@ bool verify_hashes(std::string arg)
 		}
 		else
 		{
-			files_db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES);
-			ServerFilesDao backupdao(files_db);
+			ServerFilesDaoShards filesdao_shards;
 			std::unique_ptr<FileIndex> fileindex(create_lmdb_files_index());
 
 			if(fileindex.get()==NULL)
@@ -488,7 +518,7 @@ bool verify_hashes(std::string arg)
 
 				for(size_t i=0;i<todelete.size();++i)
 				{
-					BackupServerHash::deleteFileSQL(backupdao, *fileindex, todelete[i]);
+					BackupServerHash::deleteFileSQL(filesdao_shards.getEntry(todelete[i]), *fileindex, todelete[i]);
 				}
 
 				std::cout << "done." << std::endl;